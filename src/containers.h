@@ -2,14 +2,20 @@
 
 #include <wdm.h>
 #include <wdf.h>
+#include "containers/imagename.h"
 #include "containers/procregistry.h"
 #include "containers/registeredimage.h"
+#include "epoch.h"
 
 //
 // The single instance of this struct lives in the device context.
 // But it has to be defined here so it can be shared with other components
 // in the system that should not be concerned with the full context.
 //
+// The lock serializes structural changes to the registry with readers that access entries.
+// Readers that only need the split status of a process use procregistry::GetSplitStatus()
+// and don't acquire the lock.
+//
 struct PROCESS_REGISTRY_MGMT
 {
 	WDFSPINLOCK Lock;
@@ -22,7 +28,22 @@ struct PROCESS_REGISTRY_MGMT
 // This instance is replaced from time to time hence wrapping it makes
 // for a better interface when sharing it.
 //
+// A published instance is never modified. Changes are made to a copy which then replaces
+// the published instance.
+//
+// Readers that don't hold the state lock load the instance inside an epoch read section,
+// and may use it until they leave the section. Writers wait for a grace period before
+// releasing a replaced instance.
+//
 struct REGISTERED_IMAGE_MGMT
 {
 	registeredimage::CONTEXT * volatile Instance;
+	epoch::CONTEXT *Epoch;
+
+	//
+	// Incremented after each replacement of the instance, which only happens while the
+	// state lock is held. A reader that loaded the instance before acquiring the state lock
+	// can tell from it whether the instance has been replaced since.
+	//
+	volatile LONG Generation;
 };
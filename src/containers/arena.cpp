@@ -0,0 +1,214 @@
+#include <wdm.h>
+#include "arena.h"
+#include "../util.h"
+
+namespace arena
+{
+
+struct CONTEXT
+{
+	// All chunks, most recent first, linked through the chunk header.
+	SINGLE_LIST_ENTRY Chunks;
+
+	// Free space in the most recent chunk.
+	UCHAR *Next;
+	UCHAR *End;
+
+	ST_PAGEABLE Pageable;
+};
+
+namespace
+{
+
+//
+// Preferred size of a chunk.
+// Objects that don't fit in a chunk of this size are given a chunk of their own.
+//
+const SIZE_T CHUNK_SIZE = 4 * PAGE_SIZE;
+
+//
+// The header precedes the objects in the chunk.
+// It's padded so the first object is aligned.
+//
+const SIZE_T CHUNK_HEADER_SIZE = MEMORY_ALLOCATION_ALIGNMENT;
+
+static_assert(sizeof(SINGLE_LIST_ENTRY) <= CHUNK_HEADER_SIZE, "Chunk header does not fit");
+
+POOL_TYPE
+PoolType
+(
+	CONTEXT *Context
+)
+{
+	return (Context->Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+}
+
+void
+FreeChunks
+(
+	SINGLE_LIST_ENTRY *Chunks
+)
+{
+	for (auto chunk = PopEntryList(Chunks); chunk != NULL; chunk = PopEntryList(Chunks))
+	{
+		ExFreePoolWithTag(chunk, ST_POOL_TAG);
+	}
+}
+
+} // anonymous namespace
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context,
+	ST_PAGEABLE Pageable
+)
+{
+	const auto poolType = (Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+
+	*Context = (CONTEXT*)ExAllocatePoolUninitialized(poolType, sizeof(CONTEXT), ST_POOL_TAG);
+
+	if (*Context == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	(*Context)->Chunks.Next = NULL;
+	(*Context)->Next = NULL;
+	(*Context)->End = NULL;
+	(*Context)->Pageable = Pageable;
+
+	return STATUS_SUCCESS;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	auto context = *Context;
+
+	if (context == NULL)
+	{
+		return;
+	}
+
+	*Context = NULL;
+
+	FreeChunks(&context->Chunks);
+
+	ExFreePoolWithTag(context, ST_POOL_TAG);
+}
+
+void*
+Allocate
+(
+	CONTEXT *Context,
+	SIZE_T Size
+)
+{
+	Size = util::RoundToMultiple(Size, MEMORY_ALLOCATION_ALIGNMENT);
+
+	if ((SIZE_T)(Context->End - Context->Next) >= Size)
+	{
+		auto object = Context->Next;
+
+		Context->Next += Size;
+
+		return object;
+	}
+
+	const auto payloadSize = max(Size, CHUNK_SIZE - CHUNK_HEADER_SIZE);
+
+	auto chunk = (UCHAR*)ExAllocatePoolUninitialized(PoolType(Context),
+		CHUNK_HEADER_SIZE + payloadSize, ST_POOL_TAG);
+
+	if (chunk == NULL)
+	{
+		return NULL;
+	}
+
+	if (payloadSize > Size)
+	{
+		//
+		// Continue allocating from the new chunk.
+		// Whatever remains of the previous chunk is abandoned.
+		//
+
+		PushEntryList(&Context->Chunks, (SINGLE_LIST_ENTRY*)chunk);
+
+		Context->Next = chunk + CHUNK_HEADER_SIZE + Size;
+		Context->End = chunk + CHUNK_HEADER_SIZE + payloadSize;
+	}
+	else
+	{
+		//
+		// Dedicated chunk for an oversized object.
+		// Link it behind the current chunk so allocations continue from the current chunk.
+		//
+
+		auto current = Context->Chunks.Next;
+
+		if (current != NULL)
+		{
+			PushEntryList(current, (SINGLE_LIST_ENTRY*)chunk);
+		}
+		else
+		{
+			PushEntryList(&Context->Chunks, (SINGLE_LIST_ENTRY*)chunk);
+		}
+	}
+
+	return chunk + CHUNK_HEADER_SIZE;
+}
+
+void
+Reset
+(
+	CONTEXT *Context
+)
+{
+	auto current = PopEntryList(&Context->Chunks);
+
+	if (current == NULL)
+	{
+		return;
+	}
+
+	//
+	// All chunks are now reachable only through `current`.
+	//
+
+	Context->Chunks.Next = NULL;
+
+	//
+	// Keep the most recent chunk if it's a regular chunk.
+	// A dedicated chunk is never current, unless it was the first chunk allocated.
+	//
+
+	auto start = (UCHAR*)current + CHUNK_HEADER_SIZE;
+
+	if (Context->End == start + (CHUNK_SIZE - CHUNK_HEADER_SIZE))
+	{
+		FreeChunks(current);
+
+		current->Next = NULL;
+
+		PushEntryList(&Context->Chunks, current);
+
+		Context->Next = start;
+		Context->End = start + (CHUNK_SIZE - CHUNK_HEADER_SIZE);
+
+		return;
+	}
+
+	FreeChunks(current);
+
+	ExFreePoolWithTag(current, ST_POOL_TAG);
+
+	Context->Next = NULL;
+	Context->End = NULL;
+}
+
+} // namespace arena
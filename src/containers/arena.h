@@ -0,0 +1,76 @@
+#pragma once
+
+#include <wdm.h>
+#include "../defs/types.h"
+
+//
+// Arena of variable-size objects.
+//
+// Objects are carved out of larger chunks by advancing a pointer. Objects can't be
+// freed individually. Instead, all objects are released at once by Reset() or TearDown(),
+// at a cost that depends on the number of chunks rather than the number of objects.
+//
+// The arena is not synchronized.
+// Callers are expected to serialize access, typically through the lock of the owning container.
+//
+
+namespace arena
+{
+
+struct CONTEXT;
+
+//
+// Initialize()
+//
+// IRQL <= DISPATCH, unless the arena is pageable.
+//
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context,
+	ST_PAGEABLE Pageable
+);
+
+//
+// TearDown()
+//
+// IRQL <= DISPATCH, unless the arena is pageable.
+//
+// Releases all objects and the arena itself.
+//
+void
+TearDown
+(
+	CONTEXT **Context
+);
+
+//
+// Allocate()
+//
+// IRQL <= DISPATCH, unless the arena is pageable.
+//
+// Returns an uninitialized object aligned on MEMORY_ALLOCATION_ALIGNMENT,
+// or NULL if a new chunk is needed and can't be allocated.
+//
+void*
+Allocate
+(
+	CONTEXT *Context,
+	SIZE_T Size
+);
+
+//
+// Reset()
+//
+// IRQL <= DISPATCH, unless the arena is pageable.
+//
+// Releases all objects.
+// The most recent chunk is kept so the arena can be refilled without reaching the pool.
+//
+void
+Reset
+(
+	CONTEXT *Context
+);
+
+} // namespace arena
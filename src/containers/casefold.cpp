@@ -0,0 +1,164 @@
+#include <ntifs.h>
+#include "casefold.h"
+#include "../util.h"
+#include "../defs/types.h"
+
+namespace casefold
+{
+
+//
+// The table is split on the high byte of the code unit.
+//
+// Each block holds the difference between the folded and the original code unit
+// for 256 code units. Blocks without any mappings share the first block, which is all zeros.
+//
+// Only a handful of blocks in the BMP have mappings, so the table is a few kilobytes.
+//
+struct CONTEXT
+{
+	USHORT BlockIndex[256];
+
+	USHORT NumBlocks;
+
+	USHORT Blocks[ANYSIZE_ARRAY][256];
+};
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context
+)
+{
+	NT_ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+	*Context = NULL;
+
+	//
+	// Determine which blocks have mappings.
+	//
+
+	bool hasMapping[256] = { false };
+
+	USHORT numBlocks = 1;
+
+	for (ULONG c = 0; c <= MAXUSHORT; ++c)
+	{
+		const auto high = c >> 8;
+
+		if (!hasMapping[high] && RtlDowncaseUnicodeChar((WCHAR)c) != (WCHAR)c)
+		{
+			hasMapping[high] = true;
+
+			++numBlocks;
+		}
+	}
+
+	const auto allocationSize = FIELD_OFFSET(CONTEXT, Blocks) + (numBlocks * sizeof(CONTEXT::Blocks[0]));
+
+	auto context = (CONTEXT*)ExAllocatePoolUninitialized(NonPagedPool, allocationSize, ST_POOL_TAG);
+
+	if (context == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	RtlZeroMemory(context, allocationSize);
+
+	context->NumBlocks = numBlocks;
+
+	//
+	// Capture mappings.
+	//
+
+	USHORT nextBlock = 1;
+
+	for (ULONG high = 0; high < 256; ++high)
+	{
+		if (!hasMapping[high])
+		{
+			context->BlockIndex[high] = 0;
+
+			continue;
+		}
+
+		const auto block = nextBlock++;
+
+		context->BlockIndex[high] = block;
+
+		for (ULONG low = 0; low < 256; ++low)
+		{
+			const auto c = (WCHAR)((high << 8) | low);
+
+			context->Blocks[block][low] = (USHORT)(RtlDowncaseUnicodeChar(c) - c);
+		}
+	}
+
+	*Context = context;
+
+	return STATUS_SUCCESS;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	if (*Context == NULL)
+	{
+		return;
+	}
+
+	ExFreePoolWithTag(*Context, ST_POOL_TAG);
+
+	*Context = NULL;
+}
+
+WCHAR
+Fold
+(
+	const CONTEXT *Context,
+	WCHAR Char
+)
+{
+	const auto block = Context->BlockIndex[Char >> 8];
+
+	return (WCHAR)(Char + Context->Blocks[block][Char & 0xFF]);
+}
+
+bool
+Equal
+(
+	const CONTEXT *Context,
+	const UNICODE_STRING *Lhs,
+	const UNICODE_STRING *Rhs
+)
+{
+	if (Lhs->Length != Rhs->Length)
+	{
+		return false;
+	}
+
+	//
+	// Strings are often cased identically.
+	//
+
+	if (util::EqualMemory(Lhs->Buffer, Rhs->Buffer, Lhs->Length))
+	{
+		return true;
+	}
+
+	const auto length = Lhs->Length / sizeof(WCHAR);
+
+	for (SIZE_T i = 0; i < length; ++i)
+	{
+		if (Fold(Context, Lhs->Buffer[i]) != Fold(Context, Rhs->Buffer[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+} // namespace casefold
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <wdm.h>
+
+//
+// Case folding table for UTF-16 code units.
+//
+// The system case tables are pageable, so RtlDowncaseUnicodeChar() and case-insensitive
+// string comparison are restricted to APC level and below.
+//
+// This table is captured from the system once, at PASSIVE, and is kept in non-paged memory.
+// Folding, and anything built on top of it, can then be used at any IRQL up to DISPATCH.
+//
+// Folding a code unit yields the same result as RtlDowncaseUnicodeChar().
+//
+
+namespace casefold
+{
+
+struct CONTEXT;
+
+//
+// Initialize()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context
+);
+
+void
+TearDown
+(
+	CONTEXT **Context
+);
+
+//
+// Fold()
+//
+// IRQL <= DISPATCH.
+//
+WCHAR
+Fold
+(
+	const CONTEXT *Context,
+	WCHAR Char
+);
+
+//
+// Equal()
+//
+// IRQL <= DISPATCH.
+//
+// Compares strings without regard to character casing.
+//
+bool
+Equal
+(
+	const CONTEXT *Context,
+	const UNICODE_STRING *Lhs,
+	const UNICODE_STRING *Rhs
+);
+
+} // namespace casefold
@@ -0,0 +1,987 @@
+#include <ntifs.h>
+#include "globdfa.h"
+#include "../util.h"
+
+namespace globdfa
+{
+
+//
+// Characters are partitioned into classes that the automaton cannot tell apart:
+//
+// CLASS_OTHER is every character that is not used as a literal in any pattern.
+// CLASS_SEPARATOR is the path separator, which is never matched by a wildcard.
+// Every other literal character has a class of its own, starting at CLASS_FIRST_LITERAL.
+//
+enum
+{
+	CLASS_OTHER = 0,
+	CLASS_SEPARATOR = 1,
+	CLASS_FIRST_LITERAL = 2
+};
+
+//
+// State zero rejects every input and state one is the initial state.
+//
+enum
+{
+	STATE_DEAD = 0,
+	STATE_INITIAL = 1
+};
+
+struct CONTEXT
+{
+	ULONG NumStates;
+	ULONG NumClasses;
+
+	// Sorted literal characters, excluding the path separator.
+	const WCHAR *Literals;
+	ULONG NumLiterals;
+
+	const bool *Accepting;
+
+	// NumStates * NumClasses transitions, one row per state.
+	const USHORT *Transitions;
+
+	// Class of each ASCII character.
+	USHORT AsciiClasses[128];
+};
+
+namespace
+{
+
+const WCHAR SEPARATOR = L'\\';
+
+//
+// Transitions are stored as USHORT.
+//
+const ULONG MAX_STATES = MAXUSHORT;
+
+const SIZE_T MAX_TRANSITIONS = 16 * 1024 * 1024;
+
+enum class TOKEN : UCHAR
+{
+	LITERAL,
+	ANY_CHAR,
+	ANY_RUN,
+
+	// Pattern has been fully matched.
+	END
+};
+
+//
+// Scratch data used during subset construction.
+//
+// The NFA has one state for each position in each pattern. Each DFA state
+// corresponds to a set of NFA states, which is stored sorted in `SetPool`.
+//
+struct BUILDER
+{
+	// NFA.
+	TOKEN *Tokens;
+	WCHAR *Chars;
+	ULONG NumNfaStates;
+
+	WCHAR *Literals;
+	ULONG NumLiterals;
+	ULONG NumClasses;
+
+	// One bit per NFA state, used when computing a transition.
+	ULONG64 *Marks;
+	ULONG *Scratch;
+
+	ULONG *SetPool;
+	SIZE_T SetPoolLength;
+	SIZE_T SetPoolCapacity;
+
+	// Per DFA state.
+	SIZE_T *SetOffsets;
+	ULONG *SetLengths;
+	ULONG64 *SetHashes;
+	bool *Accepting;
+	ULONG NumStates;
+	ULONG StateCapacity;
+
+	USHORT *Transitions;
+
+	// Open addressing, maps a set to its DFA state.
+	// Slots store state + 1, with zero marking an empty slot.
+	ULONG *Slots;
+	ULONG NumSlots;
+};
+
+void
+FreeIfAllocated
+(
+	void *Allocation
+)
+{
+	if (Allocation != NULL)
+	{
+		ExFreePoolWithTag(Allocation, ST_POOL_TAG);
+	}
+}
+
+void
+FreeBuilder
+(
+	BUILDER *Builder
+)
+{
+	FreeIfAllocated(Builder->Tokens);
+	FreeIfAllocated(Builder->Chars);
+	FreeIfAllocated(Builder->Literals);
+	FreeIfAllocated(Builder->Marks);
+	FreeIfAllocated(Builder->Scratch);
+	FreeIfAllocated(Builder->SetPool);
+	FreeIfAllocated(Builder->SetOffsets);
+	FreeIfAllocated(Builder->SetLengths);
+	FreeIfAllocated(Builder->SetHashes);
+	FreeIfAllocated(Builder->Accepting);
+	FreeIfAllocated(Builder->Transitions);
+	FreeIfAllocated(Builder->Slots);
+}
+
+void*
+AllocateScratch
+(
+	SIZE_T Size
+)
+{
+	return ExAllocatePoolUninitialized(PagedPool, Size, ST_POOL_TAG);
+}
+
+//
+// Grow()
+//
+// Reallocate `*Array` so it can hold at least `Required` elements.
+//
+NTSTATUS
+Grow
+(
+	void **Array,
+	SIZE_T Length,
+	SIZE_T Required,
+	SIZE_T ElementSize
+)
+{
+	auto newArray = AllocateScratch(Required * ElementSize);
+
+	if (newArray == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	if (*Array != NULL)
+	{
+		RtlCopyMemory(newArray, *Array, Length * ElementSize);
+
+		ExFreePoolWithTag(*Array, ST_POOL_TAG);
+	}
+
+	*Array = newArray;
+
+	return STATUS_SUCCESS;
+}
+
+bool
+FindLiteral
+(
+	const WCHAR *Literals,
+	ULONG NumLiterals,
+	WCHAR Char,
+	ULONG *Index
+)
+{
+	ULONG low = 0;
+	ULONG high = NumLiterals;
+
+	while (low < high)
+	{
+		const ULONG mid = low + ((high - low) / 2);
+
+		if (Literals[mid] == Char)
+		{
+			*Index = mid;
+
+			return true;
+		}
+
+		if (Literals[mid] < Char)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	*Index = low;
+
+	return false;
+}
+
+//
+// BuildNfa()
+//
+// Tokenize all patterns into a single array, with each pattern followed by an END token.
+// Runs of `*` are collapsed since they're equivalent to a single `*`.
+//
+// Also collects the set of literal characters.
+//
+NTSTATUS
+BuildNfa
+(
+	BUILDER *Builder,
+	const LOWER_UNICODE_STRING * const *Patterns,
+	SIZE_T NumPatterns
+)
+{
+	SIZE_T numNfaStates = 0;
+
+	for (SIZE_T i = 0; i < NumPatterns; ++i)
+	{
+		numNfaStates += (Patterns[i]->Length / sizeof(WCHAR)) + 1;
+	}
+
+	if (numNfaStates > MAXLONG)
+	{
+		return STATUS_IMPLEMENTATION_LIMIT;
+	}
+
+	Builder->Tokens = (TOKEN*)AllocateScratch(numNfaStates * sizeof(TOKEN));
+	Builder->Chars = (WCHAR*)AllocateScratch(numNfaStates * sizeof(WCHAR));
+
+	if (Builder->Tokens == NULL || Builder->Chars == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	ULONG numLiterals = 0;
+	ULONG maxLiterals = 0;
+
+	ULONG state = 0;
+
+	for (SIZE_T i = 0; i < NumPatterns; ++i)
+	{
+		const auto pattern = Patterns[i];
+		const auto length = pattern->Length / sizeof(WCHAR);
+
+		for (USHORT c = 0; c < length; ++c)
+		{
+			const auto ch = pattern->Buffer[c];
+
+			switch (ch)
+			{
+				case L'*':
+				{
+					if (state != 0 && c != 0 && Builder->Tokens[state - 1] == TOKEN::ANY_RUN)
+					{
+						continue;
+					}
+
+					Builder->Tokens[state] = TOKEN::ANY_RUN;
+
+					break;
+				}
+				case L'?':
+				{
+					Builder->Tokens[state] = TOKEN::ANY_CHAR;
+
+					break;
+				}
+				default:
+				{
+					Builder->Tokens[state] = TOKEN::LITERAL;
+
+					ULONG index;
+
+					if (ch != SEPARATOR && !FindLiteral(Builder->Literals, numLiterals, ch, &index))
+					{
+						if (numLiterals == maxLiterals)
+						{
+							const ULONG newMaxLiterals = (maxLiterals == 0) ? 32 : (maxLiterals * 2);
+
+							auto status = Grow((void**)&Builder->Literals, numLiterals,
+								newMaxLiterals, sizeof(WCHAR));
+
+							if (!NT_SUCCESS(status))
+							{
+								return status;
+							}
+
+							maxLiterals = newMaxLiterals;
+						}
+
+						RtlMoveMemory(&Builder->Literals[index + 1], &Builder->Literals[index],
+							(numLiterals - index) * sizeof(WCHAR));
+
+						Builder->Literals[index] = ch;
+						++numLiterals;
+					}
+				}
+			}
+
+			Builder->Chars[state] = ch;
+			++state;
+		}
+
+		Builder->Tokens[state] = TOKEN::END;
+		Builder->Chars[state] = 0;
+		++state;
+	}
+
+	Builder->NumNfaStates = state;
+	Builder->NumLiterals = numLiterals;
+	Builder->NumClasses = CLASS_FIRST_LITERAL + numLiterals;
+
+	const auto numWords = (state + 63) / 64;
+
+	Builder->Marks = (ULONG64*)AllocateScratch(numWords * sizeof(ULONG64));
+	Builder->Scratch = (ULONG*)AllocateScratch(state * sizeof(ULONG));
+
+	if (Builder->Marks == NULL || Builder->Scratch == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	RtlZeroMemory(Builder->Marks, numWords * sizeof(ULONG64));
+
+	return STATUS_SUCCESS;
+}
+
+//
+// Mark()
+//
+// Mark an NFA state and everything reachable from it without consuming input.
+// That is, a `*` may also match nothing.
+//
+void
+Mark
+(
+	BUILDER *Builder,
+	ULONG State,
+	ULONG *MinWord,
+	ULONG *MaxWord
+)
+{
+	for (;;)
+	{
+		const auto word = State / 64;
+
+		Builder->Marks[word] |= (1ULL << (State % 64));
+
+		*MinWord = min(*MinWord, word);
+		*MaxWord = max(*MaxWord, word);
+
+		if (Builder->Tokens[State] != TOKEN::ANY_RUN)
+		{
+			break;
+		}
+
+		++State;
+	}
+}
+
+//
+// CollectMarks()
+//
+// Move marked states into `Scratch`, in sorted order, and clear the marks.
+//
+ULONG
+CollectMarks
+(
+	BUILDER *Builder,
+	ULONG MinWord,
+	ULONG MaxWord
+)
+{
+	ULONG length = 0;
+
+	if (MinWord > MaxWord)
+	{
+		return length;
+	}
+
+	for (auto word = MinWord; word <= MaxWord; ++word)
+	{
+		auto bits = Builder->Marks[word];
+
+		while (bits != 0)
+		{
+			ULONG bit;
+
+			_BitScanForward64(&bit, bits);
+
+			bits &= (bits - 1);
+
+			Builder->Scratch[length++] = (word * 64) + bit;
+		}
+
+		Builder->Marks[word] = 0;
+	}
+
+	return length;
+}
+
+ULONG64
+HashSet
+(
+	const ULONG *Set,
+	ULONG Length
+)
+{
+	//
+	// FNV-1a.
+	//
+
+	ULONG64 hash = 14695981039346656037ULL;
+
+	for (ULONG i = 0; i < Length; ++i)
+	{
+		hash ^= Set[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+NTSTATUS
+GrowSlots
+(
+	BUILDER *Builder
+)
+{
+	const ULONG newNumSlots = (Builder->NumSlots == 0) ? 1024 : (Builder->NumSlots * 2);
+
+	auto newSlots = (ULONG*)AllocateScratch(newNumSlots * sizeof(ULONG));
+
+	if (newSlots == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	RtlZeroMemory(newSlots, newNumSlots * sizeof(ULONG));
+
+	for (ULONG state = 0; state < Builder->NumStates; ++state)
+	{
+		auto slot = (ULONG)(Builder->SetHashes[state] & (newNumSlots - 1));
+
+		while (newSlots[slot] != 0)
+		{
+			slot = (slot + 1) & (newNumSlots - 1);
+		}
+
+		newSlots[slot] = state + 1;
+	}
+
+	FreeIfAllocated(Builder->Slots);
+
+	Builder->Slots = newSlots;
+	Builder->NumSlots = newNumSlots;
+
+	return STATUS_SUCCESS;
+}
+
+//
+// GrowStates()
+//
+// Make room for at least one additional DFA state.
+//
+NTSTATUS
+GrowStates
+(
+	BUILDER *Builder
+)
+{
+	if (Builder->NumStates < Builder->StateCapacity)
+	{
+		return STATUS_SUCCESS;
+	}
+
+	if (Builder->StateCapacity >= MAX_STATES)
+	{
+		return STATUS_IMPLEMENTATION_LIMIT;
+	}
+
+	const ULONG newCapacity = min(MAX_STATES,
+		(Builder->StateCapacity == 0) ? 256 : (Builder->StateCapacity * 2));
+
+	if ((SIZE_T)newCapacity * Builder->NumClasses > MAX_TRANSITIONS)
+	{
+		return STATUS_IMPLEMENTATION_LIMIT;
+	}
+
+	const auto length = Builder->NumStates;
+
+	NTSTATUS status;
+
+	if (!NT_SUCCESS(status = Grow((void**)&Builder->SetOffsets, length, newCapacity, sizeof(SIZE_T)))
+		|| !NT_SUCCESS(status = Grow((void**)&Builder->SetLengths, length, newCapacity, sizeof(ULONG)))
+		|| !NT_SUCCESS(status = Grow((void**)&Builder->SetHashes, length, newCapacity, sizeof(ULONG64)))
+		|| !NT_SUCCESS(status = Grow((void**)&Builder->Accepting, length, newCapacity, sizeof(bool)))
+		|| !NT_SUCCESS(status = Grow((void**)&Builder->Transitions, (SIZE_T)length * Builder->NumClasses,
+			(SIZE_T)newCapacity * Builder->NumClasses, sizeof(USHORT))))
+	{
+		return status;
+	}
+
+	Builder->StateCapacity = newCapacity;
+
+	return STATUS_SUCCESS;
+}
+
+//
+// FindOrAddState()
+//
+// Look up the DFA state for the set in `Scratch`, or create it.
+//
+NTSTATUS
+FindOrAddState
+(
+	BUILDER *Builder,
+	ULONG Length,
+	ULONG *State
+)
+{
+	const auto set = Builder->Scratch;
+	const auto hash = HashSet(set, Length);
+
+	auto slot = (ULONG)(hash & (Builder->NumSlots - 1));
+
+	while (Builder->Slots[slot] != 0)
+	{
+		const auto candidate = Builder->Slots[slot] - 1;
+
+		if (Builder->SetHashes[candidate] == hash
+			&& Builder->SetLengths[candidate] == Length
+			&& RtlEqualMemory(&Builder->SetPool[Builder->SetOffsets[candidate]], set, Length * sizeof(ULONG)))
+		{
+			*State = candidate;
+
+			return STATUS_SUCCESS;
+		}
+
+		slot = (slot + 1) & (Builder->NumSlots - 1);
+	}
+
+	auto status = GrowStates(Builder);
+
+	if (!NT_SUCCESS(status))
+	{
+		return status;
+	}
+
+	if (Builder->SetPoolLength + Length > Builder->SetPoolCapacity)
+	{
+		const auto newCapacity = max(Builder->SetPoolCapacity * 2, Builder->SetPoolLength + Length);
+
+		status = Grow((void**)&Builder->SetPool, Builder->SetPoolLength, newCapacity, sizeof(ULONG));
+
+		if (!NT_SUCCESS(status))
+		{
+			return status;
+		}
+
+		Builder->SetPoolCapacity = newCapacity;
+	}
+
+	const auto newState = Builder->NumStates;
+
+	RtlCopyMemory(&Builder->SetPool[Builder->SetPoolLength], set, Length * sizeof(ULONG));
+
+	Builder->SetOffsets[newState] = Builder->SetPoolLength;
+	Builder->SetLengths[newState] = Length;
+	Builder->SetHashes[newState] = hash;
+
+	Builder->SetPoolLength += Length;
+
+	bool accepting = false;
+
+	for (ULONG i = 0; i < Length; ++i)
+	{
+		if (Builder->Tokens[set[i]] == TOKEN::END)
+		{
+			accepting = true;
+
+			break;
+		}
+	}
+
+	Builder->Accepting[newState] = accepting;
+
+	Builder->Slots[slot] = newState + 1;
+	++Builder->NumStates;
+
+	//
+	// Keep the load factor at or below one half.
+	//
+
+	if (Builder->NumStates * 2 > Builder->NumSlots)
+	{
+		status = GrowSlots(Builder);
+
+		if (!NT_SUCCESS(status))
+		{
+			return status;
+		}
+	}
+
+	*State = newState;
+
+	return STATUS_SUCCESS;
+}
+
+//
+// Step()
+//
+// Compute the set of NFA states reached from DFA state `State` on a character in `Class`.
+// The resulting set is left in `Scratch`.
+//
+ULONG
+Step
+(
+	BUILDER *Builder,
+	ULONG State,
+	ULONG Class
+)
+{
+	const auto set = &Builder->SetPool[Builder->SetOffsets[State]];
+	const auto length = Builder->SetLengths[State];
+
+	ULONG minWord = MAXULONG;
+	ULONG maxWord = 0;
+
+	for (ULONG i = 0; i < length; ++i)
+	{
+		const auto nfaState = set[i];
+
+		switch (Builder->Tokens[nfaState])
+		{
+			case TOKEN::LITERAL:
+			{
+				const auto ch = Builder->Chars[nfaState];
+
+				const bool match = (ch == SEPARATOR)
+					? (Class == CLASS_SEPARATOR)
+					: (Class >= CLASS_FIRST_LITERAL && Builder->Literals[Class - CLASS_FIRST_LITERAL] == ch);
+
+				if (match)
+				{
+					Mark(Builder, nfaState + 1, &minWord, &maxWord);
+				}
+
+				break;
+			}
+			case TOKEN::ANY_CHAR:
+			{
+				if (Class != CLASS_SEPARATOR)
+				{
+					Mark(Builder, nfaState + 1, &minWord, &maxWord);
+				}
+
+				break;
+			}
+			case TOKEN::ANY_RUN:
+			{
+				if (Class != CLASS_SEPARATOR)
+				{
+					Mark(Builder, nfaState, &minWord, &maxWord);
+				}
+
+				break;
+			}
+			case TOKEN::END:
+			{
+				//
+				// A fully matched pattern has no transitions. The other states
+				// in the set may still advance, so keep going.
+				//
+
+				break;
+			}
+		}
+	}
+
+	return CollectMarks(Builder, minWord, maxWord);
+}
+
+//
+// Construct()
+//
+// Subset construction.
+//
+// States are numbered in the order they're discovered, so processing them
+// in numerical order visits each state exactly once.
+//
+NTSTATUS
+Construct
+(
+	BUILDER *Builder,
+	SIZE_T NumPatterns
+)
+{
+	auto status = GrowSlots(Builder);
+
+	if (!NT_SUCCESS(status))
+	{
+		return status;
+	}
+
+	ULONG state;
+
+	//
+	// Dead state, which has the empty set.
+	//
+
+	status = FindOrAddState(Builder, 0, &state);
+
+	if (!NT_SUCCESS(status))
+	{
+		return status;
+	}
+
+	NT_ASSERT(state == STATE_DEAD);
+
+	//
+	// Initial state.
+	//
+
+	ULONG minWord = MAXULONG;
+	ULONG maxWord = 0;
+
+	for (ULONG nfaState = 0, pattern = 0; pattern < NumPatterns; ++nfaState)
+	{
+		if (nfaState == 0 || Builder->Tokens[nfaState - 1] == TOKEN::END)
+		{
+			Mark(Builder, nfaState, &minWord, &maxWord);
+
+			++pattern;
+		}
+	}
+
+	status = FindOrAddState(Builder, CollectMarks(Builder, minWord, maxWord), &state);
+
+	if (!NT_SUCCESS(status))
+	{
+		return status;
+	}
+
+	NT_ASSERT(state == STATE_INITIAL);
+
+	for (ULONG current = 0; current < Builder->NumStates; ++current)
+	{
+		for (ULONG c = 0; c < Builder->NumClasses; ++c)
+		{
+			ULONG next = STATE_DEAD;
+
+			if (current != STATE_DEAD)
+			{
+				status = FindOrAddState(Builder, Step(Builder, current, c), &next);
+
+				if (!NT_SUCCESS(status))
+				{
+					return status;
+				}
+			}
+
+			Builder->Transitions[((SIZE_T)current * Builder->NumClasses) + c] = (USHORT)next;
+		}
+	}
+
+	return STATUS_SUCCESS;
+}
+
+//
+// Finalize()
+//
+// Make a single allocation for the context and all tables.
+//
+CONTEXT*
+Finalize
+(
+	BUILDER *Builder,
+	ST_PAGEABLE Pageable
+)
+{
+	const auto numStates = Builder->NumStates;
+	const auto numClasses = Builder->NumClasses;
+	const auto numLiterals = Builder->NumLiterals;
+
+	const auto offsetTransitions = util::RoundToMultiple(sizeof(CONTEXT), TYPE_ALIGNMENT(USHORT));
+	const auto transitionsSize = (SIZE_T)numStates * numClasses * sizeof(USHORT);
+
+	const auto offsetLiterals = util::RoundToMultiple(offsetTransitions + transitionsSize, TYPE_ALIGNMENT(WCHAR));
+	const auto literalsSize = numLiterals * sizeof(WCHAR);
+
+	const auto offsetAccepting = offsetLiterals + literalsSize;
+	const auto acceptingSize = numStates * sizeof(bool);
+
+	const auto allocationSize = offsetAccepting + acceptingSize;
+
+	const auto poolType = (Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+
+	auto context = (CONTEXT*)ExAllocatePoolUninitialized(poolType, allocationSize, ST_POOL_TAG);
+
+	if (context == NULL)
+	{
+		return NULL;
+	}
+
+	auto transitions = (USHORT*)(((UCHAR*)context) + offsetTransitions);
+	auto literals = (WCHAR*)(((UCHAR*)context) + offsetLiterals);
+	auto accepting = (bool*)(((UCHAR*)context) + offsetAccepting);
+
+	RtlCopyMemory(transitions, Builder->Transitions, transitionsSize);
+	RtlCopyMemory(literals, Builder->Literals, literalsSize);
+	RtlCopyMemory(accepting, Builder->Accepting, acceptingSize);
+
+	context->NumStates = numStates;
+	context->NumClasses = numClasses;
+	context->Literals = literals;
+	context->NumLiterals = numLiterals;
+	context->Accepting = accepting;
+	context->Transitions = transitions;
+
+	for (WCHAR ch = 0; ch < ARRAYSIZE(context->AsciiClasses); ++ch)
+	{
+		ULONG index;
+
+		if (ch == SEPARATOR)
+		{
+			context->AsciiClasses[ch] = CLASS_SEPARATOR;
+		}
+		else if (FindLiteral(literals, numLiterals, ch, &index))
+		{
+			context->AsciiClasses[ch] = (USHORT)(CLASS_FIRST_LITERAL + index);
+		}
+		else
+		{
+			context->AsciiClasses[ch] = CLASS_OTHER;
+		}
+	}
+
+	return context;
+}
+
+ULONG
+ClassOf
+(
+	const CONTEXT *Context,
+	WCHAR Char
+)
+{
+	if (Char < ARRAYSIZE(Context->AsciiClasses))
+	{
+		return Context->AsciiClasses[Char];
+	}
+
+	ULONG index;
+
+	if (FindLiteral(Context->Literals, Context->NumLiterals, Char, &index))
+	{
+		return CLASS_FIRST_LITERAL + index;
+	}
+
+	return CLASS_OTHER;
+}
+
+} // anonymous namespace
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+Compile
+(
+	const LOWER_UNICODE_STRING * const *Patterns,
+	SIZE_T NumPatterns,
+	ST_PAGEABLE Pageable,
+	CONTEXT **Context
+)
+{
+	NT_ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+	*Context = NULL;
+
+	if (NumPatterns == 0)
+	{
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	BUILDER builder;
+
+	RtlZeroMemory(&builder, sizeof(builder));
+
+	auto status = BuildNfa(&builder, Patterns, NumPatterns);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto Abort;
+	}
+
+	status = Construct(&builder, NumPatterns);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto Abort;
+	}
+
+	*Context = Finalize(&builder, Pageable);
+
+	if (*Context == NULL)
+	{
+		status = STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+Abort:
+
+	FreeBuilder(&builder);
+
+	return status;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	ExFreePoolWithTag(*Context, ST_POOL_TAG);
+
+	*Context = NULL;
+}
+
+bool
+Match
+(
+	const CONTEXT *Context,
+	const LOWER_UNICODE_STRING *Path
+)
+{
+	const auto length = Path->Length / sizeof(WCHAR);
+	const auto numClasses = Context->NumClasses;
+
+	ULONG state = STATE_INITIAL;
+
+	for (USHORT i = 0; i < length; ++i)
+	{
+		state = Context->Transitions[(state * numClasses) + ClassOf(Context, Path->Buffer[i])];
+
+		if (state == STATE_DEAD)
+		{
+			return false;
+		}
+	}
+
+	return Context->Accepting[state];
+}
+
+SIZE_T
+NumStates
+(
+	const CONTEXT *Context
+)
+{
+	return Context->NumStates;
+}
+
+} // namespace globdfa
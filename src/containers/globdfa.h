@@ -0,0 +1,75 @@
+#pragma once
+
+#include <wdm.h>
+#include "../defs/types.h"
+
+//
+// Set of glob patterns compiled into a single deterministic automaton.
+//
+// The following wildcards are supported:
+//
+// `*` matches any number of characters, including none, within a single path component.
+// `?` matches exactly one character other than a path separator.
+//
+// All other characters match themselves. There is no escaping, since neither wildcard
+// character is valid in a path.
+//
+// Patterns are anchored at both ends and are matched against the entire path.
+// Strings are compared exactly, so both patterns and paths should be lower case.
+//
+// Once compiled, matching a path is a single scan over its characters without
+// any backtracking, regardless of the number of patterns.
+//
+
+namespace globdfa
+{
+
+struct CONTEXT;
+
+//
+// Compile()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+// Builds an automaton that matches any of the patterns.
+// At least one pattern must be provided.
+//
+// Returns STATUS_IMPLEMENTATION_LIMIT if the automaton would be unreasonably large.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+Compile
+(
+	const LOWER_UNICODE_STRING * const *Patterns,
+	SIZE_T NumPatterns,
+	ST_PAGEABLE Pageable,
+	CONTEXT **Context
+);
+
+void
+TearDown
+(
+	CONTEXT **Context
+);
+
+//
+// Match()
+//
+// IRQL <= DISPATCH, unless the automaton is pageable.
+//
+// Returns true if `Path` is matched by any of the patterns.
+//
+bool
+Match
+(
+	const CONTEXT *Context,
+	const LOWER_UNICODE_STRING *Path
+);
+
+SIZE_T
+NumStates
+(
+	const CONTEXT *Context
+);
+
+} // namespace globdfa
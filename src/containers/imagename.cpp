@@ -0,0 +1,547 @@
+#include <ntifs.h>
+#include <wdf.h>
+#include "imagename.h"
+#include "casefold.h"
+#include "../util.h"
+
+namespace imagename
+{
+
+struct CONTEXT
+{
+	//
+	// Names are interned from the process management thread, the IOCTL handler path
+	// and the firewall. Structural changes to the table are serialized by this lock.
+	//
+	WDFSPINLOCK Lock;
+
+	SIZE_T NumEntries;
+
+	// Footprint of the names currently in the table.
+	SIZE_T StringBytes;
+	SIZE_T VolumePrefixBytes;
+
+	// Used to look up names given in any character casing.
+	casefold::CONTEXT *Fold;
+
+	LIST_ENTRY Buckets[ANYSIZE_ARRAY];
+};
+
+namespace
+{
+
+//
+// The number of distinct images on a system is in the order of hundreds, or a few thousand.
+// A fixed number of buckets keeps chains short without the need to rehash.
+//
+const SIZE_T NUM_BUCKETS = 1024;
+
+//
+// Number of characters that InternDowncase() can convert without allocating.
+//
+const SIZE_T DOWNCASE_BUFFER_LENGTH = 260;
+
+const ULONG64 FNV_OFFSET_BASIS = 0xcbf29ce484222325;
+const ULONG64 FNV_PRIME = 0x100000001b3;
+
+//
+// FNV-1a over the string bytes.
+//
+ULONG64
+ComputeHash
+(
+	const LOWER_UNICODE_STRING *String
+)
+{
+	ULONG64 hash = FNV_OFFSET_BASIS;
+
+	auto data = (const UCHAR*)String->Buffer;
+
+	for (USHORT i = 0; i < String->Length; ++i)
+	{
+		hash ^= data[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+//
+// ComputeFoldedHash()
+//
+// Same result as ComputeHash() on a lower case copy of `String`.
+//
+ULONG64
+ComputeFoldedHash
+(
+	CONTEXT *Context,
+	const UNICODE_STRING *String
+)
+{
+	ULONG64 hash = FNV_OFFSET_BASIS;
+
+	const auto length = String->Length / sizeof(WCHAR);
+
+	for (SIZE_T i = 0; i < length; ++i)
+	{
+		const auto c = casefold::Fold(Context->Fold, String->Buffer[i]);
+
+		hash ^= (UCHAR)(c & 0xFF);
+		hash *= FNV_PRIME;
+
+		hash ^= (UCHAR)(c >> 8);
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+//
+// GetVolumePrefixLength()
+//
+// Returns the length in bytes of `\device\<volume>\`, including the trailing backslash.
+//
+USHORT
+GetVolumePrefixLength
+(
+	const LOWER_UNICODE_STRING *String
+)
+{
+	static const WCHAR DEVICE_PREFIX[] = L"\\device\\";
+
+	const SIZE_T deviceLength = (ARRAYSIZE(DEVICE_PREFIX) - 1);
+
+	const auto length = String->Length / sizeof(WCHAR);
+
+	if (length <= deviceLength
+		|| !util::EqualMemory(String->Buffer, DEVICE_PREFIX, deviceLength * sizeof(WCHAR)))
+	{
+		return 0;
+	}
+
+	for (auto i = deviceLength; i < length; ++i)
+	{
+		if (String->Buffer[i] == L'\\')
+		{
+			return (USHORT)((i + 1) * sizeof(WCHAR));
+		}
+	}
+
+	return 0;
+}
+
+LIST_ENTRY*
+GetBucket
+(
+	CONTEXT *Context,
+	ULONG64 Hash
+)
+{
+	return &Context->Buckets[Hash & (NUM_BUCKETS - 1)];
+}
+
+bool
+Equal
+(
+	const IMAGE_NAME *Name,
+	const LOWER_UNICODE_STRING *String,
+	ULONG64 Hash
+)
+{
+	if (Name->Hash != Hash
+		|| Name->String.Length != String->Length)
+	{
+		return false;
+	}
+
+	return util::EqualMemory(Name->String.Buffer, String->Buffer, String->Length);
+}
+
+//
+// TryAddRef()
+//
+// A name whose reference count has reached zero is about to be removed from the table,
+// and must not be handed out.
+//
+bool
+TryAddRef
+(
+	IMAGE_NAME *Name
+)
+{
+	for (;;)
+	{
+		const auto refCount = ReadNoFence(&Name->RefCount);
+
+		if (refCount == 0)
+		{
+			return false;
+		}
+
+		if (refCount == InterlockedCompareExchange(&Name->RefCount, refCount + 1, refCount))
+		{
+			return true;
+		}
+	}
+}
+
+IMAGE_NAME*
+FindName
+(
+	CONTEXT *Context,
+	const LOWER_UNICODE_STRING *String,
+	ULONG64 Hash
+)
+{
+	auto bucket = GetBucket(Context, Hash);
+
+	for (auto link = bucket->Flink; link != bucket; link = link->Flink)
+	{
+		auto candidate = CONTAINING_RECORD(link, IMAGE_NAME, BucketLink);
+
+		if (Equal(candidate, String, Hash) && TryAddRef(candidate))
+		{
+			return candidate;
+		}
+	}
+
+	return NULL;
+}
+
+IMAGE_NAME*
+CreateName
+(
+	CONTEXT *Context,
+	const LOWER_UNICODE_STRING *String,
+	ULONG64 Hash
+)
+{
+	//
+	// Make a single allocation for the struct and string buffer.
+	//
+
+	auto offsetStringBuffer = util::RoundToMultiple(sizeof(IMAGE_NAME), TYPE_ALIGNMENT(WCHAR));
+
+	auto allocationSize = offsetStringBuffer + String->Length;
+
+	auto name = (IMAGE_NAME*)ExAllocatePoolUninitialized(NonPagedPool, allocationSize, ST_POOL_TAG);
+
+	if (name == NULL)
+	{
+		return NULL;
+	}
+
+	auto stringBuffer = (WCHAR*)(((UCHAR*)name) + offsetStringBuffer);
+
+	RtlCopyMemory(stringBuffer, String->Buffer, String->Length);
+
+	name->String.Length = String->Length;
+	name->String.MaximumLength = String->Length;
+	name->String.Buffer = stringBuffer;
+
+	name->Hash = Hash;
+	name->VolumePrefixLength = GetVolumePrefixLength(String);
+	name->RefCount = 1;
+	name->Owner = Context;
+
+	InitializeListHead(&name->BucketLink);
+
+	return name;
+}
+
+} // anonymous namespace
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context
+)
+{
+	const auto allocationSize = FIELD_OFFSET(CONTEXT, Buckets) + (NUM_BUCKETS * sizeof(LIST_ENTRY));
+
+	auto context = (CONTEXT*)ExAllocatePoolUninitialized(NonPagedPool, allocationSize, ST_POOL_TAG);
+
+	if (context == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	auto status = WdfSpinLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &context->Lock);
+
+	if (!NT_SUCCESS(status))
+	{
+		DbgPrint("WdfSpinLockCreate() failed 0x%X\n", status);
+
+		ExFreePoolWithTag(context, ST_POOL_TAG);
+
+		return status;
+	}
+
+	status = casefold::Initialize(&context->Fold);
+
+	if (!NT_SUCCESS(status))
+	{
+		WdfObjectDelete(context->Lock);
+
+		ExFreePoolWithTag(context, ST_POOL_TAG);
+
+		return status;
+	}
+
+	context->NumEntries = 0;
+	context->StringBytes = 0;
+	context->VolumePrefixBytes = 0;
+
+	for (SIZE_T i = 0; i < NUM_BUCKETS; ++i)
+	{
+		InitializeListHead(&context->Buckets[i]);
+	}
+
+	*Context = context;
+
+	return STATUS_SUCCESS;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	auto context = *Context;
+
+	NT_ASSERT(context->NumEntries == 0);
+
+	casefold::TearDown(&context->Fold);
+
+	WdfObjectDelete(context->Lock);
+
+	ExFreePoolWithTag(context, ST_POOL_TAG);
+
+	*Context = NULL;
+}
+
+NTSTATUS
+Intern
+(
+	CONTEXT *Context,
+	const LOWER_UNICODE_STRING *String,
+	IMAGE_NAME **Name
+)
+{
+	const auto hash = ComputeHash(String);
+
+	WdfSpinLockAcquire(Context->Lock);
+
+	auto name = FindName(Context, String, hash);
+
+	if (name == NULL)
+	{
+		name = CreateName(Context, String, hash);
+
+		if (name == NULL)
+		{
+			WdfSpinLockRelease(Context->Lock);
+
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+
+		InsertHeadList(GetBucket(Context, hash), &name->BucketLink);
+
+		++Context->NumEntries;
+
+		Context->StringBytes += name->String.Length;
+		Context->VolumePrefixBytes += name->VolumePrefixLength;
+	}
+
+	WdfSpinLockRelease(Context->Lock);
+
+	*Name = name;
+
+	return STATUS_SUCCESS;
+}
+
+_IRQL_requires_max_(APC_LEVEL)
+NTSTATUS
+InternDowncase
+(
+	CONTEXT *Context,
+	const UNICODE_STRING *String,
+	IMAGE_NAME **Name
+)
+{
+	NT_ASSERT(KeGetCurrentIrql() <= APC_LEVEL);
+
+	//
+	// Most device paths fit in the buffer on the stack.
+	// The interned name makes its own copy so the lower case string is only needed briefly.
+	//
+
+	WCHAR stackBuffer[DOWNCASE_BUFFER_LENGTH];
+
+	UNICODE_STRING lower;
+
+	lower.Length = 0;
+	lower.MaximumLength = sizeof(stackBuffer);
+	lower.Buffer = stackBuffer;
+
+	if (String->Length > sizeof(stackBuffer))
+	{
+		lower.MaximumLength = String->Length;
+		lower.Buffer = (PWCH)ExAllocatePoolUninitialized(PagedPool, String->Length, ST_POOL_TAG);
+
+		if (lower.Buffer == NULL)
+		{
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+	}
+
+	auto status = util::DowncaseString(&lower, String);
+
+	if (NT_SUCCESS(status))
+	{
+		status = Intern(Context, (LOWER_UNICODE_STRING*)&lower, Name);
+	}
+
+	if (lower.Buffer != stackBuffer)
+	{
+		ExFreePoolWithTag(lower.Buffer, ST_POOL_TAG);
+	}
+
+	return status;
+}
+
+IMAGE_NAME*
+FindAnyCase
+(
+	CONTEXT *Context,
+	const UNICODE_STRING *String
+)
+{
+	return FindAnyCaseHashed(Context, String, ComputeFoldedHash(Context, String));
+}
+
+ULONG64
+HashAnyCase
+(
+	CONTEXT *Context,
+	const UNICODE_STRING *String
+)
+{
+	return ComputeFoldedHash(Context, String);
+}
+
+IMAGE_NAME*
+FindAnyCaseHashed
+(
+	CONTEXT *Context,
+	const UNICODE_STRING *String,
+	ULONG64 Hash
+)
+{
+	WdfSpinLockAcquire(Context->Lock);
+
+	auto bucket = GetBucket(Context, Hash);
+
+	IMAGE_NAME *name = NULL;
+
+	for (auto link = bucket->Flink; link != bucket; link = link->Flink)
+	{
+		auto candidate = CONTAINING_RECORD(link, IMAGE_NAME, BucketLink);
+
+		if (candidate->Hash == Hash
+			&& casefold::Equal(Context->Fold, (const UNICODE_STRING*)&candidate->String, String)
+			&& TryAddRef(candidate))
+		{
+			name = candidate;
+
+			break;
+		}
+	}
+
+	WdfSpinLockRelease(Context->Lock);
+
+	return name;
+}
+
+void
+AddRef
+(
+	IMAGE_NAME *Name
+)
+{
+	NT_ASSERT(Name->RefCount > 0);
+
+	InterlockedIncrement(&Name->RefCount);
+}
+
+void
+Release
+(
+	IMAGE_NAME *Name
+)
+{
+	ReleaseMany(Name, 1);
+}
+
+void
+ReleaseMany
+(
+	IMAGE_NAME *Name,
+	LONG Count
+)
+{
+	NT_ASSERT(Count > 0);
+
+	if (InterlockedExchangeAdd(&Name->RefCount, -Count) != Count)
+	{
+		return;
+	}
+
+	//
+	// The name can no longer be found by Intern().
+	// But it's still linked into the table.
+	//
+
+	auto context = Name->Owner;
+
+	WdfSpinLockAcquire(context->Lock);
+
+	RemoveEntryList(&Name->BucketLink);
+
+	--context->NumEntries;
+
+	context->StringBytes -= Name->String.Length;
+	context->VolumePrefixBytes -= Name->VolumePrefixLength;
+
+	WdfSpinLockRelease(context->Lock);
+
+	ExFreePoolWithTag(Name, ST_POOL_TAG);
+}
+
+SIZE_T
+NumEntries
+(
+	CONTEXT *Context
+)
+{
+	return Context->NumEntries;
+}
+
+void
+GetStatistics
+(
+	CONTEXT *Context,
+	STATISTICS *Statistics
+)
+{
+	WdfSpinLockAcquire(Context->Lock);
+
+	Statistics->NumEntries = Context->NumEntries;
+	Statistics->StringBytes = Context->StringBytes;
+	Statistics->VolumePrefixBytes = Context->VolumePrefixBytes;
+
+	WdfSpinLockRelease(Context->Lock);
+}
+
+} // namespace imagename
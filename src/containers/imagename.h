@@ -0,0 +1,215 @@
+#pragma once
+
+#include <wdm.h>
+#include "../defs/types.h"
+
+//
+// Table of interned image names.
+//
+// Every distinct lower case device path is stored once and shared by reference
+// between the process registry, the configuration and the firewall.
+//
+// Two interned names that originate from the same table are equal if and only if
+// the pointers are equal.
+//
+
+namespace imagename
+{
+
+struct CONTEXT;
+
+struct IMAGE_NAME
+{
+	// Device path using all lower-case characters.
+	LOWER_UNICODE_STRING String;
+
+	// Hash of `String`.
+	ULONG64 Hash;
+
+	//
+	// Length in bytes of the leading `\device\<volume>\` component of `String`,
+	// or zero if the path doesn't begin with a device name.
+	//
+	USHORT VolumePrefixLength;
+
+	//
+	// This is management data initialized and updated
+	// by the implementation.
+	//
+
+	volatile LONG RefCount;
+
+	LIST_ENTRY BucketLink;
+
+	CONTEXT *Owner;
+};
+
+//
+// Initialize()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context
+);
+
+//
+// TearDown()
+//
+// All references must have been released.
+//
+void
+TearDown
+(
+	CONTEXT **Context
+);
+
+//
+// Intern()
+//
+// IRQL <= DISPATCH.
+//
+// Look up or create the interned representation of `String`.
+// Returns a referenced name which must eventually be released.
+//
+NTSTATUS
+Intern
+(
+	CONTEXT *Context,
+	const LOWER_UNICODE_STRING *String,
+	IMAGE_NAME **Name
+);
+
+//
+// InternDowncase()
+//
+// IRQL <= APC.
+//
+// Converts `String` to lower case before interning it.
+//
+_IRQL_requires_max_(APC_LEVEL)
+NTSTATUS
+InternDowncase
+(
+	CONTEXT *Context,
+	const UNICODE_STRING *String,
+	IMAGE_NAME **Name
+);
+
+//
+// FindAnyCase()
+//
+// IRQL <= DISPATCH.
+//
+// Look up the interned name that matches `String` without regard to character casing.
+// Returns a referenced name which must eventually be released, or NULL if there is no match.
+//
+IMAGE_NAME*
+FindAnyCase
+(
+	CONTEXT *Context,
+	const UNICODE_STRING *String
+);
+
+//
+// HashAnyCase()
+//
+// IRQL <= DISPATCH.
+//
+// Compute the `Hash` of the interned name that would match `String`, without regard to
+// character casing. This doesn't access the table or take any lock.
+//
+ULONG64
+HashAnyCase
+(
+	CONTEXT *Context,
+	const UNICODE_STRING *String
+);
+
+//
+// FindAnyCaseHashed()
+//
+// IRQL <= DISPATCH.
+//
+// Same as FindAnyCase(), with the `Hash` of `String` as computed by HashAnyCase().
+//
+IMAGE_NAME*
+FindAnyCaseHashed
+(
+	CONTEXT *Context,
+	const UNICODE_STRING *String,
+	ULONG64 Hash
+);
+
+//
+// AddRef()
+//
+// IRQL <= DISPATCH.
+//
+// The caller must already hold a reference.
+//
+void
+AddRef
+(
+	IMAGE_NAME *Name
+);
+
+//
+// Release()
+//
+// IRQL <= DISPATCH.
+//
+void
+Release
+(
+	IMAGE_NAME *Name
+);
+
+//
+// ReleaseMany()
+//
+// IRQL <= DISPATCH.
+//
+// Releases `Count` references at once.
+//
+void
+ReleaseMany
+(
+	IMAGE_NAME *Name,
+	LONG Count
+);
+
+SIZE_T
+NumEntries
+(
+	CONTEXT *Context
+);
+
+struct STATISTICS
+{
+	// Number of interned names.
+	SIZE_T NumEntries;
+
+	// Total size of the string buffers of all names.
+	SIZE_T StringBytes;
+
+	// Part of `StringBytes` that is taken up by the leading volume component.
+	SIZE_T VolumePrefixBytes;
+};
+
+//
+// GetStatistics()
+//
+// IRQL <= DISPATCH.
+//
+void
+GetStatistics
+(
+	CONTEXT *Context,
+	STATISTICS *Statistics
+);
+
+} // namespace imagename
@@ -0,0 +1,473 @@
+#include <ntifs.h>
+#include "pathtrie.h"
+#include "../util.h"
+
+namespace pathtrie
+{
+
+struct NODE
+{
+	// Characters on the edge leading into this node.
+	const WCHAR *Label;
+	USHORT LabelLength;
+
+	// Whether a prefix ends at this node.
+	bool Terminal;
+
+	NODE *Parent;
+
+	// Sorted on the first character of each child's label.
+	NODE **Children;
+	ULONG NumChildren;
+	ULONG MaxChildren;
+};
+
+struct CONTEXT
+{
+	// The root node has an empty label.
+	NODE Root;
+
+	ST_PAGEABLE Pageable;
+};
+
+namespace
+{
+
+POOL_TYPE
+PoolType
+(
+	CONTEXT *Context
+)
+{
+	return (Context->Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+}
+
+//
+// AllocateNode()
+//
+// Make a single allocation for the node and its label.
+//
+// The label may later be trimmed from the front when the node is split,
+// which leaves `Label` pointing somewhere inside the same allocation.
+//
+NODE*
+AllocateNode
+(
+	CONTEXT *Context,
+	const WCHAR *Label,
+	USHORT LabelLength
+)
+{
+	auto offsetLabel = util::RoundToMultiple(sizeof(NODE), TYPE_ALIGNMENT(WCHAR));
+
+	auto allocationSize = offsetLabel + (LabelLength * sizeof(WCHAR));
+
+	auto node = (NODE*)ExAllocatePoolUninitialized(PoolType(Context), allocationSize, ST_POOL_TAG);
+
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	auto labelBuffer = (WCHAR*)(((UCHAR*)node) + offsetLabel);
+
+	RtlCopyMemory(labelBuffer, Label, LabelLength * sizeof(WCHAR));
+
+	node->Label = labelBuffer;
+	node->LabelLength = LabelLength;
+	node->Terminal = false;
+	node->Parent = NULL;
+	node->Children = NULL;
+	node->NumChildren = 0;
+	node->MaxChildren = 0;
+
+	return node;
+}
+
+void
+FreeNode
+(
+	NODE *Node
+)
+{
+	if (Node->Children != NULL)
+	{
+		ExFreePoolWithTag(Node->Children, ST_POOL_TAG);
+	}
+
+	ExFreePoolWithTag(Node, ST_POOL_TAG);
+}
+
+//
+// FindChild()
+//
+// Binary search on the first character of each child's label.
+//
+// Returns true if there is a child that starts with `Char`, and always updates
+// `Index` with the position where such a child is, or would be, found.
+//
+bool
+FindChild
+(
+	const NODE *Node,
+	WCHAR Char,
+	ULONG *Index
+)
+{
+	ULONG low = 0;
+	ULONG high = Node->NumChildren;
+
+	while (low < high)
+	{
+		const ULONG mid = low + ((high - low) / 2);
+
+		const auto candidate = Node->Children[mid]->Label[0];
+
+		if (candidate == Char)
+		{
+			*Index = mid;
+
+			return true;
+		}
+
+		if (candidate < Char)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	*Index = low;
+
+	return false;
+}
+
+NTSTATUS
+InsertChild
+(
+	CONTEXT *Context,
+	NODE *Node,
+	ULONG Index,
+	NODE *Child
+)
+{
+	if (Node->NumChildren == Node->MaxChildren)
+	{
+		const ULONG newMaxChildren = (Node->MaxChildren == 0) ? 2 : (Node->MaxChildren * 2);
+
+		auto newChildren = (NODE**)ExAllocatePoolUninitialized(PoolType(Context),
+			newMaxChildren * sizeof(NODE*), ST_POOL_TAG);
+
+		if (newChildren == NULL)
+		{
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+
+		if (Node->Children != NULL)
+		{
+			RtlCopyMemory(newChildren, Node->Children, Node->NumChildren * sizeof(NODE*));
+
+			ExFreePoolWithTag(Node->Children, ST_POOL_TAG);
+		}
+
+		Node->Children = newChildren;
+		Node->MaxChildren = newMaxChildren;
+	}
+
+	RtlMoveMemory(&Node->Children[Index + 1], &Node->Children[Index],
+		(Node->NumChildren - Index) * sizeof(NODE*));
+
+	Node->Children[Index] = Child;
+	++Node->NumChildren;
+
+	Child->Parent = Node;
+
+	return STATUS_SUCCESS;
+}
+
+USHORT
+CommonPrefixLength
+(
+	const WCHAR *Lhs,
+	const WCHAR *Rhs,
+	USHORT MaxLength
+)
+{
+	USHORT length = 0;
+
+	while (length < MaxLength && Lhs[length] == Rhs[length])
+	{
+		++length;
+	}
+
+	return length;
+}
+
+//
+// SplitChild()
+//
+// Insert a node between `Node` and the child at `Index`.
+// The new node takes over the first `Length` characters of the child's label.
+//
+NODE*
+SplitChild
+(
+	CONTEXT *Context,
+	NODE *Node,
+	ULONG Index,
+	USHORT Length
+)
+{
+	auto child = Node->Children[Index];
+
+	auto middle = AllocateNode(Context, child->Label, Length);
+
+	if (middle == NULL)
+	{
+		return NULL;
+	}
+
+	middle->Children = (NODE**)ExAllocatePoolUninitialized(PoolType(Context),
+		2 * sizeof(NODE*), ST_POOL_TAG);
+
+	if (middle->Children == NULL)
+	{
+		FreeNode(middle);
+
+		return NULL;
+	}
+
+	middle->MaxChildren = 2;
+	middle->NumChildren = 1;
+	middle->Children[0] = child;
+	middle->Parent = Node;
+
+	child->Label += Length;
+	child->LabelLength -= Length;
+	child->Parent = middle;
+
+	Node->Children[Index] = middle;
+
+	return middle;
+}
+
+} // anonymous namespace
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context,
+	ST_PAGEABLE Pageable
+)
+{
+	const auto poolType = (Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+
+	auto context = (CONTEXT*)ExAllocatePoolUninitialized(poolType, sizeof(CONTEXT), ST_POOL_TAG);
+
+	if (context == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	RtlZeroMemory(&context->Root, sizeof(context->Root));
+
+	context->Pageable = Pageable;
+
+	*Context = context;
+
+	return STATUS_SUCCESS;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	Reset(*Context);
+
+	ExFreePoolWithTag(*Context, ST_POOL_TAG);
+
+	*Context = NULL;
+}
+
+void
+Reset
+(
+	CONTEXT *Context
+)
+{
+	//
+	// Release nodes bottom-up without recursing.
+	// Each child is detached from its parent before being descended into.
+	//
+
+	auto root = &Context->Root;
+	auto node = root;
+
+	for (;;)
+	{
+		if (node->NumChildren != 0)
+		{
+			node = node->Children[--node->NumChildren];
+
+			continue;
+		}
+
+		if (node == root)
+		{
+			break;
+		}
+
+		auto parent = node->Parent;
+
+		FreeNode(node);
+
+		node = parent;
+	}
+
+	if (root->Children != NULL)
+	{
+		ExFreePoolWithTag(root->Children, ST_POOL_TAG);
+	}
+
+	RtlZeroMemory(root, sizeof(*root));
+}
+
+NTSTATUS
+Insert
+(
+	CONTEXT *Context,
+	const LOWER_UNICODE_STRING *Prefix
+)
+{
+	const USHORT length = Prefix->Length / sizeof(WCHAR);
+
+	if (length == 0)
+	{
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	auto node = &Context->Root;
+	USHORT position = 0;
+
+	for (;;)
+	{
+		if (position == length)
+		{
+			if (node->Terminal)
+			{
+				return STATUS_DUPLICATE_OBJECTID;
+			}
+
+			node->Terminal = true;
+
+			return STATUS_SUCCESS;
+		}
+
+		const auto remainder = &Prefix->Buffer[position];
+		const USHORT remainderLength = length - position;
+
+		ULONG index;
+
+		if (!FindChild(node, remainder[0], &index))
+		{
+			auto leaf = AllocateNode(Context, remainder, remainderLength);
+
+			if (leaf == NULL)
+			{
+				return STATUS_INSUFFICIENT_RESOURCES;
+			}
+
+			leaf->Terminal = true;
+
+			auto status = InsertChild(Context, node, index, leaf);
+
+			if (!NT_SUCCESS(status))
+			{
+				FreeNode(leaf);
+			}
+
+			return status;
+		}
+
+		auto child = node->Children[index];
+
+		const auto common = CommonPrefixLength(child->Label, remainder,
+			min(child->LabelLength, remainderLength));
+
+		if (common < child->LabelLength)
+		{
+			//
+			// The prefix diverges from, or ends inside of, the child's label.
+			//
+
+			child = SplitChild(Context, node, index, common);
+
+			if (child == NULL)
+			{
+				return STATUS_INSUFFICIENT_RESOURCES;
+			}
+		}
+
+		node = child;
+		position += common;
+	}
+}
+
+bool
+HasPrefixOf
+(
+	CONTEXT *Context,
+	const LOWER_UNICODE_STRING *Path
+)
+{
+	const USHORT length = Path->Length / sizeof(WCHAR);
+
+	const NODE *node = &Context->Root;
+	USHORT position = 0;
+
+	for (;;)
+	{
+		if (node->Terminal)
+		{
+			return true;
+		}
+
+		if (position == length)
+		{
+			return false;
+		}
+
+		ULONG index;
+
+		if (!FindChild(node, Path->Buffer[position], &index))
+		{
+			return false;
+		}
+
+		node = node->Children[index];
+
+		if (node->LabelLength > (length - position)
+			|| node->LabelLength != CommonPrefixLength(node->Label, &Path->Buffer[position], node->LabelLength))
+		{
+			return false;
+		}
+
+		position += node->LabelLength;
+	}
+}
+
+bool
+IsEmpty
+(
+	CONTEXT *Context
+)
+{
+	return Context->Root.NumChildren == 0;
+}
+
+} // namespace pathtrie
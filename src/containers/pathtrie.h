@@ -0,0 +1,83 @@
+#pragma once
+
+#include <wdm.h>
+#include "../defs/types.h"
+
+//
+// Compressed trie of path prefixes.
+//
+// Each edge is labelled with a run of characters rather than a single character,
+// and children are kept sorted on their first character. Determining whether any
+// of the stored prefixes is a prefix of a given path therefore takes time linear
+// in the length of the path, regardless of the number of prefixes stored.
+//
+// Strings are compared exactly, so both prefixes and paths should be lower case.
+//
+// The trie does not synchronize access.
+//
+
+namespace pathtrie
+{
+
+struct CONTEXT;
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context,
+	ST_PAGEABLE Pageable
+);
+
+void
+TearDown
+(
+	CONTEXT **Context
+);
+
+//
+// Reset()
+//
+// Remove all prefixes.
+//
+void
+Reset
+(
+	CONTEXT *Context
+);
+
+//
+// Insert()
+//
+// IRQL <= DISPATCH, unless the trie is pageable.
+//
+// Returns STATUS_DUPLICATE_OBJECTID if the prefix is already present.
+// Empty prefixes are not accepted.
+//
+NTSTATUS
+Insert
+(
+	CONTEXT *Context,
+	const LOWER_UNICODE_STRING *Prefix
+);
+
+//
+// HasPrefixOf()
+//
+// IRQL <= DISPATCH, unless the trie is pageable.
+//
+// Returns true if any stored prefix is a prefix of, or equal to, `Path`.
+//
+bool
+HasPrefixOf
+(
+	CONTEXT *Context,
+	const LOWER_UNICODE_STRING *Path
+);
+
+bool
+IsEmpty
+(
+	CONTEXT *Context
+);
+
+} // namespace pathtrie
@@ -0,0 +1,594 @@
+#include <ntifs.h>
+#include "pidindex.h"
+#include "../seqlock.h"
+
+namespace pidindex
+{
+
+//
+// Slots hold what's needed by lock-free lookups, and nothing else.
+// Four slots share a cache line, so a lookup typically touches a single line.
+//
+struct SLOT
+{
+	HANDLE ProcessId;
+
+	LONG Attributes;
+
+	// Zero indicates an empty slot.
+	ULONG Generation;
+};
+
+static_assert(sizeof(SLOT) == 16, "Slot does not pack evenly into cache lines");
+
+struct TABLE
+{
+	// Tables that have been replaced are kept on a list until the index is torn down.
+	LIST_ENTRY ListEntry;
+
+	// Number of slots. Always a power of two.
+	SIZE_T Capacity;
+
+	// 64 minus the base-2 logarithm of `Capacity`.
+	ULONG HashShift;
+
+	//
+	// Values of the slots with the same index.
+	// These are only accessed by callers that are serialized with writers.
+	//
+	void **Values;
+
+	SLOT Slots[ANYSIZE_ARRAY];
+};
+
+struct CONTEXT
+{
+	//
+	// Writers update the slot array inside a write section.
+	// Readers that don't hold any lock use the sequence lock to validate what they read.
+	//
+	seqlock::SEQLOCK Lock;
+
+	TABLE * volatile Table;
+
+	SIZE_T NumEntries;
+
+	// Generation of the most recently inserted mapping.
+	ULONG Generation;
+
+	//
+	// Lock-free readers may still be accessing a table after it's been replaced.
+	// Such tables can't be released until all readers are known to be gone.
+	//
+	LIST_ENTRY RetiredTables;
+};
+
+namespace
+{
+
+const SIZE_T INITIAL_CAPACITY = 1024;
+
+//
+// SlotIndex()
+//
+// Home slot of a PID.
+//
+// The live PIDs tend to occupy a narrow range. Used as slot indexes directly, they would
+// fill long runs of consecutive slots, and a removal shifts every entry that follows it
+// in the run. Multiplying by 2^64 divided by the golden ratio, and keeping the top bits
+// of the product, spreads consecutive PIDs evenly across the slot array.
+//
+inline
+SIZE_T
+SlotIndex
+(
+	HANDLE ProcessId,
+	const TABLE *Table
+)
+{
+	const auto hash = (((ULONG64)(ULONG_PTR)ProcessId) >> 2) * 0x9E3779B97F4A7C15ull;
+
+	return (SIZE_T)(hash >> Table->HashShift);
+}
+
+inline
+SIZE_T
+NextSlotIndex
+(
+	SIZE_T Index,
+	SIZE_T Capacity
+)
+{
+	return (Index + 1) & (Capacity - 1);
+}
+
+TABLE*
+AllocateTable
+(
+	SIZE_T Capacity
+)
+{
+	const auto valuesOffset = FIELD_OFFSET(TABLE, Slots) + (Capacity * sizeof(SLOT));
+	const auto allocationSize = valuesOffset + (Capacity * sizeof(void*));
+
+	auto table = (TABLE*)ExAllocatePoolZero(NonPagedPool, allocationSize, ST_POOL_TAG);
+
+	if (table == NULL)
+	{
+		return NULL;
+	}
+
+	InitializeListHead(&table->ListEntry);
+
+	table->Capacity = Capacity;
+	table->HashShift = 64;
+
+	for (auto capacity = Capacity; capacity > 1; capacity >>= 1)
+	{
+		--table->HashShift;
+	}
+
+	table->Values = (void**)(((UCHAR*)table) + valuesOffset);
+
+	return table;
+}
+
+//
+// PlaceSlot()
+//
+// Insert into table that is known to have room and not contain the key.
+//
+void
+PlaceSlot
+(
+	TABLE *Table,
+	const SLOT *Slot,
+	void *Value
+)
+{
+	auto index = SlotIndex(Slot->ProcessId, Table);
+
+	while (Table->Slots[index].Generation != 0)
+	{
+		index = NextSlotIndex(index, Table->Capacity);
+	}
+
+	Table->Slots[index] = *Slot;
+	Table->Values[index] = Value;
+}
+
+//
+// Grow()
+//
+// Rehash into a larger table and then publish it.
+//
+// Lock-free readers that are currently using the old table will find it unchanged,
+// so there's no need to enter a write section.
+//
+NTSTATUS
+Grow
+(
+	CONTEXT *Context,
+	SIZE_T MinimumCapacity
+)
+{
+	auto oldTable = Context->Table;
+
+	auto newCapacity = oldTable->Capacity;
+
+	while (newCapacity < MinimumCapacity)
+	{
+		newCapacity *= 2;
+	}
+
+	auto newTable = AllocateTable(newCapacity);
+
+	if (newTable == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	for (SIZE_T i = 0; i < oldTable->Capacity; ++i)
+	{
+		const auto slot = &oldTable->Slots[i];
+
+		if (slot->Generation != 0)
+		{
+			PlaceSlot(newTable, slot, oldTable->Values[i]);
+		}
+	}
+
+	WritePointerRelease((PVOID volatile *)&Context->Table, newTable);
+
+	InsertTailList(&Context->RetiredTables, &oldTable->ListEntry);
+
+	return STATUS_SUCCESS;
+}
+
+//
+// FindSlot()
+//
+// For use by writers and other callers that are serialized with writers.
+//
+SLOT*
+FindSlot
+(
+	CONTEXT *Context,
+	HANDLE ProcessId
+)
+{
+	auto table = Context->Table;
+
+	auto index = SlotIndex(ProcessId, table);
+
+	for (;;)
+	{
+		auto slot = &table->Slots[index];
+
+		if (slot->Generation == 0)
+		{
+			return NULL;
+		}
+
+		if (slot->ProcessId == ProcessId)
+		{
+			return slot;
+		}
+
+		index = NextSlotIndex(index, table->Capacity);
+	}
+}
+
+//
+// ProbeAttributes()
+//
+// Lock-free variant of FindSlot().
+//
+// The table may be modified concurrently, so the probe is bounded by the table size rather
+// than relying on finding an empty slot. The caller has to validate the result.
+//
+bool
+ProbeAttributes
+(
+	const TABLE *Table,
+	HANDLE ProcessId,
+	LONG *Attributes,
+	ULONG *Generation
+)
+{
+	const auto capacity = Table->Capacity;
+
+	auto index = SlotIndex(ProcessId, Table);
+
+	for (SIZE_T probes = 0; probes < capacity; ++probes)
+	{
+		const volatile SLOT *slot = &Table->Slots[index];
+
+		const auto generation = slot->Generation;
+
+		if (generation == 0)
+		{
+			return false;
+		}
+
+		if (slot->ProcessId == ProcessId)
+		{
+			*Attributes = slot->Attributes;
+			*Generation = generation;
+
+			return true;
+		}
+
+		index = NextSlotIndex(index, capacity);
+	}
+
+	return false;
+}
+
+} // anonymous namespace
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context
+)
+{
+	auto context = (CONTEXT*)ExAllocatePoolUninitialized(NonPagedPool, sizeof(CONTEXT), ST_POOL_TAG);
+
+	if (context == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	context->Table = AllocateTable(INITIAL_CAPACITY);
+
+	if (context->Table == NULL)
+	{
+		ExFreePoolWithTag(context, ST_POOL_TAG);
+
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	seqlock::Initialize(&context->Lock);
+
+	context->NumEntries = 0;
+	context->Generation = 0;
+
+	InitializeListHead(&context->RetiredTables);
+
+	*Context = context;
+
+	return STATUS_SUCCESS;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	auto context = *Context;
+
+	while (!IsListEmpty(&context->RetiredTables))
+	{
+		auto table = CONTAINING_RECORD(RemoveHeadList(&context->RetiredTables), TABLE, ListEntry);
+
+		ExFreePoolWithTag(table, ST_POOL_TAG);
+	}
+
+	ExFreePoolWithTag(context->Table, ST_POOL_TAG);
+	ExFreePoolWithTag(context, ST_POOL_TAG);
+
+	*Context = NULL;
+}
+
+void
+Reset
+(
+	CONTEXT *Context
+)
+{
+	auto table = Context->Table;
+
+	const auto oldIrql = seqlock::BeginWrite(&Context->Lock);
+
+	RtlZeroMemory(&table->Slots[0], table->Capacity * sizeof(SLOT));
+
+	seqlock::EndWrite(&Context->Lock, oldIrql);
+
+	RtlZeroMemory(table->Values, table->Capacity * sizeof(void*));
+
+	Context->NumEntries = 0;
+}
+
+NTSTATUS
+Reserve
+(
+	CONTEXT *Context,
+	SIZE_T NumAdditional
+)
+{
+	//
+	// Keep the load factor at or below 50%.
+	// Probe sequences are then short enough that lookups are effectively constant time.
+	//
+
+	const auto required = (Context->NumEntries + NumAdditional) * 2;
+
+	if (required <= Context->Table->Capacity)
+	{
+		return STATUS_SUCCESS;
+	}
+
+	return Grow(Context, required);
+}
+
+NTSTATUS
+Insert
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	void *Value,
+	LONG Attributes
+)
+{
+	NT_ASSERT(Value != NULL);
+
+	if (FindSlot(Context, ProcessId) != NULL)
+	{
+		return STATUS_DUPLICATE_OBJECTID;
+	}
+
+	auto status = Reserve(Context, 1);
+
+	if (!NT_SUCCESS(status))
+	{
+		return status;
+	}
+
+	//
+	// Zero is reserved for empty slots.
+	//
+
+	if (++Context->Generation == 0)
+	{
+		++Context->Generation;
+	}
+
+	const SLOT slot = { ProcessId, Attributes, Context->Generation };
+
+	const auto oldIrql = seqlock::BeginWrite(&Context->Lock);
+
+	PlaceSlot(Context->Table, &slot, Value);
+
+	seqlock::EndWrite(&Context->Lock, oldIrql);
+
+	++Context->NumEntries;
+
+	return STATUS_SUCCESS;
+}
+
+void*
+Find
+(
+	CONTEXT *Context,
+	HANDLE ProcessId
+)
+{
+	auto slot = FindSlot(Context, ProcessId);
+
+	if (slot == NULL)
+	{
+		return NULL;
+	}
+
+	auto table = Context->Table;
+
+	return table->Values[slot - &table->Slots[0]];
+}
+
+bool
+SetAttributes
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	LONG Attributes
+)
+{
+	auto slot = FindSlot(Context, ProcessId);
+
+	if (slot == NULL)
+	{
+		return false;
+	}
+
+	//
+	// A single aligned store.
+	// Readers observe either the old or the new value, both of which are valid.
+	//
+
+	WriteNoFence(&slot->Attributes, Attributes);
+
+	return true;
+}
+
+bool
+QueryAttributes
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	LONG *Attributes,
+	ULONG *Generation
+)
+{
+	for (;;)
+	{
+		const auto sequence = seqlock::BeginRead(&Context->Lock);
+
+		auto table = (const TABLE *)ReadPointerAcquire((PVOID const volatile *)&Context->Table);
+
+		LONG attributes = 0;
+		ULONG generation = 0;
+
+		const auto found = ProbeAttributes(table, ProcessId, &attributes, &generation);
+
+		if (seqlock::RetryRead(&Context->Lock, sequence))
+		{
+			continue;
+		}
+
+		if (found)
+		{
+			*Attributes = attributes;
+
+			if (Generation != NULL)
+			{
+				*Generation = generation;
+			}
+		}
+
+		return found;
+	}
+}
+
+bool
+Remove
+(
+	CONTEXT *Context,
+	HANDLE ProcessId
+)
+{
+	auto slot = FindSlot(Context, ProcessId);
+
+	if (slot == NULL)
+	{
+		return false;
+	}
+
+	auto table = Context->Table;
+
+	const auto capacity = table->Capacity;
+
+	//
+	// Backward shift deletion.
+	//
+	// Move subsequent entries in the probe sequence into the hole, as long as doing so
+	// does not move an entry in front of its home slot.
+	//
+
+	const auto oldIrql = seqlock::BeginWrite(&Context->Lock);
+
+	auto hole = (SIZE_T)(slot - &table->Slots[0]);
+	auto index = NextSlotIndex(hole, capacity);
+
+	for (;;)
+	{
+		auto candidate = &table->Slots[index];
+
+		if (candidate->Generation == 0)
+		{
+			break;
+		}
+
+		const auto home = SlotIndex(candidate->ProcessId, table);
+
+		//
+		// Distance from home to current position, and from home to hole,
+		// both measured in the direction of probing.
+		//
+
+		const auto distanceCurrent = (index - home) & (capacity - 1);
+		const auto distanceHole = (hole - home) & (capacity - 1);
+
+		if (distanceHole < distanceCurrent)
+		{
+			table->Slots[hole] = *candidate;
+			table->Values[hole] = table->Values[index];
+
+			hole = index;
+		}
+
+		index = NextSlotIndex(index, capacity);
+	}
+
+	RtlZeroMemory(&table->Slots[hole], sizeof(SLOT));
+
+	seqlock::EndWrite(&Context->Lock, oldIrql);
+
+	table->Values[hole] = NULL;
+
+	--Context->NumEntries;
+
+	return true;
+}
+
+SIZE_T
+NumEntries
+(
+	CONTEXT *Context
+)
+{
+	return Context->NumEntries;
+}
+
+} // namespace pidindex
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <wdm.h>
+#include "../defs/types.h"
+
+//
+// Open addressing hash index that maps a PID onto an opaque value.
+//
+// PIDs are multiples of four and are handed out densely by the system, so live PIDs
+// are scattered across the slot array with a multiplicative hash rather than placed in
+// consecutive slots. Collisions are resolved using linear probing and deletions use
+// backward shifting, so there are no tombstones to clean up.
+//
+// Each mapping also carries a small attributes value which is stored inline in the index.
+// The attributes can be queried without holding any lock, which is what makes the index
+// suitable for lookups at DISPATCH on the connection classification path.
+//
+// Values are kept in a separate array, so lock-free lookups only touch a compact array
+// of PIDs, attributes and generations.
+//
+// Each mapping is assigned a generation when it's inserted. A PID that is reused
+// will have a different generation.
+//
+// Apart from QueryAttributes(), the index does not synchronize access. Callers are expected
+// to serialize writers with each other and with any readers that use Find().
+//
+// The index is always backed by non-paged memory.
+//
+
+namespace pidindex
+{
+
+struct CONTEXT;
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context
+);
+
+void
+TearDown
+(
+	CONTEXT **Context
+);
+
+//
+// Reset()
+//
+// IRQL <= DISPATCH.
+//
+// Remove all mappings but keep the slot array.
+//
+void
+Reset
+(
+	CONTEXT *Context
+);
+
+//
+// Reserve()
+//
+// IRQL <= DISPATCH.
+//
+// Ensure there is room for `NumAdditional` additional mappings without the need to
+// reallocate the slot array.
+//
+// This makes it possible to perform a fallible operation up front and then follow up
+// with a number of infallible insertions.
+//
+NTSTATUS
+Reserve
+(
+	CONTEXT *Context,
+	SIZE_T NumAdditional
+);
+
+//
+// Insert()
+//
+// IRQL <= DISPATCH.
+//
+// `Value` must not be NULL.
+//
+// Returns STATUS_DUPLICATE_OBJECTID if there is already a mapping for `ProcessId`.
+//
+NTSTATUS
+Insert
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	void *Value,
+	LONG Attributes
+);
+
+//
+// Find()
+//
+// IRQL <= DISPATCH.
+//
+// Returns the value associated with `ProcessId` or NULL.
+//
+void*
+Find
+(
+	CONTEXT *Context,
+	HANDLE ProcessId
+);
+
+//
+// SetAttributes()
+//
+// IRQL <= DISPATCH.
+//
+// Update the attributes of an existing mapping.
+//
+bool
+SetAttributes
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	LONG Attributes
+);
+
+//
+// QueryAttributes()
+//
+// IRQL <= DISPATCH.
+//
+// Lock-free lookup that may execute concurrently with writers.
+// `Generation` is optional.
+//
+bool
+QueryAttributes
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	LONG *Attributes,
+	ULONG *Generation
+);
+
+//
+// Remove()
+//
+// IRQL <= DISPATCH.
+//
+bool
+Remove
+(
+	CONTEXT *Context,
+	HANDLE ProcessId
+);
+
+SIZE_T
+NumEntries
+(
+	CONTEXT *Context
+);
+
+} // namespace pidindex
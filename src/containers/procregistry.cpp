@@ -1,5 +1,9 @@
 #include <ntifs.h>
+#include <ntintsafe.h>
 #include "procregistry.h"
+#include "pidindex.h"
+#include "slab.h"
+#include "verdictcache.h"
 #include "../util.h"
 
 namespace procregistry
@@ -7,384 +11,1478 @@ namespace procregistry
 
 struct CONTEXT
 {
-	RTL_AVL_TABLE Tree;
+	//
+	// All entries, in the order they were added.
+	// Linked through PROCESS_REGISTRY_ENTRY::RegistryLink.
+	//
+	LIST_ENTRY Entries;
+
+	//
+	// Maps PID -> entry.
+	// Lookups are performed at DISPATCH for every classified connection.
+	//
+	// The index also carries the current split status of each entry, for the benefit
+	// of lock-free readers.
+	//
+	pidindex::CONTEXT *Index;
+
+	//
+	// Per-processor cache in front of the index, if the registry is non-paged.
+	// Invalidated whenever the index is updated.
+	//
+	verdictcache::CONTEXT *Verdicts;
+
+	//
+	// Maps image -> entries running the image.
+	// Hashed on the interned image name.
+	//
+	// This is used to find the entries affected by a configuration change
+	// without visiting every entry.
+	//
+	LIST_ENTRY *ImageBuckets;
+	SIZE_T NumImageBuckets;
+
+	// Number of distinct images.
+	SIZE_T NumImages;
+
+	//
+	// Cache of entries, if the registry is non-paged.
+	// Entries are added and removed for every process that arrives or departs.
+	//
+	slab::CONTEXT *Nodes;
+
+	imagename::CONTEXT *ImageNames;
+
 	ST_PAGEABLE Pageable;
 };
 
-namespace
-{
+namespace
+{
+
+//
+// Entries that share the same image.
+// The group is created along with the first entry and is released with the last entry.
+//
+struct IMAGE_GROUP
+{
+	LIST_ENTRY BucketLink;
+
+	// The reference is held by the entries.
+	const imagename::IMAGE_NAME *ImageName;
+
+	// Linked through PROCESS_REGISTRY_ENTRY::ImageLink.
+	LIST_ENTRY Entries;
+
+	// Number of entries, and hence the number of references held on the image name.
+	SIZE_T NumEntries;
+};
+
+//
+// Always a power of two.
+//
+const SIZE_T INITIAL_NUM_IMAGE_BUCKETS = 64;
+
+POOL_TYPE
+PoolType
+(
+	CONTEXT *Context
+)
+{
+	return (Context->Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+}
+
+LIST_ENTRY*
+AllocateImageBuckets
+(
+	CONTEXT *Context,
+	SIZE_T NumBuckets
+)
+{
+	auto buckets = (LIST_ENTRY*)
+		ExAllocatePoolUninitialized(PoolType(Context), NumBuckets * sizeof(LIST_ENTRY), ST_POOL_TAG);
+
+	if (buckets == NULL)
+	{
+		return NULL;
+	}
+
+	for (SIZE_T i = 0; i < NumBuckets; ++i)
+	{
+		InitializeListHead(&buckets[i]);
+	}
+
+	return buckets;
+}
+
+IMAGE_GROUP*
+FindImageGroup
+(
+	CONTEXT *Context,
+	const imagename::IMAGE_NAME *ImageName
+)
+{
+	auto bucket = &Context->ImageBuckets[ImageName->Hash & (Context->NumImageBuckets - 1)];
+
+	for (auto link = bucket->Flink; link != bucket; link = link->Flink)
+	{
+		auto group = CONTAINING_RECORD(link, IMAGE_GROUP, BucketLink);
+
+		if (group->ImageName == ImageName)
+		{
+			return group;
+		}
+	}
+
+	return NULL;
+}
+
+//
+// ReserveImageGroup()
+//
+// Make sure there is room for one additional image without exceeding
+// a load factor of one.
+//
+NTSTATUS
+ReserveImageGroup
+(
+	CONTEXT *Context
+)
+{
+	if (Context->NumImages < Context->NumImageBuckets)
+	{
+		return STATUS_SUCCESS;
+	}
+
+	const auto newNumBuckets = Context->NumImageBuckets * 2;
+
+	auto newBuckets = AllocateImageBuckets(Context, newNumBuckets);
+
+	if (newBuckets == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	for (SIZE_T i = 0; i < Context->NumImageBuckets; ++i)
+	{
+		auto bucket = &Context->ImageBuckets[i];
+
+		while (!IsListEmpty(bucket))
+		{
+			auto group = CONTAINING_RECORD(RemoveHeadList(bucket), IMAGE_GROUP, BucketLink);
+
+			InsertTailList(&newBuckets[group->ImageName->Hash & (newNumBuckets - 1)], &group->BucketLink);
+		}
+	}
+
+	ExFreePoolWithTag(Context->ImageBuckets, ST_POOL_TAG);
+
+	Context->ImageBuckets = newBuckets;
+	Context->NumImageBuckets = newNumBuckets;
+
+	return STATUS_SUCCESS;
+}
+
+//
+// AcquireImageGroup()
+//
+// Find the group for `ImageName`, or create an empty group.
+//
+IMAGE_GROUP*
+AcquireImageGroup
+(
+	CONTEXT *Context,
+	const imagename::IMAGE_NAME *ImageName
+)
+{
+	auto group = FindImageGroup(Context, ImageName);
+
+	if (group != NULL)
+	{
+		return group;
+	}
+
+	if (!NT_SUCCESS(ReserveImageGroup(Context)))
+	{
+		return NULL;
+	}
+
+	group = (IMAGE_GROUP*)ExAllocatePoolUninitialized(PoolType(Context), sizeof(IMAGE_GROUP), ST_POOL_TAG);
+
+	if (group == NULL)
+	{
+		return NULL;
+	}
+
+	group->ImageName = ImageName;
+
+	InitializeListHead(&group->Entries);
+
+	group->NumEntries = 0;
+
+	InsertTailList(&Context->ImageBuckets[ImageName->Hash & (Context->NumImageBuckets - 1)], &group->BucketLink);
+
+	++Context->NumImages;
+
+	return group;
+}
+
+void
+ReleaseImageGroupIfEmpty
+(
+	CONTEXT *Context,
+	IMAGE_GROUP *Group
+)
+{
+	if (!IsListEmpty(&Group->Entries))
+	{
+		return;
+	}
+
+	RemoveEntryList(&Group->BucketLink);
+
+	--Context->NumImages;
+
+	ExFreePoolWithTag(Group, ST_POOL_TAG);
+}
+
+PROCESS_REGISTRY_ENTRY*
+AllocateEntry
+(
+	CONTEXT *Context
+)
+{
+	if (Context->Nodes != NULL)
+	{
+		return (PROCESS_REGISTRY_ENTRY*)slab::Allocate(Context->Nodes);
+	}
+
+	return (PROCESS_REGISTRY_ENTRY*)
+		ExAllocatePoolUninitialized(PagedPool, sizeof(PROCESS_REGISTRY_ENTRY), ST_POOL_TAG);
+}
+
+void
+FreeEntry
+(
+	CONTEXT *Context,
+	PROCESS_REGISTRY_ENTRY *Entry
+)
+{
+	if (Context->Nodes != NULL)
+	{
+		slab::Free(Context->Nodes, Entry);
+	}
+	else
+	{
+		ExFreePoolWithTag(Entry, ST_POOL_TAG);
+	}
+}
+
+void
+LinkToParent
+(
+	PROCESS_REGISTRY_ENTRY *Parent,
+	PROCESS_REGISTRY_ENTRY *Entry
+)
+{
+	Entry->ParentEntry = Parent;
+
+	InsertTailList(&Parent->Children, &Entry->SiblingLink);
+}
+
+//
+// IsSelfOrAncestor()
+//
+// Determine whether `Candidate` is `Entry` or an ancestor of `Entry`.
+//
+bool
+IsSelfOrAncestor
+(
+	PROCESS_REGISTRY_ENTRY *Entry,
+	PROCESS_REGISTRY_ENTRY *Candidate
+)
+{
+	for (auto current = Entry; current != NULL; current = current->ParentEntry)
+	{
+		if (current == Candidate)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool
+NTAPI
+ResolveParentLink
+(
+	PROCESS_REGISTRY_ENTRY *Entry,
+	void *Context
+)
+{
+	if (Entry->ParentEntry != NULL
+		|| Entry->ParentProcessId == 0)
+	{
+		return true;
+	}
+
+	auto parent = FindEntry((CONTEXT*)Context, Entry->ParentProcessId);
+
+	//
+	// PIDs are reused, so a process snapshot may describe what appears to be a cycle.
+	// Leave such an entry without a parent rather than corrupting the tree.
+	//
+
+	if (parent == NULL
+		|| IsSelfOrAncestor(parent, Entry))
+	{
+		return true;
+	}
+
+	LinkToParent(parent, Entry);
+
+	return true;
+}
+
+void
+InvalidateVerdicts
+(
+	CONTEXT *Context
+)
+{
+	if (Context->Verdicts != NULL)
+	{
+		verdictcache::Invalidate(Context->Verdicts);
+	}
+}
+
+bool
+NTAPI
+ResolveSplitStatus
+(
+	HANDLE ProcessId,
+	LONG *Value,
+	void *Context
+)
+{
+	auto context = (CONTEXT*)Context;
+
+	return pidindex::QueryAttributes(context->Index, ProcessId, Value, NULL);
+}
+
+void
+InnerDeleteEntry
+(
+	CONTEXT *Context,
+	PROCESS_REGISTRY_ENTRY *Entry
+)
+{
+	const auto imageName = Entry->ImageName;
+
+	auto group = FindImageGroup(Context, imageName);
+
+	NT_ASSERT(group != NULL);
+
+	RemoveEntryList(&Entry->ImageLink);
+
+	--group->NumEntries;
+
+	ReleaseImageGroupIfEmpty(Context, group);
+
+	RemoveEntryList(&Entry->RegistryLink);
+
+	pidindex::Remove(Context->Index, Entry->ProcessId);
+
+	InvalidateVerdicts(Context);
+
+	FreeEntry(Context, Entry);
+
+	imagename::Release(imageName);
+}
+
+void
+InitializeEntryValues
+(
+	HANDLE ParentProcessId,
+	HANDLE ProcessId,
+	ST_PROCESS_SPLIT_STATUS Split,
+	PROCESS_REGISTRY_ENTRY *Entry
+)
+{
+	Entry->ParentProcessId = ParentProcessId;
+	Entry->ProcessId = ProcessId;
+
+	static const PROCESS_REGISTRY_ENTRY_SETTINGS settings =
+	{
+		.Split = ST_PROCESS_SPLIT_STATUS_OFF,
+		.HasFirewallState = false
+	};
+
+	Entry->Settings = { Split, false };
+	Entry->TargetSettings = settings;
+	Entry->PreviousSettings = settings;
+
+	Entry->ParentEntry = NULL;
+}
+
+//
+// Working state for each entry in a process snapshot, while it's being added.
+//
+struct SNAPSHOT_NODE
+{
+	// Registry entry created for the snapshot entry at the same position.
+	PROCESS_REGISTRY_ENTRY *Entry;
+
+	// Position of the parent in the snapshot, or NO_PARENT.
+	SIZE_T Parent;
+
+	enum class STATE : UCHAR
+	{
+		UNVISITED,
+		ON_PATH,
+		DONE
+	}
+	State;
+};
+
+//
+// PID or parent PID of a snapshot entry, along with the position of the entry.
+// Sorting and searching these doesn't have to visit the snapshot.
+//
+struct SNAPSHOT_KEY
+{
+	ULONG_PTR ProcessId;
+	SIZE_T Position;
+};
+
+const SIZE_T NO_PARENT = ~(SIZE_T)0;
+
+const SIZE_T RADIX_BITS = 8;
+const SIZE_T RADIX_SIZE = 1 << RADIX_BITS;
+
+//
+// SortKeys()
+//
+// This is a least significant digit radix sort. Only as many passes are made as are needed to
+// cover the highest PID, so a snapshot is sorted in three or four linear passes.
+//
+// `Temporary` holds as many elements as `Keys`, and `Counts` holds RADIX_SIZE elements.
+//
+void
+SortKeys
+(
+	SNAPSHOT_KEY *Keys,
+	SIZE_T NumKeys,
+	SNAPSHOT_KEY *Temporary,
+	SIZE_T *Counts
+)
+{
+	ULONG_PTR allKeys = 0;
+
+	for (SIZE_T i = 0; i < NumKeys; ++i)
+	{
+		allKeys |= Keys[i].ProcessId;
+	}
+
+	auto source = Keys;
+	auto destination = Temporary;
+
+	for (SIZE_T shift = 0;
+		shift < (sizeof(ULONG_PTR) * 8) && (allKeys >> shift) != 0;
+		shift += RADIX_BITS)
+	{
+		RtlZeroMemory(Counts, RADIX_SIZE * sizeof(SIZE_T));
+
+		for (SIZE_T i = 0; i < NumKeys; ++i)
+		{
+			++Counts[(source[i].ProcessId >> shift) & (RADIX_SIZE - 1)];
+		}
+
+		SIZE_T offset = 0;
+
+		for (SIZE_T digit = 0; digit < RADIX_SIZE; ++digit)
+		{
+			const auto count = Counts[digit];
+
+			Counts[digit] = offset;
+
+			offset += count;
+		}
+
+		for (SIZE_T i = 0; i < NumKeys; ++i)
+		{
+			destination[Counts[(source[i].ProcessId >> shift) & (RADIX_SIZE - 1)]++] = source[i];
+		}
+
+		const auto temp = source;
+
+		source = destination;
+		destination = temp;
+	}
+
+	if (source != Keys)
+	{
+		RtlCopyMemory(Keys, source, NumKeys * sizeof(SNAPSHOT_KEY));
+	}
+}
+
+//
+// FindSnapshotParents()
+//
+// Assign `SNAPSHOT_NODE::Parent` by joining entries sorted on parent PID with
+// entries sorted on PID. Both are walked once, in order.
+//
+void
+FindSnapshotParents
+(
+	const SNAPSHOT_ENTRY *Entries,
+	const SNAPSHOT_KEY *SortedProcessIds,
+	const SNAPSHOT_KEY *SortedParentProcessIds,
+	SIZE_T NumEntries,
+	SNAPSHOT_NODE *Nodes
+)
+{
+	SIZE_T candidate = 0;
+
+	for (SIZE_T i = 0; i < NumEntries; ++i)
+	{
+		const auto parentProcessId = SortedParentProcessIds[i].ProcessId;
+		const auto position = SortedParentProcessIds[i].Position;
+
+		Nodes[position].Parent = NO_PARENT;
+
+		if (parentProcessId == 0
+			|| parentProcessId == (ULONG_PTR)Entries[position].ProcessId)
+		{
+			continue;
+		}
+
+		while (candidate < NumEntries
+			&& SortedProcessIds[candidate].ProcessId < parentProcessId)
+		{
+			++candidate;
+		}
+
+		if (candidate < NumEntries
+			&& SortedProcessIds[candidate].ProcessId == parentProcessId)
+		{
+			Nodes[position].Parent = SortedProcessIds[candidate].Position;
+		}
+	}
+}
+
+//
+// BreakSnapshotCycles()
+//
+// Clear the parent of one entry in each cycle.
+//
+// Each walk towards the root stops at the first entry that's already known to lead to a root,
+// so every entry is visited a bounded number of times regardless of the depth of the tree.
+//
+void
+BreakSnapshotCycles
+(
+	SNAPSHOT_NODE *Nodes,
+	SIZE_T NumEntries
+)
+{
+	using STATE = SNAPSHOT_NODE::STATE;
+
+	for (SIZE_T i = 0; i < NumEntries; ++i)
+	{
+		if (Nodes[i].State != STATE::UNVISITED)
+		{
+			continue;
+		}
+
+		for (auto current = i;;)
+		{
+			Nodes[current].State = STATE::ON_PATH;
+
+			const auto parent = Nodes[current].Parent;
+
+			if (parent == NO_PARENT
+				|| Nodes[parent].State == STATE::DONE)
+			{
+				break;
+			}
+
+			if (Nodes[parent].State == STATE::ON_PATH)
+			{
+				Nodes[current].Parent = NO_PARENT;
+
+				break;
+			}
+
+			current = parent;
+		}
+
+		for (auto current = i;
+			current != NO_PARENT && Nodes[current].State == STATE::ON_PATH;
+			current = Nodes[current].Parent)
+		{
+			Nodes[current].State = STATE::DONE;
+		}
+	}
+}
+
+} // anonymous namespace
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context,
+	imagename::CONTEXT *ImageNames,
+	ST_PAGEABLE Pageable
+)
+{
+	const auto poolType = (Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+
+	*Context = (CONTEXT*)
+		ExAllocatePoolUninitialized(poolType, sizeof(CONTEXT), ST_POOL_TAG);
+
+	if (*Context == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	InitializeListHead(&(*Context)->Entries);
+
+	(*Context)->Nodes = NULL;
+	(*Context)->Verdicts = NULL;
+	(*Context)->ImageNames = ImageNames;
+	(*Context)->Pageable = Pageable;
+
+	auto status = pidindex::Initialize(&(*Context)->Index);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto Abort;
+	}
+
+	(*Context)->ImageBuckets = AllocateImageBuckets(*Context, INITIAL_NUM_IMAGE_BUCKETS);
+
+	if ((*Context)->ImageBuckets == NULL)
+	{
+		status = STATUS_INSUFFICIENT_RESOURCES;
+
+		goto Abort_teardown_index;
+	}
+
+	(*Context)->NumImageBuckets = INITIAL_NUM_IMAGE_BUCKETS;
+	(*Context)->NumImages = 0;
+
+	if (Pageable == ST_PAGEABLE::YES)
+	{
+		return STATUS_SUCCESS;
+	}
+
+	status = slab::Initialize(&(*Context)->Nodes, sizeof(PROCESS_REGISTRY_ENTRY));
+
+	if (!NT_SUCCESS(status))
+	{
+		goto Abort_free_buckets;
+	}
+
+	status = verdictcache::Initialize(&(*Context)->Verdicts);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto Abort_teardown_nodes;
+	}
+
+	return STATUS_SUCCESS;
+
+Abort_teardown_nodes:
+
+	slab::TearDown(&(*Context)->Nodes);
+
+Abort_free_buckets:
+
+	ExFreePoolWithTag((*Context)->ImageBuckets, ST_POOL_TAG);
+
+Abort_teardown_index:
+
+	pidindex::TearDown(&(*Context)->Index);
+
+Abort:
+
+	ExFreePoolWithTag(*Context, ST_POOL_TAG);
+
+	*Context = NULL;
+
+	return status;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	Reset(*Context);
+
+	pidindex::TearDown(&(*Context)->Index);
+
+	verdictcache::TearDown(&(*Context)->Verdicts);
+
+	slab::TearDown(&(*Context)->Nodes);
+
+	ExFreePoolWithTag((*Context)->ImageBuckets, ST_POOL_TAG);
+	ExFreePoolWithTag(*Context, ST_POOL_TAG);
+
+	*Context = NULL;
+}
+
+void
+Reset
+(
+	CONTEXT *Context
+)
+{
+	if (Context->Nodes == NULL)
+	{
+		while (!IsListEmpty(&Context->Entries))
+		{
+			auto entry = CONTAINING_RECORD(Context->Entries.Flink, PROCESS_REGISTRY_ENTRY, RegistryLink);
+
+			InnerDeleteEntry(Context, entry);
+		}
+	}
+	else
+	{
+		//
+		// Release the references on image names one image at a time, and then
+		// release all entries at once by resetting the node cache.
+		// No entry is visited.
+		//
+
+		for (SIZE_T i = 0; i < Context->NumImageBuckets; ++i)
+		{
+			auto bucket = &Context->ImageBuckets[i];
+
+			while (!IsListEmpty(bucket))
+			{
+				auto group = CONTAINING_RECORD(RemoveHeadList(bucket), IMAGE_GROUP, BucketLink);
+
+				imagename::ReleaseMany((imagename::IMAGE_NAME*)group->ImageName, (LONG)group->NumEntries);
+
+				ExFreePoolWithTag(group, ST_POOL_TAG);
+			}
+		}
+
+		Context->NumImages = 0;
+
+		InitializeListHead(&Context->Entries);
+
+		slab::Reset(Context->Nodes);
+	}
+
+	pidindex::Reset(Context->Index);
+
+	InvalidateVerdicts(Context);
+}
+
+NTSTATUS
+InitializeEntry
+(
+	CONTEXT *Context,
+	HANDLE ParentProcessId,
+	HANDLE ProcessId,
+	ST_PROCESS_SPLIT_STATUS Split,
+	UNICODE_STRING *ImageName,
+	PROCESS_REGISTRY_ENTRY *Entry
+)
+{
+	if (ImageName == NULL
+		|| ImageName->Length == 0)
+	{
+		return InitializeEntryLower(Context, ParentProcessId, ProcessId, Split, NULL, Entry);
+	}
+
+	RtlZeroMemory(Entry, sizeof(*Entry));
+
+	auto status = imagename::InternDowncase(Context->ImageNames, ImageName, &Entry->ImageName);
+
+	if (!NT_SUCCESS(status))
+	{
+		return status;
+	}
+
+	InitializeEntryValues(ParentProcessId, ProcessId, Split, Entry);
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS
+InitializeEntryLower
+(
+	CONTEXT *Context,
+	HANDLE ParentProcessId,
+	HANDLE ProcessId,
+	ST_PROCESS_SPLIT_STATUS Split,
+	const LOWER_UNICODE_STRING *ImageName,
+	PROCESS_REGISTRY_ENTRY *Entry
+)
+{
+	RtlZeroMemory(Entry, sizeof(*Entry));
+
+	LOWER_UNICODE_STRING emptyImageName = { 0 };
+
+	if (ImageName == NULL)
+	{
+		ImageName = &emptyImageName;
+	}
+
+	auto status = imagename::Intern(Context->ImageNames, ImageName, &Entry->ImageName);
+
+	if (!NT_SUCCESS(status))
+	{
+		return status;
+	}
+
+	InitializeEntryValues(ParentProcessId, ProcessId, Split, Entry);
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS
+Reserve
+(
+	CONTEXT *Context,
+	SIZE_T NumAdditional
+)
+{
+	return pidindex::Reserve(Context->Index, NumAdditional);
+}
+
+NTSTATUS
+AddEntry
+(
+	CONTEXT *Context,
+	PROCESS_REGISTRY_ENTRY *Entry
+)
+{
+	//
+	// Make room in the index up front.
+	// This way the entry can't be added to the registry but not the index.
+	//
+
+	auto status = pidindex::Reserve(Context->Index, 1);
+
+	if (!NT_SUCCESS(status))
+	{
+		return status;
+	}
+
+	if (FindEntry(Context, Entry->ProcessId) != NULL)
+	{
+		return STATUS_DUPLICATE_OBJECTID;
+	}
+
+	auto group = AcquireImageGroup(Context, Entry->ImageName);
+
+	if (group == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	auto newEntry = AllocateEntry(Context);
+
+	if (newEntry == NULL)
+	{
+		ReleaseImageGroupIfEmpty(Context, group);
+
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	*newEntry = *Entry;
+
+	status = pidindex::Insert(Context->Index, newEntry->ProcessId, newEntry, newEntry->Settings.Split);
+
+	NT_ASSERT(NT_SUCCESS(status));
+
+	InvalidateVerdicts(Context);
+
+	newEntry->ParentEntry = NULL;
+
+	InitializeListHead(&newEntry->Children);
+	InitializeListHead(&newEntry->SiblingLink);
+
+	InsertTailList(&Context->Entries, &newEntry->RegistryLink);
+	InsertTailList(&group->Entries, &newEntry->ImageLink);
+
+	++group->NumEntries;
+
+	if (newEntry->ParentProcessId != 0)
+	{
+		auto parent = FindEntry(Context, newEntry->ParentProcessId);
+
+		if (parent != NULL && parent != newEntry)
+		{
+			LinkToParent(parent, newEntry);
+		}
+	}
+
+	return STATUS_SUCCESS;
+}
+
+void
+ResolveParentLinks
+(
+	CONTEXT *Context
+)
+{
+	ForEach(Context, ResolveParentLink, Context);
+}
+
+NTSTATUS
+AddSnapshot
+(
+	CONTEXT *Context,
+	const SNAPSHOT_ENTRY *Entries,
+	SIZE_T NumEntries
+)
+{
+	NT_ASSERT(IsEmpty(Context));
+
+	if (NumEntries == 0)
+	{
+		return STATUS_SUCCESS;
+	}
+
+	//
+	// Allocate all working state at once.
+	//
+
+	const auto elementSize = sizeof(SNAPSHOT_NODE) + (3 * sizeof(SNAPSHOT_KEY));
+
+	SIZE_T scratchSize;
+
+	auto status = RtlSIZETMult(NumEntries, elementSize, &scratchSize);
+
+	if (!NT_SUCCESS(status)
+		|| !NT_SUCCESS(RtlULongPtrAdd(scratchSize, RADIX_SIZE * sizeof(SIZE_T), &scratchSize)))
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	auto processIds = (SNAPSHOT_KEY*)ExAllocatePoolUninitialized(PoolType(Context), scratchSize, ST_POOL_TAG);
+
+	if (processIds == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	auto parentProcessIds = processIds + NumEntries;
+	auto temporary = parentProcessIds + NumEntries;
+	auto nodes = (SNAPSHOT_NODE*)(temporary + NumEntries);
+	auto counts = (SIZE_T*)(nodes + NumEntries);
+
+	//
+	// Sort once on PID, and once on parent PID.
+	// Duplicate PIDs end up next to each other, and each parent is found by walking
+	// both sorted arrays side by side.
+	//
+
+	for (SIZE_T i = 0; i < NumEntries; ++i)
+	{
+		processIds[i] = { (ULONG_PTR)Entries[i].ProcessId, i };
+		parentProcessIds[i] = { (ULONG_PTR)Entries[i].ParentProcessId, i };
+	}
+
+	SortKeys(processIds, NumEntries, temporary, counts);
+
+	for (SIZE_T i = 1; i < NumEntries; ++i)
+	{
+		if (processIds[i].ProcessId == processIds[i - 1].ProcessId)
+		{
+			status = STATUS_DUPLICATE_OBJECTID;
+
+			goto Abort_free_scratch;
+		}
+	}
+
+	SortKeys(parentProcessIds, NumEntries, temporary, counts);
+
+	FindSnapshotParents(Entries, processIds, parentProcessIds, NumEntries, nodes);
+
+	status = pidindex::Reserve(Context->Index, NumEntries);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto Abort_free_scratch;
+	}
+
+	//
+	// Create and index all entries in a single pass.
+	//
+
+	for (SIZE_T i = 0; i < NumEntries; ++i)
+	{
+		imagename::IMAGE_NAME *imageName;
+
+		status = imagename::Intern(Context->ImageNames, &Entries[i].ImageName, &imageName);
+
+		if (!NT_SUCCESS(status))
+		{
+			goto Abort_reset;
+		}
+
+		auto group = AcquireImageGroup(Context, imageName);
+
+		if (group == NULL)
+		{
+			imagename::Release(imageName);
+
+			status = STATUS_INSUFFICIENT_RESOURCES;
+
+			goto Abort_reset;
+		}
+
+		auto entry = AllocateEntry(Context);
+
+		if (entry == NULL)
+		{
+			ReleaseImageGroupIfEmpty(Context, group);
+
+			imagename::Release(imageName);
+
+			status = STATUS_INSUFFICIENT_RESOURCES;
 
-RTL_GENERIC_COMPARE_RESULTS
-TreeCompareRoutine
-(
-	__in struct _RTL_AVL_TABLE *Table,
-	__in PVOID  FirstStruct,
-	__in PVOID  SecondStruct
-)
-{
-	UNREFERENCED_PARAMETER(Table);
+			goto Abort_reset;
+		}
 
-	auto first = ((PROCESS_REGISTRY_ENTRY*)FirstStruct)->ProcessId;
-	auto second = ((PROCESS_REGISTRY_ENTRY*)SecondStruct)->ProcessId;
+		InitializeEntryValues(Entries[i].ParentProcessId, Entries[i].ProcessId,
+			ST_PROCESS_SPLIT_STATUS_OFF, entry);
 
-	if (first < second)
-	{
-		return GenericLessThan;
+		entry->ImageName = imageName;
+
+		InitializeListHead(&entry->Children);
+		InitializeListHead(&entry->SiblingLink);
+
+		InsertTailList(&Context->Entries, &entry->RegistryLink);
+		InsertTailList(&group->Entries, &entry->ImageLink);
+
+		++group->NumEntries;
+
+		status = pidindex::Insert(Context->Index, entry->ProcessId, entry, entry->Settings.Split);
+
+		NT_ASSERT(NT_SUCCESS(status));
+
+		nodes[i].Entry = entry;
+		nodes[i].State = SNAPSHOT_NODE::STATE::UNVISITED;
 	}
 
-	if (first > second)
+	//
+	// Link parents in a second pass.
+	//
+
+	BreakSnapshotCycles(nodes, NumEntries);
+
+	for (SIZE_T i = 0; i < NumEntries; ++i)
 	{
-		return GenericGreaterThan;
+		if (nodes[i].Parent != NO_PARENT)
+		{
+			LinkToParent(nodes[nodes[i].Parent].Entry, nodes[i].Entry);
+		}
 	}
 
-	return GenericEqual;
-}
+	InvalidateVerdicts(Context);
 
-PVOID
-TreeAllocateRoutineNonPaged
-(
-	__in struct _RTL_AVL_TABLE *Table,
-	__in CLONG ByteSize
-)
-{
-	UNREFERENCED_PARAMETER(Table);
+	ExFreePoolWithTag(processIds, ST_POOL_TAG);
+
+	return STATUS_SUCCESS;
+
+Abort_reset:
+
+	Reset(Context);
+
+Abort_free_scratch:
 
-	return ExAllocatePoolUninitialized(NonPagedPool, ByteSize, ST_POOL_TAG);
+	ExFreePoolWithTag(processIds, ST_POOL_TAG);
+
+	return status;
 }
 
-PVOID
-TreeAllocateRoutinePaged
+void
+ReleaseEntry
 (
-	__in struct _RTL_AVL_TABLE *Table,
-	__in CLONG ByteSize
+	PROCESS_REGISTRY_ENTRY *Entry
 )
 {
-	UNREFERENCED_PARAMETER(Table);
+	if (Entry->ImageName != NULL)
+	{
+		imagename::Release(Entry->ImageName);
 
-	return ExAllocatePoolUninitialized(PagedPool, ByteSize, ST_POOL_TAG);
+		Entry->ImageName = NULL;
+	}
 }
 
-VOID
-TreeFreeRoutine
+PROCESS_REGISTRY_ENTRY*
+FindEntry
 (
-	__in struct _RTL_AVL_TABLE *Table,
-	__in PVOID Buffer
+	CONTEXT *Context,
+	HANDLE ProcessId
 )
 {
-	UNREFERENCED_PARAMETER(Table);
-
-	ExFreePoolWithTag(Buffer, ST_POOL_TAG);
+	return (PROCESS_REGISTRY_ENTRY*)pidindex::Find(Context->Index, ProcessId);
 }
 
-//
-// ClearDepartingParentLink()
-//
-// `Entry` is an enumerated entry in the tree.
-// `Context` is the PID corresponding to an entry that's being removed from the tree.
-//
-// If `Entry` is a child of `Context` it needs to be updated to indicate that the parent process
-// is no longer available.
-//
-bool
-NTAPI
-ClearDepartingParentLink
+void
+PublishSettings
 (
-	PROCESS_REGISTRY_ENTRY *Entry,
-	void *Context
+	CONTEXT *Context,
+	PROCESS_REGISTRY_ENTRY *Entry
 )
 {
-	auto departingProcessId = (HANDLE)Context;
+	const auto status = pidindex::SetAttributes(Context->Index, Entry->ProcessId, Entry->Settings.Split);
 
-	if (Entry->ParentProcessId == departingProcessId)
-	{
-		Entry->ParentProcessId = 0;
-		Entry->ParentEntry = NULL;
-	}
+	NT_ASSERT(status);
 
-	return true;
+	UNREFERENCED_PARAMETER(status);
+
+	InvalidateVerdicts(Context);
 }
 
 bool
-InnerDeleteEntry
+GetSplitStatus
 (
 	CONTEXT *Context,
-	PROCESS_REGISTRY_ENTRY *Entry
+	HANDLE ProcessId,
+	ST_PROCESS_SPLIT_STATUS *Split
 )
 {
-	LOWER_UNICODE_STRING imageName = { 0 };
+	LONG attributes;
 
-	util::Swap(&Entry->ImageName, &imageName);
+	const auto found = (Context->Verdicts != NULL)
+		? verdictcache::Lookup(Context->Verdicts, ProcessId, ResolveSplitStatus, Context, &attributes)
+		: ResolveSplitStatus(ProcessId, &attributes, Context);
 
-	const auto status = RtlDeleteElementGenericTableAvl(&Context->Tree, Entry);
-
-	if (FALSE == status)
+	if (!found)
 	{
-		util::Swap(&Entry->ImageName, &imageName);
-
 		return false;
 	}
 
-	if (imageName.Buffer != NULL)
-	{
-		util::FreeStringBuffer(&imageName);
-	}
+	*Split = (ST_PROCESS_SPLIT_STATUS)attributes;
 
 	return true;
 }
 
-} // anonymous namespace
-
-NTSTATUS
-Initialize
+bool
+QuerySplitStatus
 (
-	CONTEXT **Context,
-	ST_PAGEABLE Pageable
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	ST_PROCESS_SPLIT_STATUS *Split
 )
 {
-	const auto poolType = (Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+	LONG attributes;
 
-	*Context = (CONTEXT*)
-		ExAllocatePoolUninitialized(poolType, sizeof(CONTEXT), ST_POOL_TAG);
-
-	if (*Context == NULL)
+	if (!ResolveSplitStatus(ProcessId, &attributes, Context))
 	{
-		return STATUS_INSUFFICIENT_RESOURCES;
+		return false;
 	}
 
-	(*Context)->Pageable = Pageable;
-
-	const auto allocRoutine = (Pageable == ST_PAGEABLE::YES)
-		? TreeAllocateRoutinePaged : TreeAllocateRoutineNonPaged;
+	*Split = (ST_PROCESS_SPLIT_STATUS)attributes;
 
-	RtlInitializeGenericTableAvl(&(*Context)->Tree, TreeCompareRoutine,
-		allocRoutine, TreeFreeRoutine, NULL);
-
-	return STATUS_SUCCESS;
+	return true;
 }
 
 void
-TearDown
+GetVerdictCacheStatistics
 (
-	CONTEXT **Context
+	CONTEXT *Context,
+	verdictcache::STATISTICS *Statistics
 )
 {
-	Reset(*Context);
+	if (Context->Verdicts == NULL)
+	{
+		RtlZeroMemory(Statistics, sizeof(*Statistics));
 
-	ExFreePoolWithTag(*Context, ST_POOL_TAG);
+		return;
+	}
 
-	*Context = NULL;
+	verdictcache::GetStatistics(Context->Verdicts, Statistics);
 }
 
 void
-Reset
+GetEntryCacheStatistics
 (
-	CONTEXT *Context
+	CONTEXT *Context,
+	slab::STATISTICS *Statistics
 )
 {
-	for (;;)
+	if (Context->Nodes == NULL)
 	{
-		auto entry = (PROCESS_REGISTRY_ENTRY*)RtlGetElementGenericTableAvl(&Context->Tree, 0);
-
-		if (NULL == entry)
-		{
-			break;
-		}
-
-		//
-		// It's believed that `InnerDeleteEntry` will never fail as long as
-		// the following conditions are met:
-		//
-		// - The tree's CompareRoutine and FreeRoutine are correctly implemented.
-		// - Nodes in the tree are regarded as internally consistent by tree CompareRoutine.
-		// - `entry` argument is valid.
-		//
+		RtlZeroMemory(Statistics, sizeof(*Statistics));
 
-		InnerDeleteEntry(Context, entry);
+		return;
 	}
+
+	slab::GetStatistics(Context->Nodes, Statistics);
 }
 
-NTSTATUS
-InitializeEntry
+bool
+DeleteEntry
 (
 	CONTEXT *Context,
-	HANDLE ParentProcessId,
-	HANDLE ProcessId,
-	ST_PROCESS_SPLIT_STATUS Split,
-	UNICODE_STRING *ImageName,
 	PROCESS_REGISTRY_ENTRY *Entry
 )
 {
-	RtlZeroMemory(Entry, sizeof(*Entry));
+	//
+	// Detach the entry from the tree structure before deleting it.
+	//
 
-	if (ImageName != NULL
-		&& ImageName->Length != 0)
-	{
-		LOWER_UNICODE_STRING lowerImageName;
+	LIST_ENTRY children;
 
-		auto status = util::AllocateCopyDowncaseString(&lowerImageName, ImageName, Context->Pageable);
+	util::ReparentList(&children, &Entry->Children);
 
-		if (!NT_SUCCESS(status))
-		{
-			return status;
-		}
+	RemoveEntryList(&Entry->SiblingLink);
 
-		Entry->ImageName = lowerImageName;
-	}
+	InnerDeleteEntry(Context, Entry);
 
-	Entry->ParentProcessId = ParentProcessId;
-	Entry->ProcessId = ProcessId;
+	//
+	// Children are now orphaned.
+	// Indicate that the parent process is no longer available.
+	//
 
-	static const PROCESS_REGISTRY_ENTRY_SETTINGS settings =
+	while (!IsListEmpty(&children))
 	{
-		.Split = ST_PROCESS_SPLIT_STATUS_OFF,
-		.HasFirewallState = false
-	};
+		auto child = CONTAINING_RECORD(RemoveHeadList(&children), PROCESS_REGISTRY_ENTRY, SiblingLink);
 
-	Entry->Settings = { Split, false };
-	Entry->TargetSettings = settings;
-	Entry->PreviousSettings = settings;
+		child->ParentProcessId = 0;
+		child->ParentEntry = NULL;
 
-	Entry->ParentEntry = NULL;
+		InitializeListHead(&child->SiblingLink);
+	}
 
-	return STATUS_SUCCESS;
+	return true;
 }
 
-NTSTATUS
-AddEntry
+bool
+DeleteEntryById
 (
 	CONTEXT *Context,
-	PROCESS_REGISTRY_ENTRY *Entry
+	HANDLE ProcessId
 )
 {
-	//
-	// Insert entry into tree.
-	// This makes a copy of the entry.
-	//
-
-	BOOLEAN newElement;
-
-	auto record = RtlInsertElementGenericTableAvl(&Context->Tree, Entry, (CLONG)sizeof(*Entry), &newElement);
+	auto entry = FindEntry(Context, ProcessId);
 
-	if (record != NULL && newElement != FALSE)
+	if (entry == NULL)
 	{
-		return STATUS_SUCCESS;
+		return false;
 	}
 
-	//
-	// Handle failure cases.
-	//
+	return DeleteEntry(Context, entry);
+}
 
-	if (record == NULL)
+bool
+ForEach
+(
+	CONTEXT *Context,
+	ST_PR_FOREACH Callback,
+	void *ClientContext
+)
+{
+	for (auto link = Context->Entries.Flink;
+		 link != &Context->Entries;
+		 link = link->Flink)
 	{
-		// Allocation of record failed.
-		return STATUS_INSUFFICIENT_RESOURCES;
+		auto entry = CONTAINING_RECORD(link, PROCESS_REGISTRY_ENTRY, RegistryLink);
+
+		if (!Callback(entry, ClientContext))
+		{
+			return false;
+		}
 	}
 
-	// There's already a record for this PID.
-	return STATUS_DUPLICATE_OBJECTID;
+	return true;
 }
 
-void
-ReleaseEntry
+bool
+ForEachEntryWithImage
 (
-	PROCESS_REGISTRY_ENTRY *Entry
+	CONTEXT *Context,
+	const imagename::IMAGE_NAME *ImageName,
+	ST_PR_FOREACH Callback,
+	void *ClientContext
 )
 {
-	if (Entry->ImageName.Buffer != NULL)
+	auto group = FindImageGroup(Context, ImageName);
+
+	if (group == NULL)
+	{
+		return true;
+	}
+
+	for (auto link = group->Entries.Flink; link != &group->Entries; link = link->Flink)
 	{
-		util::FreeStringBuffer(&Entry->ImageName);
+		auto entry = CONTAINING_RECORD(link, PROCESS_REGISTRY_ENTRY, ImageLink);
+
+		if (!Callback(entry, ClientContext))
+		{
+			return false;
+		}
 	}
+
+	return true;
 }
 
-PROCESS_REGISTRY_ENTRY*
-FindEntry
+bool
+ForEachImage
 (
 	CONTEXT *Context,
-	HANDLE ProcessId
+	ST_PR_FOREACH_IMAGE Callback,
+	void *ClientContext
 )
 {
-	PROCESS_REGISTRY_ENTRY record = { 0 };
+	for (SIZE_T i = 0; i < Context->NumImageBuckets; ++i)
+	{
+		auto bucket = &Context->ImageBuckets[i];
+
+		for (auto link = bucket->Flink; link != bucket; link = link->Flink)
+		{
+			auto group = CONTAINING_RECORD(link, IMAGE_GROUP, BucketLink);
 
-	record.ProcessId = ProcessId;
+			if (!Callback(group->ImageName, ClientContext))
+			{
+				return false;
+			}
+		}
+	}
 
-	return (PROCESS_REGISTRY_ENTRY*)RtlLookupElementGenericTableAvl(&Context->Tree, &record);
+	return true;
 }
 
-bool
-DeleteEntry
+PROCESS_REGISTRY_ENTRY*
+GetParentEntry
 (
 	CONTEXT *Context,
 	PROCESS_REGISTRY_ENTRY *Entry
 )
 {
-	const auto processId = Entry->ProcessId;
-
-	const auto status = InnerDeleteEntry(Context, Entry);
-
-	if (status)
-	{
-		ForEach(Context, ClearDepartingParentLink, processId);
-	}
+	UNREFERENCED_PARAMETER(Context);
 
-	return status;
+	return Entry->ParentEntry;
 }
 
 bool
-DeleteEntryById
+ForEachChild
 (
 	CONTEXT *Context,
-	HANDLE ProcessId
+	PROCESS_REGISTRY_ENTRY *Entry,
+	ST_PR_FOREACH Callback,
+	void *ClientContext
 )
 {
-	auto entry = FindEntry(Context, ProcessId);
+	UNREFERENCED_PARAMETER(Context);
 
-	if (entry == NULL)
+	for (auto link = Entry->Children.Flink;
+		 link != &Entry->Children;
+		 link = link->Flink)
 	{
-		return false;
+		auto child = CONTAINING_RECORD(link, PROCESS_REGISTRY_ENTRY, SiblingLink);
+
+		if (!Callback(child, ClientContext))
+		{
+			return false;
+		}
 	}
 
-	return DeleteEntry(Context, entry);
+	return true;
 }
 
 bool
-ForEach
+ForEachDescendant
 (
 	CONTEXT *Context,
+	PROCESS_REGISTRY_ENTRY *Entry,
 	ST_PR_FOREACH Callback,
 	void *ClientContext
 )
 {
-	for (auto entry = RtlEnumerateGenericTableAvl(&Context->Tree, TRUE);
-		 entry != NULL;
-		 entry = RtlEnumerateGenericTableAvl(&Context->Tree, FALSE))
+	UNREFERENCED_PARAMETER(Context);
+
+	//
+	// Pre-order traversal that uses the parent links rather than a stack.
+	// The depth of the process tree is not bounded.
+	//
+
+	auto current = Entry;
+
+	for (;;)
 	{
-		if (!Callback((PROCESS_REGISTRY_ENTRY*)entry, ClientContext))
+		if (!IsListEmpty(&current->Children))
+		{
+			current = CONTAINING_RECORD(current->Children.Flink, PROCESS_REGISTRY_ENTRY, SiblingLink);
+		}
+		else
+		{
+			//
+			// Move to the next sibling.
+			// Or the next sibling of the closest ancestor that has one.
+			//
+
+			for (;;)
+			{
+				if (current == Entry)
+				{
+					return true;
+				}
+
+				auto parent = current->ParentEntry;
+
+				if (current->SiblingLink.Flink != &parent->Children)
+				{
+					current = CONTAINING_RECORD(current->SiblingLink.Flink, PROCESS_REGISTRY_ENTRY, SiblingLink);
+
+					break;
+				}
+
+				current = parent;
+			}
+		}
+
+		if (!Callback(current, ClientContext))
 		{
 			return false;
 		}
 	}
-
-	return true;
 }
 
-PROCESS_REGISTRY_ENTRY*
-GetParentEntry
+bool
+ForEachTopological
 (
 	CONTEXT *Context,
-	PROCESS_REGISTRY_ENTRY *Entry
+	ST_PR_FOREACH Callback,
+	void *ClientContext
 )
 {
-	if (NULL != Entry->ParentEntry)
-	{
-		return Entry->ParentEntry;
-	}
+	//
+	// Every entry without a parent is the root of a tree.
+	// Visiting each tree in pre-order reaches every entry exactly once.
+	//
 
-	if (0 == Entry->ParentProcessId)
+	for (auto link = Context->Entries.Flink;
+		 link != &Context->Entries;
+		 link = link->Flink)
 	{
-		return NULL;
+		auto root = CONTAINING_RECORD(link, PROCESS_REGISTRY_ENTRY, RegistryLink);
+
+		if (root->ParentEntry != NULL)
+		{
+			continue;
+		}
+
+		if (!Callback(root, ClientContext)
+			|| !ForEachDescendant(Context, root, Callback, ClientContext))
+		{
+			return false;
+		}
 	}
 
-	return (Entry->ParentEntry = FindEntry(Context, Entry->ParentProcessId));
+	return true;
 }
 
 bool
@@ -393,7 +1491,7 @@ IsEmpty
 	CONTEXT *Context
 )
 {
-	return FALSE != RtlIsGenericTableEmptyAvl(&Context->Tree);
+	return FALSE != IsListEmpty(&Context->Entries);
 }
 
 } // namespace procregistry
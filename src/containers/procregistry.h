@@ -2,6 +2,9 @@
 
 #include <ntddk.h>
 #include "../defs/types.h"
+#include "imagename.h"
+#include "verdictcache.h"
+#include "slab.h"
 
 namespace procregistry
 {
@@ -26,8 +29,11 @@ struct PROCESS_REGISTRY_ENTRY
 
 	PROCESS_REGISTRY_ENTRY_SETTINGS PreviousSettings;
 
-	// Device path using all lower-case characters.
-	LOWER_UNICODE_STRING ImageName;
+	//
+	// Interned device path using all lower-case characters.
+	// Processes that share an image also share the name.
+	//
+	imagename::IMAGE_NAME *ImageName;
 
 	//
 	// This is management data initialized and updated
@@ -36,6 +42,18 @@ struct PROCESS_REGISTRY_ENTRY
 	// It would be inconvenient to store it anywhere else.
 	//
 	PROCESS_REGISTRY_ENTRY *ParentEntry;
+
+	// Entries whose `ParentEntry` refers to this entry.
+	LIST_ENTRY Children;
+
+	// Link in the `Children` list of the parent entry.
+	LIST_ENTRY SiblingLink;
+
+	// Link in the list of entries that share the same image.
+	LIST_ENTRY ImageLink;
+
+	// Link in the list of all entries.
+	LIST_ENTRY RegistryLink;
 };
 
 struct CONTEXT;
@@ -44,6 +62,7 @@ NTSTATUS
 Initialize
 (
 	CONTEXT **Context,
+	imagename::CONTEXT *ImageNames,
 	ST_PAGEABLE Pageable
 );
 
@@ -64,8 +83,10 @@ Reset
 //
 // IRQL <= APC.
 //
-// Initializes `Entry` with provided values and initializes a buffer of
-// the correct backing and format for `Entry->ImageName.Buffer`.
+// Initializes `Entry` with provided values and acquires a reference on
+// the interned `Entry->ImageName`.
+//
+// An absent image name is interned as the empty string.
 //
 // The provided `Entry` argument is typically allocated on the stack.
 //
@@ -80,6 +101,44 @@ InitializeEntry
 	PROCESS_REGISTRY_ENTRY *Entry
 );
 
+//
+// InitializeEntryLower()
+//
+// IRQL <= DISPATCH.
+//
+// Same as InitializeEntry() but for an image name that is already lower-case.
+//
+// This avoids allocating a lower-case copy of the name for each entry, when the caller
+// is able to downcase a large number of names into the same buffer.
+//
+NTSTATUS
+InitializeEntryLower
+(
+	CONTEXT *Context,
+	HANDLE ParentProcessId,
+	HANDLE ProcessId,
+	ST_PROCESS_SPLIT_STATUS Split,
+	const LOWER_UNICODE_STRING *ImageName,
+	PROCESS_REGISTRY_ENTRY *Entry
+);
+
+//
+// Reserve()
+//
+// IRQL <= DISPATCH.
+//
+// Make room for `NumAdditional` additional entries in the PID index.
+//
+// Use this ahead of adding a large number of entries, so the index is sized once
+// rather than grown repeatedly.
+//
+NTSTATUS
+Reserve
+(
+	CONTEXT *Context,
+	SIZE_T NumAdditional
+);
+
 //
 // AddEntry()
 //
@@ -87,12 +146,16 @@ InitializeEntry
 //
 // On Success:
 //
-// The `Entry` argument will be copied and `Entry->ImageName.Buffer`
+// The `Entry` argument will be copied and the reference held by `Entry->ImageName`
 // is taken ownership of.
 //
+// The new entry is linked to its parent, if the parent is present in the registry.
+// Entries that are added ahead of their parent are not linked until ResolveParentLinks()
+// is called.
+//
 // On failure:
 //
-// `Entry->ImageName.Buffer` is not taken ownership of.
+// The reference held by `Entry->ImageName` is not taken ownership of.
 //
 NTSTATUS
 AddEntry
@@ -101,10 +164,48 @@ AddEntry
 	PROCESS_REGISTRY_ENTRY *Entry
 );
 
+//
+// Process as described by a process snapshot.
+//
+struct SNAPSHOT_ENTRY
+{
+	HANDLE ParentProcessId;
+	HANDLE ProcessId;
+
+	// Device path using all lower-case characters. May be empty.
+	LOWER_UNICODE_STRING ImageName;
+};
+
+//
+// AddSnapshot()
+//
+// IRQL <= DISPATCH.
+//
+// Populate an empty registry from a process snapshot.
+// All entries are added with split status ST_PROCESS_SPLIT_STATUS_OFF.
+//
+// The snapshot is not required to list parents before their children. It's sorted on PID
+// once, which is used to reject duplicate PIDs and to find parents, and parent links are
+// established in a single pass once all entries are indexed.
+//
+// PIDs are reused, so a snapshot may describe what appears to be a cycle. One entry in each
+// such cycle is left without a parent.
+//
+// Returns STATUS_DUPLICATE_OBJECTID if a PID is listed more than once.
+// On failure, the registry is left empty.
+//
+NTSTATUS
+AddSnapshot
+(
+	CONTEXT *Context,
+	const SNAPSHOT_ENTRY *Entries,
+	SIZE_T NumEntries
+);
+
 //
 // ReleaseEntry()
 //
-// Memory backing the imagename string buffer is allocated by InitializeEntry().
+// The image name reference is acquired by InitializeEntry().
 //
 // Use this function to release an entry that could not be added, in order to
 // keep details abstracted.
@@ -115,6 +216,22 @@ ReleaseEntry
 	PROCESS_REGISTRY_ENTRY *Entry
 );
 
+//
+// ResolveParentLinks()
+//
+// IRQL <= DISPATCH.
+//
+// Link entries that were added ahead of their parent.
+//
+// Each unlinked entry walks the ancestry of its parent to avoid creating a cycle.
+// Prefer AddSnapshot() when populating the registry from a process snapshot.
+//
+void
+ResolveParentLinks
+(
+	CONTEXT *Context
+);
+
 PROCESS_REGISTRY_ENTRY*
 FindEntry
 (
@@ -122,6 +239,90 @@ FindEntry
 	HANDLE ProcessId
 );
 
+//
+// PublishSettings()
+//
+// IRQL <= DISPATCH.
+//
+// Make updated settings on an entry in the registry visible to GetSplitStatus().
+//
+// This should be called after each update to `Entry->Settings`.
+//
+void
+PublishSettings
+(
+	CONTEXT *Context,
+	PROCESS_REGISTRY_ENTRY *Entry
+);
+
+//
+// GetSplitStatus()
+//
+// IRQL <= DISPATCH.
+//
+// Look up the current split status of a process.
+//
+// This function doesn't require the registry lock and can execute concurrently with
+// any updates to the registry.
+//
+// Repeated lookups are answered from a per-processor cache.
+//
+bool
+GetSplitStatus
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	ST_PROCESS_SPLIT_STATUS *Split
+);
+
+//
+// QuerySplitStatus()
+//
+// IRQL <= DISPATCH.
+//
+// Same as GetSplitStatus() but bypasses the per-processor cache.
+//
+// Use this for one-off lookups, so they don't displace the cached verdicts of processes
+// that are classifying connections.
+//
+bool
+QuerySplitStatus
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	ST_PROCESS_SPLIT_STATUS *Split
+);
+
+//
+// GetVerdictCacheStatistics()
+//
+// IRQL <= DISPATCH.
+//
+// Statistics for the cache used by GetSplitStatus().
+// All counters are zero if the registry is pageable.
+//
+void
+GetVerdictCacheStatistics
+(
+	CONTEXT *Context,
+	verdictcache::STATISTICS *Statistics
+);
+
+//
+// GetEntryCacheStatistics()
+//
+// IRQL <= DISPATCH.
+//
+// Statistics for the cache that entries are allocated from.
+// All counters are zero if the registry is pageable.
+//
+void
+GetEntryCacheStatistics
+(
+	CONTEXT *Context,
+	slab::STATISTICS *Statistics
+);
+
 bool
 DeleteEntry
 (
@@ -138,6 +339,12 @@ DeleteEntryById
 
 typedef bool (NTAPI *ST_PR_FOREACH)(PROCESS_REGISTRY_ENTRY *Entry, void *Context);
 
+//
+// ForEach()
+//
+// Enumerates entries in the order they were added, not in PID order.
+// Entries added by AddSnapshot() are in the order they're listed in the snapshot.
+//
 bool
 ForEach
 (
@@ -153,6 +360,89 @@ GetParentEntry
 	PROCESS_REGISTRY_ENTRY *Entry
 );
 
+//
+// ForEachEntryWithImage()
+//
+// Enumerate entries that are running the interned image `ImageName`.
+// No other entries are visited.
+//
+// The callback must not add or remove entries.
+//
+bool
+ForEachEntryWithImage
+(
+	CONTEXT *Context,
+	const imagename::IMAGE_NAME *ImageName,
+	ST_PR_FOREACH Callback,
+	void *ClientContext
+);
+
+typedef bool (NTAPI *ST_PR_FOREACH_IMAGE)(const imagename::IMAGE_NAME *ImageName, void *Context);
+
+//
+// ForEachImage()
+//
+// Enumerate each distinct image that is running, once.
+//
+// The callback must not add or remove entries.
+//
+bool
+ForEachImage
+(
+	CONTEXT *Context,
+	ST_PR_FOREACH_IMAGE Callback,
+	void *ClientContext
+);
+
+//
+// ForEachChild()
+//
+// Enumerate immediate children of `Entry`.
+//
+// The callback must not add or remove entries.
+//
+bool
+ForEachChild
+(
+	CONTEXT *Context,
+	PROCESS_REGISTRY_ENTRY *Entry,
+	ST_PR_FOREACH Callback,
+	void *ClientContext
+);
+
+//
+// ForEachDescendant()
+//
+// Enumerate all descendants of `Entry`, parents before children.
+// `Entry` itself is not included.
+//
+// The callback must not add or remove entries.
+//
+bool
+ForEachDescendant
+(
+	CONTEXT *Context,
+	PROCESS_REGISTRY_ENTRY *Entry,
+	ST_PR_FOREACH Callback,
+	void *ClientContext
+);
+
+//
+// ForEachTopological()
+//
+// Enumerate all entries, parents before children.
+// Each entry is visited once.
+//
+// The callback must not add or remove entries.
+//
+bool
+ForEachTopological
+(
+	CONTEXT *Context,
+	ST_PR_FOREACH Callback,
+	void *ClientContext
+);
+
 bool
 IsEmpty
 (
@@ -1,5 +1,8 @@
 #include <ntifs.h>
 #include "registeredimage.h"
+#include "pathtrie.h"
+#include "globdfa.h"
+#include "arena.h"
 #include "../util.h"
 
 namespace registeredimage
@@ -7,7 +10,44 @@ namespace registeredimage
 
 struct CONTEXT
 {
+	// All entries, in insertion order.
 	LIST_ENTRY ListEntry;
+
+	//
+	// Entries hashed on the interned image name.
+	// Exact lookups are performed for every arriving process and for every
+	// process in the registry when the configuration is updated.
+	//
+	LIST_ENTRY *Buckets;
+	SIZE_T NumBuckets;
+
+	//
+	// Blocked Bloom filter over the hashed entries.
+	// Most images that are looked up are not in the configuration, and are rejected
+	// after reading a single cache line of the filter.
+	//
+	ULONG64 *Filter;
+	SIZE_T NumFilterBlocks;
+
+	// Number of hashed entries.
+	SIZE_T NumEntries;
+
+	// Directory prefixes of prefix entries.
+	pathtrie::CONTEXT *Prefixes;
+
+	// Compiled pattern entries, or NULL if there are none.
+	globdfa::CONTEXT *Patterns;
+
+	//
+	// Storage for entries.
+	// This is released all at once when the instance is reset or torn down.
+	//
+	arena::CONTEXT *Storage;
+
+	// Removed entries, available for reuse.
+	LIST_ENTRY FreeEntries;
+
+	imagename::CONTEXT *ImageNames;
 	ST_PAGEABLE Pageable;
 };
 
@@ -15,55 +55,396 @@ namespace
 {
 
 //
-// FindEntry()
+// Always a power of two.
+//
+const SIZE_T INITIAL_NUM_BUCKETS = 16;
+
 //
-// Use at PASSIVE only (APC is OK unless in paging file IO path).
-// Presumably because character tables are stored in pageable memory.
+// A filter block is one cache line.
+// The filter is sized along with the buckets, to 16 bits per hashed entry at the highest load factor.
 //
-// Implements case-insensitive comparison.
+const SIZE_T FILTER_BLOCK_WORDS = 8;
+const SIZE_T FILTER_BLOCK_BITS = FILTER_BLOCK_WORDS * 64;
+const SIZE_T BUCKETS_PER_FILTER_BLOCK = FILTER_BLOCK_BITS / 16;
+
 //
-REGISTERED_IMAGE_ENTRY*
-FindEntry
+// Number of bits set in the block, for each entry.
+//
+const SIZE_T FILTER_NUM_PROBES = 4;
+
+SIZE_T
+NumFilterBlocksForBuckets
+(
+	SIZE_T NumBuckets
+)
+{
+	return (NumBuckets > BUCKETS_PER_FILTER_BLOCK) ? (NumBuckets / BUCKETS_PER_FILTER_BLOCK) : 1;
+}
+
+ULONG64*
+AllocateFilter
+(
+	SIZE_T NumBlocks,
+	ST_PAGEABLE Pageable
+)
+{
+	const auto poolType = (Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+
+	const auto filterSize = NumBlocks * FILTER_BLOCK_WORDS * sizeof(ULONG64);
+
+	auto filter = (ULONG64*)ExAllocatePoolUninitialized(poolType, filterSize, ST_POOL_TAG);
+
+	if (filter != NULL)
+	{
+		RtlZeroMemory(filter, filterSize);
+	}
+
+	return filter;
+}
+
+//
+// GetFilterBlock()
+//
+// The low bits of the hash select the bucket, so the block is selected by the high bits.
+//
+ULONG64*
+GetFilterBlock
+(
+	ULONG64 *Filter,
+	SIZE_T NumBlocks,
+	ULONG64 Hash
+)
+{
+	return &Filter[((Hash >> 32) & (NumBlocks - 1)) * FILTER_BLOCK_WORDS];
+}
+
+//
+// FilterProbes()
+//
+// Remix the hash so probes are independent of the bits used for selecting the bucket and block.
+// Each probe consumes 9 bits, taken from the well-mixed upper part of the product.
+//
+ULONG64
+FilterProbes
+(
+	ULONG64 Hash
+)
+{
+	return (Hash * 0x9e3779b97f4a7c15) >> 28;
+}
+
+void
+FilterAdd
+(
+	ULONG64 *Filter,
+	SIZE_T NumBlocks,
+	ULONG64 Hash
+)
+{
+	auto block = GetFilterBlock(Filter, NumBlocks, Hash);
+	auto probes = FilterProbes(Hash);
+
+	for (SIZE_T i = 0; i < FILTER_NUM_PROBES; ++i, probes >>= 9)
+	{
+		const auto bit = probes & (FILTER_BLOCK_BITS - 1);
+
+		block[bit / 64] |= (1ULL << (bit % 64));
+	}
+}
+
+bool
+FilterMayContain
 (
 	CONTEXT *Context,
-	UNICODE_STRING *ImageName
+	ULONG64 Hash
+)
+{
+	auto block = GetFilterBlock(Context->Filter, Context->NumFilterBlocks, Hash);
+	auto probes = FilterProbes(Hash);
+
+	for (SIZE_T i = 0; i < FILTER_NUM_PROBES; ++i, probes >>= 9)
+	{
+		const auto bit = probes & (FILTER_BLOCK_BITS - 1);
+
+		if (0 == (block[bit / 64] & (1ULL << (bit % 64))))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//
+// RebuildFilter()
+//
+// Entries can't be removed from the filter, so it's rebuilt from the remaining entries instead.
+//
+void
+RebuildFilter
+(
+	CONTEXT *Context
 )
 {
+	RtlZeroMemory(Context->Filter, Context->NumFilterBlocks * FILTER_BLOCK_WORDS * sizeof(ULONG64));
+
 	for (auto entry = Context->ListEntry.Flink;
 		entry != &Context->ListEntry;
 		entry = entry->Flink)
 	{
-		auto candidate = (REGISTERED_IMAGE_ENTRY*)entry;
+		auto record = (REGISTERED_IMAGE_ENTRY*)entry;
 
-		if (0 == RtlCompareUnicodeString((UNICODE_STRING*)&candidate->ImageName, ImageName, TRUE))
+		if (record->Type == ENTRY_TYPE::EXACT)
 		{
-			return candidate;
+			FilterAdd(Context->Filter, Context->NumFilterBlocks, record->ImageName->Hash);
 		}
 	}
+}
 
-	return NULL;
+LIST_ENTRY*
+AllocateBuckets
+(
+	SIZE_T NumBuckets,
+	ST_PAGEABLE Pageable
+)
+{
+	const auto poolType = (Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+
+	auto buckets = (LIST_ENTRY*)
+		ExAllocatePoolUninitialized(poolType, NumBuckets * sizeof(LIST_ENTRY), ST_POOL_TAG);
+
+	if (buckets == NULL)
+	{
+		return NULL;
+	}
+
+	for (SIZE_T i = 0; i < NumBuckets; ++i)
+	{
+		InitializeListHead(&buckets[i]);
+	}
+
+	return buckets;
+}
+
+LIST_ENTRY*
+GetBucket
+(
+	CONTEXT *Context,
+	const imagename::IMAGE_NAME *ImageName
+)
+{
+	return &Context->Buckets[ImageName->Hash & (Context->NumBuckets - 1)];
+}
+
+//
+// ReserveEntry()
+//
+// Make sure there is room for one additional entry without exceeding
+// a load factor of one.
+//
+NTSTATUS
+ReserveEntry
+(
+	CONTEXT *Context
+)
+{
+	if (Context->NumEntries < Context->NumBuckets)
+	{
+		return STATUS_SUCCESS;
+	}
+
+	const auto newNumBuckets = Context->NumBuckets * 2;
+
+	auto newBuckets = AllocateBuckets(newNumBuckets, Context->Pageable);
+
+	if (newBuckets == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	const auto newNumFilterBlocks = NumFilterBlocksForBuckets(newNumBuckets);
+
+	auto newFilter = Context->Filter;
+
+	if (newNumFilterBlocks != Context->NumFilterBlocks)
+	{
+		newFilter = AllocateFilter(newNumFilterBlocks, Context->Pageable);
+
+		if (newFilter == NULL)
+		{
+			ExFreePoolWithTag(newBuckets, ST_POOL_TAG);
+
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+	}
+
+	for (auto entry = Context->ListEntry.Flink;
+		entry != &Context->ListEntry;
+		entry = entry->Flink)
+	{
+		auto record = (REGISTERED_IMAGE_ENTRY*)entry;
+
+		if (record->Type != ENTRY_TYPE::EXACT)
+		{
+			continue;
+		}
+
+		InsertTailList(&newBuckets[record->ImageName->Hash & (newNumBuckets - 1)], &record->BucketLink);
+	}
+
+	ExFreePoolWithTag(Context->Buckets, ST_POOL_TAG);
+
+	Context->Buckets = newBuckets;
+	Context->NumBuckets = newNumBuckets;
+
+	if (newFilter != Context->Filter)
+	{
+		ExFreePoolWithTag(Context->Filter, ST_POOL_TAG);
+
+		Context->Filter = newFilter;
+		Context->NumFilterBlocks = newNumFilterBlocks;
+
+		RebuildFilter(Context);
+	}
+
+	return STATUS_SUCCESS;
 }
 
 //
 // FindEntryExact()
 //
 // Use at DISPATCH.
-// Implements case-sensitive comparison.
+// Interned names are equal if and only if the pointers are equal.
 //
 REGISTERED_IMAGE_ENTRY*
 FindEntryExact
 (
 	CONTEXT *Context,
-	LOWER_UNICODE_STRING *ImageName
+	const imagename::IMAGE_NAME *ImageName
+)
+{
+	if (!FilterMayContain(Context, ImageName->Hash))
+	{
+		return NULL;
+	}
+
+	auto bucket = GetBucket(Context, ImageName);
+
+	for (auto entry = bucket->Flink;
+		entry != bucket;
+		entry = entry->Flink)
+	{
+		auto candidate = CONTAINING_RECORD(entry, REGISTERED_IMAGE_ENTRY, BucketLink);
+
+		if (candidate->ImageName == ImageName)
+		{
+			return candidate;
+		}
+	}
+
+	return NULL;
+}
+
+//
+// FindEntry()
+//
+// Use at DISPATCH.
+// Implements case-insensitive comparison by resolving `ImageName` to an interned name.
+//
+// The filter is keyed on the same hash as the table of interned names, so most names that
+// are not configured are rejected before the table, and its lock, is touched.
+//
+REGISTERED_IMAGE_ENTRY*
+FindEntry
+(
+	CONTEXT *Context,
+	UNICODE_STRING *ImageName
+)
+{
+	const auto hash = imagename::HashAnyCase(Context->ImageNames, ImageName);
+
+	if (!FilterMayContain(Context, hash))
+	{
+		return NULL;
+	}
+
+	auto imageName = imagename::FindAnyCaseHashed(Context->ImageNames, ImageName, hash);
+
+	if (imageName == NULL)
+	{
+		//
+		// The name isn't interned, so no entry refers to it.
+		//
+
+		return NULL;
+	}
+
+	auto record = FindEntryExact(Context, imageName);
+
+	imagename::Release(imageName);
+
+	return record;
+}
+
+REGISTERED_IMAGE_ENTRY*
+AllocateEntry
+(
+	CONTEXT *Context,
+	imagename::IMAGE_NAME *ImageName,
+	ENTRY_TYPE Type
 )
 {
+	REGISTERED_IMAGE_ENTRY *record;
+
+	if (FALSE == IsListEmpty(&Context->FreeEntries))
+	{
+		record = (REGISTERED_IMAGE_ENTRY*)RemoveHeadList(&Context->FreeEntries);
+	}
+	else
+	{
+		record = (REGISTERED_IMAGE_ENTRY*)arena::Allocate(Context->Storage, sizeof(REGISTERED_IMAGE_ENTRY));
+
+		if (record == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	InitializeListHead(&record->ListEntry);
+	InitializeListHead(&record->BucketLink);
+
+	record->ImageName = ImageName;
+	record->Type = Type;
+
+	return record;
+}
+
+//
+// FindEntryOfType()
+//
+// Use at DISPATCH.
+// Exact entries are hashed, other entries are found by searching the list.
+//
+REGISTERED_IMAGE_ENTRY*
+FindEntryOfType
+(
+	CONTEXT *Context,
+	const imagename::IMAGE_NAME *ImageName,
+	ENTRY_TYPE Type
+)
+{
+	if (Type == ENTRY_TYPE::EXACT)
+	{
+		return FindEntryExact(Context, ImageName);
+	}
+
 	for (auto entry = Context->ListEntry.Flink;
 		entry != &Context->ListEntry;
 		entry = entry->Flink)
 	{
 		auto candidate = (REGISTERED_IMAGE_ENTRY*)entry;
 
-		if (util::Equal(ImageName, &candidate->ImageName))
+		if (candidate->Type == Type && candidate->ImageName == ImageName)
 		{
 			return candidate;
 		}
@@ -72,49 +453,116 @@ FindEntryExact
 	return NULL;
 }
 
+//
+// AddEntryOfType()
+//
+// Creates a new entry that holds an additional reference on `ImageName`.
+// Duplicates are not stored.
+//
+// Pattern entries are not matched until CompilePatterns() is called.
+//
 NTSTATUS
-AddEntryInner
+AddEntryOfType
 (
 	CONTEXT *Context,
-	LOWER_UNICODE_STRING *ImageName
+	imagename::IMAGE_NAME *ImageName,
+	ENTRY_TYPE Type
 )
 {
-	//
-	// Make a single allocation for the struct and string buffer.
-	//
+	auto status = STATUS_SUCCESS;
 
-	auto offsetStringBuffer = util::RoundToMultiple(sizeof(REGISTERED_IMAGE_ENTRY), 8);
+	switch (Type)
+	{
+		case ENTRY_TYPE::EXACT:
+		{
+			if (NULL != FindEntryExact(Context, ImageName))
+			{
+				return STATUS_SUCCESS;
+			}
 
-	auto allocationSize = offsetStringBuffer + ImageName->Length;
+			status = ReserveEntry(Context);
 
-	const auto poolType = (Context->Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+			if (!NT_SUCCESS(status))
+			{
+				return status;
+			}
 
-    auto record = (REGISTERED_IMAGE_ENTRY*)
-		ExAllocatePoolUninitialized(poolType, allocationSize, ST_POOL_TAG);
+			break;
+		}
+		case ENTRY_TYPE::PATTERN:
+		{
+			if (NULL != FindEntryOfType(Context, ImageName, Type))
+			{
+				return STATUS_SUCCESS;
+			}
+
+			break;
+		}
+		case ENTRY_TYPE::PREFIX:
+		{
+			//
+			// Duplicates are detected when the prefix is inserted into the trie, below.
+			//
+
+			break;
+		}
+	}
+
+	auto record = AllocateEntry(Context, ImageName, Type);
 
-    if (record == NULL)
-    {
+	if (record == NULL)
+	{
 		return STATUS_INSUFFICIENT_RESOURCES;
-    }
+	}
 
-    auto stringBuffer = (WCHAR*)(((CHAR*)record) + offsetStringBuffer);
+	if (Type == ENTRY_TYPE::PREFIX)
+	{
+		status = pathtrie::Insert(Context->Prefixes, &ImageName->String);
 
-    InitializeListHead(&record->ListEntry);
+		if (!NT_SUCCESS(status))
+		{
+			InsertTailList(&Context->FreeEntries, &record->ListEntry);
 
-	record->ImageName.Length = ImageName->Length;
-	record->ImageName.MaximumLength = ImageName->Length;
-	record->ImageName.Buffer = stringBuffer;
+			//
+			// The trie detects duplicates for us.
+			//
+
+			return (status == STATUS_DUPLICATE_OBJECTID) ? STATUS_SUCCESS : status;
+		}
+	}
 
-    RtlCopyMemory(stringBuffer, ImageName->Buffer, ImageName->Length);
+	imagename::AddRef(ImageName);
 
 	InsertTailList(&Context->ListEntry, &record->ListEntry);
 
+	if (Type == ENTRY_TYPE::EXACT)
+	{
+		InsertTailList(GetBucket(Context, ImageName), &record->BucketLink);
+
+		FilterAdd(Context->Filter, Context->NumFilterBlocks, ImageName->Hash);
+
+		++Context->NumEntries;
+	}
+
 	return STATUS_SUCCESS;
 }
 
+void
+FreeEntry
+(
+	CONTEXT *Context,
+	REGISTERED_IMAGE_ENTRY *Entry
+)
+{
+	imagename::Release(Entry->ImageName);
+
+	InsertTailList(&Context->FreeEntries, &Entry->ListEntry);
+}
+
 bool
 RemoveEntryInner
 (
+	CONTEXT *Context,
 	REGISTERED_IMAGE_ENTRY *Entry
 )
 {
@@ -124,8 +572,13 @@ RemoveEntryInner
 	}
 
 	RemoveEntryList(&Entry->ListEntry);
+	RemoveEntryList(&Entry->BucketLink);
+
+	--Context->NumEntries;
 
-	ExFreePoolWithTag(Entry, ST_POOL_TAG);
+	FreeEntry(Context, Entry);
+
+	RebuildFilter(Context);
 
 	return true;
 }
@@ -136,6 +589,7 @@ NTSTATUS
 Initialize
 (
 	CONTEXT **Context,
+	imagename::CONTEXT *ImageNames,
 	ST_PAGEABLE Pageable
 )
 {
@@ -148,7 +602,65 @@ Initialize
 		return STATUS_INSUFFICIENT_RESOURCES;
 	}
 
+	(*Context)->Buckets = AllocateBuckets(INITIAL_NUM_BUCKETS, Pageable);
+
+	if ((*Context)->Buckets == NULL)
+	{
+		ExFreePoolWithTag(*Context, ST_POOL_TAG);
+
+		*Context = NULL;
+
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	(*Context)->NumFilterBlocks = NumFilterBlocksForBuckets(INITIAL_NUM_BUCKETS);
+	(*Context)->Filter = AllocateFilter((*Context)->NumFilterBlocks, Pageable);
+
+	if ((*Context)->Filter == NULL)
+	{
+		ExFreePoolWithTag((*Context)->Buckets, ST_POOL_TAG);
+		ExFreePoolWithTag(*Context, ST_POOL_TAG);
+
+		*Context = NULL;
+
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	auto status = pathtrie::Initialize(&(*Context)->Prefixes, Pageable);
+
+	if (!NT_SUCCESS(status))
+	{
+		ExFreePoolWithTag((*Context)->Filter, ST_POOL_TAG);
+		ExFreePoolWithTag((*Context)->Buckets, ST_POOL_TAG);
+		ExFreePoolWithTag(*Context, ST_POOL_TAG);
+
+		*Context = NULL;
+
+		return status;
+	}
+
+	status = arena::Initialize(&(*Context)->Storage, Pageable);
+
+	if (!NT_SUCCESS(status))
+	{
+		pathtrie::TearDown(&(*Context)->Prefixes);
+
+		ExFreePoolWithTag((*Context)->Filter, ST_POOL_TAG);
+		ExFreePoolWithTag((*Context)->Buckets, ST_POOL_TAG);
+		ExFreePoolWithTag(*Context, ST_POOL_TAG);
+
+		*Context = NULL;
+
+		return status;
+	}
+
+	(*Context)->Patterns = NULL;
+	(*Context)->NumBuckets = INITIAL_NUM_BUCKETS;
+	(*Context)->NumEntries = 0;
+
 	InitializeListHead(&(*Context)->ListEntry);
+	InitializeListHead(&(*Context)->FreeEntries);
+	(*Context)->ImageNames = ImageNames;
 	(*Context)->Pageable = Pageable;
 
 	return STATUS_SUCCESS;
@@ -164,49 +676,219 @@ AddEntry
 {
 	NT_ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
 
-	//
-	// Avoid storing duplicates.
-	// FindEntry doesn't care about character casing.
-	//
+	imagename::IMAGE_NAME *imageName;
+
+	auto status = imagename::InternDowncase(Context->ImageNames, ImageName, &imageName);
 
-	if (NULL != FindEntry(Context, ImageName))
+	if (!NT_SUCCESS(status))
 	{
-		return STATUS_SUCCESS;
+		return status;
 	}
 
 	//
-	// Make a lower case string copy.
+	// The interned name is lower case so duplicates are detected
+	// without regard to character casing.
 	//
 
-	UNICODE_STRING lowerImageName;
+	status = AddEntryOfType(Context, imageName, ENTRY_TYPE::EXACT);
+
+	imagename::Release(imageName);
+
+	return status;
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+AddPrefixEntry
+(
+	CONTEXT *Context,
+	UNICODE_STRING *Prefix
+)
+{
+	NT_ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+	if (Prefix->Length == 0)
+	{
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	imagename::IMAGE_NAME *prefix;
 
-	auto status = RtlDowncaseUnicodeString(&lowerImageName, ImageName, TRUE);
+	auto status = imagename::InternDowncase(Context->ImageNames, Prefix, &prefix);
 
 	if (!NT_SUCCESS(status))
 	{
 		return status;
 	}
 
-	status = AddEntryInner(Context, (LOWER_UNICODE_STRING*)&lowerImageName);
+	status = AddEntryOfType(Context, prefix, ENTRY_TYPE::PREFIX);
 
-	RtlFreeUnicodeString(&lowerImageName);
+	imagename::Release(prefix);
 
 	return status;
 }
 
+_IRQL_requires_(PASSIVE_LEVEL)
 NTSTATUS
-AddEntryExact
+AddPatternEntry
 (
 	CONTEXT *Context,
-	LOWER_UNICODE_STRING *ImageName
+	UNICODE_STRING *Pattern
 )
 {
-	if (NULL != FindEntryExact(Context, ImageName))
+	NT_ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+	imagename::IMAGE_NAME *pattern;
+
+	auto status = imagename::InternDowncase(Context->ImageNames, Pattern, &pattern);
+
+	if (!NT_SUCCESS(status))
+	{
+		return status;
+	}
+
+	status = AddEntryOfType(Context, pattern, ENTRY_TYPE::PATTERN);
+
+	imagename::Release(pattern);
+
+	return status;
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+CompilePatterns
+(
+	CONTEXT *Context
+)
+{
+	NT_ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+	if (Context->Patterns != NULL)
+	{
+		globdfa::TearDown(&Context->Patterns);
+	}
+
+	SIZE_T numPatterns = 0;
+
+	for (auto entry = Context->ListEntry.Flink;
+		entry != &Context->ListEntry;
+		entry = entry->Flink)
+	{
+		if (((REGISTERED_IMAGE_ENTRY*)entry)->Type == ENTRY_TYPE::PATTERN)
+		{
+			++numPatterns;
+		}
+	}
+
+	if (numPatterns == 0)
 	{
 		return STATUS_SUCCESS;
 	}
 
-	return AddEntryInner(Context, ImageName);
+	auto patterns = (const LOWER_UNICODE_STRING**)
+		ExAllocatePoolUninitialized(PagedPool, numPatterns * sizeof(LOWER_UNICODE_STRING*), ST_POOL_TAG);
+
+	if (patterns == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	SIZE_T index = 0;
+
+	for (auto entry = Context->ListEntry.Flink;
+		entry != &Context->ListEntry;
+		entry = entry->Flink)
+	{
+		auto record = (REGISTERED_IMAGE_ENTRY*)entry;
+
+		if (record->Type == ENTRY_TYPE::PATTERN)
+		{
+			patterns[index++] = &record->ImageName->String;
+		}
+	}
+
+	auto status = globdfa::Compile(patterns, numPatterns, Context->Pageable, &Context->Patterns);
+
+	ExFreePoolWithTag(patterns, ST_POOL_TAG);
+
+	return status;
+}
+
+NTSTATUS
+AddEntryExact
+(
+	CONTEXT *Context,
+	imagename::IMAGE_NAME *ImageName
+)
+{
+	return AddEntryOfType(Context, ImageName, ENTRY_TYPE::EXACT);
+}
+
+NTSTATUS
+Clone
+(
+	CONTEXT *Context,
+	CONTEXT *Exclude,
+	CONTEXT **Clone
+)
+{
+	CONTEXT *clone;
+
+	auto status = Initialize(&clone, Context->ImageNames, Context->Pageable);
+
+	if (!NT_SUCCESS(status))
+	{
+		return status;
+	}
+
+	for (auto entry = Context->ListEntry.Flink;
+		entry != &Context->ListEntry;
+		entry = entry->Flink)
+	{
+		auto record = (REGISTERED_IMAGE_ENTRY*)entry;
+
+		if (Exclude != NULL && NULL != FindEntryOfType(Exclude, record->ImageName, record->Type))
+		{
+			continue;
+		}
+
+		status = AddEntryOfType(clone, record->ImageName, record->Type);
+
+		if (!NT_SUCCESS(status))
+		{
+			TearDown(&clone);
+
+			return status;
+		}
+	}
+
+	*Clone = clone;
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS
+Merge
+(
+	CONTEXT *Context,
+	CONTEXT *Other
+)
+{
+	for (auto entry = Other->ListEntry.Flink;
+		entry != &Other->ListEntry;
+		entry = entry->Flink)
+	{
+		auto record = (REGISTERED_IMAGE_ENTRY*)entry;
+
+		auto status = AddEntryOfType(Context, record->ImageName, record->Type);
+
+		if (!NT_SUCCESS(status))
+		{
+			return status;
+		}
+	}
+
+	return STATUS_SUCCESS;
 }
 
 bool
@@ -225,7 +907,7 @@ bool
 HasEntryExact
 (
 	CONTEXT *Context,
-	LOWER_UNICODE_STRING *ImageName
+	const imagename::IMAGE_NAME *ImageName
 )
 {
 	auto record = FindEntryExact(Context, ImageName);
@@ -233,6 +915,28 @@ HasEntryExact
 	return record != NULL;
 }
 
+bool
+HasMatchingEntry
+(
+	CONTEXT *Context,
+	const imagename::IMAGE_NAME *ImageName
+)
+{
+	if (NULL != FindEntryExact(Context, ImageName))
+	{
+		return true;
+	}
+
+	if (!pathtrie::IsEmpty(Context->Prefixes)
+		&& pathtrie::HasPrefixOf(Context->Prefixes, &ImageName->String))
+	{
+		return true;
+	}
+
+	return Context->Patterns != NULL
+		&& globdfa::Match(Context->Patterns, &ImageName->String);
+}
+
 bool
 RemoveEntry
 (
@@ -240,17 +944,17 @@ RemoveEntry
 	UNICODE_STRING *ImageName
 )
 {
-	return RemoveEntryInner(FindEntry(Context, ImageName));
+	return RemoveEntryInner(Context, FindEntry(Context, ImageName));
 }
 
 bool
 RemoveEntryExact
 (
 	CONTEXT *Context,
-	LOWER_UNICODE_STRING *ImageName
+	const imagename::IMAGE_NAME *ImageName
 )
 {
-	return RemoveEntryInner(FindEntryExact(Context, ImageName));
+	return RemoveEntryInner(Context, FindEntryExact(Context, ImageName));
 }
 
 bool
@@ -267,7 +971,54 @@ ForEach
 	{
 		auto typedEntry = (REGISTERED_IMAGE_ENTRY *)entry;
 
-		if (!Callback(&typedEntry->ImageName, ClientContext))
+		if (!Callback(&typedEntry->ImageName->String, typedEntry->Type, ClientContext))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool
+ForEachExact
+(
+	CONTEXT *Context,
+	ST_RI_FOREACH_EXACT Callback,
+	void *ClientContext
+)
+{
+	for (auto entry = Context->ListEntry.Flink;
+		entry != &Context->ListEntry;
+		entry = entry->Flink)
+	{
+		auto typedEntry = (REGISTERED_IMAGE_ENTRY *)entry;
+
+		if (typedEntry->Type != ENTRY_TYPE::EXACT)
+		{
+			continue;
+		}
+
+		if (!Callback(typedEntry->ImageName, ClientContext))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool
+HasOnlyExactEntries
+(
+	CONTEXT *Context
+)
+{
+	for (auto entry = Context->ListEntry.Flink;
+		entry != &Context->ListEntry;
+		entry = entry->Flink)
+	{
+		if (((REGISTERED_IMAGE_ENTRY *)entry)->Type != ENTRY_TYPE::EXACT)
 		{
 			return false;
 		}
@@ -282,11 +1033,37 @@ Reset
 	CONTEXT *Context
 )
 {
-	while (FALSE == IsListEmpty(&Context->ListEntry))
+	//
+	// Entries hold a reference on their image name, so entries are visited once.
+	// The entries themselves are released along with the arena.
+	//
+
+	for (auto entry = Context->ListEntry.Flink;
+		entry != &Context->ListEntry;
+		entry = entry->Flink)
 	{
-		auto entry = RemoveHeadList(&Context->ListEntry);
+		imagename::Release(((REGISTERED_IMAGE_ENTRY*)entry)->ImageName);
+	}
 
-		ExFreePoolWithTag(entry, ST_POOL_TAG);
+	InitializeListHead(&Context->ListEntry);
+	InitializeListHead(&Context->FreeEntries);
+
+	arena::Reset(Context->Storage);
+
+	for (SIZE_T i = 0; i < Context->NumBuckets; ++i)
+	{
+		InitializeListHead(&Context->Buckets[i]);
+	}
+
+	Context->NumEntries = 0;
+
+	RtlZeroMemory(Context->Filter, Context->NumFilterBlocks * FILTER_BLOCK_WORDS * sizeof(ULONG64));
+
+	pathtrie::Reset(Context->Prefixes);
+
+	if (Context->Patterns != NULL)
+	{
+		globdfa::TearDown(&Context->Patterns);
 	}
 }
 
@@ -298,6 +1075,12 @@ TearDown
 {
 	Reset(*Context);
 
+	pathtrie::TearDown(&(*Context)->Prefixes);
+
+	arena::TearDown(&(*Context)->Storage);
+
+	ExFreePoolWithTag((*Context)->Filter, ST_POOL_TAG);
+	ExFreePoolWithTag((*Context)->Buckets, ST_POOL_TAG);
 	ExFreePoolWithTag(*Context, ST_POOL_TAG);
 
 	*Context = NULL;
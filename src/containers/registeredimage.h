@@ -2,16 +2,38 @@
 
 #include <wdm.h>
 #include "../defs/types.h"
+#include "imagename.h"
 
 namespace registeredimage
 {
 
+enum class ENTRY_TYPE
+{
+	// Matches only the exact image.
+	EXACT,
+
+	// Matches every image whose path starts with the entry.
+	PREFIX,
+
+	// Matches every image whose path is matched by the glob pattern in the entry.
+	PATTERN
+};
+
 struct REGISTERED_IMAGE_ENTRY
 {
 	LIST_ENTRY ListEntry;
 
-	// Device path using all lower-case characters.
-	LOWER_UNICODE_STRING ImageName;
+	// Link in the hash bucket.
+	LIST_ENTRY BucketLink;
+
+	// Interned device path using all lower-case characters.
+	imagename::IMAGE_NAME *ImageName;
+
+	//
+	// Only exact entries are hashed, and found by the functions
+	// that look up or remove entries by name.
+	//
+	ENTRY_TYPE Type;
 };
 
 struct CONTEXT;
@@ -20,6 +42,7 @@ NTSTATUS
 Initialize
 (
 	CONTEXT **Context,
+	imagename::CONTEXT *ImageNames,
 	ST_PAGEABLE Pageable
 );
 
@@ -38,26 +61,109 @@ AddEntry
 	UNICODE_STRING *ImageName
 );
 
+//
+// AddPrefixEntry()
+//
+// IRQL == PASSIVE_LEVEL
+//
+// Converts prefix to lower case before creating a prefix entry.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+AddPrefixEntry
+(
+	CONTEXT *Context,
+	UNICODE_STRING *Prefix
+);
+
+//
+// AddPatternEntry()
+//
+// IRQL == PASSIVE_LEVEL
+//
+// Converts pattern to lower case before creating a pattern entry.
+// See globdfa.h for the pattern syntax.
+//
+// Pattern entries are not matched until CompilePatterns() is called.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+AddPatternEntry
+(
+	CONTEXT *Context,
+	UNICODE_STRING *Pattern
+);
+
+//
+// CompilePatterns()
+//
+// IRQL == PASSIVE_LEVEL
+//
+// Compiles all pattern entries into a single automaton used by HasMatchingEntry().
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+CompilePatterns
+(
+	CONTEXT *Context
+);
+
 //
 // AddEntryExact()
 //
 // IRQL <= DISPATCH
 //
-// Creates a new entry with the `ImageName` argument exactly as passed.
+// Creates a new entry that holds an additional reference on `ImageName`.
 //
 NTSTATUS
 AddEntryExact
 (
 	CONTEXT *Context,
-	LOWER_UNICODE_STRING *ImageName
+	imagename::IMAGE_NAME *ImageName
+);
+
+//
+// Clone()
+//
+// IRQL <= DISPATCH, unless the instance is pageable.
+//
+// Creates a new instance with the same entries, skipping any entries that are also
+// present in `Exclude`, if provided.
+//
+// Pattern entries are not matched until CompilePatterns() is called on the new instance.
+//
+NTSTATUS
+Clone
+(
+	CONTEXT *Context,
+	CONTEXT *Exclude,
+	CONTEXT **Clone
+);
+
+//
+// Merge()
+//
+// IRQL <= DISPATCH, unless the instance is pageable.
+//
+// Adds all entries in `Other` that are not already present.
+// The instance may be partially updated on failure.
+//
+// Pattern entries are not matched until CompilePatterns() is called.
+//
+NTSTATUS
+Merge
+(
+	CONTEXT *Context,
+	CONTEXT *Other
 );
 
 //
 // HasEntry()
 //
-// IRQL <= APC
+// IRQL <= DISPATCH
 //
 // Compares existing entries against `ImageName` without regard to character casing.
+// No lower case copy of `ImageName` is made.
 //
 bool
 HasEntry
@@ -71,19 +177,35 @@ HasEntry
 //
 // IRQL <= DISPATCH
 //
-// Compares existing entries against case-sensitive `ImageName` argument.
+// Compares existing entries against interned `ImageName` argument.
+// This is a pointer comparison.
 //
 bool
 HasEntryExact
 (
 	CONTEXT *Context,
-	LOWER_UNICODE_STRING *ImageName
+	const imagename::IMAGE_NAME *ImageName
+);
+
+//
+// HasMatchingEntry()
+//
+// IRQL <= DISPATCH
+//
+// Determines whether `ImageName` is matched by an exact entry, a prefix entry or a pattern entry.
+// This runs in time linear in the length of `ImageName`, regardless of the number of entries.
+//
+bool
+HasMatchingEntry
+(
+	CONTEXT *Context,
+	const imagename::IMAGE_NAME *ImageName
 );
 
 //
 // RemoveEntry()
 //
-// IRQL <= APC
+// IRQL <= DISPATCH
 //
 // Searches for and removes entry matching `ImageName` without regard to character casing.
 //
@@ -99,17 +221,22 @@ RemoveEntry
 //
 // IRQL <= DISPATCH
 //
-// Searches for and removes entry using case-sensitive matching of `ImageName`.
+// Searches for and removes entry matching interned `ImageName`.
 //
 bool
 RemoveEntryExact
 (
 	CONTEXT *Context,
-	LOWER_UNICODE_STRING *ImageName
+	const imagename::IMAGE_NAME *ImageName
 );
 
-typedef bool (NTAPI *ST_RI_FOREACH)(const LOWER_UNICODE_STRING *ImageName, void *Context);
+typedef bool (NTAPI *ST_RI_FOREACH)(const LOWER_UNICODE_STRING *ImageName, ENTRY_TYPE Type, void *Context);
 
+//
+// ForEach()
+//
+// Enumerates entries of all types in the order they were added.
+//
 bool
 ForEach
 (
@@ -118,6 +245,32 @@ ForEach
 	void *ClientContext
 );
 
+typedef bool (NTAPI *ST_RI_FOREACH_EXACT)(const imagename::IMAGE_NAME *ImageName, void *Context);
+
+//
+// ForEachExact()
+//
+// Enumerates the interned image names of exact entries.
+//
+bool
+ForEachExact
+(
+	CONTEXT *Context,
+	ST_RI_FOREACH_EXACT Callback,
+	void *ClientContext
+);
+
+//
+// HasOnlyExactEntries()
+//
+// Returns true if there are no prefix or pattern entries.
+//
+bool
+HasOnlyExactEntries
+(
+	CONTEXT *Context
+);
+
 void
 Reset
 (
@@ -0,0 +1,281 @@
+#include <wdm.h>
+#include "ring.h"
+#include "../util.h"
+#include "../defs/types.h"
+
+namespace ring
+{
+
+struct CONTEXT
+{
+	// Position of the next slot to be reserved.
+	volatile LONG64 ReservePosition;
+
+	// Keeps the producer and consumer positions on separate cache lines.
+	UCHAR Padding[SYSTEM_CACHE_ALIGNMENT_SIZE];
+
+	// Position of the next slot to be popped.
+	volatile LONG64 PopPosition;
+
+	SIZE_T SlotStride;
+
+	SIZE_T Mask;
+
+	UCHAR *Slots;
+	UCHAR *SlotsEnd;
+
+	// Start of the allocation that holds the slots.
+	void *SlotsAllocation;
+};
+
+namespace
+{
+
+//
+// Each slot is preceded by a sequence number, which determines who owns the slot.
+//
+// If the sequence equals the position a producer is reserving, the slot is free.
+// If it equals the position plus one, the slot has been published.
+// Releasing the slot makes it free for the position on the next lap around the ring.
+//
+struct SLOT_HEADER
+{
+	volatile LONG64 Sequence;
+};
+
+const SIZE_T SLOT_HEADER_SIZE = MEMORY_ALLOCATION_ALIGNMENT;
+
+static_assert(sizeof(SLOT_HEADER) <= SLOT_HEADER_SIZE, "Slot header does not fit");
+
+SLOT_HEADER*
+HeaderAt
+(
+	CONTEXT *Context,
+	LONG64 Position
+)
+{
+	return (SLOT_HEADER*)(Context->Slots + ((Position & Context->Mask) * Context->SlotStride));
+}
+
+SLOT_HEADER*
+HeaderFromSlot
+(
+	void *Slot
+)
+{
+	return (SLOT_HEADER*)((UCHAR*)Slot - SLOT_HEADER_SIZE);
+}
+
+void*
+SlotFromHeader
+(
+	SLOT_HEADER *Header
+)
+{
+	return (UCHAR*)Header + SLOT_HEADER_SIZE;
+}
+
+} // anonymous namespace
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context,
+	SIZE_T SlotSize,
+	SIZE_T NumSlots
+)
+{
+	*Context = NULL;
+
+	if (NumSlots == 0 || (NumSlots & (NumSlots - 1)) != 0)
+	{
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	auto context = (CONTEXT*)ExAllocatePoolUninitialized(NonPagedPool, sizeof(CONTEXT), ST_POOL_TAG);
+
+	if (context == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	//
+	// Slots are padded to a whole number of cache lines so producers working on
+	// adjacent slots don't interfere with each other.
+	//
+
+	context->SlotStride = util::RoundToMultiple(SLOT_HEADER_SIZE + SlotSize, SYSTEM_CACHE_ALIGNMENT_SIZE);
+	context->Mask = NumSlots - 1;
+
+	const auto allocationSize = (NumSlots * context->SlotStride) + SYSTEM_CACHE_ALIGNMENT_SIZE;
+
+	context->SlotsAllocation = ExAllocatePoolUninitialized(NonPagedPool, allocationSize, ST_POOL_TAG);
+
+	if (context->SlotsAllocation == NULL)
+	{
+		ExFreePoolWithTag(context, ST_POOL_TAG);
+
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	context->Slots = (UCHAR*)util::RoundToMultiple((SIZE_T)context->SlotsAllocation, SYSTEM_CACHE_ALIGNMENT_SIZE);
+	context->SlotsEnd = context->Slots + (NumSlots * context->SlotStride);
+
+	for (SIZE_T i = 0; i < NumSlots; ++i)
+	{
+		HeaderAt(context, i)->Sequence = i;
+	}
+
+	context->ReservePosition = 0;
+	context->PopPosition = 0;
+
+	*Context = context;
+
+	return STATUS_SUCCESS;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	auto context = *Context;
+
+	if (context == NULL)
+	{
+		return;
+	}
+
+	*Context = NULL;
+
+	ExFreePoolWithTag(context->SlotsAllocation, ST_POOL_TAG);
+	ExFreePoolWithTag(context, ST_POOL_TAG);
+}
+
+void*
+Reserve
+(
+	CONTEXT *Context
+)
+{
+	auto position = ReadNoFence64(&Context->ReservePosition);
+
+	for (;;)
+	{
+		auto header = HeaderAt(Context, position);
+
+		const auto difference = ReadAcquire64(&header->Sequence) - position;
+
+		if (difference == 0)
+		{
+			const auto observed = InterlockedCompareExchange64(&Context->ReservePosition, position + 1, position);
+
+			if (observed == position)
+			{
+				return SlotFromHeader(header);
+			}
+
+			position = observed;
+		}
+		else if (difference < 0)
+		{
+			//
+			// The slot has not been released since the previous lap.
+			//
+
+			return NULL;
+		}
+		else
+		{
+			//
+			// Another producer reserved the slot.
+			//
+
+			position = ReadNoFence64(&Context->ReservePosition);
+		}
+	}
+}
+
+void
+Publish
+(
+	CONTEXT *Context,
+	void *Slot
+)
+{
+	UNREFERENCED_PARAMETER(Context);
+
+	//
+	// The producer owns the slot, so the sequence equals the reserved position.
+	//
+
+	auto header = HeaderFromSlot(Slot);
+
+	WriteRelease64(&header->Sequence, header->Sequence + 1);
+}
+
+void*
+Pop
+(
+	CONTEXT *Context
+)
+{
+	const auto position = ReadNoFence64(&Context->PopPosition);
+
+	auto header = HeaderAt(Context, position);
+
+	if (ReadAcquire64(&header->Sequence) != position + 1)
+	{
+		return NULL;
+	}
+
+	WriteNoFence64(&Context->PopPosition, position + 1);
+
+	return SlotFromHeader(header);
+}
+
+void
+Release
+(
+	CONTEXT *Context,
+	void *Slot
+)
+{
+	//
+	// The consumer owns the slot, so the sequence equals the popped position plus one.
+	//
+	// Only this slot's sequence is updated, and no shared release position is kept, so slots
+	// can be released out of order. Clients rely on this, e.g. procmon frees records that
+	// are cancelled when coalescing a batch before it frees the rest of the batch.
+	//
+
+	auto header = HeaderFromSlot(Slot);
+
+	WriteRelease64(&header->Sequence, header->Sequence - 1 + (LONG64)(Context->Mask + 1));
+}
+
+bool
+Contains
+(
+	const CONTEXT *Context,
+	const void *Memory
+)
+{
+	return (const UCHAR*)Memory >= Context->Slots
+		&& (const UCHAR*)Memory < Context->SlotsEnd;
+}
+
+SIZE_T
+Depth
+(
+	CONTEXT *Context
+)
+{
+	const auto popped = ReadNoFence64(&Context->PopPosition);
+	const auto reserved = ReadNoFence64(&Context->ReservePosition);
+
+	return (reserved > popped) ? (SIZE_T)(reserved - popped) : 0;
+}
+
+} // namespace ring
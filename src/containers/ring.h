@@ -0,0 +1,141 @@
+#pragma once
+
+#include <wdm.h>
+
+//
+// Bounded multi-producer single-consumer ring of fixed-size slots.
+//
+// All memory is allocated up front, so neither producers nor the consumer reach the pool.
+// Producers never block. If the ring is full, Reserve() fails and the producer has to
+// fall back on some other means.
+//
+// Producers reserve a slot, fill it in and then publish it. The consumer receives slots in
+// the order they were reserved, and hands each slot back once it's done with it.
+// Slots can be released in any order, but a slot that has not been released blocks
+// producers from wrapping around the ring and past it.
+//
+// The backing memory is non-paged.
+// Reserve(), Publish() and Release() may be called concurrently from any number of threads.
+// Pop() may only be called by a single thread at a time.
+//
+
+namespace ring
+{
+
+struct CONTEXT;
+
+//
+// Initialize()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+// `NumSlots` has to be a power of two.
+// Slots are aligned on MEMORY_ALLOCATION_ALIGNMENT.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context,
+	SIZE_T SlotSize,
+	SIZE_T NumSlots
+);
+
+//
+// TearDown()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+void
+TearDown
+(
+	CONTEXT **Context
+);
+
+//
+// Reserve()
+//
+// IRQL <= DISPATCH.
+//
+// Returns NULL if the ring is full.
+//
+void*
+Reserve
+(
+	CONTEXT *Context
+);
+
+//
+// Publish()
+//
+// IRQL <= DISPATCH.
+//
+// Make a reserved slot available to the consumer.
+//
+void
+Publish
+(
+	CONTEXT *Context,
+	void *Slot
+);
+
+//
+// Pop()
+//
+// IRQL <= DISPATCH.
+//
+// Returns the next published slot, or NULL if there is none.
+//
+void*
+Pop
+(
+	CONTEXT *Context
+);
+
+//
+// Release()
+//
+// IRQL <= DISPATCH.
+//
+// Return a slot that was received from Pop().
+//
+// Slots need not be released in the order they were popped. Each slot tracks its own state,
+// so releasing a slot only makes that slot available to producers. A slot that is held
+// still stops producers from wrapping past it.
+//
+void
+Release
+(
+	CONTEXT *Context,
+	void *Slot
+);
+
+//
+// Contains()
+//
+// IRQL <= DISPATCH.
+//
+// Determine whether the memory is a slot in the ring.
+//
+bool
+Contains
+(
+	const CONTEXT *Context,
+	const void *Memory
+);
+
+//
+// Depth()
+//
+// IRQL <= DISPATCH.
+//
+// Number of slots reserved by producers and not yet popped by the consumer.
+//
+SIZE_T
+Depth
+(
+	CONTEXT *Context
+);
+
+} // namespace ring
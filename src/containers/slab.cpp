@@ -0,0 +1,254 @@
+#include <wdm.h>
+#include <wdf.h>
+#include "slab.h"
+#include "../util.h"
+#include "../defs/types.h"
+
+namespace slab
+{
+
+struct CONTEXT
+{
+	WDFSPINLOCK Lock;
+
+	SIZE_T ObjectSize;
+
+	SIZE_T ObjectsPerSlab;
+
+	// Free objects, linked through the first bytes of each object.
+	SINGLE_LIST_ENTRY FreeList;
+
+	// All slabs, linked through the slab header.
+	SINGLE_LIST_ENTRY Slabs;
+
+	STATISTICS Statistics;
+};
+
+namespace
+{
+
+//
+// Preferred size of a slab.
+// A slab always holds at least MIN_OBJECTS_PER_SLAB objects, even if that makes it larger.
+//
+const SIZE_T SLAB_SIZE = 4 * PAGE_SIZE;
+
+const SIZE_T MIN_OBJECTS_PER_SLAB = 8;
+
+//
+// The header precedes the objects in the slab.
+// It's padded so the first object is aligned.
+//
+const SIZE_T SLAB_HEADER_SIZE = MEMORY_ALLOCATION_ALIGNMENT;
+
+static_assert(sizeof(SINGLE_LIST_ENTRY) <= SLAB_HEADER_SIZE, "Slab header does not fit");
+
+void
+AccountAllocation
+(
+	CONTEXT *Context
+)
+{
+	++Context->Statistics.Allocations;
+	++Context->Statistics.InUse;
+
+	if (Context->Statistics.InUse > Context->Statistics.PeakInUse)
+	{
+		Context->Statistics.PeakInUse = Context->Statistics.InUse;
+	}
+}
+
+} // anonymous namespace
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context,
+	SIZE_T ObjectSize
+)
+{
+	*Context = NULL;
+
+	auto context = (CONTEXT*)ExAllocatePoolUninitialized(NonPagedPool, sizeof(CONTEXT), ST_POOL_TAG);
+
+	if (context == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	RtlZeroMemory(context, sizeof(*context));
+
+	auto status = WdfSpinLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &context->Lock);
+
+	if (!NT_SUCCESS(status))
+	{
+		ExFreePoolWithTag(context, ST_POOL_TAG);
+
+		return status;
+	}
+
+	if (ObjectSize < sizeof(SINGLE_LIST_ENTRY))
+	{
+		ObjectSize = sizeof(SINGLE_LIST_ENTRY);
+	}
+
+	context->ObjectSize = util::RoundToMultiple(ObjectSize, MEMORY_ALLOCATION_ALIGNMENT);
+
+	context->ObjectsPerSlab = (SLAB_SIZE - SLAB_HEADER_SIZE) / context->ObjectSize;
+
+	if (context->ObjectsPerSlab < MIN_OBJECTS_PER_SLAB)
+	{
+		context->ObjectsPerSlab = MIN_OBJECTS_PER_SLAB;
+	}
+
+	*Context = context;
+
+	return STATUS_SUCCESS;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	auto context = *Context;
+
+	if (context == NULL)
+	{
+		return;
+	}
+
+	*Context = NULL;
+
+	NT_ASSERT(context->Statistics.InUse == 0);
+
+	for (auto slab = PopEntryList(&context->Slabs); slab != NULL; slab = PopEntryList(&context->Slabs))
+	{
+		ExFreePoolWithTag(slab, ST_POOL_TAG);
+	}
+
+	WdfObjectDelete(context->Lock);
+
+	ExFreePoolWithTag(context, ST_POOL_TAG);
+}
+
+void*
+Allocate
+(
+	CONTEXT *Context
+)
+{
+	WdfSpinLockAcquire(Context->Lock);
+
+	auto object = PopEntryList(&Context->FreeList);
+
+	if (object != NULL)
+	{
+		AccountAllocation(Context);
+
+		WdfSpinLockRelease(Context->Lock);
+
+		return object;
+	}
+
+	WdfSpinLockRelease(Context->Lock);
+
+	//
+	// Allocate a new slab without holding the lock.
+	// The first object is returned to the caller and the rest are made available to everyone.
+	//
+
+	auto slab = (UCHAR*)ExAllocatePoolUninitialized(NonPagedPool,
+		SLAB_HEADER_SIZE + (Context->ObjectsPerSlab * Context->ObjectSize), ST_POOL_TAG);
+
+	if (slab == NULL)
+	{
+		return NULL;
+	}
+
+	auto objects = slab + SLAB_HEADER_SIZE;
+
+	WdfSpinLockAcquire(Context->Lock);
+
+	PushEntryList(&Context->Slabs, (SINGLE_LIST_ENTRY*)slab);
+
+	for (auto i = Context->ObjectsPerSlab - 1; i != 0; --i)
+	{
+		PushEntryList(&Context->FreeList, (SINGLE_LIST_ENTRY*)(objects + (i * Context->ObjectSize)));
+	}
+
+	++Context->Statistics.Slabs;
+
+	AccountAllocation(Context);
+
+	WdfSpinLockRelease(Context->Lock);
+
+	return objects;
+}
+
+void
+Free
+(
+	CONTEXT *Context,
+	void *Object
+)
+{
+	WdfSpinLockAcquire(Context->Lock);
+
+	PushEntryList(&Context->FreeList, (SINGLE_LIST_ENTRY*)Object);
+
+	++Context->Statistics.Frees;
+	--Context->Statistics.InUse;
+
+	WdfSpinLockRelease(Context->Lock);
+}
+
+void
+Reset
+(
+	CONTEXT *Context
+)
+{
+	WdfSpinLockAcquire(Context->Lock);
+
+	auto slabs = Context->Slabs;
+
+	Context->Slabs.Next = NULL;
+	Context->FreeList.Next = NULL;
+
+	Context->Statistics.Frees += Context->Statistics.InUse;
+	Context->Statistics.InUse = 0;
+
+	WdfSpinLockRelease(Context->Lock);
+
+	for (auto slab = PopEntryList(&slabs); slab != NULL; slab = PopEntryList(&slabs))
+	{
+		ExFreePoolWithTag(slab, ST_POOL_TAG);
+	}
+}
+
+SIZE_T
+ObjectSize
+(
+	const CONTEXT *Context
+)
+{
+	return Context->ObjectSize;
+}
+
+void
+GetStatistics
+(
+	CONTEXT *Context,
+	STATISTICS *Statistics
+)
+{
+	WdfSpinLockAcquire(Context->Lock);
+
+	*Statistics = Context->Statistics;
+
+	WdfSpinLockRelease(Context->Lock);
+}
+
+} // namespace slab
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <wdm.h>
+
+//
+// Cache of fixed-size objects.
+//
+// Objects are carved out of larger slabs that are allocated from the pool on demand.
+// Freed objects are kept on a free list and are handed out again by later allocations,
+// so a steady stream of allocations and frees doesn't reach the pool at all.
+//
+// Slabs are not returned to the pool until the cache is torn down. The memory held
+// by the cache is therefore bounded by the peak number of objects in use.
+//
+// The cache is always backed by non-paged memory.
+// All functions other than Initialize() and TearDown() may be called concurrently.
+//
+
+namespace slab
+{
+
+struct CONTEXT;
+
+struct STATISTICS
+{
+	// Number of successful allocations.
+	SIZE_T Allocations;
+
+	// Number of objects that were freed.
+	SIZE_T Frees;
+
+	// Number of objects currently allocated.
+	SIZE_T InUse;
+
+	// Highest number of objects allocated at any one time.
+	SIZE_T PeakInUse;
+
+	// Number of slabs allocated from the pool.
+	SIZE_T Slabs;
+};
+
+//
+// Initialize()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+// Objects are aligned on MEMORY_ALLOCATION_ALIGNMENT.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context,
+	SIZE_T ObjectSize
+);
+
+//
+// TearDown()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+// All objects must have been freed.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+void
+TearDown
+(
+	CONTEXT **Context
+);
+
+//
+// Reset()
+//
+// IRQL <= DISPATCH.
+//
+// Releases all objects at once, without having to free each object.
+// Objects allocated before the call must no longer be used.
+//
+void
+Reset
+(
+	CONTEXT *Context
+);
+
+//
+// Allocate()
+//
+// IRQL <= DISPATCH.
+//
+// Returns an uninitialized object, or NULL if a new slab is needed and can't be allocated.
+//
+void*
+Allocate
+(
+	CONTEXT *Context
+);
+
+//
+// Free()
+//
+// IRQL <= DISPATCH.
+//
+void
+Free
+(
+	CONTEXT *Context,
+	void *Object
+);
+
+SIZE_T
+ObjectSize
+(
+	const CONTEXT *Context
+);
+
+//
+// GetStatistics()
+//
+// IRQL <= DISPATCH.
+//
+void
+GetStatistics
+(
+	CONTEXT *Context,
+	STATISTICS *Statistics
+);
+
+} // namespace slab
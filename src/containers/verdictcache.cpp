@@ -0,0 +1,247 @@
+#include <wdm.h>
+#include "verdictcache.h"
+#include "../util.h"
+#include "../defs/types.h"
+
+namespace verdictcache
+{
+
+namespace
+{
+
+//
+// Number of entries in each processor's cache. Must be a power of two.
+//
+const SIZE_T NUM_ENTRIES = 64;
+
+struct ENTRY
+{
+	HANDLE ProcessId;
+
+	// Generation that was current when the entry was resolved.
+	LONG64 Generation;
+
+	LONG Value;
+
+	bool Present;
+};
+
+struct PROCESSOR_CACHE
+{
+	ULONG64 Hits;
+	ULONG64 Misses;
+
+	ENTRY Entries[NUM_ENTRIES];
+};
+
+//
+// Each processor's cache starts on a separate cache line.
+//
+const SIZE_T PROCESSOR_CACHE_STRIDE =
+	(sizeof(PROCESSOR_CACHE) + SYSTEM_CACHE_ALIGNMENT_SIZE - 1) & ~(SIZE_T(SYSTEM_CACHE_ALIGNMENT_SIZE) - 1);
+
+} // anonymous namespace
+
+struct CONTEXT
+{
+	//
+	// Entries with a different generation are stale.
+	// Starts at 1 so zeroed entries are never valid.
+	//
+	volatile LONG64 Generation;
+
+	ULONG NumProcessors;
+
+	// Aligned on a cache line.
+	UCHAR *Caches;
+
+	// Start of the allocation that holds the caches.
+	void *CachesAllocation;
+};
+
+namespace
+{
+
+SIZE_T
+EntryIndex
+(
+	HANDLE ProcessId
+)
+{
+	//
+	// PIDs are multiples of four.
+	//
+
+	return (((ULONG_PTR)ProcessId) >> 2) & (NUM_ENTRIES - 1);
+}
+
+PROCESSOR_CACHE*
+GetProcessorCache
+(
+	CONTEXT *Context,
+	ULONG Processor
+)
+{
+	return (PROCESSOR_CACHE*)(Context->Caches + (Processor * PROCESSOR_CACHE_STRIDE));
+}
+
+} // anonymous namespace
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context
+)
+{
+	*Context = NULL;
+
+	auto context = (CONTEXT*)ExAllocatePoolUninitialized(NonPagedPool, sizeof(CONTEXT), ST_POOL_TAG);
+
+	if (context == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	context->Generation = 1;
+	context->NumProcessors = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+	const auto allocationSize = (context->NumProcessors * PROCESSOR_CACHE_STRIDE) + SYSTEM_CACHE_ALIGNMENT_SIZE;
+
+	context->CachesAllocation = ExAllocatePoolUninitialized(NonPagedPool, allocationSize, ST_POOL_TAG);
+
+	if (context->CachesAllocation == NULL)
+	{
+		ExFreePoolWithTag(context, ST_POOL_TAG);
+
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	RtlZeroMemory(context->CachesAllocation, allocationSize);
+
+	context->Caches = (UCHAR*)util::RoundToMultiple((SIZE_T)context->CachesAllocation, SYSTEM_CACHE_ALIGNMENT_SIZE);
+
+	*Context = context;
+
+	return STATUS_SUCCESS;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	auto context = *Context;
+
+	if (context == NULL)
+	{
+		return;
+	}
+
+	*Context = NULL;
+
+	ExFreePoolWithTag(context->CachesAllocation, ST_POOL_TAG);
+	ExFreePoolWithTag(context, ST_POOL_TAG);
+}
+
+bool
+Lookup
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	ST_VC_RESOLVE Resolve,
+	void *ResolveContext,
+	LONG *Value
+)
+{
+	//
+	// Stay on the same processor for the duration of the lookup.
+	// This also ensures the processor's cache is not accessed concurrently.
+	//
+
+	KIRQL oldIrql;
+
+	KeRaiseIrql(DISPATCH_LEVEL, &oldIrql);
+
+	const auto processor = KeGetCurrentProcessorNumberEx(NULL);
+
+	if (processor >= Context->NumProcessors)
+	{
+		NT_ASSERT(FALSE);
+
+		const auto present = Resolve(ProcessId, Value, ResolveContext);
+
+		KeLowerIrql(oldIrql);
+
+		return present;
+	}
+
+	auto cache = GetProcessorCache(Context, processor);
+	auto entry = &cache->Entries[EntryIndex(ProcessId)];
+
+	//
+	// The generation has to be sampled before resolving.
+	// If the backing store is updated after this point, the generation is bumped as well,
+	// and the entry will not be used by later lookups.
+	//
+
+	const auto generation = ReadAcquire64(&Context->Generation);
+
+	if (entry->Generation == generation && entry->ProcessId == ProcessId)
+	{
+		++cache->Hits;
+	}
+	else
+	{
+		++cache->Misses;
+
+		LONG value = 0;
+
+		entry->Present = Resolve(ProcessId, &value, ResolveContext);
+		entry->ProcessId = ProcessId;
+		entry->Value = value;
+		entry->Generation = generation;
+	}
+
+	const auto present = entry->Present;
+
+	if (present)
+	{
+		*Value = entry->Value;
+	}
+
+	KeLowerIrql(oldIrql);
+
+	return present;
+}
+
+void
+Invalidate
+(
+	CONTEXT *Context
+)
+{
+	InterlockedIncrement64(&Context->Generation);
+}
+
+void
+GetStatistics
+(
+	CONTEXT *Context,
+	STATISTICS *Statistics
+)
+{
+	RtlZeroMemory(Statistics, sizeof(*Statistics));
+
+	for (ULONG processor = 0; processor < Context->NumProcessors; ++processor)
+	{
+		const auto cache = GetProcessorCache(Context, processor);
+
+		Statistics->Hits += ReadULong64NoFence(&cache->Hits);
+		Statistics->Misses += ReadULong64NoFence(&cache->Misses);
+	}
+
+	Statistics->Invalidations = ReadAcquire64(&Context->Generation) - 1;
+}
+
+} // namespace verdictcache
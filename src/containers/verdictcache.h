@@ -0,0 +1,113 @@
+#pragma once
+
+#include <wdm.h>
+
+//
+// Per-processor cache of lookups keyed on PID.
+//
+// Each processor has a small direct-mapped cache that is only ever accessed by that
+// processor, at DISPATCH. A hit does not write to any memory shared with other processors.
+//
+// Entries are tagged with the generation that was current when the entry was resolved.
+// Writers bump the global generation after updating the backing store, which invalidates
+// every cached entry on every processor at once.
+//
+// Absent mappings are cached as well.
+//
+// The cache is always backed by non-paged memory.
+//
+
+namespace verdictcache
+{
+
+struct CONTEXT;
+
+struct STATISTICS
+{
+	// Lookups that were answered by the cache.
+	ULONG64 Hits;
+
+	// Lookups that had to be resolved against the backing store.
+	ULONG64 Misses;
+
+	// Number of times the cache was invalidated.
+	ULONG64 Invalidations;
+};
+
+//
+// Resolves a lookup against the backing store.
+// Returns whether there is a mapping for the PID.
+//
+typedef bool (NTAPI *ST_VC_RESOLVE)(HANDLE ProcessId, LONG *Value, void *Context);
+
+//
+// Initialize()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context
+);
+
+//
+// TearDown()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+void
+TearDown
+(
+	CONTEXT **Context
+);
+
+//
+// Lookup()
+//
+// IRQL <= DISPATCH.
+//
+// `Resolve` is called at DISPATCH if the cache can't answer the lookup.
+// May execute concurrently with other lookups and with Invalidate().
+//
+bool
+Lookup
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	ST_VC_RESOLVE Resolve,
+	void *ResolveContext,
+	LONG *Value
+);
+
+//
+// Invalidate()
+//
+// IRQL <= DISPATCH.
+//
+// Call after any update to the backing store.
+// Lookups that start after this returns will not observe values cached before the update.
+//
+void
+Invalidate
+(
+	CONTEXT *Context
+);
+
+//
+// GetStatistics()
+//
+// IRQL <= DISPATCH.
+//
+// Counters are sampled without synchronization and may be slightly out of date.
+//
+void
+GetStatistics
+(
+	CONTEXT *Context,
+	STATISTICS *Statistics
+);
+
+} // namespace verdictcache
@@ -12,9 +12,33 @@ typedef struct tag_ST_CONFIGURATION_ENTRY
 
 	// Byte length for non-null terminated wide char string.
 	USHORT ImageNameLength;
+
+	// ST_CONFIGURATION_ENTRY_FLAG_*
+	// This occupies what was previously padding. It's only read by the driver when
+	// the configuration is sent with IOCTL_ST_SET_CONFIGURATION_EX, or as a delta.
+	// Bits that are not defined must then be zero.
+	USHORT Flags;
 }
 ST_CONFIGURATION_ENTRY;
 
+//
+// The image name is a directory prefix, typically ending with a path separator.
+// All images whose path starts with the prefix are matched.
+//
+#define ST_CONFIGURATION_ENTRY_FLAG_PREFIX 0x0001
+
+//
+// The image name is a glob pattern that is matched against the entire path.
+// `*` matches any run of characters within a path component, and `?` matches a single character
+// other than a path separator.
+//
+// Cannot be combined with ST_CONFIGURATION_ENTRY_FLAG_PREFIX.
+//
+#define ST_CONFIGURATION_ENTRY_FLAG_PATTERN 0x0002
+
+#define ST_CONFIGURATION_ENTRY_FLAGS_VALID \
+	(ST_CONFIGURATION_ENTRY_FLAG_PREFIX | ST_CONFIGURATION_ENTRY_FLAG_PATTERN)
+
 typedef struct tag_ST_CONFIGURATION_HEADER
 {
 	// Number of entries immediately following the header.
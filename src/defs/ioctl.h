@@ -53,3 +53,48 @@
 //
 #define IOCTL_ST_RESET \
 	CTL_CODE(ST_DEVICE_TYPE, 11, METHOD_NEITHER, FILE_ANY_ACCESS)
+
+//
+// IOCTL_ST_ADD_CONFIGURATION_ENTRIES:
+//
+// Add entries to the current configuration.
+// Input: Same format as IOCTL_ST_SET_CONFIGURATION_EX.
+//
+// Only processes affected by the added entries are re-evaluated.
+//
+#define IOCTL_ST_ADD_CONFIGURATION_ENTRIES \
+	CTL_CODE(ST_DEVICE_TYPE, 12, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// IOCTL_ST_REMOVE_CONFIGURATION_ENTRIES:
+//
+// Remove entries from the current configuration.
+// Input: Same format as IOCTL_ST_SET_CONFIGURATION_EX.
+//
+// Entries are matched on both the image name and the entry flags. Entries that are not
+// present in the configuration are ignored. Removing all entries has the same effect
+// as IOCTL_ST_CLEAR_CONFIGURATION.
+//
+#define IOCTL_ST_REMOVE_CONFIGURATION_ENTRIES \
+	CTL_CODE(ST_DEVICE_TYPE, 13, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// IOCTL_ST_GET_STATISTICS:
+//
+// Retrieve statistics on the handling of process events.
+// Output: ST_PROCESS_EVENT_STATISTICS.
+//
+#define IOCTL_ST_GET_STATISTICS \
+	CTL_CODE(ST_DEVICE_TYPE, 14, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// IOCTL_ST_SET_CONFIGURATION_EX:
+//
+// Same as IOCTL_ST_SET_CONFIGURATION, except that ST_CONFIGURATION_ENTRY::Flags is honored
+// and validated. Unused flags must be zero.
+//
+// IOCTL_ST_SET_CONFIGURATION treats the field as padding and ignores it,
+// so every entry is an exact image name.
+//
+#define IOCTL_ST_SET_CONFIGURATION_EX \
+	CTL_CODE(ST_DEVICE_TYPE, 15, METHOD_BUFFERED, FILE_ANY_ACCESS)
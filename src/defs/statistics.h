@@ -0,0 +1,81 @@
+#pragma once
+
+//
+// Structures related to querying driver statistics.
+//
+
+#define ST_LATENCY_HISTOGRAM_NUM_BUCKETS 24
+
+//
+// Latencies in microseconds, on a log scale.
+//
+// Bucket 0 counts samples below 2 microseconds.
+// Bucket N counts samples in the range [2^N, 2^(N+1)) microseconds.
+// The last bucket also counts all samples that exceed its range.
+//
+typedef struct tag_ST_LATENCY_HISTOGRAM
+{
+	ULONGLONG Buckets[ST_LATENCY_HISTOGRAM_NUM_BUCKETS];
+}
+ST_LATENCY_HISTOGRAM;
+
+typedef struct tag_ST_PROCESS_EVENT_STATISTICS
+{
+	// Time from the system notifying the driver until the event is picked up for processing.
+	ST_LATENCY_HISTOGRAM QueueLatency;
+
+	// Time from the event being picked up until the arriving process is in the process registry.
+	ST_LATENCY_HISTOGRAM RegistrationLatency;
+
+	// Highest number of events that were picked up from the ring at once.
+	ULONGLONG RingDepthHighWater;
+
+	// Highest number of events that were picked up from the overflow queue at once.
+	ULONGLONG OverflowDepthHighWater;
+
+	// Number of processes that arrived and departed before being picked up.
+	ULONGLONG NumCoalescedPairs;
+
+	// Number of events that did not fit in the ring.
+	ULONGLONG NumOverflowed;
+
+	// Number of events with an image name that had to be stored outside the ring.
+	ULONGLONG NumSpilled;
+
+	// Number of events that were lost.
+	ULONGLONG NumDropped;
+
+	// Number of processes whose split status was determined in the process notification.
+	ULONGLONG NumEarlyVerdicts;
+
+	// Number of classifications in the callouts that were answered by an early verdict.
+	ULONGLONG NumEarlyClassifications;
+
+	// Number of classifications in the callouts that were pended, because the split status
+	// of the process was not yet known.
+	ULONGLONG NumPendedClassifications;
+
+	// Split status lookups from the callouts that were answered by the verdict cache.
+	ULONGLONG NumVerdictCacheHits;
+
+	// Split status lookups from the callouts that had to consult the process registry.
+	ULONGLONG NumVerdictCacheMisses;
+
+	// Number of times the verdict cache was invalidated by an update to the process registry.
+	ULONGLONG NumVerdictCacheInvalidations;
+
+	// Number of process registry entries allocated from and returned to the entry cache.
+	ULONGLONG NumRegistryEntryAllocations;
+	ULONGLONG NumRegistryEntryFrees;
+
+	// Highest number of process registry entries allocated from the cache at any one time.
+	ULONGLONG PeakRegistryEntries;
+
+	// Number of events allocated from and returned to the event cache.
+	ULONGLONG NumEventAllocations;
+	ULONGLONG NumEventFrees;
+
+	// Highest number of events allocated from the cache at any one time.
+	ULONGLONG PeakEvents;
+}
+ST_PROCESS_EVENT_STATISTICS;
@@ -31,6 +31,9 @@ typedef struct tag_ST_DEVICE_CONTEXT
 	// Sublayer GUIDs provided by the client and used when registering filters.
 	ST_SUBLAYER_GUIDS SublayerGuids;
 
+	// Image names shared by the process registry, the configuration and the firewall.
+	imagename::CONTEXT *ImageNames;
+
 	PROCESS_REGISTRY_MGMT ProcessRegistry;
 
 	// Protected by state lock.
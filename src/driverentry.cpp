@@ -627,9 +627,13 @@ StEvtIoDeviceControlSerial
             // IOCTL_ST_REGISTER_IP_ADDRESSES
             // IOCTL_ST_GET_IP_ADDRESSES
             // IOCTL_ST_SET_CONFIGURATION
+            // IOCTL_ST_SET_CONFIGURATION_EX
+            // IOCTL_ST_ADD_CONFIGURATION_ENTRIES
+            // IOCTL_ST_REMOVE_CONFIGURATION_ENTRIES
             // IOCTL_ST_GET_CONFIGURATION
             // IOCTL_ST_CLEAR_CONFIGURATION
             // IOCTL_ST_QUERY_PROCESS
+            // IOCTL_ST_GET_STATISTICS
             //
 
             if (IoControlCode == IOCTL_ST_REGISTER_IP_ADDRESSES)
@@ -651,11 +655,13 @@ StEvtIoDeviceControlSerial
                 return;
             }
 
-            if (IoControlCode == IOCTL_ST_SET_CONFIGURATION)
+            if (IoControlCode == IOCTL_ST_SET_CONFIGURATION
+                || IoControlCode == IOCTL_ST_SET_CONFIGURATION_EX)
             {
                 registeredimage::CONTEXT *imageset;
 
-                auto status = ioctl::SetConfigurationPrepare(Request, &imageset);
+                auto status = ioctl::SetConfigurationPrepare(device, Request,
+                    (IoControlCode == IOCTL_ST_SET_CONFIGURATION_EX), &imageset);
 
                 if (!NT_SUCCESS(status))
                 {
@@ -674,6 +680,32 @@ StEvtIoDeviceControlSerial
                 return;
             }
 
+            if (IoControlCode == IOCTL_ST_ADD_CONFIGURATION_ENTRIES
+                || IoControlCode == IOCTL_ST_REMOVE_CONFIGURATION_ENTRIES)
+            {
+                ioctl::CONFIGURATION_DELTA delta;
+
+                auto status = (IoControlCode == IOCTL_ST_ADD_CONFIGURATION_ENTRIES)
+                    ? ioctl::AddConfigurationEntriesPrepare(device, Request, &delta)
+                    : ioctl::RemoveConfigurationEntriesPrepare(device, Request, &delta);
+
+                if (!NT_SUCCESS(status))
+                {
+                    WdfRequestComplete(Request, status);
+
+                    return;
+                }
+
+                //
+                // Potential state transition here.
+                //
+                status = ioctl::UpdateConfiguration(device, &delta);
+
+                WdfRequestComplete(Request, status);
+
+                return;
+            }
+
             if (IoControlCode == IOCTL_ST_GET_CONFIGURATION)
             {
                 ioctl::GetConfigurationComplete(device, Request);
@@ -700,6 +732,13 @@ StEvtIoDeviceControlSerial
                 return;
             }
 
+            if (IoControlCode == IOCTL_ST_GET_STATISTICS)
+            {
+                ioctl::GetStatisticsComplete(device, Request);
+
+                return;
+            }
+
             break;
         }
         case ST_DRIVER_STATE_ZOMBIE:
@@ -0,0 +1,224 @@
+#include <wdm.h>
+#include "epoch.h"
+#include "util.h"
+#include "defs/types.h"
+
+namespace epoch
+{
+
+namespace
+{
+
+struct PROCESSOR_SLOT
+{
+	// Number of readers in each of the two most recent epochs, indexed on epoch parity.
+	volatile LONG Readers[2];
+};
+
+//
+// Each processor's slot is on a separate cache line.
+//
+const SIZE_T PROCESSOR_SLOT_STRIDE =
+	(sizeof(PROCESSOR_SLOT) + SYSTEM_CACHE_ALIGNMENT_SIZE - 1) & ~(SIZE_T(SYSTEM_CACHE_ALIGNMENT_SIZE) - 1);
+
+//
+// Number of times Synchronize() polls a counter before it starts sleeping between polls.
+//
+const ULONG SYNCHRONIZE_SPIN_LIMIT = 1000;
+
+//
+// Interval between polls once the spin limit is reached, in 100 ns units.
+//
+const LONGLONG SYNCHRONIZE_BACKOFF = 10 * 1000;
+
+} // anonymous namespace
+
+struct CONTEXT
+{
+	volatile LONG Epoch;
+
+	ULONG NumSlots;
+
+	// Aligned on a cache line.
+	UCHAR *Slots;
+
+	// Start of the allocation that holds the slots.
+	void *SlotsAllocation;
+};
+
+namespace
+{
+
+PROCESSOR_SLOT*
+GetSlot
+(
+	CONTEXT *Context,
+	ULONG Slot
+)
+{
+	return (PROCESSOR_SLOT*)(Context->Slots + (Slot * PROCESSOR_SLOT_STRIDE));
+}
+
+} // anonymous namespace
+
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context
+)
+{
+	*Context = NULL;
+
+	auto context = (CONTEXT*)ExAllocatePoolUninitialized(NonPagedPool, sizeof(CONTEXT), ST_POOL_TAG);
+
+	if (context == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	context->Epoch = 0;
+	context->NumSlots = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+	const auto allocationSize = (context->NumSlots * PROCESSOR_SLOT_STRIDE) + SYSTEM_CACHE_ALIGNMENT_SIZE;
+
+	context->SlotsAllocation = ExAllocatePoolUninitialized(NonPagedPool, allocationSize, ST_POOL_TAG);
+
+	if (context->SlotsAllocation == NULL)
+	{
+		ExFreePoolWithTag(context, ST_POOL_TAG);
+
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	RtlZeroMemory(context->SlotsAllocation, allocationSize);
+
+	context->Slots = (UCHAR*)util::RoundToMultiple((SIZE_T)context->SlotsAllocation, SYSTEM_CACHE_ALIGNMENT_SIZE);
+
+	*Context = context;
+
+	return STATUS_SUCCESS;
+}
+
+void
+TearDown
+(
+	CONTEXT **Context
+)
+{
+	auto context = *Context;
+
+	if (context == NULL)
+	{
+		return;
+	}
+
+	*Context = NULL;
+
+	ExFreePoolWithTag(context->SlotsAllocation, ST_POOL_TAG);
+	ExFreePoolWithTag(context, ST_POOL_TAG);
+}
+
+void
+Enter
+(
+	CONTEXT *Context,
+	READ_SECTION *Section
+)
+{
+	KeRaiseIrql(DISPATCH_LEVEL, &Section->OldIrql);
+
+	//
+	// Processors that are added at runtime share a slot with another processor.
+	// Counters are updated with interlocked operations so this is safe.
+	//
+
+	Section->Slot = KeGetCurrentProcessorNumberEx(NULL) % Context->NumSlots;
+
+	auto slot = GetSlot(Context, Section->Slot);
+
+	for (;;)
+	{
+		const auto epoch = ReadAcquire(&Context->Epoch);
+
+		InterlockedIncrement(&slot->Readers[epoch & 1]);
+
+		//
+		// If the epoch was advanced in the meantime, the writer may already have found
+		// the counter to be drained. Count the reader in the new epoch instead.
+		//
+
+		if (ReadNoFence(&Context->Epoch) == epoch)
+		{
+			Section->Epoch = epoch;
+
+			return;
+		}
+
+		InterlockedDecrement(&slot->Readers[epoch & 1]);
+	}
+}
+
+void
+Leave
+(
+	CONTEXT *Context,
+	READ_SECTION *Section
+)
+{
+	auto slot = GetSlot(Context, Section->Slot);
+
+	InterlockedDecrement(&slot->Readers[Section->Epoch & 1]);
+
+	KeLowerIrql(Section->OldIrql);
+}
+
+void
+Synchronize
+(
+	CONTEXT *Context
+)
+{
+	NT_ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+	//
+	// Readers that enter after this point are counted in the new epoch.
+	//
+
+	const auto previous = InterlockedIncrement(&Context->Epoch) - 1;
+
+	//
+	// The wait is bounded. Read sections execute at DISPATCH on other processors and can't be
+	// preempted, and no read section can enter the previous epoch after the increment above.
+	//
+	// Read sections are short, so the counters usually drain within a few polls. A reader may
+	// still be held up by interrupts on its processor, so after a while the writer sleeps
+	// between polls rather than occupying its own processor.
+	//
+
+	ULONG spins = 0;
+
+	for (ULONG i = 0; i < Context->NumSlots; ++i)
+	{
+		auto slot = GetSlot(Context, i);
+
+		while (ReadAcquire(&slot->Readers[previous & 1]) != 0)
+		{
+			if (spins < SYNCHRONIZE_SPIN_LIMIT)
+			{
+				++spins;
+
+				YieldProcessor();
+
+				continue;
+			}
+
+			LARGE_INTEGER interval;
+
+			interval.QuadPart = -SYNCHRONIZE_BACKOFF;
+
+			KeDelayExecutionThread(KernelMode, FALSE, &interval);
+		}
+	}
+}
+
+} // namespace epoch
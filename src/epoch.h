@@ -0,0 +1,100 @@
+#pragma once
+
+#include <wdm.h>
+
+//
+// Epoch-based reclamation.
+//
+// Readers enter a read section before loading a shared pointer, and leave it once they're done
+// with the object it points to. Read sections never block and never wait on writers.
+//
+// A writer publishes a replacement object and then calls Synchronize(). When Synchronize()
+// returns, every read section that could have observed the old object has been left,
+// and the old object can be released.
+//
+// Readers are counted per processor, in one of two counters selected by the current epoch.
+// Synchronize() advances the epoch and waits for the counters of the previous epoch to drain.
+//
+// Read sections are executed at DISPATCH, so they are short and can't be preempted.
+// Writers must be serialized by other means.
+//
+
+namespace epoch
+{
+
+struct CONTEXT;
+
+struct READ_SECTION
+{
+	KIRQL OldIrql;
+	ULONG Slot;
+	LONG Epoch;
+};
+
+//
+// Initialize()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+Initialize
+(
+	CONTEXT **Context
+);
+
+//
+// TearDown()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+// There must not be any active read sections.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+void
+TearDown
+(
+	CONTEXT **Context
+);
+
+//
+// Enter()
+//
+// IRQL <= DISPATCH.
+//
+// Raises to DISPATCH for the duration of the read section.
+//
+void
+Enter
+(
+	CONTEXT *Context,
+	READ_SECTION *Section
+);
+
+//
+// Leave()
+//
+// IRQL == DISPATCH.
+//
+void
+Leave
+(
+	CONTEXT *Context,
+	READ_SECTION *Section
+);
+
+//
+// Synchronize()
+//
+// IRQL == PASSIVE_LEVEL.
+//
+// Waits for all read sections that were entered before the call to be left.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+void
+Synchronize
+(
+	CONTEXT *Context
+);
+
+} // namespace epoch
@@ -1,4 +1,5 @@
 #include "builder.h"
+#include "context.h"
 
 namespace eventing
 {
@@ -6,30 +7,69 @@ namespace eventing
 namespace
 {
 
-bool
+//
+// AllocateEvent()
+//
+// Allocate an event along with a zeroed buffer of `BufferSize` bytes.
+// The buffer immediately follows the event.
+//
+RAW_EVENT*
+AllocateEvent
+(
+	CONTEXT *Context,
+	size_t BufferSize
+)
+{
+	const auto allocationSize = sizeof(RAW_EVENT) + BufferSize;
+
+	RAW_EVENT *evt;
+
+	if (allocationSize <= slab::ObjectSize(Context->EventCache))
+	{
+		evt = (RAW_EVENT*)slab::Allocate(Context->EventCache);
+	}
+	else
+	{
+		evt = (RAW_EVENT*)ExAllocatePoolUninitialized(NonPagedPool, allocationSize, ST_POOL_TAG);
+	}
+
+	if (evt == NULL)
+	{
+		return NULL;
+	}
+
+	RtlZeroMemory(evt, allocationSize);
+
+	InitializeListHead(&evt->ListEntry);
+
+	evt->Buffer = evt + 1;
+	evt->BufferSize = BufferSize;
+
+	return evt;
+}
+
+RAW_EVENT*
 BuildSplittingEvent
 (
+	CONTEXT *Context,
 	HANDLE ProcessId,
 	ST_SPLITTING_STATUS_CHANGE_REASON Reason,
 	LOWER_UNICODE_STRING *ImageName,
-	bool Start,
-	void **Buffer,
-	size_t *BufferSize
+	bool Start
 )
 {
 	auto headerSize = FIELD_OFFSET(ST_EVENT_HEADER, EventData);
 	auto eventSize = FIELD_OFFSET(ST_SPLITTING_EVENT, ImageName) + ImageName->Length;
-	auto allocationSize = headerSize + eventSize;
 
-	auto buffer = ExAllocatePoolZero(NonPagedPool, allocationSize, ST_POOL_TAG);
+	auto raw = AllocateEvent(Context, headerSize + eventSize);
 
-	if (buffer == NULL)
+	if (raw == NULL)
 	{
-		return false;
+		return NULL;
 	}
 
-	auto header = (ST_EVENT_HEADER*)buffer;
-	auto evt = (ST_SPLITTING_EVENT*)(((UCHAR*)buffer) + FIELD_OFFSET(ST_EVENT_HEADER, EventData));
+	auto header = (ST_EVENT_HEADER*)raw->Buffer;
+	auto evt = (ST_SPLITTING_EVENT*)(((UCHAR*)raw->Buffer) + FIELD_OFFSET(ST_EVENT_HEADER, EventData));
 
 	header->EventId = (Start ? ST_EVENT_ID_START_SPLITTING_PROCESS : ST_EVENT_ID_STOP_SPLITTING_PROCESS);
 	header->EventSize = eventSize;
@@ -40,35 +80,30 @@ BuildSplittingEvent
 
 	RtlCopyMemory(evt->ImageName, ImageName->Buffer, ImageName->Length);
 
-	*Buffer = buffer;
-	*BufferSize = allocationSize;
-
-	return true;
+	return raw;
 }
 
-bool
+RAW_EVENT*
 BuildSplittingErrorEvent
 (
+	CONTEXT *Context,
 	HANDLE ProcessId,
 	LOWER_UNICODE_STRING *ImageName,
-	bool Start,
-	void **Buffer,
-	size_t *BufferSize
+	bool Start
 )
 {
 	auto headerSize = FIELD_OFFSET(ST_EVENT_HEADER, EventData);
 	auto eventSize = FIELD_OFFSET(ST_SPLITTING_ERROR_EVENT, ImageName) + ImageName->Length;
-	auto allocationSize = headerSize + eventSize;
 
-	auto buffer = ExAllocatePoolZero(NonPagedPool, allocationSize, ST_POOL_TAG);
+	auto raw = AllocateEvent(Context, headerSize + eventSize);
 
-	if (buffer == NULL)
+	if (raw == NULL)
 	{
-		return false;
+		return NULL;
 	}
 
-	auto header = (ST_EVENT_HEADER*)buffer;
-	auto evt = (ST_SPLITTING_ERROR_EVENT*)(((UCHAR*)buffer) + FIELD_OFFSET(ST_EVENT_HEADER, EventData));
+	auto header = (ST_EVENT_HEADER*)raw->Buffer;
+	auto evt = (ST_SPLITTING_ERROR_EVENT*)(((UCHAR*)raw->Buffer) + FIELD_OFFSET(ST_EVENT_HEADER, EventData));
 
 	header->EventId = (Start ? ST_EVENT_ID_ERROR_START_SPLITTING_PROCESS : ST_EVENT_ID_ERROR_STOP_SPLITTING_PROCESS);
 	header->EventSize = eventSize;
@@ -78,34 +113,7 @@ BuildSplittingErrorEvent
 
 	RtlCopyMemory(evt->ImageName, ImageName->Buffer, ImageName->Length);
 
-	*Buffer = buffer;
-	*BufferSize = allocationSize;
-
-	return true;
-}
-
-RAW_EVENT*
-WrapEvent
-(
-	void *Buffer,
-	size_t BufferSize
-)
-{
-	auto evt = (RAW_EVENT*)ExAllocatePoolUninitialized(NonPagedPool, sizeof(RAW_EVENT), ST_POOL_TAG);
-
-	if (evt == NULL)
-	{
-		ExFreePoolWithTag(Buffer, ST_POOL_TAG);
-
-		return NULL;
-	}
-
-	InitializeListHead(&evt->ListEntry);
-
-	evt->Buffer = Buffer;
-	evt->BufferSize = BufferSize;
-
-	return evt;
+	return raw;
 }
 
 } // anonymous namespace
@@ -113,105 +121,69 @@ WrapEvent
 RAW_EVENT*
 BuildStartSplittingEvent
 (
+	CONTEXT *Context,
 	HANDLE ProcessId,
 	ST_SPLITTING_STATUS_CHANGE_REASON Reason,
 	LOWER_UNICODE_STRING *ImageName
 )
 {
-	void *buffer;
-	size_t bufferSize;
-
-	auto status = BuildSplittingEvent(ProcessId, Reason, ImageName, true, &buffer, &bufferSize);
-
-	if (!status)
-	{
-		return NULL;
-	}
-
-	return WrapEvent(buffer, bufferSize);
+	return BuildSplittingEvent(Context, ProcessId, Reason, ImageName, true);
 }
 
 RAW_EVENT*
 BuildStopSplittingEvent
 (
+	CONTEXT *Context,
 	HANDLE ProcessId,
 	ST_SPLITTING_STATUS_CHANGE_REASON Reason,
 	LOWER_UNICODE_STRING *ImageName
 )
 {
-	void *buffer;
-	size_t bufferSize;
-
-	auto status = BuildSplittingEvent(ProcessId, Reason, ImageName, false, &buffer, &bufferSize);
-
-	if (!status)
-	{
-		return NULL;
-	}
-
-	return WrapEvent(buffer, bufferSize);
+	return BuildSplittingEvent(Context, ProcessId, Reason, ImageName, false);
 }
 
 RAW_EVENT*
 BuildStartSplittingErrorEvent
 (
+	CONTEXT *Context,
 	HANDLE ProcessId,
 	LOWER_UNICODE_STRING *ImageName
 )
 {
-	void *buffer;
-	size_t bufferSize;
-
-	auto status = BuildSplittingErrorEvent(ProcessId, ImageName, false, &buffer, &bufferSize);
-
-	if (!status)
-	{
-		return NULL;
-	}
-
-	return WrapEvent(buffer, bufferSize);
+	return BuildSplittingErrorEvent(Context, ProcessId, ImageName, false);
 }
 
 RAW_EVENT*
 BuildStopSplittingErrorEvent
 (
+	CONTEXT *Context,
 	HANDLE ProcessId,
 	LOWER_UNICODE_STRING *ImageName
 )
 {
-	void *buffer;
-	size_t bufferSize;
-
-	auto status = BuildSplittingErrorEvent(ProcessId, ImageName, false, &buffer, &bufferSize);
-
-	if (!status)
-	{
-		return NULL;
-	}
-
-	return WrapEvent(buffer, bufferSize);
+	return BuildSplittingErrorEvent(Context, ProcessId, ImageName, false);
 }
 
 RAW_EVENT*
 BuildErrorMessageEvent
 (
+	CONTEXT *Context,
 	NTSTATUS Status,
 	const UNICODE_STRING *ErrorMessage
 )
 {
 	auto headerSize = FIELD_OFFSET(ST_EVENT_HEADER, EventData);
 	auto eventSize = FIELD_OFFSET(ST_ERROR_MESSAGE_EVENT, ErrorMessage) + ErrorMessage->Length;
-	auto allocationSize = headerSize + eventSize;
 
-	auto buffer = ExAllocatePoolZero(NonPagedPool, allocationSize, ST_POOL_TAG);
+	auto raw = AllocateEvent(Context, headerSize + eventSize);
 
-	if (buffer == NULL)
+	if (raw == NULL)
 	{
 		return NULL;
 	}
 
-	auto header = (ST_EVENT_HEADER*)buffer;
-	auto evt = (ST_ERROR_MESSAGE_EVENT*)(((UCHAR*)buffer) + FIELD_OFFSET(ST_EVENT_HEADER, EventData));
+	auto header = (ST_EVENT_HEADER*)raw->Buffer;
+	auto evt = (ST_ERROR_MESSAGE_EVENT*)(((UCHAR*)raw->Buffer) + FIELD_OFFSET(ST_EVENT_HEADER, EventData));
 
 	header->EventId = ST_EVENT_ID_ERROR_MESSAGE;
 	header->EventSize = eventSize;
@@ -221,12 +193,13 @@ BuildErrorMessageEvent
 
 	RtlCopyMemory(evt->ErrorMessage, ErrorMessage->Buffer, ErrorMessage->Length);
 
-	return WrapEvent(buffer, allocationSize);
+	return raw;
 }
 
 void
 ReleaseEvent
 (
+	CONTEXT *Context,
 	RAW_EVENT **Event
 )
 {
@@ -239,8 +212,14 @@ ReleaseEvent
 
 	*Event = NULL;
 
-    ExFreePoolWithTag(evt->Buffer, ST_POOL_TAG);
-    ExFreePoolWithTag(evt, ST_POOL_TAG);
+	if (sizeof(RAW_EVENT) + evt->BufferSize <= slab::ObjectSize(Context->EventCache))
+	{
+		slab::Free(Context->EventCache, evt);
+
+		return;
+	}
+
+	ExFreePoolWithTag(evt, ST_POOL_TAG);
 }
 
 } // namespace eventing
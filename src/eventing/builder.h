@@ -11,6 +11,7 @@ namespace eventing
 RAW_EVENT*
 BuildStartSplittingEvent
 (
+	CONTEXT *Context,
 	HANDLE ProcessId,
 	ST_SPLITTING_STATUS_CHANGE_REASON Reason,
 	LOWER_UNICODE_STRING *ImageName
@@ -19,6 +20,7 @@ BuildStartSplittingEvent
 RAW_EVENT*
 BuildStopSplittingEvent
 (
+	CONTEXT *Context,
 	HANDLE ProcessId,
 	ST_SPLITTING_STATUS_CHANGE_REASON Reason,
 	LOWER_UNICODE_STRING *ImageName
@@ -27,6 +29,7 @@ BuildStopSplittingEvent
 RAW_EVENT*
 BuildStartSplittingErrorEvent
 (
+	CONTEXT *Context,
 	HANDLE ProcessId,
 	LOWER_UNICODE_STRING *ImageName
 );
@@ -34,6 +37,7 @@ BuildStartSplittingErrorEvent
 RAW_EVENT*
 BuildStopSplittingErrorEvent
 (
+	CONTEXT *Context,
 	HANDLE ProcessId,
 	LOWER_UNICODE_STRING *ImageName
 );
@@ -41,6 +45,7 @@ BuildStopSplittingErrorEvent
 RAW_EVENT*
 BuildErrorMessageEvent
 (
+	CONTEXT *Context,
 	NTSTATUS Status,
 	const UNICODE_STRING *ErrorMessage
 );
@@ -48,6 +53,7 @@ BuildErrorMessageEvent
 void
 ReleaseEvent
 (
+	CONTEXT *Context,
 	RAW_EVENT **Event
 );
 
@@ -2,6 +2,7 @@
 
 #include <wdm.h>
 #include <wdf.h>
+#include "../containers/slab.h"
 
 namespace eventing
 {
@@ -16,6 +17,12 @@ struct CONTEXT
 	LIST_ENTRY EventQueue;
 
 	SIZE_T NumEvents;
+
+	//
+	// Cache of events.
+	// Events that don't fit in a cache object are allocated from the pool.
+	//
+	slab::CONTEXT *EventCache;
 };
 
 } // namespace eventing
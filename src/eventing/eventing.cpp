@@ -12,6 +12,12 @@ namespace eventing
 namespace
 {
 
+//
+// Size of the objects in the event cache.
+// This fits events that carry an image path of up to 256 characters.
+//
+const SIZE_T EVENT_CACHE_OBJECT_SIZE = 1024;
+
 void EnqueueEvent
 (
     CONTEXT *Context,
@@ -32,7 +38,7 @@ void EnqueueEvent
 
         --Context->NumEvents;
 
-        ReleaseEvent(&oldEvent);
+        ReleaseEvent(Context, &oldEvent);
     }
 
     //
@@ -48,6 +54,7 @@ void EnqueueEvent
 
 void CompleteRequestReleaseEvent
 (
+    CONTEXT *Context,
     WDFREQUEST Request,
     void *RequestBuffer,
     RAW_EVENT *Event
@@ -57,7 +64,7 @@ void CompleteRequestReleaseEvent
 
     WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS, Event->BufferSize);
 
-    ReleaseEvent(&Event);
+    ReleaseEvent(Context, &Event);
 }
 
 } // anonymous namespace
@@ -91,6 +98,15 @@ Initialize
         goto Abort;
     }
 
+    status = slab::Initialize(&context->EventCache, EVENT_CACHE_OBJECT_SIZE);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("slab::Initialize() failed 0x%X\n", status);
+
+        goto Abort_delete_lock;
+    }
+
     WDF_IO_QUEUE_CONFIG queueConfig;
 
     WDF_IO_QUEUE_CONFIG_INIT
@@ -113,13 +129,17 @@ Initialize
     {
         DbgPrint("WdfIoQueueCreate() failed 0x%X\n", status);
 
-        goto Abort_delete_lock;
+        goto Abort_teardown_cache;
     }
 
     *Context = context;
 
     return STATUS_SUCCESS;
 
+Abort_teardown_cache:
+
+    slab::TearDown(&context->EventCache);
+
 Abort_delete_lock:
 
     WdfObjectDelete(context->EventQueueLock);
@@ -148,7 +168,7 @@ TearDown
 	{
 		auto evt = (RAW_EVENT*)RemoveHeadList(&context->EventQueue);
 
-		ReleaseEvent(&evt);
+		ReleaseEvent(context, &evt);
 	}
 
     context->NumEvents = 0;
@@ -178,6 +198,8 @@ TearDown
     WdfObjectDelete(context->RequestQueue);
     WdfObjectDelete(context->EventQueueLock);
 
+    slab::TearDown(&context->EventCache);
+
     //
     // Release context.
     //
@@ -241,7 +263,7 @@ Emit
         WdfRequestComplete(pendedRequest, status);
     }
 
-    CompleteRequestReleaseEvent(pendedRequest, buffer, evt);
+    CompleteRequestReleaseEvent(Context, pendedRequest, buffer, evt);
 }
 
 void
@@ -311,7 +333,17 @@ CollectOne
         return;
     }
 
-    CompleteRequestReleaseEvent(Request, buffer, evt);
+    CompleteRequestReleaseEvent(Context, Request, buffer, evt);
+}
+
+void
+GetCacheStatistics
+(
+    CONTEXT *Context,
+    slab::STATISTICS *Statistics
+)
+{
+    slab::GetStatistics(Context->EventCache, Statistics);
 }
 
 } // eventing
@@ -2,6 +2,7 @@
 
 #include <wdm.h>
 #include <wdf.h>
+#include "../containers/slab.h"
 
 namespace eventing
 {
@@ -58,4 +59,19 @@ CollectOne
 	WDFREQUEST Request
 );
 
+//
+// GetCacheStatistics()
+//
+// IRQL <= DISPATCH.
+//
+// Statistics for the cache that events are allocated from.
+// Events that are too large for the cache are not counted.
+//
+void
+GetCacheStatistics
+(
+	CONTEXT *Context,
+	slab::STATISTICS *Statistics
+);
+
 } // namespace eventing
@@ -19,9 +19,10 @@ struct BLOCK_CONNECTIONS_ENTRY
 	LIST_ENTRY ListEntry;
 
 	//
-	// Device path using all lower-case characters.
+	// Interned device path using all lower-case characters.
+	// The entry holds a reference on the name.
 	//
-	LOWER_UNICODE_STRING ImageName;
+	imagename::IMAGE_NAME *ImageName;
 
 	//
 	// Number of process instances that use this entry.
@@ -271,6 +272,17 @@ CustomGetAppIdFromFileName
 	return STATUS_SUCCESS;
 }
 
+void
+FreeBlockConnectionsEntry
+(
+	BLOCK_CONNECTIONS_ENTRY *Entry
+)
+{
+	imagename::Release(Entry->ImageName);
+
+	ExFreePoolWithTag(Entry, ST_POOL_TAG);
+}
+
 //
 // FindBlockConnectionsEntry()
 // 
@@ -280,7 +292,7 @@ BLOCK_CONNECTIONS_ENTRY*
 FindBlockConnectionsEntry
 (
 	LIST_ENTRY *List,
-	const LOWER_UNICODE_STRING *ImageName
+	const imagename::IMAGE_NAME *ImageName
 )
 {
 	for (auto entry = List->Flink;
@@ -289,7 +301,7 @@ FindBlockConnectionsEntry
 	{
 		auto candidate = (BLOCK_CONNECTIONS_ENTRY*)entry;
 
-		if (util::Equal(ImageName, &candidate->ImageName))
+		if (candidate->ImageName == ImageName)
 		{
 			return candidate;
 		}
@@ -511,7 +523,7 @@ NTSTATUS
 AddBlockFiltersCreateEntryTx
 (
 	HANDLE WfpSession,
-	const LOWER_UNICODE_STRING *ImageName,
+	imagename::IMAGE_NAME *ImageName,
 	const IN_ADDR *TunnelIpv4,
 	const IN6_ADDR *TunnelIpv6,
 	AddBlockFiltersFunc Blocker,
@@ -519,25 +531,20 @@ AddBlockFiltersCreateEntryTx
 	const GUID *BaselineSublayerKey
 )
 {
-	auto offsetStringBuffer = util::RoundToMultiple(sizeof(BLOCK_CONNECTIONS_ENTRY),
-		TYPE_ALIGNMENT(WCHAR));
-
-	auto allocationSize = offsetStringBuffer + ImageName->Length;
-
 	auto entry = (BLOCK_CONNECTIONS_ENTRY*)
-		ExAllocatePoolUninitialized(PagedPool, allocationSize, ST_POOL_TAG);
+		ExAllocatePoolUninitialized(PagedPool, sizeof(BLOCK_CONNECTIONS_ENTRY), ST_POOL_TAG);
 
 	if (entry == NULL)
 	{
 		return STATUS_INSUFFICIENT_RESOURCES;
 	}
 
-	RtlZeroMemory(entry, allocationSize);
+	RtlZeroMemory(entry, sizeof(*entry));
 
 	auto status = Blocker
 	(
 		WfpSession,
-		ImageName,
+		&ImageName->String,
 		TunnelIpv4,
 		TunnelIpv6,
 		&entry->OutboundFilterIdV4,
@@ -554,17 +561,13 @@ AddBlockFiltersCreateEntryTx
 		goto Cleanup;
 	}
 
-	auto stringBuffer = (WCHAR*)(((UINT8*)entry) + offsetStringBuffer);
-
 	InitializeListHead(&entry->ListEntry);
 
 	entry->RefCount = 1;
 
-	entry->ImageName.Length = ImageName->Length;
-	entry->ImageName.MaximumLength = ImageName->Length;
-	entry->ImageName.Buffer = stringBuffer;
+	imagename::AddRef(ImageName);
 
-	RtlCopyMemory(stringBuffer, ImageName->Buffer, ImageName->Length);
+	entry->ImageName = ImageName;
 
 	*Entry = entry;
 
@@ -688,7 +691,7 @@ FreeList
 
 	while ((entry = RemoveHeadList(List)) != List)
 	{
-		ExFreePoolWithTag(entry, ST_POOL_TAG);
+		FreeBlockConnectionsEntry((BLOCK_CONNECTIONS_ENTRY*)entry);
 	}
 }
 
@@ -753,7 +756,7 @@ TearDown
 
 		auto next = rawEntry->Flink;
 
-		ExFreePoolWithTag(rawEntry, ST_POOL_TAG);
+		FreeBlockConnectionsEntry(entry);
 
 		rawEntry = next;
 	}
@@ -823,7 +826,7 @@ TransactionCommit
 			{
 				auto addEvent = (TRANSACTION_EVENT_ADD_ENTRY*)rawEvent;
 
-				ExFreePoolWithTag(addEvent->Target, ST_POOL_TAG);
+				FreeBlockConnectionsEntry(addEvent->Target);
 
 				break;
 			}
@@ -886,7 +889,7 @@ TransactionAbort
 			{
 				RemoveEntryList(&evt->Target->ListEntry);
 
-				ExFreePoolWithTag(evt->Target, ST_POOL_TAG);
+				FreeBlockConnectionsEntry(evt->Target);
 
 				break;
 			}
@@ -923,7 +926,7 @@ NTSTATUS
 RegisterFilterBlockAppTunnelTrafficTx2
 (
 	void *Context,
-	const LOWER_UNICODE_STRING *ImageName,
+	imagename::IMAGE_NAME *ImageName,
 	const IN_ADDR *TunnelIpv4,
 	const IN6_ADDR *TunnelIpv6
 )
@@ -977,14 +980,14 @@ RegisterFilterBlockAppTunnelTrafficTx2
 	{
 		DbgPrint("Could not update local transaction: 0x%X\n", status);
 
-		ExFreePoolWithTag(entry, ST_POOL_TAG);
+		FreeBlockConnectionsEntry(entry);
 
 		return status;
 	}
 
 	InsertTailList(&context->BlockedTunnelConnections, &entry->ListEntry);
 
-	DbgPrint("Added tunnel block filters for %wZ\n", (const UNICODE_STRING*)ImageName);
+	DbgPrint("Added tunnel block filters for %wZ\n", (const UNICODE_STRING*)&ImageName->String);
 
 	return STATUS_SUCCESS;
 }
@@ -993,7 +996,7 @@ NTSTATUS
 RemoveFilterBlockAppTunnelTrafficTx2
 (
 	void *Context,
-	const LOWER_UNICODE_STRING *ImageName
+	const imagename::IMAGE_NAME *ImageName
 )
 {
 	auto context = (APP_FILTERS_CONTEXT*)Context;
@@ -1049,7 +1052,7 @@ RemoveFilterBlockAppTunnelTrafficTx2
 
 	if (NT_SUCCESS(status))
 	{
-		DbgPrint("Removed tunnel block filters for %wZ\n", (const UNICODE_STRING*)ImageName);
+		DbgPrint("Removed tunnel block filters for %wZ\n", (const UNICODE_STRING*)&ImageName->String);
 	}
 
 	return status;
@@ -1153,7 +1156,7 @@ UpdateFiltersTx2
 		status = AddBlockFiltersCreateEntryTx
 		(
 			context->WfpSession,
-			&entry->ImageName,
+			entry->ImageName,
 			TunnelIpv4,
 			TunnelIpv6,
 			AddTunnelBlockFiltersTx,
@@ -4,6 +4,7 @@
 #include <inaddr.h>
 #include <in6addr.h>
 #include "../defs/types.h"
+#include "../containers/imagename.h"
 
 //
 // This module is used to manage app-specific filters.
@@ -65,7 +66,7 @@ NTSTATUS
 RegisterFilterBlockAppTunnelTrafficTx2
 (
 	void *Context,
-	const LOWER_UNICODE_STRING *ImageName,
+	imagename::IMAGE_NAME *ImageName,
 	const IN_ADDR *TunnelIpv4,
 	const IN6_ADDR *TunnelIpv6
 );
@@ -74,7 +75,7 @@ NTSTATUS
 RemoveFilterBlockAppTunnelTrafficTx2
 (
 	void *Context,
-	const LOWER_UNICODE_STRING *ImageName
+	const imagename::IMAGE_NAME *ImageName
 );
 
 //
@@ -218,16 +218,18 @@ RewriteBind
 
 	const bool ipv4 = FixedValues->layerId == FWPS_LAYER_ALE_BIND_REDIRECT_V4;
 
-	WdfSpinLockAcquire(Context->IpAddresses.Lock);
+	ST_IP_ADDRESSES ipAddresses;
+
+	ReadIpAddresses(&Context->IpAddresses, &ipAddresses);
 
 	if (ipv4)
 	{
 		auto bindTarget = (SOCKADDR_IN*)&(bindRequest->localAddressAndPort);
 
 		if (IN4_IS_ADDR_UNSPECIFIED(&(bindTarget->sin_addr))
-			|| IN4_ADDR_EQUAL(&(bindTarget->sin_addr), &(Context->IpAddresses.Addresses.TunnelIpv4)))
+			|| IN4_ADDR_EQUAL(&(bindTarget->sin_addr), &(ipAddresses.TunnelIpv4)))
 		{
-			const auto newTarget = &Context->IpAddresses.Addresses.InternetIpv4;
+			const auto newTarget = &ipAddresses.InternetIpv4;
 
 			LogBindRedirect(HANDLE(MetaValues->processId), bindTarget, newTarget);
 
@@ -243,9 +245,9 @@ RewriteBind
 		static const IN6_ADDR IN6_ADDR_ANY = { 0 };
 		
 		if (IN6_ADDR_EQUAL(&(bindTarget->sin6_addr), &IN6_ADDR_ANY)
-			|| IN6_ADDR_EQUAL(&(bindTarget->sin6_addr), &(Context->IpAddresses.Addresses.TunnelIpv6)))
+			|| IN6_ADDR_EQUAL(&(bindTarget->sin6_addr), &(ipAddresses.TunnelIpv6)))
 		{
-			const auto newTarget = &Context->IpAddresses.Addresses.InternetIpv6;
+			const auto newTarget = &ipAddresses.InternetIpv6;
 
 			LogBindRedirect(HANDLE(MetaValues->processId), bindTarget, newTarget);
 
@@ -255,8 +257,6 @@ RewriteBind
 		}
 	}
 
-	WdfSpinLockRelease(Context->IpAddresses.Lock);
-
 Cleanup_data:
 
 	//
@@ -482,11 +482,9 @@ RewriteConnection
 {
 	UNREFERENCED_PARAMETER(MetaValues);
 
-	WdfSpinLockAcquire(Context->IpAddresses.Lock);
-
-	const auto ipAddresses = Context->IpAddresses.Addresses;
+	ST_IP_ADDRESSES ipAddresses;
 
-	WdfSpinLockRelease(Context->IpAddresses.Lock);
+	ReadIpAddresses(&Context->IpAddresses, &ipAddresses);
 
 	//
 	// Identify the specific cases we're interested in or abort.
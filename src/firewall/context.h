@@ -3,6 +3,7 @@
 #include <wdm.h>
 #include <wdf.h>
 #include "firewall.h"
+#include "ipaddresses.h"
 #include "mode.h"
 #include "pending.h"
 #include "../ipaddr.h"
@@ -13,13 +14,6 @@
 namespace firewall
 {
 
-struct IP_ADDRESSES_MGMT
-{
-	WDFSPINLOCK Lock;
-	ST_IP_ADDRESSES Addresses;
-	SPLITTING_MODE SplittingMode;
-};
-
 struct TRANSACTION_MGMT
 {
 	// Lock that is held for the duration of a transaction.
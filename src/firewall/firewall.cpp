@@ -278,7 +278,7 @@ WfpTransactionBegin
 
 		DECLARE_CONST_UNICODE_STRING(errorMessage, L"Could not create WFP transaction");
 
-		auto evt = eventing::BuildErrorMessageEvent(status, &errorMessage);
+		auto evt = eventing::BuildErrorMessageEvent(Context->Eventing, status, &errorMessage);
 
 		eventing::Emit(Context->Eventing, &evt);
 	}
@@ -300,7 +300,7 @@ WfpTransactionCommit
 
 		DECLARE_CONST_UNICODE_STRING(errorMessage, L"Could not commit WFP transaction");
 
-		auto evt = eventing::BuildErrorMessageEvent(status, &errorMessage);
+		auto evt = eventing::BuildErrorMessageEvent(Context->Eventing, status, &errorMessage);
 
 		eventing::Emit(Context->Eventing, &evt);
 	}
@@ -322,7 +322,7 @@ WfpTransactionAbort
 
 		DECLARE_CONST_UNICODE_STRING(errorMessage, L"Could not abort WFP transaction");
 
-		auto evt = eventing::BuildErrorMessageEvent(status, &errorMessage);
+		auto evt = eventing::BuildErrorMessageEvent(Context->Eventing, status, &errorMessage);
 
 		eventing::Emit(Context->Eventing, &evt);
 	}
@@ -990,18 +990,9 @@ Initialize
 	context->Eventing = Eventing;
 	context->SublayerGuids = *SublayerGuids;
 
-    auto status = WdfSpinLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &context->IpAddresses.Lock);
+	seqlock::Initialize(&context->IpAddresses.Lock);
 
-    if (!NT_SUCCESS(status))
-    {
-        DbgPrint("WdfSpinLockCreate() failed 0x%X\n", status);
-
-		context->IpAddresses.Lock = NULL;
-
-		goto Abort;
-    }
-
-	status = WdfWaitLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &context->Transaction.Lock);
+	auto status = WdfWaitLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &context->Transaction.Lock);
 
     if (!NT_SUCCESS(status))
     {
@@ -1009,7 +1000,7 @@ Initialize
 
 		context->Transaction.Lock = NULL;
 
-		goto Abort_delete_ip_lock;
+		goto Abort;
     }
 
 	status = pending::Initialize
@@ -1084,10 +1075,6 @@ Abort_delete_transaction_lock:
 
 	WdfObjectDelete(context->Transaction.Lock);
 
-Abort_delete_ip_lock:
-
-	WdfObjectDelete(context->IpAddresses.Lock);
-
 Abort:
 
 	ExFreePoolWithTag(context, ST_POOL_TAG);
@@ -1175,8 +1162,6 @@ TearDown
 		return status;
 	}
 
-	WdfObjectDelete(context->IpAddresses.Lock);
-
 	WdfObjectDelete(context->Transaction.Lock);
 
 	ExFreePoolWithTag(context, ST_POOL_TAG);
@@ -1445,12 +1430,7 @@ RegisterUpdatedIpAddresses
 
 	auto intermediateNonPagedAddresses = *IpAddresses;
 
-	WdfSpinLockAcquire(Context->IpAddresses.Lock);
-
-	Context->IpAddresses.Addresses = intermediateNonPagedAddresses;
-	Context->IpAddresses.SplittingMode = newMode;
-
-	WdfSpinLockRelease(Context->IpAddresses.Lock);
+	PublishIpAddresses(&Context->IpAddresses, &intermediateNonPagedAddresses, newMode);
 
 	Context->ActiveFilters = newActiveFilters;
 
@@ -1582,7 +1562,7 @@ TransactionCommit
 
 			DECLARE_CONST_UNICODE_STRING(errorMessage, L"Could not remove ALE reauthorization filters");
 
-			auto evt = eventing::BuildErrorMessageEvent(status, &errorMessage);
+			auto evt = eventing::BuildErrorMessageEvent(Context->Eventing, status, &errorMessage);
 
 			eventing::Emit(Context->Eventing, &evt);
 		}
@@ -1637,7 +1617,7 @@ NTSTATUS
 RegisterAppBecomingSplitTx
 (
 	CONTEXT *Context,
-	const LOWER_UNICODE_STRING *ImageName
+	imagename::IMAGE_NAME *ImageName
 )
 {
 	NT_ASSERT(Context->SplittingEnabled);
@@ -1686,7 +1666,7 @@ NTSTATUS
 RegisterAppBecomingUnsplitTx
 (
 	CONTEXT *Context,
-	const LOWER_UNICODE_STRING *ImageName
+	const imagename::IMAGE_NAME *ImageName
 )
 {
 	NT_ASSERT(Context->SplittingEnabled);
@@ -1707,4 +1687,13 @@ RegisterAppBecomingUnsplitTx
 	return appfilters::RemoveFilterBlockAppTunnelTrafficTx2(Context->AppFiltersContext, ImageName);
 }
 
+ULONG64
+NumPendedClassifications
+(
+	CONTEXT *Context
+)
+{
+	return pending::NumPendedRequests(Context->PendedClassifications);
+}
+
 } // namespace firewall
@@ -4,6 +4,7 @@
 #include "../ipaddr.h"
 #include "../defs/types.h"
 #include "../defs/sublayer.h"
+#include "../containers/imagename.h"
 #include "../procbroker/procbroker.h"
 #include "../eventing/eventing.h"
 
@@ -109,14 +110,28 @@ NTSTATUS
 RegisterAppBecomingSplitTx
 (
 	CONTEXT *Context,
-	const LOWER_UNICODE_STRING *ImageName
+	imagename::IMAGE_NAME *ImageName
 );
 
 NTSTATUS
 RegisterAppBecomingUnsplitTx
 (
 	CONTEXT *Context,
-	const LOWER_UNICODE_STRING *ImageName
+	const imagename::IMAGE_NAME *ImageName
+);
+
+//
+// NumPendedClassifications()
+//
+// IRQL <= DISPATCH.
+//
+// Number of classifications that have been pended because the split status of the process
+// was not known.
+//
+ULONG64
+NumPendedClassifications
+(
+	CONTEXT *Context
 );
 
 } // namespace firewall
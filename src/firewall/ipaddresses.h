@@ -0,0 +1,80 @@
+#pragma once
+
+#include <wdm.h>
+#include "mode.h"
+#include "../ipaddr.h"
+#include "../seqlock.h"
+
+namespace firewall
+{
+
+//
+// Addresses are read by callouts, without acquiring a lock.
+// Readers have to use the sequence lock to obtain a consistent copy.
+//
+struct IP_ADDRESSES_MGMT
+{
+	seqlock::SEQLOCK Lock;
+	ST_IP_ADDRESSES Addresses;
+	SPLITTING_MODE SplittingMode;
+};
+
+//
+// ReadIpAddresses()
+//
+// IRQL <= DISPATCH.
+//
+// Obtain a consistent copy of the registered IP addresses.
+//
+// This doesn't acquire a lock. Callouts are executing concurrently on all processors
+// and IP addresses are updated very infrequently.
+//
+inline
+void
+ReadIpAddresses
+(
+	const IP_ADDRESSES_MGMT *IpAddresses,
+	ST_IP_ADDRESSES *Addresses
+)
+{
+	for (;;)
+	{
+		const auto sequence = seqlock::BeginRead(&IpAddresses->Lock);
+
+		*Addresses = IpAddresses->Addresses;
+
+		if (!seqlock::RetryRead(&IpAddresses->Lock, sequence))
+		{
+			return;
+		}
+	}
+}
+
+//
+// PublishIpAddresses()
+//
+// IRQL <= DISPATCH.
+//
+// Replace the addresses and the splitting mode as seen by readers.
+//
+// Writers must be serialized by other means. `Addresses` has to be backed by non-paged
+// memory, since it's copied inside the write section.
+//
+inline
+void
+PublishIpAddresses
+(
+	IP_ADDRESSES_MGMT *IpAddresses,
+	const ST_IP_ADDRESSES *Addresses,
+	SPLITTING_MODE SplittingMode
+)
+{
+	const auto oldIrql = seqlock::BeginWrite(&IpAddresses->Lock);
+
+	IpAddresses->Addresses = *Addresses;
+	IpAddresses->SplittingMode = SplittingMode;
+
+	seqlock::EndWrite(&IpAddresses->Lock, oldIrql);
+}
+
+} // namespace firewall
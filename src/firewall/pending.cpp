@@ -1,6 +1,7 @@
 #include "pending.h"
 #include "classify.h"
 #include "../util.h"
+#include "../containers/slab.h"
 
 #include "../trace.h"
 #include "pending.tmh"
@@ -39,6 +40,12 @@ struct CONTEXT
 
     // PENDED_CLASSIFICATION
 	LIST_ENTRY Classifications;
+
+    // Cache of PENDED_CLASSIFICATION records.
+    slab::CONTEXT *RecordCache;
+
+    // Number of requests that have been pended.
+    volatile LONG64 NumPended;
 };
 
 namespace
@@ -176,6 +183,7 @@ FailRequest
 void
 ReauthPendedRequest
 (
+    CONTEXT *Context,
     PENDED_CLASSIFICATION *Record
 )
 {
@@ -189,12 +197,13 @@ ReauthPendedRequest
     FwpsCompleteClassify0(Record->ClassifyHandle, 0, NULL);
     FwpsReleaseClassifyHandle0(Record->ClassifyHandle);
 
-    ExFreePoolWithTag(Record, ST_POOL_TAG);
+    slab::Free(Context->RecordCache, Record);
 }
 
 void
 FailPendedRequest
 (
+    CONTEXT *Context,
     PENDED_CLASSIFICATION *Record,
     bool ReauthOnFailure = true
 )
@@ -225,13 +234,13 @@ FailPendedRequest
 
         if (ReauthOnFailure)
         {
-            ReauthPendedRequest(Record);
+            ReauthPendedRequest(Context, Record);
 
             return;
         }
     }
 
-    ExFreePoolWithTag(Record, ST_POOL_TAG);
+    slab::Free(Context->RecordCache, Record);
 }
 
 //
@@ -256,7 +265,7 @@ FailAllPendedRequests
 
         RemoveEntryList(&record->ListEntry);
 
-        FailPendedRequest(record, false);
+        FailPendedRequest(Context, record, false);
     }
 }
 
@@ -299,7 +308,7 @@ HandleProcessEvent
         {
             RemoveEntryList(&record->ListEntry);
 
-            FailPendedRequest(record);
+            FailPendedRequest(context, record);
 
             continue;
         }
@@ -313,11 +322,11 @@ HandleProcessEvent
 
         if (Arriving)
         {
-            ReauthPendedRequest(record);
+            ReauthPendedRequest(context, record);
         }
         else
         {
-            FailPendedRequest(record, false);
+            FailPendedRequest(context, record, false);
         }
     }
 
@@ -355,6 +364,15 @@ Initialize
 		goto Abort;
     }
 
+    status = slab::Initialize(&context->RecordCache, sizeof(PENDED_CLASSIFICATION));
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("slab::Initialize() failed\n");
+
+		goto Abort_delete_lock;
+    }
+
 	InitializeListHead(&context->Classifications);
 
     //
@@ -368,13 +386,17 @@ Initialize
 	{
         DbgPrint("Could not register with process event broker\n");
 
-		goto Abort_delete_lock;
+		goto Abort_teardown_cache;
 	}
 
     *Context = context;
 
     return STATUS_SUCCESS;
 
+Abort_teardown_cache:
+
+    slab::TearDown(&context->RecordCache);
+
 Abort_delete_lock:
 
     WdfObjectDelete(context->Lock);
@@ -400,6 +422,8 @@ TearDown
 
     FailAllPendedRequests(context);
 
+    slab::TearDown(&context->RecordCache);
+
     WdfObjectDelete(context->Lock);
 
     ExFreePoolWithTag(context, ST_POOL_TAG);
@@ -428,12 +452,11 @@ PendRequest
         ProcessId
     );
 
-    auto record = (PENDED_CLASSIFICATION*)
-        ExAllocatePoolUninitialized(NonPagedPool, sizeof(PENDED_CLASSIFICATION), ST_POOL_TAG);
+    auto record = (PENDED_CLASSIFICATION*)slab::Allocate(Context->RecordCache);
 
     if (record == NULL)
     {
-        DbgPrint("ExAllocatePoolUninitialized() failed\n");
+        DbgPrint("slab::Allocate() failed\n");
 
         return STATUS_INSUFFICIENT_RESOURCES;
     }
@@ -473,11 +496,13 @@ PendRequest
 
     WdfSpinLockRelease(Context->Lock);
 
+    InterlockedIncrement64(&Context->NumPended);
+
     return STATUS_SUCCESS;
 
 Abort:
 
-    ExFreePoolWithTag(record, ST_POOL_TAG);
+    slab::Free(Context->RecordCache, record);
 
     return status;
 }
@@ -532,4 +557,13 @@ FailRequest
     return STATUS_SUCCESS;
 }
 
+ULONG64
+NumPendedRequests
+(
+    CONTEXT *Context
+)
+{
+    return ReadNoFence64(&Context->NumPended);
+}
+
 } // namespace firewall::pending
@@ -49,4 +49,17 @@ FailRequest
     FWPS_CLASSIFY_OUT0 *ClassifyOut
 );
 
+//
+// NumPendedRequests()
+//
+// IRQL <= DISPATCH.
+//
+// Number of requests that have been pended since the module was initialized.
+//
+ULONG64
+NumPendedRequests
+(
+    CONTEXT *Context
+);
+
 } // namespace firewall::pending
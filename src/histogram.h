@@ -0,0 +1,71 @@
+#pragma once
+
+#include "defs/statistics.h"
+
+//
+// Recording of samples into the log-scale histograms that are reported to clients.
+//
+// Histograms are not synchronized. Each histogram should have a single writer,
+// and readers may observe a sample in one bucket before the next.
+//
+// Only basic integer types are used, so this can be built outside the driver.
+//
+
+namespace histogram
+{
+
+//
+// BucketIndex()
+//
+// Determine which bucket a sample belongs in.
+//
+inline
+ULONG
+BucketIndex
+(
+	ULONGLONG Value
+)
+{
+	ULONG index = 0;
+
+	while (Value > 1 && index < (ST_LATENCY_HISTOGRAM_NUM_BUCKETS - 1))
+	{
+		Value >>= 1;
+
+		++index;
+	}
+
+	return index;
+}
+
+inline
+void
+Record
+(
+	ST_LATENCY_HISTOGRAM *Histogram,
+	ULONGLONG Value
+)
+{
+	++Histogram->Buckets[BucketIndex(Value)];
+}
+
+//
+// RecordInterval()
+//
+// Record the time between two interrupt time samples, which are in units of 100 ns.
+//
+inline
+void
+RecordInterval
+(
+	ST_LATENCY_HISTOGRAM *Histogram,
+	ULONGLONG Start,
+	ULONGLONG End
+)
+{
+	const ULONGLONG UNITS_PER_MICROSECOND = 10;
+
+	Record(Histogram, (End > Start) ? ((End - Start) / UNITS_PER_MICROSECOND) : 0);
+}
+
+} // namespace histogram
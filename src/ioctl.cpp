@@ -7,6 +7,7 @@
 #include "defs/process.h"
 #include "defs/queryprocess.h"
 #include "validation.h"
+#include "targetsettings.h"
 #include "eventing/eventing.h"
 #include "eventing/builder.h"
 
@@ -33,6 +34,7 @@ enum class MIN_REQUEST_SIZE
 	GET_STATE = sizeof(SIZE_T),
     QUERY_PROCESS = sizeof(ST_QUERY_PROCESS),
     QUERY_PROCESS_RESPONSE = sizeof(ST_QUERY_PROCESS_RESPONSE),
+    GET_STATISTICS = sizeof(ST_PROCESS_EVENT_STATISTICS),
 };
 
 bool VpnActive(const ST_IP_ADDRESSES *IpAddresses)
@@ -43,7 +45,8 @@ bool VpnActive(const ST_IP_ADDRESSES *IpAddresses)
 NTSTATUS
 InitializeProcessRegistryMgmt
 (
-    PROCESS_REGISTRY_MGMT *Mgmt
+    PROCESS_REGISTRY_MGMT *Mgmt,
+    imagename::CONTEXT *ImageNames
 )
 {
     auto status = WdfSpinLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &Mgmt->Lock);
@@ -55,7 +58,7 @@ InitializeProcessRegistryMgmt
         goto Abort;
     }
 
-    status = procregistry::Initialize(&Mgmt->Instance, ST_PAGEABLE::NO);
+    status = procregistry::Initialize(&Mgmt->Instance, ImageNames, ST_PAGEABLE::NO);
 
     if (!NT_SUCCESS(status))
     {
@@ -97,39 +100,92 @@ DestroyProcessRegistryMgmt
     }
 }
 
-//
-// UpdateTargetSplitSetting()
-//
-// Updates the target split setting on a process registry entry.
-//
-// Target state is set to split if either of:
-//
-// - Imagename is included in config.
-// - Currently split by inheritance and parent has departed.
-//
-bool
-NTAPI
-UpdateTargetSplitSetting
+NTSTATUS
+InitializeRegisteredImageMgmt
 (
-    procregistry::PROCESS_REGISTRY_ENTRY *Entry,
-    void *Context
+    REGISTERED_IMAGE_MGMT *Mgmt,
+    imagename::CONTEXT *ImageNames
 )
 {
-    auto context = (ST_DEVICE_CONTEXT*)Context;
+    Mgmt->Generation = 0;
 
-    Entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_OFF;
+    auto status = epoch::Initialize(&Mgmt->Epoch);
 
-    if (registeredimage::HasEntryExact(context->RegisteredImage.Instance, &Entry->ImageName))
+    if (!NT_SUCCESS(status))
     {
-        Entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG;
+        DbgPrint("epoch::Initialize() failed 0x%X\n", status);
+
+        goto Abort;
     }
-    else if (Entry->ParentProcessId == 0
-        && Entry->Settings.Split == ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE)
+
+    status = registeredimage::Initialize
+    (
+        (registeredimage::CONTEXT**)&Mgmt->Instance,
+        ImageNames,
+        ST_PAGEABLE::NO
+    );
+
+    if (!NT_SUCCESS(status))
     {
-        Entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
+        DbgPrint("registeredimage::Initialize() failed 0x%X\n", status);
+
+        goto Abort_teardown_epoch;
     }
 
-    return true;
+    return STATUS_SUCCESS;
+
+Abort_teardown_epoch:
+
+    epoch::TearDown(&Mgmt->Epoch);
+
+Abort:
+
+    Mgmt->Instance = NULL;
+    Mgmt->Epoch = NULL;
+
+    return status;
+}
+
+void
+DestroyRegisteredImageMgmt
+(
+    REGISTERED_IMAGE_MGMT *Mgmt
+)
+{
+    if (Mgmt->Instance != NULL)
+    {
+        registeredimage::TearDown((registeredimage::CONTEXT**)&Mgmt->Instance);
+    }
+
+    epoch::TearDown(&Mgmt->Epoch);
+}
+
+//
+// PublishConfiguration()
+//
+// Replace the published configuration.
+//
+// Returns the previous configuration once no lock-free reader can still be using it.
+// Early verdicts that were based on the previous configuration are discarded.
+//
+registeredimage::CONTEXT*
+PublishConfiguration
+(
+    ST_DEVICE_CONTEXT *Context,
+    registeredimage::CONTEXT *Imageset
+)
+{
+    auto oldConfiguration = Context->RegisteredImage.Instance;
+
+    WritePointerRelease((PVOID volatile *)&Context->RegisteredImage.Instance, Imageset);
+
+    InterlockedIncrement(&Context->RegisteredImage.Generation);
+
+    epoch::Synchronize(Context->RegisteredImage.Epoch);
+
+    procmgmt::ClearEarlyVerdicts(Context->ProcessMgmt);
+
+    return oldConfiguration;
 }
 
 //
@@ -171,7 +227,7 @@ ApplyFinalizeTargetSettings
         // Not split -> split
         //
 
-        auto status = firewall::RegisterAppBecomingSplitTx(Context->Firewall, &Entry->ImageName);
+        auto status = firewall::RegisterAppBecomingSplitTx(Context->Firewall, Entry->ImageName);
 
         if (!NT_SUCCESS(status))
         {
@@ -194,7 +250,7 @@ ApplyFinalizeTargetSettings
 
     if (Entry->Settings.HasFirewallState)
     {
-        auto status = firewall::RegisterAppBecomingUnsplitTx(Context->Firewall, &Entry->ImageName);
+        auto status = firewall::RegisterAppBecomingUnsplitTx(Context->Firewall, Entry->ImageName);
 
         if (!NT_SUCCESS(status))
         {
@@ -207,51 +263,15 @@ ApplyFinalizeTargetSettings
     return true;
 }
 
-//
-// PropagateApplyTargetSettings()
-//
-// Traverse ancestry to see if parent/grandparent/etc is being split.
-// Then apply target split setting.
-//
 bool
 NTAPI
-PropagateApplyTargetSettings
+ApplyTargetSettings
 (
     procregistry::PROCESS_REGISTRY_ENTRY *Entry,
     void *Context
 )
 {
-    auto context = (ST_DEVICE_CONTEXT *)Context;
-
-    if (!util::SplittingEnabled(Entry->TargetSettings.Split))
-    {
-        auto currentEntry = Entry;
-
-        //
-        // In the current state of changing settings,
-        // we have to follow the ancestry all the way to the root.
-        //
-
-        for (;;)
-        {
-            const auto parent = procregistry::GetParentEntry(context->ProcessRegistry.Instance, currentEntry);
-
-            if (NULL == parent)
-            {
-                break;
-            }
-
-            if (util::SplittingEnabled(parent->TargetSettings.Split))
-            {
-                Entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
-                break;
-            }
-
-            currentEntry = parent;
-        }
-    }
-
-    return ApplyFinalizeTargetSettings(context, Entry);
+    return ApplyFinalizeTargetSettings((ST_DEVICE_CONTEXT*)Context, Entry);
 }
 
 struct CONFIGURATION_COMPUTE_LENGTH_CONTEXT
@@ -265,9 +285,12 @@ NTAPI
 GetConfigurationComputeLength
 (
     const LOWER_UNICODE_STRING *Entry,
+    registeredimage::ENTRY_TYPE Type,
     void *Context
 )
 {
+    UNREFERENCED_PARAMETER(Type);
+
     auto ctx = (CONFIGURATION_COMPUTE_LENGTH_CONTEXT*)Context;
 
     ++(ctx->NumEntries);
@@ -294,6 +317,7 @@ NTAPI
 GetConfigurationSerialize
 (
     const LOWER_UNICODE_STRING *Entry,
+    registeredimage::ENTRY_TYPE Type,
     void *Context
 )
 {
@@ -306,6 +330,28 @@ GetConfigurationSerialize
     ctx->Entry->ImageNameOffset = ctx->StringOffset;
     ctx->Entry->ImageNameLength = Entry->Length;
 
+    switch (Type)
+    {
+        case registeredimage::ENTRY_TYPE::PREFIX:
+        {
+            ctx->Entry->Flags = ST_CONFIGURATION_ENTRY_FLAG_PREFIX;
+
+            break;
+        }
+        case registeredimage::ENTRY_TYPE::PATTERN:
+        {
+            ctx->Entry->Flags = ST_CONFIGURATION_ENTRY_FLAG_PATTERN;
+
+            break;
+        }
+        default:
+        {
+            ctx->Entry->Flags = 0;
+
+            break;
+        }
+    }
+
     RtlCopyMemory(ctx->StringDest, Entry->Buffer, Entry->Length);
 
     //
@@ -327,6 +373,9 @@ GetConfigurationSerialize
 // We don't need to worry about the current driver state, because if callouts
 // are active this means the current state is "engaged".
 //
+// The process registry lock is not acquired. This is called for every connection
+// on every processor and the registry provides a lock-free lookup for this purpose.
+//
 firewall::PROCESS_SPLIT_VERDICT
 CallbackQueryProcess
 (
@@ -336,22 +385,23 @@ CallbackQueryProcess
 {
     auto context = (ST_DEVICE_CONTEXT*)RawContext;
 
-    WdfSpinLockAcquire(context->ProcessRegistry.Lock);
-
-    auto process = procregistry::FindEntry(context->ProcessRegistry.Instance, ProcessId);
-
-    firewall::PROCESS_SPLIT_VERDICT verdict = firewall::PROCESS_SPLIT_VERDICT::UNKNOWN;
+    ST_PROCESS_SPLIT_STATUS split;
 
-    if (process != NULL)
+    if (!procregistry::GetSplitStatus(context->ProcessRegistry.Instance, ProcessId, &split))
     {
-        verdict = (util::SplittingEnabled(process->Settings.Split)
-            ? firewall::PROCESS_SPLIT_VERDICT::DO_SPLIT
-            : firewall::PROCESS_SPLIT_VERDICT::DONT_SPLIT);
-    }
+        //
+        // The process may have been created too recently to be in the registry.
+        //
 
-    WdfSpinLockRelease(context->ProcessRegistry.Lock);
+        if (!procmgmt::QueryEarlyVerdict(context->ProcessMgmt, ProcessId, &split))
+        {
+            return firewall::PROCESS_SPLIT_VERDICT::UNKNOWN;
+        }
+    }
 
-    return verdict;
+    return (util::SplittingEnabled(split)
+        ? firewall::PROCESS_SPLIT_VERDICT::DO_SPLIT
+        : firewall::PROCESS_SPLIT_VERDICT::DONT_SPLIT);
 }
 
 bool
@@ -359,12 +409,35 @@ NTAPI
 DbgPrintConfiguration
 (
     const LOWER_UNICODE_STRING *Entry,
+    registeredimage::ENTRY_TYPE Type,
     void *Context
 )
 {
     UNREFERENCED_PARAMETER(Context);
 
-    DbgPrint("%wZ\n", (const UNICODE_STRING*)Entry);
+    const char *suffix = "";
+
+    switch (Type)
+    {
+        case registeredimage::ENTRY_TYPE::EXACT:
+        {
+            break;
+        }
+        case registeredimage::ENTRY_TYPE::PREFIX:
+        {
+            suffix = " (prefix)";
+
+            break;
+        }
+        case registeredimage::ENTRY_TYPE::PATTERN:
+        {
+            suffix = " (pattern)";
+
+            break;
+        }
+    }
+
+    DbgPrint("%wZ%s\n", (const UNICODE_STRING*)Entry, suffix);
 
     return true;
 }
@@ -389,12 +462,14 @@ RealizeAnnounceSettingsChange
     Entry->PreviousSettings = Entry->Settings;
     Entry->Settings = Entry->TargetSettings;
 
+    procregistry::PublishSettings(context->ProcessRegistry.Instance, Entry);
+
     if (util::SplittingEnabled(Entry->Settings.Split))
     {
         if (!util::SplittingEnabled(Entry->PreviousSettings.Split))
         {
-            auto evt = eventing::BuildStartSplittingEvent(Entry->ProcessId,
-                ST_SPLITTING_REASON_BY_CONFIG, &Entry->ImageName);
+            auto evt = eventing::BuildStartSplittingEvent(context->Eventing, Entry->ProcessId,
+                ST_SPLITTING_REASON_BY_CONFIG, &Entry->ImageName->String);
 
             eventing::Emit(context->Eventing, &evt);
         }
@@ -403,8 +478,8 @@ RealizeAnnounceSettingsChange
     {
         if (util::SplittingEnabled(Entry->PreviousSettings.Split))
         {
-            auto evt = eventing::BuildStopSplittingEvent(Entry->ProcessId,
-                ST_SPLITTING_REASON_BY_CONFIG, &Entry->ImageName);
+            auto evt = eventing::BuildStopSplittingEvent(context->Eventing, Entry->ProcessId,
+                ST_SPLITTING_REASON_BY_CONFIG, &Entry->ImageName->String);
 
             eventing::Emit(context->Eventing, &evt);
         }
@@ -450,7 +525,7 @@ SyncProcessRegistry
     // IOCTL handler path.
     //
 
-    procregistry::ForEach(Context->ProcessRegistry.Instance, UpdateTargetSplitSetting, Context);
+    targetsettings::ComputeAll(Context->ProcessRegistry.Instance, Context->RegisteredImage.Instance);
 
     auto status = firewall::TransactionBegin(Context->Firewall);
 
@@ -461,7 +536,7 @@ SyncProcessRegistry
         return status;
     }
 
-    auto successful = procregistry::ForEach(Context->ProcessRegistry.Instance, PropagateApplyTargetSettings, Context);
+    auto successful = procregistry::ForEach(Context->ProcessRegistry.Instance, ApplyTargetSettings, Context);
 
     if (!successful)
     {
@@ -489,6 +564,12 @@ SyncProcessRegistry
 
     procregistry::ForEach(Context->ProcessRegistry.Instance, RealizeAnnounceSettingsChange, Context);
 
+    //
+    // Early verdicts may have been inherited from a process whose split status was updated.
+    //
+
+    procmgmt::ClearEarlyVerdicts(Context->ProcessMgmt);
+
     return STATUS_SUCCESS;
 
 Abort:
@@ -503,6 +584,115 @@ Abort:
     return status;
 }
 
+bool
+ForEachInSubtree
+(
+    ST_DEVICE_CONTEXT *Context,
+    procregistry::PROCESS_REGISTRY_ENTRY *Root,
+    procregistry::ST_PR_FOREACH Callback
+)
+{
+    if (!Callback(Root, Context))
+    {
+        return false;
+    }
+
+    return procregistry::ForEachDescendant(Context->ProcessRegistry.Instance, Root, Callback, Context);
+}
+
+//
+// SyncProcessRegistryDelta()
+//
+// Same as SyncProcessRegistry(), after entries have been added to or removed from
+// the configuration. The updated configuration must already be installed.
+//
+// Only subtrees rooted at processes whose image is matched by the changed entries are
+// visited. See targetsettings::CollectAffectedRoots().
+//
+NTSTATUS
+SyncProcessRegistryDelta
+(
+    ST_DEVICE_CONTEXT *Context,
+    registeredimage::CONTEXT *OldConfiguration,
+    registeredimage::CONTEXT *Entries
+)
+{
+    targetsettings::AFFECTED_ROOTS affected;
+
+    auto status = targetsettings::CollectAffectedRoots(Context->ProcessRegistry.Instance,
+        OldConfiguration, Context->RegisteredImage.Instance, Entries, &affected);
+
+    if (!NT_SUCCESS(status) || affected.NumRoots == 0)
+    {
+        goto Cleanup;
+    }
+
+    targetsettings::ComputeAffected(Context->ProcessRegistry.Instance,
+        Context->RegisteredImage.Instance, &affected);
+
+    status = firewall::TransactionBegin(Context->Firewall);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("Could not create firewall transaction: 0x%X\n", status);
+
+        goto Cleanup;
+    }
+
+    for (SIZE_T i = 0; i < affected.NumRoots; ++i)
+    {
+        if (!ForEachInSubtree(Context, affected.Roots[i], ApplyTargetSettings))
+        {
+            DbgPrint("Could not add/remove firewall filters\n");
+
+            status = STATUS_UNSUCCESSFUL;
+
+            goto Abort;
+        }
+    }
+
+    status = firewall::TransactionCommit(Context->Firewall, true);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("Could not commit firewall transaction\n");
+
+        goto Abort;
+    }
+
+    //
+    // No fallible operations beyond here.
+    //
+    // Send splitting events and finish off.
+    //
+
+    for (SIZE_T i = 0; i < affected.NumRoots; ++i)
+    {
+        ForEachInSubtree(Context, affected.Roots[i], RealizeAnnounceSettingsChange);
+    }
+
+    procmgmt::ClearEarlyVerdicts(Context->ProcessMgmt);
+
+    goto Cleanup;
+
+Abort:
+
+    {
+        auto s2 = firewall::TransactionAbort(Context->Firewall);
+
+        if (!NT_SUCCESS(s2))
+        {
+            DbgPrint("Could not abort firewall transaction: 0x%X\n", s2);
+        }
+    }
+
+Cleanup:
+
+    targetsettings::ReleaseAffectedRoots(&affected);
+
+    return status;
+}
+
 NTSTATUS
 EnterEngagedState
 (
@@ -565,6 +755,13 @@ LeaveEngagedState
 
     Context->DriverState.State = ST_DRIVER_STATE_READY;
 
+    //
+    // Processes that were created while leaving the engaged state may have been given an
+    // early verdict. Clearing the verdicts after updating the state also discards those.
+    //
+
+    procmgmt::ClearEarlyVerdicts(Context->ProcessMgmt);
+
     DbgPrint("Successful state transition ENGAGED -> READY\n");
 
     return STATUS_SUCCESS;
@@ -679,9 +876,7 @@ RegisterConfigurationAtReady
 
     if (!VpnActive(&Context->IpAddresses))
     {
-        auto oldConfiguration = Context->RegisteredImage.Instance;
-
-        Context->RegisteredImage.Instance = Imageset;
+        auto oldConfiguration = PublishConfiguration(Context, Imageset);
 
         registeredimage::TearDown(&oldConfiguration);
 
@@ -692,9 +887,7 @@ RegisterConfigurationAtReady
     // VPN is active so enter engaged state.
     //
 
-    auto oldConfiguration = Context->RegisteredImage.Instance;
-
-    Context->RegisteredImage.Instance = Imageset;
+    auto oldConfiguration = PublishConfiguration(Context, Imageset);
 
     auto status = EnterEngagedState(Context, &Context->IpAddresses);
 
@@ -702,7 +895,7 @@ RegisterConfigurationAtReady
     {
         DbgPrint("Could not enter engaged state: 0x%X\n", status);
 
-        Context->RegisteredImage.Instance = oldConfiguration;
+        PublishConfiguration(Context, oldConfiguration);
 
         registeredimage::TearDown(&Imageset);
 
@@ -714,37 +907,255 @@ RegisterConfigurationAtReady
     return STATUS_SUCCESS;
 }
 
+//
+// DiffConfiguration()
+//
+// Collect the entries that are present in only one of the configurations.
+//
+NTSTATUS
+DiffConfiguration
+(
+    registeredimage::CONTEXT *Lhs,
+    registeredimage::CONTEXT *Rhs,
+    registeredimage::CONTEXT **Changes
+)
+{
+    registeredimage::CONTEXT *removed = NULL;
+
+    auto status = registeredimage::Clone(Lhs, Rhs, Changes);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    status = registeredimage::Clone(Rhs, Lhs, &removed);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto Abort;
+    }
+
+    status = registeredimage::Merge(*Changes, removed);
+
+    registeredimage::TearDown(&removed);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto Abort;
+    }
+
+    status = registeredimage::CompilePatterns(*Changes);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto Abort;
+    }
+
+    return STATUS_SUCCESS;
+
+Abort:
+
+    registeredimage::TearDown(Changes);
+
+    return status;
+}
+
 NTSTATUS
 RegisterConfigurationAtEngaged
 (
-    ST_DEVICE_CONTEXT *Context,
-    registeredimage::CONTEXT *Imageset
+    ST_DEVICE_CONTEXT *Context,
+    registeredimage::CONTEXT *Imageset
+)
+{
+    auto oldConfiguration = Context->RegisteredImage.Instance;
+
+    //
+    // Only processes matched by entries that were added or removed need to be
+    // re-evaluated. Fall back to a full sync if the difference can't be computed.
+    //
+
+    registeredimage::CONTEXT *changes = NULL;
+
+    auto status = DiffConfiguration(Imageset, oldConfiguration, &changes);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("Could not compute configuration changes: 0x%X\n", status);
+
+        changes = NULL;
+    }
+
+    PublishConfiguration(Context, Imageset);
+
+    //
+    // Update process registry to reflect new configuration.
+    //
+
+    if (changes != NULL)
+    {
+        status = SyncProcessRegistryDelta(Context, oldConfiguration, changes);
+
+        registeredimage::TearDown(&changes);
+    }
+    else
+    {
+        status = SyncProcessRegistry(Context, true);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("Could not synchronize process registry with configuration: 0x%X\n", status);
+
+        PublishConfiguration(Context, oldConfiguration);
+
+        registeredimage::TearDown(&Imageset);
+
+        return status;
+    }
+
+    registeredimage::TearDown(&oldConfiguration);
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RegisterConfigurationDeltaAtEngaged
+(
+    ST_DEVICE_CONTEXT *Context,
+    CONFIGURATION_DELTA *Delta
+)
+{
+    auto oldConfiguration = PublishConfiguration(Context, Delta->Imageset);
+
+    //
+    // Update affected processes in the process registry.
+    //
+
+    auto status = SyncProcessRegistryDelta(Context, oldConfiguration, Delta->Entries);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("Could not synchronize process registry with configuration: 0x%X\n", status);
+
+        PublishConfiguration(Context, oldConfiguration);
+
+        registeredimage::TearDown(&Delta->Imageset);
+
+        return status;
+    }
+
+    Delta->Imageset = NULL;
+
+    registeredimage::TearDown(&oldConfiguration);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// RegisterEmptyConfiguration()
+//
+// Updates that remove all entries are handled the same as clearing the configuration.
+//
+NTSTATUS
+RegisterEmptyConfiguration
+(
+    ST_DEVICE_CONTEXT *Context,
+    registeredimage::CONTEXT *Imageset
+)
+{
+    if (Context->DriverState.State == ST_DRIVER_STATE_ENGAGED)
+    {
+        auto status = LeaveEngagedState(Context);
+
+        if (!NT_SUCCESS(status))
+        {
+            DbgPrint("Could not leave engaged state: 0x%X\n", status);
+
+            registeredimage::TearDown(&Imageset);
+
+            return status;
+        }
+    }
+
+    auto oldConfiguration = PublishConfiguration(Context, Imageset);
+
+    registeredimage::TearDown(&oldConfiguration);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// ConfigurationDeltaPrepare()
+//
+// Parse client buffer and derive the updated configuration from the current configuration.
+//
+// The configuration is only ever replaced in the serialized IOCTL handler path,
+// so it can be read here without acquiring the state lock.
+//
+NTSTATUS
+ConfigurationDeltaPrepare
+(
+    WDFDEVICE Device,
+    WDFREQUEST Request,
+    bool Remove,
+    CONFIGURATION_DELTA *Delta
 )
 {
-    auto oldConfiguration = Context->RegisteredImage.Instance;
+    Delta->Imageset = NULL;
 
-    Context->RegisteredImage.Instance = Imageset;
+    auto status = SetConfigurationPrepare(Device, Request, true, &Delta->Entries);
 
-    //
-    // Update process registry to reflect new configuration.
-    //
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
 
-    auto status = SyncProcessRegistry(Context, true);
+    auto context = DeviceGetSplitTunnelContext(Device);
+
+    auto current = context->RegisteredImage.Instance;
+
+    status = registeredimage::Clone(current, (Remove ? Delta->Entries : NULL), &Delta->Imageset);
 
     if (!NT_SUCCESS(status))
     {
-        DbgPrint("Could not synchronize process registry with configuration: 0x%X\n", status);
+        DbgPrint("Could not create new registered image instance: 0x%X\n", status);
 
-        Context->RegisteredImage.Instance = oldConfiguration;
+        goto Abort;
+    }
 
-        registeredimage::TearDown(&Imageset);
+    if (!Remove)
+    {
+        status = registeredimage::Merge(Delta->Imageset, Delta->Entries);
 
-        return status;
+        if (!NT_SUCCESS(status))
+        {
+            DbgPrint("Could not insert new entry into registered image instance: 0x%X\n", status);
+
+            goto Abort_teardown_imageset;
+        }
     }
 
-    registeredimage::TearDown(&oldConfiguration);
+    status = registeredimage::CompilePatterns(Delta->Imageset);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("Could not compile patterns in registered image instance: 0x%X\n", status);
+
+        goto Abort_teardown_imageset;
+    }
 
     return STATUS_SUCCESS;
+
+Abort_teardown_imageset:
+
+    registeredimage::TearDown(&Delta->Imageset);
+
+Abort:
+
+    registeredimage::TearDown(&Delta->Entries);
+
+    return status;
 }
 
 void
@@ -835,9 +1246,21 @@ ResetInner
 
     RtlZeroMemory(&Context->IpAddresses, sizeof(Context->IpAddresses));
 
+    //
+    // Releasing the registry and the configuration used to dominate the time of a reset,
+    // so keep track of it.
+    //
+
+    const auto releaseStart = KeQueryInterruptTime();
+
     procregistry::TearDown(&Context->ProcessRegistry.Instance);
 
-    registeredimage::TearDown((registeredimage::CONTEXT**)&Context->RegisteredImage.Instance);
+    DestroyRegisteredImageMgmt(&Context->RegisteredImage);
+
+    DbgPrint("Released process registry and configuration in %llu us\n",
+        (KeQueryInterruptTime() - releaseStart) / 10);
+
+    imagename::TearDown(&Context->ImageNames);
 
     procbroker::TearDown(&Context->ProcessEventBroker);
 
@@ -895,18 +1318,21 @@ Initialize
         goto Abort_teardown_eventing;
     }
 
-    status = registeredimage::Initialize
-    (
-        (registeredimage::CONTEXT**)&context->RegisteredImage.Instance,
-        ST_PAGEABLE::NO
-    );
+    status = imagename::Initialize(&context->ImageNames);
 
     if (!NT_SUCCESS(status))
     {
         goto Abort_teardown_procbroker;
     }
 
-    status = InitializeProcessRegistryMgmt(&context->ProcessRegistry);
+    status = InitializeRegisteredImageMgmt(&context->RegisteredImage, context->ImageNames);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto Abort_teardown_imagenames;
+    }
+
+    status = InitializeProcessRegistryMgmt(&context->ProcessRegistry, context->ImageNames);
 
     if (!NT_SUCCESS(status))
     {
@@ -971,7 +1397,11 @@ Abort_teardown_process_registry:
 
 Abort_teardown_registeredimage:
 
-    registeredimage::TearDown((registeredimage::CONTEXT**)&context->RegisteredImage.Instance);
+    DestroyRegisteredImageMgmt(&context->RegisteredImage);
+
+Abort_teardown_imagenames:
+
+    imagename::TearDown(&context->ImageNames);
 
 Abort_teardown_procbroker:
 
@@ -994,7 +1424,9 @@ Abort_teardown_eventing:
 NTSTATUS
 SetConfigurationPrepare
 (
+    WDFDEVICE Device,
     WDFREQUEST Request,
+    bool EntryFlags,
     registeredimage::CONTEXT **Imageset
 )
 {
@@ -1013,7 +1445,7 @@ SetConfigurationPrepare
         return status;
     }
 
-    if (!ValidateUserBufferConfiguration(buffer, bufferLength))
+    if (!ValidateUserBufferConfiguration(buffer, bufferLength, EntryFlags))
     {
         DbgPrint("Invalid configuration data in buffer provided to IOCTL\n");
 
@@ -1035,9 +1467,11 @@ SetConfigurationPrepare
     // Create new instance for storing image names.
     //
 
+    auto context = DeviceGetSplitTunnelContext(Device);
+
     registeredimage::CONTEXT *imageset;
 
-    status = registeredimage::Initialize(&imageset, ST_PAGEABLE::NO);
+    status = registeredimage::Initialize(&imageset, context->ImageNames, ST_PAGEABLE::NO);
 
     if (!NT_SUCCESS(status))
     {
@@ -1058,7 +1492,24 @@ SetConfigurationPrepare
         s.MaximumLength = entry->ImageNameLength;
         s.Buffer = (WCHAR*)(stringBuffer + entry->ImageNameOffset);
 
-        status = registeredimage::AddEntry(imageset, &s);
+        //
+        // Without entry flags, all entries are exact image names.
+        //
+
+        const auto flags = (EntryFlags ? entry->Flags : 0);
+
+        if ((flags & ST_CONFIGURATION_ENTRY_FLAG_PREFIX) != 0)
+        {
+            status = registeredimage::AddPrefixEntry(imageset, &s);
+        }
+        else if ((flags & ST_CONFIGURATION_ENTRY_FLAG_PATTERN) != 0)
+        {
+            status = registeredimage::AddPatternEntry(imageset, &s);
+        }
+        else
+        {
+            status = registeredimage::AddEntry(imageset, &s);
+        }
 
         if (!NT_SUCCESS(status))
         {
@@ -1070,6 +1521,22 @@ SetConfigurationPrepare
         }
     }
 
+    //
+    // Build the automaton for pattern entries once, rather than matching
+    // each pattern separately whenever a process is evaluated.
+    //
+
+    status = registeredimage::CompilePatterns(imageset);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("Could not compile patterns in registered image instance: 0x%X\n", status);
+
+        registeredimage::TearDown(&imageset);
+
+        return status;
+    }
+
     *Imageset = imageset;
 
     return STATUS_SUCCESS;
@@ -1131,6 +1598,101 @@ SetConfiguration
     return status;
 }
 
+NTSTATUS
+AddConfigurationEntriesPrepare
+(
+    WDFDEVICE Device,
+    WDFREQUEST Request,
+    CONFIGURATION_DELTA *Delta
+)
+{
+    return ConfigurationDeltaPrepare(Device, Request, false, Delta);
+}
+
+NTSTATUS
+RemoveConfigurationEntriesPrepare
+(
+    WDFDEVICE Device,
+    WDFREQUEST Request,
+    CONFIGURATION_DELTA *Delta
+)
+{
+    return ConfigurationDeltaPrepare(Device, Request, true, Delta);
+}
+
+//
+// UpdateConfiguration()
+//
+// Store updated configuration.
+//
+// Possibly enter/leave engaged state depending on a number of factors.
+//
+NTSTATUS
+UpdateConfiguration
+(
+    WDFDEVICE Device,
+    CONFIGURATION_DELTA *Delta
+)
+{
+    auto context = DeviceGetSplitTunnelContext(Device);
+
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    WdfWaitLockAcquire(context->DriverState.Lock, NULL);
+
+    if (registeredimage::IsEmpty(Delta->Imageset))
+    {
+        status = RegisterEmptyConfiguration(context, Delta->Imageset);
+    }
+    else
+    {
+        switch (context->DriverState.State)
+        {
+            case ST_DRIVER_STATE_READY:
+            {
+                status = RegisterConfigurationAtReady(context, Delta->Imageset);
+
+                break;
+            }
+            case ST_DRIVER_STATE_ENGAGED:
+            {
+                status = RegisterConfigurationDeltaAtEngaged(context, Delta);
+
+                break;
+            }
+            default:
+            {
+                registeredimage::TearDown(&Delta->Imageset);
+
+                break;
+            }
+        }
+    }
+
+    WdfWaitLockRelease(context->DriverState.Lock);
+
+    Delta->Imageset = NULL;
+
+    registeredimage::TearDown(&Delta->Entries);
+
+    if (NT_SUCCESS(status))
+    {
+        DbgPrint("Successfully updated configuration\n");
+
+        //
+        // No locking required since we're in a serialized IOCTL handler path.
+        //
+        registeredimage::ForEach
+        (
+            context->RegisteredImage.Instance,
+            DbgPrintConfiguration,
+            NULL
+        );
+    }
+
+    return status;
+}
+
 //
 // GetConfigurationComplete()
 //
@@ -1262,6 +1824,21 @@ ClearConfiguration
 {
     auto context = DeviceGetSplitTunnelContext(Device);
 
+    //
+    // The published configuration can't be modified, so create an empty replacement up front.
+    //
+
+    registeredimage::CONTEXT *emptyConfiguration;
+
+    auto status = registeredimage::Initialize(&emptyConfiguration, context->ImageNames, ST_PAGEABLE::NO);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("Could not create empty configuration: 0x%X\n", status);
+
+        return status;
+    }
+
     WdfWaitLockAcquire(context->DriverState.Lock, NULL);
 
     if (context->DriverState.State == ST_DRIVER_STATE_ENGAGED)
@@ -1271,22 +1848,32 @@ ClearConfiguration
         // (This updates the process registry and sends splitting events.)
         //
 
-        auto status = LeaveEngagedState(context);
+        status = LeaveEngagedState(context);
 
         if (!NT_SUCCESS(status))
         {
             WdfWaitLockRelease(context->DriverState.Lock);
 
+            registeredimage::TearDown(&emptyConfiguration);
+
             DbgPrint("Could not leave engaged state: 0x%X\n", status);
 
             return status;
         }
     }
 
-    registeredimage::Reset(context->RegisteredImage.Instance);
+    const auto resetStart = KeQueryInterruptTime();
+
+    auto oldConfiguration = PublishConfiguration(context, emptyConfiguration);
+
+    registeredimage::TearDown(&oldConfiguration);
+
+    const auto resetDuration = KeQueryInterruptTime() - resetStart;
 
     WdfWaitLockRelease(context->DriverState.Lock);
 
+    DbgPrint("Cleared configuration in %llu us\n", resetDuration / 10);
+
     DbgPrint("Successfully processed IOCTL_ST_CLEAR_CONFIGURATION\n");
 
     return STATUS_SUCCESS;
@@ -1326,65 +1913,86 @@ RegisterProcesses
     NT_ASSERT(procregistry::IsEmpty(context->ProcessRegistry.Instance));
 
     //
-    // Insert records one by one.
-    //
-    // We can't check the configuration to get accurate information on whether the process being
-    // inserted should have its traffic split.
+    // Downcase all image names into a single allocation that also holds the snapshot.
+    // The registry only keeps the interned names, so the allocation is released
+    // once the snapshot has been added.
     //
-    // Because there is no configuration yet.
+    // Names are stored at the same offsets as in the input buffer.
+    // The snapshot is no larger than the input entries, so the size can't overflow.
     //
 
+    static_assert(sizeof(procregistry::SNAPSHOT_ENTRY) <= sizeof(ST_PROCESS_DISCOVERY_ENTRY),
+        "Snapshot entry is larger than discovery entry");
+
+    const auto stringBufferLength = (SIZE_T)(((UCHAR*)buffer + bufferLength) - stringBuffer);
+
+    auto snapshot = (procregistry::SNAPSHOT_ENTRY*)ExAllocatePoolUninitialized(PagedPool,
+        (header->NumEntries * sizeof(procregistry::SNAPSHOT_ENTRY)) + stringBufferLength, ST_POOL_TAG);
+
+    if (snapshot == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    auto lowerStringBuffer = (UCHAR*)(snapshot + header->NumEntries);
+
     for (auto i = 0; i < header->NumEntries; ++i, ++entry)
     {
-        UNICODE_STRING imagename;
+        snapshot[i].ParentProcessId = entry->ParentProcessId;
+        snapshot[i].ProcessId = entry->ProcessId;
 
-        imagename.Length = entry->ImageNameLength;
-        imagename.MaximumLength = entry->ImageNameLength;
+        UNICODE_STRING lower;
 
-        if (entry->ImageNameLength == 0)
-        {
-            imagename.Buffer = NULL;
-        }
-        else
+        lower.Length = 0;
+        lower.MaximumLength = entry->ImageNameLength;
+        lower.Buffer = (WCHAR*)(lowerStringBuffer + entry->ImageNameOffset);
+
+        if (entry->ImageNameLength != 0)
         {
-            imagename.Buffer = (WCHAR*)(stringBuffer + entry->ImageNameOffset);
-        }
+            UNICODE_STRING imagename;
 
-        procregistry::PROCESS_REGISTRY_ENTRY registryEntry = { 0 };
+            imagename.Length = entry->ImageNameLength;
+            imagename.MaximumLength = entry->ImageNameLength;
+            imagename.Buffer = (WCHAR*)(stringBuffer + entry->ImageNameOffset);
 
-        status = procregistry::InitializeEntry
-        (
-            context->ProcessRegistry.Instance,
-            entry->ParentProcessId,
-            entry->ProcessId,
-            ST_PROCESS_SPLIT_STATUS_OFF,
-            &imagename,
-            &registryEntry
-        );
+            status = util::DowncaseString(&lower, &imagename);
 
-        if (!NT_SUCCESS(status))
-        {
-            procregistry::Reset(context->ProcessRegistry.Instance);
+            if (!NT_SUCCESS(status))
+            {
+                ExFreePoolWithTag(snapshot, ST_POOL_TAG);
 
-            return status;
+                return status;
+            }
         }
 
-        status = procregistry::AddEntry
-        (
-            context->ProcessRegistry.Instance,
-            &registryEntry
-        );
+        snapshot[i].ImageName = *(LOWER_UNICODE_STRING*)&lower;
+    }
 
-        if (!NT_SUCCESS(status))
-        {
-            procregistry::ReleaseEntry(&registryEntry);
+    //
+    // We can't check the configuration to get accurate information on whether the processes being
+    // inserted should have their traffic split.
+    //
+    // Because there is no configuration yet.
+    //
 
-            procregistry::Reset(context->ProcessRegistry.Instance);
+    status = procregistry::AddSnapshot(context->ProcessRegistry.Instance, snapshot, header->NumEntries);
 
-            return status;
-        }
+    ExFreePoolWithTag(snapshot, ST_POOL_TAG);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
     }
 
+    imagename::STATISTICS imageNameStatistics;
+
+    imagename::GetStatistics(context->ImageNames, &imageNameStatistics);
+
+    DbgPrint("Registered %llu processes using %llu image names in %llu bytes, "
+        "of which %llu bytes are volume prefixes\n", (ULONG64)header->NumEntries,
+        (ULONG64)imageNameStatistics.NumEntries, (ULONG64)imageNameStatistics.StringBytes,
+        (ULONG64)imageNameStatistics.VolumePrefixBytes);
+
     context->DriverState.State = ST_DRIVER_STATE_READY;
 
     procmgmt::Activate(context->ProcessMgmt);
@@ -1643,7 +2251,7 @@ QueryProcessComplete
 
     auto requiredLength = sizeof(ST_QUERY_PROCESS_RESPONSE)
         - RTL_FIELD_SIZE(ST_QUERY_PROCESS_RESPONSE, ImageName)
-        + record->ImageName.Length;
+        + record->ImageName->String.Length;
 
     if (bufferLength < requiredLength)
     {
@@ -1665,9 +2273,9 @@ QueryProcessComplete
     response->ProcessId = record->ProcessId;
     response->ParentProcessId = record->ParentProcessId;
     response->Split = (util::SplittingEnabled(record->Settings.Split) ? TRUE : FALSE);
-    response->ImageNameLength = record->ImageName.Length;
+    response->ImageNameLength = record->ImageName->String.Length;
 
-    RtlCopyMemory(&response->ImageName, record->ImageName.Buffer, record->ImageName.Length);
+    RtlCopyMemory(&response->ImageName, record->ImageName->String.Buffer, record->ImageName->String.Length);
 
     WdfSpinLockRelease(context->ProcessRegistry.Lock);
 
@@ -1678,6 +2286,71 @@ QueryProcessComplete
     WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS, requiredLength);
 }
 
+//
+// GetStatisticsComplete()
+//
+// Returns statistics on the handling of process events, on the verdict cache used by
+// the callouts, and on the object caches, to driver client.
+//
+void
+GetStatisticsComplete
+(
+    WDFDEVICE Device,
+    WDFREQUEST Request
+)
+{
+    PVOID buffer;
+
+    auto status = WdfRequestRetrieveOutputBuffer
+    (
+        Request,
+        (size_t)MIN_REQUEST_SIZE::GET_STATISTICS,
+        &buffer,
+        NULL
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("Unable to retrieve client buffer or invalid buffer size\n");
+
+        WdfRequestComplete(Request, status);
+
+        return;
+    }
+
+    auto context = DeviceGetSplitTunnelContext(Device);
+
+    auto statistics = (ST_PROCESS_EVENT_STATISTICS*)buffer;
+
+    procmgmt::GetStatistics(context->ProcessMgmt, statistics);
+
+    statistics->NumPendedClassifications = firewall::NumPendedClassifications(context->Firewall);
+
+    verdictcache::STATISTICS verdictCacheStatistics;
+
+    procregistry::GetVerdictCacheStatistics(context->ProcessRegistry.Instance, &verdictCacheStatistics);
+
+    statistics->NumVerdictCacheHits = verdictCacheStatistics.Hits;
+    statistics->NumVerdictCacheMisses = verdictCacheStatistics.Misses;
+    statistics->NumVerdictCacheInvalidations = verdictCacheStatistics.Invalidations;
+
+    slab::STATISTICS cacheStatistics;
+
+    procregistry::GetEntryCacheStatistics(context->ProcessRegistry.Instance, &cacheStatistics);
+
+    statistics->NumRegistryEntryAllocations = cacheStatistics.Allocations;
+    statistics->NumRegistryEntryFrees = cacheStatistics.Frees;
+    statistics->PeakRegistryEntries = cacheStatistics.PeakInUse;
+
+    eventing::GetCacheStatistics(context->Eventing, &cacheStatistics);
+
+    statistics->NumEventAllocations = cacheStatistics.Allocations;
+    statistics->NumEventFrees = cacheStatistics.Frees;
+    statistics->PeakEvents = cacheStatistics.PeakInUse;
+
+    WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS, sizeof(ST_PROCESS_EVENT_STATISTICS));
+}
+
 void
 ResetComplete
 (
@@ -24,13 +24,18 @@ Initialize
 //
 // Parse client buffer into registeredimage instance.
 //
+// `EntryFlags` is set for IOCTL_ST_SET_CONFIGURATION_EX, where entries carry flags.
+// Otherwise the flags field is treated as padding and all entries are exact image names.
+//
 // This should be called at PASSIVE, and the actual updating and
 // state transition may be performed at DISPATCH.
 //
 NTSTATUS
 SetConfigurationPrepare
 (
+    WDFDEVICE Device,
     WDFREQUEST Request,
+    bool EntryFlags,
     registeredimage::CONTEXT **Imageset
 );
 
@@ -41,6 +46,55 @@ SetConfiguration
     registeredimage::CONTEXT *Imageset
 );
 
+//
+// Pending update of the configuration, in which entries are added or removed.
+//
+struct CONFIGURATION_DELTA
+{
+    // Entries being added or removed.
+    registeredimage::CONTEXT *Entries;
+
+    // Current configuration with the update applied.
+    registeredimage::CONTEXT *Imageset;
+};
+
+//
+// AddConfigurationEntriesPrepare()
+// RemoveConfigurationEntriesPrepare()
+//
+// Parse client buffer into the entries being added or removed,
+// and derive the updated configuration.
+//
+// These should be called at PASSIVE, same as SetConfigurationPrepare().
+//
+NTSTATUS
+AddConfigurationEntriesPrepare
+(
+    WDFDEVICE Device,
+    WDFREQUEST Request,
+    CONFIGURATION_DELTA *Delta
+);
+
+NTSTATUS
+RemoveConfigurationEntriesPrepare
+(
+    WDFDEVICE Device,
+    WDFREQUEST Request,
+    CONFIGURATION_DELTA *Delta
+);
+
+//
+// UpdateConfiguration()
+//
+// Store updated configuration, and re-evaluate only the processes affected by the update.
+//
+NTSTATUS
+UpdateConfiguration
+(
+    WDFDEVICE Device,
+    CONFIGURATION_DELTA *Delta
+);
+
 void
 GetConfigurationComplete
 (
@@ -89,6 +143,13 @@ QueryProcessComplete
     WDFREQUEST Request
 );
 
+void
+GetStatisticsComplete
+(
+    WDFDEVICE Device,
+    WDFREQUEST Request
+);
+
 void
 ResetComplete
 (
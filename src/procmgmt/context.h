@@ -3,6 +3,7 @@
 #include "../procmon/procmon.h"
 #include "../procbroker/procbroker.h"
 #include "../containers.h"
+#include "../containers/pidindex.h"
 #include "../eventing/eventing.h"
 #include "../firewall/firewall.h"
 #include "callbacks.h"
@@ -10,6 +11,8 @@
 namespace procmgmt
 {
 
+struct BATCH_ITEM;
+
 struct CONTEXT
 {
 	procmon::CONTEXT *ProcessMonitor;
@@ -29,6 +32,47 @@ struct CONTEXT
 	ENGAGED_STATE_ACTIVE_FN EngagedStateActive;
 
     void *CallbackContext;
+
+	//
+	// State for each event in the batch that is being handled.
+	//
+	// Only accessed by the procmon worker thread.
+	//
+	BATCH_ITEM *BatchItems;
+
+	//
+	// Time from an arriving process being picked up by procmon until it's been added
+	// to the process registry. Only updated by the procmon worker thread.
+	//
+	ST_LATENCY_HISTOGRAM RegistrationLatency;
+
+	//
+	// Split status of arriving processes that was determined in the process notification,
+	// for processes that are not yet in the process registry.
+	//
+	// Each value is the `QueueTime` of the arrival that the verdict was determined for.
+	//
+	// The lock serializes writers. Lookups are lock-free.
+	//
+	pidindex::CONTEXT *EarlyVerdicts;
+	WDFSPINLOCK EarlyVerdictsLock;
+
+	//
+	// Incremented whenever early verdicts are cleared, under the lock.
+	// A verdict that was determined under an earlier generation is not published.
+	//
+	volatile LONG EarlyVerdictsGeneration;
+
+	volatile LONG64 NumEarlyVerdicts;
+
+	// Lookups through QueryEarlyVerdict() that found a verdict.
+	volatile LONG64 NumEarlyAnswers;
 };
 
+//
+// Maximum number of events that are handled under a single acquisition of the state lock
+// and the process registry lock.
+//
+const SIZE_T MAX_BATCH_EVENTS = 128;
+
 } // namespace procmgmt
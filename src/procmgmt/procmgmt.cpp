@@ -1,6 +1,7 @@
 #include "procmgmt.h"
 #include "context.h"
 #include "../util.h"
+#include "../histogram.h"
 #include "../defs/events.h"
 #include "../eventing/builder.h"
 
@@ -45,7 +46,7 @@ EmitAddEntryErrorEvents
 
     DECLARE_CONST_UNICODE_STRING(errorMessage, L"Failed in call to procregistry::AddEntry()");
 
-    auto errorEvent = eventing::BuildErrorMessageEvent(ErrorCode, &errorMessage);
+    auto errorEvent = eventing::BuildErrorMessageEvent(Eventing, ErrorCode, &errorMessage);
 
     eventing::Emit(Eventing, &errorEvent);
 
@@ -56,6 +57,7 @@ EmitAddEntryErrorEvents
 
     auto splittingErrorEvent = eventing::BuildStartSplittingErrorEvent
     (
+        Eventing,
         ProcessId,
         ImageName
     );
@@ -94,28 +96,18 @@ ValidateCollision
         goto Abort_unlock_break;
     }
 
-    if (existingEntry->ImageName.Length == 0)
-    {
-        if (newEntry->ImageName.Length != 0)
-        {
-            DbgPrint("Validate PR collision - "\
-                "registered entry is without image name but proposed entry is not\n");
-
-            goto Abort_unlock_break;
-        }
-
-        goto Approved;
-    }
+    //
+    // Image names are interned, and entries without an image name share the interned
+    // empty string. So this also covers the case where only one of the entries has a name.
+    //
 
-    if (!util::Equal(&existingEntry->ImageName, &newEntry->ImageName))
+    if (existingEntry->ImageName != newEntry->ImageName)
     {
         DbgPrint("Validate PR collision - mismatched image name\n");
 
         goto Abort_unlock_break;
     }
 
-Approved:
-
     DbgPrint("Process registry collision validation has succeeded\n");
 
     return true;
@@ -139,39 +131,136 @@ struct ArrivalEvent
 
     //
     // Successfully adding a new entry in the process registry makes the
-    // registry take ownership of the imagename buffer passed.
+    // registry take ownership of the imagename reference passed.
     //
     // Therefore, if we need to emit a splitting event for a successful addition,
-    // we have to duplicate the imagename here to preserve it.
+    // we have to hold an additional reference here to preserve it.
     //
-    LOWER_UNICODE_STRING Imagename;
+    imagename::IMAGE_NAME *Imagename;
 };
 
-void
-EvaluateSplitting
+} // anonymous namespace
+
+//
+// State for an event in the batch that is being handled.
+//
+// Events are applied to the process registry under a single acquisition of the registry lock.
+// Everything that has to be done at PASSIVE is recorded here and completed afterwards.
+//
+struct BATCH_ITEM
+{
+    const procmon::PROCESS_EVENT *Event;
+
+    bool Arriving;
+
+    //
+    // Arriving process: the entry that is added to the registry.
+    // Only valid if `Prepared` is set.
+    //
+    // Departing process: `ProcessId`, `Settings` and `ImageName` of the entry that was removed
+    // from the registry. `ImageName` holds a reference of its own, and is NULL if the process
+    // was not found.
+    //
+    // Events may be stored in paged memory, so the PID is also copied here.
+    //
+    procregistry::PROCESS_REGISTRY_ENTRY Entry;
+
+    bool Prepared;
+
+    // Arriving process: the image matches the configuration.
+    bool Configured;
+
+    ArrivalEvent Arrival;
+
+    //
+    // Arriving process: the status of adding the entry.
+    // Departing process: the status of removing the entry.
+    //
+    NTSTATUS Status;
+
+    // An arriving process collided with an identical entry.
+    bool ValidCollision;
+};
+
+namespace
+{
+
+//
+// MatchConfiguration()
+//
+// First part of determining whether an arriving process should be split.
+// Doesn't depend on the process registry.
+//
+// The configuration is read without relying on the state lock, so this may be called
+// before the lock is acquired. The result is applied by ApplyConfigurationMatch().
+//
+bool
+MatchConfiguration
 (
     CONTEXT *Context,
+    const procregistry::PROCESS_REGISTRY_ENTRY *RegistryEntry
+)
+{
+    epoch::READ_SECTION section;
+
+    epoch::Enter(Context->RegisteredImage->Epoch, &section);
+
+    auto registeredImage = (registeredimage::CONTEXT*)
+        ReadPointerAcquire((PVOID volatile *)&Context->RegisteredImage->Instance);
+
+    const auto configured = registeredimage::HasMatchingEntry(registeredImage, RegistryEntry->ImageName);
+
+    epoch::Leave(Context->RegisteredImage->Epoch, &section);
+
+    return configured;
+}
+
+//
+// ApplyConfigurationMatch()
+//
+// Mark an arriving process whose image matches the configuration as split.
+//
+void
+ApplyConfigurationMatch
+(
     procregistry::PROCESS_REGISTRY_ENTRY *RegistryEntry,
     ArrivalEvent *ArrivalEvent
 )
 {
-    auto registeredImage = Context->RegisteredImage->Instance;
+    RegistryEntry->Settings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG;
+    ArrivalEvent->SplittingReason |= ST_SPLITTING_REASON_BY_CONFIG;
 
-    if (registeredimage::HasEntryExact(registeredImage, &RegistryEntry->ImageName))
-    {
-        RegistryEntry->Settings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG;
-        ArrivalEvent->SplittingReason |= ST_SPLITTING_REASON_BY_CONFIG;
+    ArrivalEvent->EmitEvent = true;
 
-        goto Duplicate_imagename;
-    }
+    imagename::AddRef(RegistryEntry->ImageName);
 
+    ArrivalEvent->Imagename = RegistryEntry->ImageName;
+}
+
+//
+// InheritSplitting()
+//
+// Second part of determining whether an arriving process should be split.
+//
+// The registry lock is held, so the parent is looked up as of this point in the batch.
+//
+void
+InheritSplitting
+(
+    CONTEXT *Context,
+    procregistry::PROCESS_REGISTRY_ENTRY *RegistryEntry,
+    ArrivalEvent *ArrivalEvent
+)
+{
     //
-    // Note that we're providing an entry which is not yet added to the registry.
-    // This may seem wrong but is totally fine.
+    // The entry is not yet added to the registry and therefore not linked to its parent.
+    // Look up the parent directly.
     //
     auto processRegistry = Context->ProcessRegistry;
 
-    auto parent = procregistry::GetParentEntry(processRegistry->Instance, RegistryEntry);
+    auto parent = (RegistryEntry->ParentProcessId == 0)
+        ? NULL
+        : procregistry::FindEntry(processRegistry->Instance, RegistryEntry->ParentProcessId);
 
     if (parent == NULL || !util::SplittingEnabled(parent->Settings.Split))
     {
@@ -181,53 +270,37 @@ EvaluateSplitting
     RegistryEntry->Settings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
     ArrivalEvent->SplittingReason |= ST_SPLITTING_REASON_BY_INHERITANCE;
 
-Duplicate_imagename:
-
     ArrivalEvent->EmitEvent = true;
 
-    auto status = util::DuplicateString
-    (
-        &ArrivalEvent->Imagename,
-        &RegistryEntry->ImageName,
-        ST_PAGEABLE::NO
-    );
-
-    if (NT_SUCCESS(status))
-    {
-        return;
-    }
-
-    DbgPrint("Cannot emit splitting event for arriving process due to resource exhaustion\n");
+    imagename::AddRef(RegistryEntry->ImageName);
 
-    ArrivalEvent->EmitEvent = false;
+    ArrivalEvent->Imagename = RegistryEntry->ImageName;
 }
 
-void
-HandleProcessArriving
+//
+// PrepareProcessArriving()
+//
+// Create the registry entry for an arriving process.
+//
+// This only interns the image name, which doesn't depend on the state of the driver,
+// so it's done before the state lock is acquired.
+//
+NTSTATUS
+PrepareProcessArriving
 (
     CONTEXT *Context,
-    const procmon::PROCESS_EVENT *Record
+    const procmon::PROCESS_EVENT *Record,
+    procregistry::PROCESS_REGISTRY_ENTRY *RegistryEntry
 )
 {
-    //
-    // State lock is held and is locking out IOCTL handlers.
-    //
-    // The process registry lock will be required for updating the process registry.
-    // The configuration lock won't be required.
-    //
-
-    auto processRegistry = Context->ProcessRegistry;
-
-    procregistry::PROCESS_REGISTRY_ENTRY registryEntry = { 0 };
-
     auto status = procregistry::InitializeEntry
     (
-        processRegistry->Instance,
+        Context->ProcessRegistry->Instance,
         Record->Details->ParentProcessId,
         Record->ProcessId,
         ST_PROCESS_SPLIT_STATUS_OFF,
         &(Record->Details->ImageName),
-        &registryEntry
+        RegistryEntry
     );
 
     if (!NT_SUCCESS(status))
@@ -236,46 +309,74 @@ HandleProcessArriving
         DbgPrint("  Status: 0x%X\n", status);
         DbgPrint("  PID: %p\n", Record->ProcessId);
         DbgPrint("  Imagename: %wZ\n", &(Record->Details->ImageName));
-
-        return;
     }
 
-    ArrivalEvent arrivalEvent =
-    {
-        .SplittingReason = ST_SPLITTING_REASON_PROCESS_ARRIVING,
-        .EmitEvent = false,
-        .Imagename = { 0, 0, NULL }
-    };
+    return status;
+}
 
-    if (Context->EngagedStateActive(Context->CallbackContext))
+//
+// ApplyProcessArriving()
+//
+// The registry lock is held.
+//
+// Completes the split evaluation and adds the prepared entry to the registry.
+//
+void
+ApplyProcessArriving
+(
+    CONTEXT *Context,
+    bool Engaged,
+    BATCH_ITEM *Item
+)
+{
+    if (Engaged && !Item->Arrival.EmitEvent)
     {
-        EvaluateSplitting(Context, &registryEntry, &arrivalEvent);
+        InheritSplitting(Context, &Item->Entry, &Item->Arrival);
     }
 
-    //
-    // Insert entry into registry.
-    //
-
-    WdfSpinLockAcquire(processRegistry->Lock);
+    Item->Status = procregistry::AddEntry(Context->ProcessRegistry->Instance, &Item->Entry);
 
-    status = procregistry::AddEntry(processRegistry->Instance, &registryEntry);
+    if (Item->Status == STATUS_DUPLICATE_OBJECTID)
+    {
+        Item->ValidCollision = ValidateCollision(Context, &Item->Entry);
+    }
+}
 
-    WdfSpinLockRelease(processRegistry->Lock);
+//
+// CompleteProcessArriving()
+//
+// Emits events for an arriving process after the registry lock is released.
+// Releases the prepared entry if it was not added.
+//
+void
+CompleteProcessArriving
+(
+    CONTEXT *Context,
+    BATCH_ITEM *Item
+)
+{
+    auto record = Item->Event;
+    auto registryEntry = &Item->Entry;
+    auto status = Item->Status;
 
     if (NT_SUCCESS(status))
     {
+        histogram::RecordInterval(&Context->RegistrationLatency, record->DispatchTime,
+            KeQueryInterruptTimePrecise(NULL));
+
         //
-        // Entry was successfully added and we no longer own the imagename buffer
-        // referenced by the registry entry.
+        // Entry was successfully added and we no longer own the imagename reference
+        // held by the registry entry.
         //
 
-        if (arrivalEvent.EmitEvent)
+        if (Item->Arrival.EmitEvent)
         {
             auto splittingEvent = eventing::BuildStartSplittingEvent
             (
-                Record->ProcessId,
-                (ST_SPLITTING_STATUS_CHANGE_REASON)arrivalEvent.SplittingReason,
-                &arrivalEvent.Imagename
+                Context->Eventing,
+                record->ProcessId,
+                (ST_SPLITTING_STATUS_CHANGE_REASON)Item->Arrival.SplittingReason,
+                &Item->Arrival.Imagename->String
             );
 
             eventing::Emit(Context->Eventing, &splittingEvent);
@@ -297,15 +398,13 @@ HandleProcessArriving
         // event will already have been emitted.
         //
 
-        const auto validationStatus = ValidateCollision(Context, &registryEntry);
-
-        if (!validationStatus)
+        if (!Item->ValidCollision)
         {
-            EmitAddEntryErrorEvents(Context->Eventing, status, registryEntry.ProcessId,
-                &registryEntry.ImageName, arrivalEvent.EmitEvent);
+            EmitAddEntryErrorEvents(Context->Eventing, status, registryEntry->ProcessId,
+                &registryEntry->ImageName->String, Item->Arrival.EmitEvent);
         }
 
-        procregistry::ReleaseEntry(&registryEntry);
+        procregistry::ReleaseEntry(registryEntry);
     }
     else
     {
@@ -313,19 +412,19 @@ HandleProcessArriving
         // General error handling.
         //
 
-        EmitAddEntryErrorEvents(Context->Eventing, status, registryEntry.ProcessId,
-            &registryEntry.ImageName, arrivalEvent.EmitEvent);
+        EmitAddEntryErrorEvents(Context->Eventing, status, registryEntry->ProcessId,
+            &registryEntry->ImageName->String, Item->Arrival.EmitEvent);
 
-        procregistry::ReleaseEntry(&registryEntry);
+        procregistry::ReleaseEntry(registryEntry);
     }
 
     //
     // Clean up event data.
     //
 
-    if (arrivalEvent.Imagename.Buffer != NULL)
+    if (Item->Arrival.Imagename != NULL)
     {
-        util::FreeStringBuffer(&arrivalEvent.Imagename);
+        imagename::Release(Item->Arrival.Imagename);
     }
 
     //
@@ -357,7 +456,7 @@ UpdateFirewallDepartingProcess
         return status;
     }
 
-    status = firewall::RegisterAppBecomingUnsplitTx(Context->Firewall, &registryEntry->ImageName);
+    status = firewall::RegisterAppBecomingUnsplitTx(Context->Firewall, registryEntry->ImageName);
 
     if (!NT_SUCCESS(status))
     {
@@ -390,30 +489,74 @@ UpdateFirewallDepartingProcess
     return status;
 }
 
+//
+// ApplyProcessDeparting()
+//
+// The registry lock is held.
+//
+// Removes the entry of a departing process, and keeps what's needed to complete
+// the departure afterwards.
+//
+void
+ApplyProcessDeparting
+(
+    CONTEXT *Context,
+    BATCH_ITEM *Item
+)
+{
+    auto processRegistry = Context->ProcessRegistry;
+
+    auto registryEntry = procregistry::FindEntry(processRegistry->Instance, Item->Entry.ProcessId);
+
+    if (NULL == registryEntry)
+    {
+        Item->Entry.ImageName = NULL;
+
+        return;
+    }
+
+    Item->Entry.Settings = registryEntry->Settings;
+    Item->Entry.ImageName = registryEntry->ImageName;
+
+    imagename::AddRef(Item->Entry.ImageName);
+
+    const bool deleteSuccessful = procregistry::DeleteEntry(processRegistry->Instance, registryEntry);
+
+    Item->Status = (deleteSuccessful ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL);
+}
+
+//
+// CompleteProcessDeparting()
+//
+// Updates the firewall and emits events for a departing process after the registry lock
+// is released.
+//
 void
-HandleProcessDeparting
+CompleteProcessDeparting
 (
     CONTEXT *Context,
-    const procmon::PROCESS_EVENT *Record
+    BATCH_ITEM *Item
 )
 {
-    //DbgPrint("Process departing: 0x%X\n", Record->ProcessId);
+    //DbgPrint("Process departing: 0x%X\n", Item->Entry.ProcessId);
 
     //
     // We're still at PASSIVE_LEVEL and the state lock is held.
     // IOCTL handlers are locked out.
     //
-    // Complete all processing and acquire the spin lock only when
-    // updating the process tree.
-    //
 
-    auto processRegistry = Context->ProcessRegistry;
-
-    auto registryEntry = procregistry::FindEntry(processRegistry->Instance, Record->ProcessId);
+    auto registryEntry = &Item->Entry;
 
-    if (NULL == registryEntry)
+    if (NULL == registryEntry->ImageName)
     {
-        DbgPrint("Received process-departing event for unknown PID\n");
+        //
+        // Coalesced processes are usually not known.
+        //
+
+        if (!Item->Event->Coalesced)
+        {
+            DbgPrint("Received process-departing event for unknown PID\n");
+        }
 
         return;
     }
@@ -426,74 +569,441 @@ HandleProcessDeparting
 
         if (NT_SUCCESS(status))
         {
-            evt = eventing::BuildStopSplittingEvent(registryEntry->ProcessId,
-                ST_SPLITTING_REASON_PROCESS_DEPARTING, &registryEntry->ImageName);
+            evt = eventing::BuildStopSplittingEvent(Context->Eventing, registryEntry->ProcessId,
+                ST_SPLITTING_REASON_PROCESS_DEPARTING, &registryEntry->ImageName->String);
         }
         else
         {
-            evt = eventing::BuildStopSplittingErrorEvent(registryEntry->ProcessId,
-                &registryEntry->ImageName);
+            evt = eventing::BuildStopSplittingErrorEvent(Context->Eventing, registryEntry->ProcessId,
+                &registryEntry->ImageName->String);
         }
 
         eventing::Emit(Context->Eventing, &evt);
     }
     else if (util::SplittingEnabled(registryEntry->Settings.Split))
     {
-        auto splittingEvent = eventing::BuildStopSplittingEvent(Record->ProcessId, 
-            ST_SPLITTING_REASON_PROCESS_DEPARTING, &registryEntry->ImageName);
+        auto splittingEvent = eventing::BuildStopSplittingEvent(Context->Eventing, registryEntry->ProcessId,
+            ST_SPLITTING_REASON_PROCESS_DEPARTING, &registryEntry->ImageName->String);
 
         eventing::Emit(Context->Eventing, &splittingEvent);
     }
 
-    WdfSpinLockAcquire(processRegistry->Lock);
-
-    const bool deleteSuccessful = procregistry::DeleteEntry(processRegistry->Instance, registryEntry);
-
-    WdfSpinLockRelease(processRegistry->Lock);
+    imagename::Release(registryEntry->ImageName);
 
-    NT_ASSERT(deleteSuccessful);
+    NT_ASSERT(NT_SUCCESS(Item->Status));
 
     //
     // This is unlikely to ever be an issue,
     // but if it was, we'd want to know about it.
     //
 
-    if (!deleteSuccessful)
+    if (!NT_SUCCESS(Item->Status))
     {
         DECLARE_CONST_UNICODE_STRING(errorMessage, L"Failed in call to procregistry::DeleteEntry()");
 
-        auto errorEvent = eventing::BuildErrorMessageEvent(STATUS_UNSUCCESSFUL, &errorMessage);
+        auto errorEvent = eventing::BuildErrorMessageEvent(Context->Eventing, STATUS_UNSUCCESSFUL, &errorMessage);
 
         eventing::Emit(Context->Eventing, &errorEvent);
     }
 }
 
+//
+// Early verdicts are stored in the PID index as the arrival time of the process.
+//
+static_assert(sizeof(void*) >= sizeof(ULONGLONG), "Arrival times don't fit in index values");
+
+//
+// RetractEarlyVerdict()
+//
+// Remove the early verdict that was determined for the arrival at `ArrivalTime`.
+//
+// A verdict for a later process that has been assigned the same PID is left in place.
+// Pass zero for `ArrivalTime` when the process is departing, in which case any verdict
+// for the PID belongs to it.
+//
+void
+RetractEarlyVerdict
+(
+    CONTEXT *Context,
+    HANDLE ProcessId,
+    ULONGLONG ArrivalTime
+)
+{
+    //
+    // Most processes never have an early verdict, so check without taking the lock.
+    //
+    // The verdict for an arrival is published before the arrival is queued, and a PID is
+    // only reused after the departure of its previous process has been notified. So a verdict
+    // that is published for the PID while this runs belongs to a later process, and is kept.
+    //
+
+    LONG attributes;
+
+    if (!pidindex::QueryAttributes(Context->EarlyVerdicts, ProcessId, &attributes, NULL))
+    {
+        return;
+    }
+
+    WdfSpinLockAcquire(Context->EarlyVerdictsLock);
+
+    const auto arrival = (ULONGLONG)(ULONG_PTR)pidindex::Find(Context->EarlyVerdicts, ProcessId);
+
+    if (arrival != 0
+        && (ArrivalTime == 0 || ArrivalTime == arrival))
+    {
+        pidindex::Remove(Context->EarlyVerdicts, ProcessId);
+    }
+
+    WdfSpinLockRelease(Context->EarlyVerdictsLock);
+}
+
+//
+// LookupEarlyVerdict()
+//
+// Same as QueryEarlyVerdict(), without counting the lookup as an answered classification.
+//
+bool
+LookupEarlyVerdict
+(
+    CONTEXT *Context,
+    HANDLE ProcessId,
+    ST_PROCESS_SPLIT_STATUS *Split
+)
+{
+    LONG attributes;
+
+    if (!pidindex::QueryAttributes(Context->EarlyVerdicts, ProcessId, &attributes, NULL))
+    {
+        return false;
+    }
+
+    *Split = (ST_PROCESS_SPLIT_STATUS)attributes;
+
+    return true;
+}
+
+//
+// ResolveEarlyVerdict()
+//
+// Determine whether an arriving process should be split, for the cases that can be
+// resolved quickly and without taking the state lock.
+//
+// This mirrors MatchConfiguration() and InheritSplitting() but only considers exact
+// configuration entries, and a parent that is either registered or has an early verdict
+// of its own.
+//
+// This runs for every process that is created, so everything is skipped if there is no
+// configuration, and lookups don't go through the verdict cache.
+//
+bool
+ResolveEarlyVerdict
+(
+    CONTEXT *Context,
+    const procmon::PROCESS_EVENT_DETAILS *Details,
+    ST_PROCESS_SPLIT_STATUS *Split
+)
+{
+    epoch::READ_SECTION section;
+
+    epoch::Enter(Context->RegisteredImage->Epoch, &section);
+
+    auto registeredImage = (registeredimage::CONTEXT*)
+        ReadPointerAcquire((PVOID volatile *)&Context->RegisteredImage->Instance);
+
+    const auto empty = registeredimage::IsEmpty(registeredImage);
+
+    const auto configured = !empty && registeredimage::HasEntry(registeredImage,
+        (UNICODE_STRING*)&Details->ImageName);
+
+    epoch::Leave(Context->RegisteredImage->Epoch, &section);
+
+    if (configured)
+    {
+        *Split = ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG;
+
+        return true;
+    }
+
+    //
+    // Without a configuration, no process is split.
+    //
+
+    if (empty || Details->ParentProcessId == 0)
+    {
+        return false;
+    }
+
+    ST_PROCESS_SPLIT_STATUS parentSplit;
+
+    const auto parentKnown =
+        procregistry::QuerySplitStatus(Context->ProcessRegistry->Instance, Details->ParentProcessId, &parentSplit)
+        || LookupEarlyVerdict(Context, Details->ParentProcessId, &parentSplit);
+
+    if (!parentKnown || !util::SplittingEnabled(parentSplit))
+    {
+        return false;
+    }
+
+    *Split = ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
+
+    return true;
+}
+
+//
+// ProcessEventInlineHandler()
+//
+// Publish the split status of an arriving process before the process gets to run,
+// so its connections can be classified before it's been added to the process registry.
+//
+// The verdict is retracted when the process is added to the registry or departs,
+// whichever happens first. It's also discarded if the verdicts are cleared while
+// it's being determined.
+//
 void
 NTAPI
-ProcessEventSink
+ProcessEventInlineHandler
 (
-	const procmon::PROCESS_EVENT *Event,
-	void *Context
+    HANDLE ProcessId,
+    const procmon::PROCESS_EVENT_DETAILS *Details,
+    ULONGLONG QueueTime,
+    void *Context
 )
 {
     auto context = (CONTEXT*)Context;
 
-    const auto arriving = (Event->Details != NULL);
+    if (Details == NULL)
+    {
+        RetractEarlyVerdict(context, ProcessId, 0);
+
+        return;
+    }
+
+    //
+    // Read the generation before anything the verdict is based on.
+    // Leaving the engaged state, and updating the configuration or the registry,
+    // are all followed by clearing the verdicts.
+    //
+
+    const auto generation = ReadAcquire(&context->EarlyVerdictsGeneration);
 
-    context->AcquireStateLock(context->CallbackContext);
+    if (!context->EngagedStateActive(context->CallbackContext))
+    {
+        return;
+    }
+
+    ST_PROCESS_SPLIT_STATUS split;
 
-    if (arriving)
+    if (!ResolveEarlyVerdict(context, Details, &split))
     {
-        HandleProcessArriving(context, Event);
+        return;
     }
-    else
+
+    //
+    // The queue time identifies the arrival, and is never zero.
+    //
+
+    NT_ASSERT(QueueTime != 0);
+
+    auto published = false;
+
+    WdfSpinLockAcquire(context->EarlyVerdictsLock);
+
+    if (generation == context->EarlyVerdictsGeneration)
+    {
+        published = NT_SUCCESS(pidindex::Insert(context->EarlyVerdicts, ProcessId,
+            (void*)(ULONG_PTR)QueueTime, split));
+    }
+
+    WdfSpinLockRelease(context->EarlyVerdictsLock);
+
+    if (published)
+    {
+        InterlockedIncrement64(&context->NumEarlyVerdicts);
+    }
+}
+
+//
+// HandleEventBatch()
+//
+// Handle events in the range [First, End), which includes at most MAX_BATCH_EVENTS events.
+//
+// Registry entries for arriving processes are prepared, and matched against the configuration,
+// up front. All events are then applied, in order, under a single acquisition of the state lock
+// and of the process registry lock. Firewall updates and events, which require PASSIVE, are
+// completed once the registry lock has been released.
+//
+// The firewall updates stay under the state lock. IOCTL handlers that hold the lock disable
+// splitting and rewrite the firewall state of registered processes, and a departing process's
+// filters must not be removed concurrently with that.
+//
+void
+HandleEventBatch
+(
+    CONTEXT *Context,
+    const LIST_ENTRY *First,
+    const LIST_ENTRY *End
+)
+{
+    SIZE_T numItems = 0;
+
+    for (auto link = First; link != End; link = link->Flink, ++numItems)
+    {
+        auto event = (const procmon::PROCESS_EVENT*)link;
+        auto item = &Context->BatchItems[numItems];
+
+        item->Event = event;
+        item->Arriving = (event->Details != NULL);
+        item->Entry.ProcessId = event->ProcessId;
+        item->Status = STATUS_SUCCESS;
+        item->ValidCollision = false;
+        item->Configured = false;
+
+        item->Arrival.SplittingReason = ST_SPLITTING_REASON_PROCESS_ARRIVING;
+        item->Arrival.EmitEvent = false;
+        item->Arrival.Imagename = NULL;
+
+        if (item->Arriving)
+        {
+            item->Prepared = NT_SUCCESS(PrepareProcessArriving(Context, event, &item->Entry));
+        }
+    }
+
+    //
+    // Match the configuration before acquiring the state lock, so that a configuration
+    // update that holds the lock doesn't hold up arriving processes for any longer than
+    // necessary. The generation is read first, so a replacement of the configuration that
+    // the matching may have missed is detected once the lock is held.
+    //
+
+    const auto generation = ReadAcquire(&Context->RegisteredImage->Generation);
+
+    for (SIZE_T i = 0; i < numItems; ++i)
+    {
+        auto item = &Context->BatchItems[i];
+
+        if (item->Arriving && item->Prepared)
+        {
+            item->Configured = MatchConfiguration(Context, &item->Entry);
+        }
+    }
+
+    Context->AcquireStateLock(Context->CallbackContext);
+
+    //
+    // State lock is held and is locking out IOCTL handlers.
+    //
+
+    const auto engaged = Context->EngagedStateActive(Context->CallbackContext);
+
+    if (engaged)
+    {
+        //
+        // The configuration is only replaced while the state lock is held,
+        // so it can't change again until the lock is released.
+        //
+
+        const auto rematch = (generation != ReadNoFence(&Context->RegisteredImage->Generation));
+
+        for (SIZE_T i = 0; i < numItems; ++i)
+        {
+            auto item = &Context->BatchItems[i];
+
+            if (!item->Arriving || !item->Prepared)
+            {
+                continue;
+            }
+
+            if (rematch)
+            {
+                item->Configured = MatchConfiguration(Context, &item->Entry);
+            }
+
+            if (item->Configured)
+            {
+                ApplyConfigurationMatch(&item->Entry, &item->Arrival);
+            }
+        }
+    }
+
+    auto processRegistry = Context->ProcessRegistry;
+
+    WdfSpinLockAcquire(processRegistry->Lock);
+
+    for (SIZE_T i = 0; i < numItems; ++i)
+    {
+        auto item = &Context->BatchItems[i];
+
+        if (!item->Arriving)
+        {
+            ApplyProcessDeparting(Context, item);
+        }
+        else if (item->Prepared)
+        {
+            ApplyProcessArriving(Context, engaged, item);
+        }
+    }
+
+    WdfSpinLockRelease(processRegistry->Lock);
+
+    for (SIZE_T i = 0; i < numItems; ++i)
+    {
+        auto item = &Context->BatchItems[i];
+
+        if (!item->Arriving)
+        {
+            CompleteProcessDeparting(Context, item);
+        }
+        else if (item->Prepared)
+        {
+            CompleteProcessArriving(Context, item);
+        }
+    }
+
+    Context->ReleaseStateLock(Context->CallbackContext);
+
+    for (auto link = First; link != End; link = link->Flink)
     {
-        HandleProcessDeparting(context, Event);
+        auto event = (const procmon::PROCESS_EVENT*)link;
+
+        if (event->Details != NULL)
+        {
+            RetractEarlyVerdict(Context, event->ProcessId, event->QueueTime);
+        }
+
+        procbroker::Publish(Context->ProcessEventBroker, event->ProcessId, event->Details != NULL);
     }
+}
+
+void
+NTAPI
+ProcessEventBatchSink
+(
+	const LIST_ENTRY *Events,
+	void *Context
+)
+{
+    auto context = (CONTEXT*)Context;
+
+    //
+    // Split the events into batches that fit in the array of batch items.
+    // This also bounds the time that the locks are held.
+    //
+
+    auto first = Events->Flink;
 
-    context->ReleaseStateLock(context->CallbackContext);
+    while (first != Events)
+    {
+        auto end = first;
+
+        for (SIZE_T numEvents = 0; numEvents < MAX_BATCH_EVENTS && end != Events; ++numEvents)
+        {
+            end = end->Flink;
+        }
 
-    procbroker::Publish(context->ProcessEventBroker, Event->ProcessId, arriving);
+        HandleEventBatch(context, first, end);
+
+        first = end;
+    }
 }
 
 } // anonymous namespace
@@ -522,17 +1032,49 @@ Initialize
 
     RtlZeroMemory(context, sizeof(*context));
 
-    auto status = procmon::Initialize(&context->ProcessMonitor, ProcessEventSink, context);
+    //
+    // Batch items are accessed while holding the registry lock.
+    //
+
+    context->BatchItems = (BATCH_ITEM*)ExAllocatePoolUninitialized
+    (
+        NonPagedPool,
+        MAX_BATCH_EVENTS * sizeof(BATCH_ITEM),
+        ST_POOL_TAG
+    );
+
+    if (NULL == context->BatchItems)
+    {
+        ExFreePoolWithTag(context, ST_POOL_TAG);
+
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    auto status = pidindex::Initialize(&context->EarlyVerdicts);
 
     if (!NT_SUCCESS(status))
     {
-        DbgPrint("procmon::Initialize() failed 0x%X\n", status);
+        DbgPrint("pidindex::Initialize() failed 0x%X\n", status);
 
-        ExFreePoolWithTag(context, ST_POOL_TAG);
+        goto Abort;
+    }
 
-        return status;
+    status = WdfSpinLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &context->EarlyVerdictsLock);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("WdfSpinLockCreate() failed 0x%X\n", status);
+
+        context->EarlyVerdictsLock = NULL;
+
+        goto Abort;
     }
 
+    //
+    // The inline handler is invoked as soon as procmon is initialized,
+    // so everything it uses has to be set up first.
+    //
+
     context->ProcessEventBroker = ProcessEventBroker;
     context->ProcessRegistry = ProcessRegistry;
     context->RegisteredImage = RegisteredImage;
@@ -544,9 +1086,36 @@ Initialize
     context->EngagedStateActive = EngagedStateActive;
     context->CallbackContext = CallbackContext;
 
+    status = procmon::Initialize(&context->ProcessMonitor, ProcessEventBatchSink,
+        ProcessEventInlineHandler, context);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("procmon::Initialize() failed 0x%X\n", status);
+
+        goto Abort;
+    }
+
     *Context = context;
 
     return STATUS_SUCCESS;
+
+Abort:
+
+    if (context->EarlyVerdictsLock != NULL)
+    {
+        WdfObjectDelete(context->EarlyVerdictsLock);
+    }
+
+    if (context->EarlyVerdicts != NULL)
+    {
+        pidindex::TearDown(&context->EarlyVerdicts);
+    }
+
+    ExFreePoolWithTag(context->BatchItems, ST_POOL_TAG);
+    ExFreePoolWithTag(context, ST_POOL_TAG);
+
+    return status;
 }
 
 void
@@ -559,6 +1128,11 @@ TearDown
 
     procmon::TearDown(&context->ProcessMonitor);
 
+    WdfObjectDelete(context->EarlyVerdictsLock);
+
+    pidindex::TearDown(&context->EarlyVerdicts);
+
+    ExFreePoolWithTag(context->BatchItems, ST_POOL_TAG);
     ExFreePoolWithTag(context, ST_POOL_TAG);
 
     *Context = NULL;
@@ -573,4 +1147,56 @@ Activate
     procmon::EnableDispatching(Context->ProcessMonitor);
 }
 
+bool
+QueryEarlyVerdict
+(
+    CONTEXT *Context,
+    HANDLE ProcessId,
+    ST_PROCESS_SPLIT_STATUS *Split
+)
+{
+    if (!LookupEarlyVerdict(Context, ProcessId, Split))
+    {
+        return false;
+    }
+
+    InterlockedIncrement64(&Context->NumEarlyAnswers);
+
+    return true;
+}
+
+void
+ClearEarlyVerdicts
+(
+    CONTEXT *Context
+)
+{
+    WdfSpinLockAcquire(Context->EarlyVerdictsLock);
+
+    InterlockedIncrement(&Context->EarlyVerdictsGeneration);
+
+    if (0 != pidindex::NumEntries(Context->EarlyVerdicts))
+    {
+        pidindex::Reset(Context->EarlyVerdicts);
+    }
+
+    WdfSpinLockRelease(Context->EarlyVerdictsLock);
+}
+
+void
+GetStatistics
+(
+    CONTEXT *Context,
+    ST_PROCESS_EVENT_STATISTICS *Statistics
+)
+{
+    procmon::GetStatistics(Context->ProcessMonitor, Statistics);
+
+    RtlCopyMemory(&Statistics->RegistrationLatency, &Context->RegistrationLatency,
+        sizeof(Statistics->RegistrationLatency));
+
+    Statistics->NumEarlyVerdicts = ReadNoFence64(&Context->NumEarlyVerdicts);
+    Statistics->NumEarlyClassifications = ReadNoFence64(&Context->NumEarlyAnswers);
+}
+
 } // namespace procmgmt
@@ -2,6 +2,7 @@
 
 #include <ntddk.h>
 #include <wdf.h>
+#include "../procmon/procmon.h"
 #include "../procbroker/procbroker.h"
 #include "../containers.h"
 #include "../eventing/eventing.h"
@@ -46,4 +47,53 @@ Activate
 	CONTEXT *Context
 );
 
+//
+// QueryEarlyVerdict()
+//
+// IRQL <= DISPATCH.
+//
+// Look up the split status of an arriving process that is not yet in the process registry.
+//
+// The split status is only available if it could be determined as the process was created,
+// and only until the process has been added to the registry.
+//
+// Each lookup that finds a verdict is counted as a classification that was answered early.
+//
+bool
+QueryEarlyVerdict
+(
+	CONTEXT *Context,
+	HANDLE ProcessId,
+	ST_PROCESS_SPLIT_STATUS *Split
+);
+
+//
+// ClearEarlyVerdicts()
+//
+// IRQL <= DISPATCH.
+//
+// Discard all early verdicts, including any that are being determined concurrently.
+//
+// Call this whenever a verdict that has already been determined could be invalidated:
+// after publishing a configuration, after updating the split status of processes in the
+// registry, and when leaving the engaged state.
+//
+void
+ClearEarlyVerdicts
+(
+	CONTEXT *Context
+);
+
+//
+// GetStatistics()
+//
+// IRQL <= DISPATCH.
+//
+void
+GetStatistics
+(
+	CONTEXT *Context,
+	ST_PROCESS_EVENT_STATISTICS *Statistics
+);
+
 } // namespace procmgmt
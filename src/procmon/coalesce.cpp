@@ -0,0 +1,130 @@
+#include "coalesce.h"
+
+namespace procmon::coalesce
+{
+
+namespace
+{
+
+//
+// FindSlot()
+//
+// Find the slot for a PID in the current batch.
+// Optionally claim a free slot if there isn't one.
+//
+// Returns NULL if the PID has no slot and none could be claimed.
+//
+SLOT*
+FindSlot
+(
+    CONTEXT *Context,
+    HANDLE ProcessId,
+    bool Claim
+)
+{
+    //
+    // PIDs are multiples of four.
+    //
+
+    const auto hash = (((ULONG64)ProcessId >> 2) * 0x9e3779b97f4a7c15) >> 56;
+
+    for (SIZE_T probe = 0; probe < NUM_SLOTS; ++probe)
+    {
+        auto slot = &Context->Slots[(hash + probe) % NUM_SLOTS];
+
+        if (slot->Generation != Context->Generation)
+        {
+            if (!Claim)
+            {
+                return NULL;
+            }
+
+            slot->ProcessId = ProcessId;
+            slot->Arrival = NULL;
+            slot->Generation = Context->Generation;
+            slot->HasChildren = false;
+
+            return slot;
+        }
+
+        if (slot->ProcessId == ProcessId)
+        {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+} // anonymous namespace
+
+SIZE_T
+CoalesceEvents
+(
+    CONTEXT *Context,
+    LIST_ENTRY *Queue,
+    LIST_ENTRY *Cancelled
+)
+{
+    if (++Context->Generation == 0)
+    {
+        RtlZeroMemory(Context->Slots, sizeof(Context->Slots));
+
+        Context->Generation = 1;
+    }
+
+    SIZE_T numCoalesced = 0;
+
+    for (auto link = Queue->Flink; link != Queue; link = link->Flink)
+    {
+        auto event = (PROCESS_EVENT*)link;
+
+        if (event->Details != NULL)
+        {
+            auto parent = FindSlot(Context, event->Details->ParentProcessId, false);
+
+            if (parent != NULL && parent->Arrival != NULL)
+            {
+                parent->HasChildren = true;
+            }
+
+            //
+            // If there are no free slots the process is delivered as usual.
+            //
+
+            auto slot = FindSlot(Context, event->ProcessId, true);
+
+            if (slot != NULL)
+            {
+                slot->Arrival = event;
+                slot->HasChildren = false;
+            }
+
+            continue;
+        }
+
+        auto slot = FindSlot(Context, event->ProcessId, false);
+
+        if (slot == NULL || slot->Arrival == NULL)
+        {
+            continue;
+        }
+
+        if (!slot->HasChildren)
+        {
+            RemoveEntryList(&slot->Arrival->ListEntry);
+
+            InsertTailList(Cancelled, &slot->Arrival->ListEntry);
+
+            event->Coalesced = true;
+
+            ++numCoalesced;
+        }
+
+        slot->Arrival = NULL;
+    }
+
+    return numCoalesced;
+}
+
+} // namespace procmon::coalesce
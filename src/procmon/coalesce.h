@@ -0,0 +1,69 @@
+#pragma once
+
+#include <wdm.h>
+#include "procmon.h"
+
+//
+// Cancels out processes that arrive and depart within the same batch of process events.
+//
+// Used by the procmon worker thread, before a batch is delivered to the client.
+//
+
+namespace procmon::coalesce
+{
+
+//
+// Tracks the most recent arriving process for a PID within a batch.
+// Slots from earlier batches are identified by their generation.
+//
+struct SLOT
+{
+	HANDLE ProcessId;
+
+	// Arriving event that can still be cancelled.
+	PROCESS_EVENT *Arrival;
+
+	ULONG Generation;
+
+	// Another process in the batch has named this process as its parent.
+	bool HasChildren;
+};
+
+const SIZE_T NUM_SLOTS = 256;
+
+//
+// Zero-initialize before first use.
+//
+struct CONTEXT
+{
+	SLOT Slots[NUM_SLOTS];
+	ULONG Generation;
+};
+
+//
+// CoalesceEvents()
+//
+// IRQL <= DISPATCH.
+//
+// Finds processes in `Queue` that arrive and depart within the queue.
+//
+// The arriving event is moved to `Cancelled` and the departing event is kept, but marked
+// as coalesced. The client still has to be told about the departure, since the process may
+// have been picked up by other means, e.g. when the process registry was populated.
+//
+// A process is not coalesced if any process in the queue was created while it was
+// alive and named it as its parent. The client has to see the parent to update the child.
+//
+// If more than NUM_SLOTS processes arrive in the queue, some are not considered.
+//
+// Returns the number of coalesced pairs.
+//
+SIZE_T
+CoalesceEvents
+(
+	CONTEXT *Context,
+	LIST_ENTRY *Queue,
+	LIST_ENTRY *Cancelled
+);
+
+} // namespace procmon::coalesce
@@ -3,6 +3,8 @@
 #include <wdm.h>
 #include <wdf.h>
 #include "procmon.h"
+#include "coalesce.h"
+#include "../containers/ring.h"
 
 namespace procmon
 {
@@ -12,12 +14,27 @@ struct CONTEXT
 	// The thread that services queued process events.
 	PETHREAD DispatchWorker;
 
-	// Lock to coordinate work on the queue.
+	//
+	// Incoming process events.
+	// Queued without taking a lock or allocating memory.
+	//
+	ring::CONTEXT *Ring;
+
+	// Lock to coordinate work on the overflow queue.
 	WDFWAITLOCK QueueLock;
 
-	// Queue of incoming process events.
+	//
+	// Queue of incoming process events that did not fit in the ring.
+	// Records on this queue are allocated from the pool.
+	//
 	LIST_ENTRY EventQueue;
 
+	//
+	// Set when a record is added to the overflow queue, and cleared when the worker thread
+	// collects the queue. Events are diverted to the overflow queue while this is set.
+	//
+	volatile LONG Overflowing;
+
 	// Event that signals worker should exit.
 	KEVENT ExitWorker;
 
@@ -30,18 +47,41 @@ struct CONTEXT
 	// This variable controls whether an event should only be queued or if the queue should be
 	// signalled as well.
 	//
-	bool DispatchingEnabled;
+	volatile bool DispatchingEnabled;
 
 	//
-	// Client callback function that receives process events.
+	// Client callback function that receives batches of process events.
 	// Single client only in this layer.
 	//
-	PROCESS_EVENT_SINK ProcessEventSink;
+	PROCESS_EVENT_BATCH_SINK ProcessEventSink;
 
 	//
-	// Context to pass along when making the callback.
+	// Optional client callback function that is invoked before events are queued.
+	//
+	PROCESS_EVENT_INLINE_HANDLER InlineHandler;
+
+	//
+	// Context to pass along when making the callbacks.
 	//
 	void *SinkContext;
+
+	//
+	// Used by the worker thread to find processes that arrive and depart within a batch.
+	//
+	coalesce::CONTEXT Coalescing;
+
+	volatile LONG64 NumCoalescedPairs;
+
+	volatile LONG64 NumOverflowed;
+	volatile LONG64 NumSpilled;
+	volatile LONG64 NumDropped;
+
+	//
+	// Only updated by the worker thread.
+	//
+	ST_LATENCY_HISTOGRAM QueueLatency;
+	ULONGLONG RingDepthHighWater;
+	ULONGLONG OverflowDepthHighWater;
 };
 
 } // namespace procmon
@@ -2,6 +2,7 @@
 #include "procmon.h"
 #include "context.h"
 #include "../util.h"
+#include "../histogram.h"
 #include "../defs/types.h"
 
 #include "../trace.h"
@@ -24,6 +25,140 @@ namespace
 //
 CONTEXT *g_Context = NULL;
 
+//
+// Layout of a queued event.
+//
+// Records are normally kept in the ring. The image name is stored inline if it fits,
+// and is otherwise kept in the buffer that was allocated when querying the name.
+//
+// If the ring is full, records are allocated from the pool, and the image name
+// is never stored inline.
+//
+struct EVENT_RECORD
+{
+    PROCESS_EVENT Event;
+
+    PROCESS_EVENT_DETAILS Details;
+
+    // Allocation that holds the image name, if it's not stored inline.
+    UNICODE_STRING *SpilledName;
+
+    WCHAR InlineName[ANYSIZE_ARRAY];
+};
+
+//
+// Size of the slots in the ring.
+// This fits an arriving process with an image path of up to 200 characters.
+//
+const SIZE_T RING_SLOT_SIZE = FIELD_OFFSET(EVENT_RECORD, InlineName) + (200 * sizeof(WCHAR));
+
+const SIZE_T RING_NUM_SLOTS = 256;
+
+//
+// AllocateRecord()
+//
+// Allocate a record from the ring, unless events are being diverted to the overflow queue.
+//
+// `Overflow` is set if the record has to be queued on the overflow queue.
+//
+EVENT_RECORD*
+AllocateRecord
+(
+    CONTEXT *Context,
+    bool *Overflow
+)
+{
+    if (0 == ReadAcquire(&Context->Overflowing))
+    {
+        auto record = (EVENT_RECORD*)ring::Reserve(Context->Ring);
+
+        if (record != NULL)
+        {
+            *Overflow = false;
+
+            return record;
+        }
+    }
+
+    *Overflow = true;
+
+    return (EVENT_RECORD*)ExAllocatePoolUninitialized(PagedPool,
+        FIELD_OFFSET(EVENT_RECORD, InlineName), ST_POOL_TAG);
+}
+
+void
+FreeRecord
+(
+    CONTEXT *Context,
+    LIST_ENTRY *Record
+)
+{
+    auto record = (EVENT_RECORD*)Record;
+
+    if (record->SpilledName != NULL)
+    {
+        ExFreePoolWithTag(record->SpilledName, ST_POOL_TAG);
+    }
+
+    if (ring::Contains(Context->Ring, record))
+    {
+        ring::Release(Context->Ring, record);
+
+        return;
+    }
+
+    ExFreePoolWithTag(record, ST_POOL_TAG);
+}
+
+//
+// QueueRecord()
+//
+// Make a record available to the worker thread.
+//
+void
+QueueRecord
+(
+    CONTEXT *Context,
+    EVENT_RECORD *Record,
+    bool Overflow
+)
+{
+    if (Overflow)
+    {
+        //
+        // Once a record has been diverted, all records are diverted until the worker has
+        // collected the overflow queue. This ensures records are delivered in order.
+        //
+
+        WdfWaitLockAcquire(Context->QueueLock, NULL);
+
+        InsertTailList(&Context->EventQueue, &Record->Event.ListEntry);
+
+        InterlockedExchange(&Context->Overflowing, 1);
+
+        WdfWaitLockRelease(Context->QueueLock);
+
+        InterlockedIncrement64(&Context->NumOverflowed);
+    }
+    else
+    {
+        ring::Publish(Context->Ring, Record);
+    }
+
+    //
+    // Pairs with the barrier in the worker thread, after it clears the event.
+    // Either the worker sees the record, or the event is seen to be cleared.
+    //
+
+    MemoryBarrier();
+
+    if (Context->DispatchingEnabled
+        && 0 == KeReadStateEvent(&Context->WakeUpWorker))
+    {
+        KeSetEvent(&Context->WakeUpWorker, 0, FALSE);
+    }
+}
+
 void
 SystemProcessEvent
 (
@@ -37,16 +172,17 @@ SystemProcessEvent
     // Build a self-contained event record and queue it to a dedicated thread.
     //
 
-    PROCESS_EVENT *record = NULL;
+    const auto queueTime = KeQueryInterruptTimePrecise(NULL);
+
+    EVENT_RECORD *record = NULL;
+
+    bool overflow;
 
     if (CreateInfo != NULL)
     {
         //
         // Process is arriving.
         //
-        // First, get the filename so we can determine the size of the final
-        // buffer that needs to be allocated.
-        //
 
         UNICODE_STRING *imageName;
 
@@ -58,15 +194,19 @@ SystemProcessEvent
             DbgPrint("  Could not determine image filename, status: 0x%X\n", status);
             DbgPrint("  PID of arriving process %p\n", ProcessId);
 
+            InterlockedIncrement64(&g_Context->NumDropped);
+
             return;
         }
 
-        auto offsetDetails = util::RoundToMultiple(sizeof(PROCESS_EVENT), TYPE_ALIGNMENT(PROCESS_EVENT_DETAILS));
-        auto offsetStringBuffer = util::RoundToMultiple(offsetDetails + sizeof(PROCESS_EVENT_DETAILS), TYPE_ALIGNMENT(WCHAR));
+        if (g_Context->InlineHandler != NULL)
+        {
+            const PROCESS_EVENT_DETAILS details = { CreateInfo->ParentProcessId, *imageName };
 
-        auto allocationSize = offsetStringBuffer + imageName->Length;
+            g_Context->InlineHandler(ProcessId, &details, queueTime, g_Context->SinkContext);
+        }
 
-        record = (PROCESS_EVENT *)ExAllocatePoolUninitialized(PagedPool, allocationSize, ST_POOL_TAG);
+        record = AllocateRecord(g_Context, &overflow);
 
         if (record == NULL)
         {
@@ -77,23 +217,44 @@ SystemProcessEvent
 
             ExFreePoolWithTag(imageName, ST_POOL_TAG);
 
+            InterlockedIncrement64(&g_Context->NumDropped);
+
             return;
         }
 
-        auto details = (PROCESS_EVENT_DETAILS*)(((CHAR*)record) + offsetDetails);
-        auto stringBuffer = (WCHAR*)(((CHAR*)record) + offsetStringBuffer);
+        InitializeListHead(&record->Event.ListEntry);
+        record->Event.ProcessId = ProcessId;
+        record->Event.Details = &record->Details;
+        record->Event.Coalesced = false;
+        record->Event.QueueTime = queueTime;
+
+        record->Details.ParentProcessId = CreateInfo->ParentProcessId;
+        record->Details.ImageName.Length = imageName->Length;
+        record->Details.ImageName.MaximumLength = imageName->Length;
+
+        if (!overflow
+            && imageName->Length <= RING_SLOT_SIZE - FIELD_OFFSET(EVENT_RECORD, InlineName))
+        {
+            record->Details.ImageName.Buffer = record->InlineName;
+            record->SpilledName = NULL;
 
-        InitializeListHead(&record->ListEntry);
-        record->ProcessId = ProcessId;
-        record->Details = details;
+            RtlCopyMemory(record->InlineName, imageName->Buffer, imageName->Length);
+            ExFreePoolWithTag(imageName, ST_POOL_TAG);
+        }
+        else
+        {
+            //
+            // Keep the name where it is rather than copying it.
+            //
 
-        details->ParentProcessId = CreateInfo->ParentProcessId;
-        details->ImageName.Length = imageName->Length;
-        details->ImageName.MaximumLength = imageName->Length;
-        details->ImageName.Buffer = stringBuffer;
+            record->Details.ImageName.Buffer = imageName->Buffer;
+            record->SpilledName = imageName;
 
-        RtlCopyMemory(stringBuffer, imageName->Buffer, imageName->Length);
-        ExFreePoolWithTag(imageName, ST_POOL_TAG);
+            if (!overflow)
+            {
+                InterlockedIncrement64(&g_Context->NumSpilled);
+            }
+        }
     }
     else
     {
@@ -101,7 +262,12 @@ SystemProcessEvent
         // Process is departing.
         //
 
-        record = (PROCESS_EVENT *)ExAllocatePoolUninitialized(PagedPool, sizeof(PROCESS_EVENT), ST_POOL_TAG);
+        if (g_Context->InlineHandler != NULL)
+        {
+            g_Context->InlineHandler(ProcessId, NULL, queueTime, g_Context->SinkContext);
+        }
+
+        record = AllocateRecord(g_Context, &overflow);
 
         if (record == NULL)
         {
@@ -109,28 +275,152 @@ SystemProcessEvent
             DbgPrint("  Failed to allocate memory\n");
             DbgPrint("  PID of departing process %p\n", ProcessId);
 
+            InterlockedIncrement64(&g_Context->NumDropped);
+
             return;
         }
 
-        InitializeListHead(&record->ListEntry);
-        record->ProcessId = ProcessId;
-        record->Details = NULL;
+        InitializeListHead(&record->Event.ListEntry);
+        record->Event.ProcessId = ProcessId;
+        record->Event.Details = NULL;
+        record->Event.Coalesced = false;
+        record->Event.QueueTime = queueTime;
+
+        record->SpilledName = NULL;
     }
 
     //
     // Queue to worker thread.
     //
 
-    WdfWaitLockAcquire(g_Context->QueueLock, NULL);
+    QueueRecord(g_Context, record, overflow);
+}
+
+//
+// DrainRing()
+//
+// Move all published records in the ring onto the end of the queue.
+// Returns the number of records that were moved.
+//
+SIZE_T
+DrainRing
+(
+    CONTEXT *Context,
+    LIST_ENTRY *Queue
+)
+{
+    SIZE_T numRecords = 0;
+
+    for (auto record = (EVENT_RECORD*)ring::Pop(Context->Ring);
+        record != NULL;
+        record = (EVENT_RECORD*)ring::Pop(Context->Ring))
+    {
+        InsertTailList(Queue, &record->Event.ListEntry);
+
+        ++numRecords;
+    }
+
+    return numRecords;
+}
+
+//
+// CollectRecords()
+//
+// Collect all queued records, in the order they were queued.
+//
+// Records on the overflow queue were all queued after the records that are in the ring
+// at the time the overflow queue is collected. Producers are diverted away from the ring
+// until the overflow queue has been collected, so nothing can be queued in between.
+//
+// A producer that reserved a slot before records were diverted may not yet have published it.
+// The overflow queue is then left for later, since the ring has to be drained first.
+// The producer signals the worker when it publishes the slot.
+//
+void
+CollectRecords
+(
+    CONTEXT *Context,
+    LIST_ENTRY *Queue
+)
+{
+    InitializeListHead(Queue);
 
-    InsertTailList(&g_Context->EventQueue, &record->ListEntry);
+    auto numRing = DrainRing(Context, Queue);
 
-    if (g_Context->DispatchingEnabled)
+    SIZE_T numOverflow = 0;
+
+    if (0 != ReadAcquire(&Context->Overflowing))
     {
-        KeSetEvent(&g_Context->WakeUpWorker, 0, FALSE);
+        WdfWaitLockAcquire(Context->QueueLock, NULL);
+
+        numRing += DrainRing(Context, Queue);
+
+        if (0 == ring::Depth(Context->Ring))
+        {
+            while (!IsListEmpty(&Context->EventQueue))
+            {
+                InsertTailList(Queue, RemoveHeadList(&Context->EventQueue));
+
+                ++numOverflow;
+            }
+
+            InterlockedExchange(&Context->Overflowing, 0);
+        }
+
+        WdfWaitLockRelease(Context->QueueLock);
     }
 
-    WdfWaitLockRelease(g_Context->QueueLock);
+    Context->RingDepthHighWater = max(Context->RingDepthHighWater, numRing);
+    Context->OverflowDepthHighWater = max(Context->OverflowDepthHighWater, numOverflow);
+}
+
+//
+// StampDispatchTime()
+//
+// Record how long each event was queued.
+//
+void
+StampDispatchTime
+(
+    CONTEXT *Context,
+    LIST_ENTRY *Queue
+)
+{
+    const auto dispatchTime = KeQueryInterruptTimePrecise(NULL);
+
+    for (auto link = Queue->Flink; link != Queue; link = link->Flink)
+    {
+        auto event = (PROCESS_EVENT*)link;
+
+        event->DispatchTime = dispatchTime;
+
+        histogram::RecordInterval(&Context->QueueLatency, event->QueueTime, dispatchTime);
+    }
+}
+
+void
+FreeQueuedRecords
+(
+    CONTEXT *Context
+)
+{
+    LIST_ENTRY queue;
+
+    InitializeListHead(&queue);
+
+    DrainRing(Context, &queue);
+
+    LIST_ENTRY *record;
+
+    while ((record = RemoveHeadList(&queue)) != &queue)
+    {
+        FreeRecord(Context, record);
+    }
+
+    while ((record = RemoveHeadList(&Context->EventQueue)) != &Context->EventQueue)
+    {
+        FreeRecord(Context, record);
+    }
 }
 
 void
@@ -145,41 +435,60 @@ DispatchWorker
     {
         KeWaitForSingleObject(&context->WakeUpWorker, Executive, KernelMode, FALSE, NULL);
 
-        WdfWaitLockAcquire(context->QueueLock, NULL);
-
         if (0 != KeReadStateEvent(&context->ExitWorker))
         {
-            WdfWaitLockRelease(context->QueueLock);
-
             PsTerminateSystemThread(STATUS_SUCCESS);
 
             return;
         }
 
+        KeClearEvent(&context->WakeUpWorker);
+
         //
-        // Reparent the queue in order to release the lock sooner.
+        // Pairs with the barrier in QueueRecord().
         //
 
-        LIST_ENTRY queue;
+        MemoryBarrier();
 
-        util::ReparentList(&queue, &context->EventQueue);
+        LIST_ENTRY queue;
 
-        KeClearEvent(&context->WakeUpWorker);
+        CollectRecords(context, &queue);
 
-        WdfWaitLockRelease(context->QueueLock);
+        if (IsListEmpty(&queue))
+        {
+            continue;
+        }
 
         //
         // There are one or more records queued.
-        // Process all available records.
+        // Deliver all available records at once.
         //
 
+        StampDispatchTime(context, &queue);
+
+        LIST_ENTRY cancelled;
+
+        InitializeListHead(&cancelled);
+
+        const auto numCoalesced = coalesce::CoalesceEvents(&context->Coalescing, &queue, &cancelled);
+
+        if (numCoalesced != 0)
+        {
+            InterlockedAdd64(&context->NumCoalescedPairs, numCoalesced);
+        }
+
         LIST_ENTRY *record;
 
-        while ((record = RemoveHeadList(&queue)) != &queue)
+        while ((record = RemoveHeadList(&cancelled)) != &cancelled)
         {
-            context->ProcessEventSink((PROCESS_EVENT*)record, context->SinkContext);
+            FreeRecord(context, record);
+        }
 
-            ExFreePoolWithTag(record, ST_POOL_TAG);
+        context->ProcessEventSink(&queue, context->SinkContext);
+
+        while ((record = RemoveHeadList(&queue)) != &queue)
+        {
+            FreeRecord(context, record);
         }
     }
 }
@@ -190,7 +499,8 @@ NTSTATUS
 Initialize
 (
     CONTEXT **Context,
-	PROCESS_EVENT_SINK ProcessEventSink,
+	PROCESS_EVENT_BATCH_SINK ProcessEventSink,
+	PROCESS_EVENT_INLINE_HANDLER InlineHandler,
 	void *SinkContext
 )
 {
@@ -208,6 +518,7 @@ Initialize
     RtlZeroMemory(context, sizeof(*context));
 
 	context->ProcessEventSink = ProcessEventSink;
+	context->InlineHandler = InlineHandler;
 	context->SinkContext = SinkContext;
 
     InitializeListHead(&context->EventQueue);
@@ -226,6 +537,15 @@ Initialize
         goto Abort;
     }
 
+    status = ring::Initialize(&context->Ring, RING_SLOT_SIZE, RING_NUM_SLOTS);
+
+    if (!NT_SUCCESS(status))
+    {
+        DbgPrint("ring::Initialize() failed 0x%X\n", status);
+
+        goto Abort;
+    }
+
     g_Context = context;
 
     //
@@ -310,14 +630,11 @@ Abort:
         // Drain event queue to avoid leaking events.
         //
 
-        LIST_ENTRY *record;
-
-        while ((record = RemoveHeadList(&context->EventQueue)) != &context->EventQueue)
-        {
-            ExFreePoolWithTag(record, ST_POOL_TAG);
-        }
+        FreeQueuedRecords(context);
     }
 
+    ring::TearDown(&context->Ring);
+
     if (context->QueueLock != NULL)
     {
         WdfObjectDelete(context->QueueLock);
@@ -363,17 +680,14 @@ TearDown
     // Drain event queue to avoid leaking events.
     //
 
-    LIST_ENTRY *record;
-
-    while ((record = RemoveHeadList(&context->EventQueue)) != &context->EventQueue)
-    {
-        ExFreePoolWithTag(record, ST_POOL_TAG);
-    }
+    FreeQueuedRecords(context);
 
     //
     // Release remaining resources.
     //
 
+    ring::TearDown(&context->Ring);
+
     WdfObjectDelete(context->QueueLock);
 
     ExFreePoolWithTag(context, ST_POOL_TAG);
@@ -391,12 +705,35 @@ EnableDispatching
 
 	Context->DispatchingEnabled = true;
 
-    if (!IsListEmpty(&Context->EventQueue))
-    {
-        KeSetEvent(&Context->WakeUpWorker, 0, FALSE);
-    }
-
     WdfWaitLockRelease(Context->QueueLock);
+
+    //
+    // Records may have been queued in the ring without signalling the worker.
+    //
+
+    KeSetEvent(&Context->WakeUpWorker, 0, FALSE);
+}
+
+void
+GetStatistics
+(
+	CONTEXT *Context,
+	ST_PROCESS_EVENT_STATISTICS *Statistics
+)
+{
+	//
+	// Values that are updated by the worker thread may be slightly inconsistent.
+	//
+
+	RtlCopyMemory(&Statistics->QueueLatency, &Context->QueueLatency, sizeof(Statistics->QueueLatency));
+
+	Statistics->RingDepthHighWater = Context->RingDepthHighWater;
+	Statistics->OverflowDepthHighWater = Context->OverflowDepthHighWater;
+
+	Statistics->NumCoalescedPairs = ReadNoFence64(&Context->NumCoalescedPairs);
+	Statistics->NumOverflowed = ReadNoFence64(&Context->NumOverflowed);
+	Statistics->NumSpilled = ReadNoFence64(&Context->NumSpilled);
+	Statistics->NumDropped = ReadNoFence64(&Context->NumDropped);
 }
 
 }
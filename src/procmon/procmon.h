@@ -1,6 +1,7 @@
 #pragma once
 
 #include <wdm.h>
+#include "../defs/statistics.h"
 
 namespace procmon
 {
@@ -25,10 +26,46 @@ typedef struct tag_PROCESS_EVENT
 	// If a process is departing, this field is set to NULL.
 	//
 	PROCESS_EVENT_DETAILS *Details;
+
+	//
+	// Set on a departing process if the event for its arrival was queued in the same batch.
+	// The arrival has been cancelled and was not delivered.
+	//
+	bool Coalesced;
+
+	// Interrupt time when the system notified the driver.
+	ULONGLONG QueueTime;
+
+	// Interrupt time when the event was picked up by the worker thread.
+	ULONGLONG DispatchTime;
 }
 PROCESS_EVENT;
 
-typedef void (NTAPI *PROCESS_EVENT_SINK)(const PROCESS_EVENT *Event, void *Context);
+//
+// Receives all events that were queued since the previous call, in the order they occurred.
+// The events are linked through `PROCESS_EVENT::ListEntry`.
+//
+// The events are owned by procmon and are released when the sink returns.
+//
+typedef void (NTAPI *PROCESS_EVENT_BATCH_SINK)(const LIST_ENTRY *Events, void *Context);
+
+//
+// Receives each event synchronously, in the context of the system notification,
+// before the event is queued. This is at PASSIVE, on the thread that is creating
+// or terminating the process.
+//
+// `Details` is NULL if the process is departing.
+//
+// `QueueTime` is the same as `PROCESS_EVENT::QueueTime` of the event that is about to be
+// queued. It tells apart arrivals of different processes that are assigned the same PID.
+//
+typedef void (NTAPI *PROCESS_EVENT_INLINE_HANDLER)
+(
+	HANDLE ProcessId,
+	const PROCESS_EVENT_DETAILS *Details,
+	ULONGLONG QueueTime,
+	void *Context
+);
 
 struct CONTEXT;
 
@@ -36,7 +73,8 @@ NTSTATUS
 Initialize
 (
 	CONTEXT **Context,
-	PROCESS_EVENT_SINK ProcessEventSink,
+	PROCESS_EVENT_BATCH_SINK ProcessEventSink,
+	PROCESS_EVENT_INLINE_HANDLER InlineHandler,
 	void *SinkContext
 );
 
@@ -52,4 +90,18 @@ EnableDispatching
 	CONTEXT *Context
 );
 
+//
+// GetStatistics()
+//
+// IRQL <= DISPATCH.
+//
+// Fills in everything except the registration latency, which is tracked by the client.
+//
+void
+GetStatistics
+(
+	CONTEXT *Context,
+	ST_PROCESS_EVENT_STATISTICS *Statistics
+);
+
 } // namespace procmon
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <wdm.h>
+
+//
+// Sequence lock.
+//
+// Readers don't write to shared memory and never block writers.
+// A reader samples the sequence number before and after reading the protected data,
+// and has to retry if a write was in progress or completed in between.
+//
+// Writers must be serialized by other means.
+//
+// Write sections are executed at DISPATCH. Otherwise a reader running at DISPATCH on the
+// same processor as a preempted writer would spin forever.
+//
+// This also means the protected data has to be backed by non-paged memory.
+//
+
+namespace seqlock
+{
+
+struct SEQLOCK
+{
+	volatile LONG Sequence;
+};
+
+inline
+void
+Initialize
+(
+	SEQLOCK *Lock
+)
+{
+	Lock->Sequence = 0;
+}
+
+//
+// BeginWrite()
+//
+// IRQL <= DISPATCH.
+//
+// Returns the IRQL that should be passed to EndWrite().
+//
+inline
+KIRQL
+BeginWrite
+(
+	SEQLOCK *Lock
+)
+{
+	KIRQL oldIrql;
+
+	KeRaiseIrql(DISPATCH_LEVEL, &oldIrql);
+
+	NT_ASSERT((Lock->Sequence & 1) == 0);
+
+	WriteNoFence(&Lock->Sequence, Lock->Sequence + 1);
+
+	//
+	// The odd sequence number has to be visible before any updates to the data.
+	//
+
+	KeMemoryBarrier();
+
+	return oldIrql;
+}
+
+inline
+void
+EndWrite
+(
+	SEQLOCK *Lock,
+	KIRQL OldIrql
+)
+{
+	WriteRelease(&Lock->Sequence, Lock->Sequence + 1);
+
+	KeLowerIrql(OldIrql);
+}
+
+//
+// BeginRead()
+//
+// IRQL <= DISPATCH.
+//
+// Returns the sequence number that should be passed to RetryRead().
+//
+inline
+LONG
+BeginRead
+(
+	const SEQLOCK *Lock
+)
+{
+	for (;;)
+	{
+		const auto sequence = ReadAcquire(&Lock->Sequence);
+
+		if ((sequence & 1) == 0)
+		{
+			return sequence;
+		}
+
+		YieldProcessor();
+	}
+}
+
+//
+// RetryRead()
+//
+// Returns true if the data read since BeginRead() may be inconsistent.
+//
+inline
+bool
+RetryRead
+(
+	const SEQLOCK *Lock,
+	LONG Sequence
+)
+{
+	//
+	// Reads of the data must complete before the sequence number is sampled again.
+	// Loads are not reordered with other loads on x64, so a compiler barrier is sufficient there.
+	//
+
+#if defined(_AMD64_)
+	KeMemoryBarrierWithoutFence();
+#else
+	KeMemoryBarrier();
+#endif
+
+	return ReadNoFence(&Lock->Sequence) != Sequence;
+}
+
+} // namespace seqlock
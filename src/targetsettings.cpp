@@ -0,0 +1,259 @@
+#include "targetsettings.h"
+#include "util.h"
+
+namespace targetsettings
+{
+
+namespace
+{
+
+//
+// PropagateTargetSplitSetting()
+//
+// Same as Evaluate(), and also split the entry if its parent is being split.
+//
+// The parent must be visited first. Its target setting then already accounts for
+// all of its ancestors, so there's no need to look further up the tree.
+//
+bool
+NTAPI
+PropagateTargetSplitSetting
+(
+	procregistry::PROCESS_REGISTRY_ENTRY *Entry,
+	void *Context
+)
+{
+	Evaluate((registeredimage::CONTEXT*)Context, Entry);
+
+	if (!util::SplittingEnabled(Entry->TargetSettings.Split)
+		&& Entry->ParentEntry != NULL
+		&& util::SplittingEnabled(Entry->ParentEntry->TargetSettings.Split))
+	{
+		Entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
+	}
+
+	return true;
+}
+
+struct COLLECT_CONTEXT
+{
+	procregistry::CONTEXT *Registry;
+
+	// Configuration before and after the update.
+	registeredimage::CONTEXT *OldConfiguration;
+	registeredimage::CONTEXT *Configuration;
+
+	// Entries being added or removed.
+	registeredimage::CONTEXT *Entries;
+
+	AFFECTED_ROOTS *Roots;
+};
+
+//
+// IsAffectedByDelta()
+//
+// Determine whether the entries being added or removed change whether
+// the image is matched by the configuration.
+//
+bool
+IsAffectedByDelta
+(
+	COLLECT_CONTEXT *Context,
+	procregistry::PROCESS_REGISTRY_ENTRY *Entry
+)
+{
+	if (!registeredimage::HasMatchingEntry(Context->Entries, Entry->ImageName))
+	{
+		return false;
+	}
+
+	return registeredimage::HasMatchingEntry(Context->OldConfiguration, Entry->ImageName)
+		!= registeredimage::HasMatchingEntry(Context->Configuration, Entry->ImageName);
+}
+
+bool
+NTAPI
+CollectAffectedRoot
+(
+	procregistry::PROCESS_REGISTRY_ENTRY *Entry,
+	void *Context
+)
+{
+	auto ctx = (COLLECT_CONTEXT*)Context;
+
+	if (!IsAffectedByDelta(ctx, Entry))
+	{
+		return true;
+	}
+
+	for (auto ancestor = Entry->ParentEntry; ancestor != NULL; ancestor = ancestor->ParentEntry)
+	{
+		if (IsAffectedByDelta(ctx, ancestor))
+		{
+			return true;
+		}
+	}
+
+	auto roots = ctx->Roots;
+
+	if (roots->NumRoots == roots->MaxRoots)
+	{
+		const auto newMaxRoots = (roots->MaxRoots == 0) ? 16 : (roots->MaxRoots * 2);
+
+		auto newRoots = (procregistry::PROCESS_REGISTRY_ENTRY**)ExAllocatePoolUninitialized(NonPagedPool,
+			newMaxRoots * sizeof(procregistry::PROCESS_REGISTRY_ENTRY*), ST_POOL_TAG);
+
+		if (newRoots == NULL)
+		{
+			return false;
+		}
+
+		if (roots->Roots != NULL)
+		{
+			RtlCopyMemory(newRoots, roots->Roots, roots->NumRoots * sizeof(procregistry::PROCESS_REGISTRY_ENTRY*));
+
+			ExFreePoolWithTag(roots->Roots, ST_POOL_TAG);
+		}
+
+		roots->Roots = newRoots;
+		roots->MaxRoots = newMaxRoots;
+	}
+
+	roots->Roots[roots->NumRoots++] = Entry;
+
+	return true;
+}
+
+//
+// CollectAffectedImage()
+//
+// Visit the processes running an image that is matched by the changed entries.
+// Images that are not running are looked up in constant time.
+//
+bool
+NTAPI
+CollectAffectedImage
+(
+	const imagename::IMAGE_NAME *ImageName,
+	void *Context
+)
+{
+	auto ctx = (COLLECT_CONTEXT*)Context;
+
+	if (!registeredimage::HasMatchingEntry(ctx->Entries, ImageName))
+	{
+		return true;
+	}
+
+	return procregistry::ForEachEntryWithImage(ctx->Registry, ImageName, CollectAffectedRoot, ctx);
+}
+
+} // anonymous namespace
+
+void
+Evaluate
+(
+	registeredimage::CONTEXT *Configuration,
+	procregistry::PROCESS_REGISTRY_ENTRY *Entry
+)
+{
+	Entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_OFF;
+
+	if (registeredimage::HasMatchingEntry(Configuration, Entry->ImageName))
+	{
+		Entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG;
+	}
+	else if (Entry->ParentProcessId == 0
+		&& Entry->Settings.Split == ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE)
+	{
+		Entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
+	}
+}
+
+void
+ComputeAll
+(
+	procregistry::CONTEXT *Registry,
+	registeredimage::CONTEXT *Configuration
+)
+{
+	procregistry::ForEachTopological(Registry, PropagateTargetSplitSetting, Configuration);
+}
+
+NTSTATUS
+CollectAffectedRoots
+(
+	procregistry::CONTEXT *Registry,
+	registeredimage::CONTEXT *OldConfiguration,
+	registeredimage::CONTEXT *Configuration,
+	registeredimage::CONTEXT *Entries,
+	AFFECTED_ROOTS *Roots
+)
+{
+	Roots->Roots = NULL;
+	Roots->NumRoots = 0;
+	Roots->MaxRoots = 0;
+
+	COLLECT_CONTEXT ctx;
+
+	ctx.Registry = Registry;
+	ctx.OldConfiguration = OldConfiguration;
+	ctx.Configuration = Configuration;
+	ctx.Entries = Entries;
+	ctx.Roots = Roots;
+
+	const auto collected = registeredimage::HasOnlyExactEntries(Entries)
+		? registeredimage::ForEachExact(Entries, CollectAffectedImage, &ctx)
+		: procregistry::ForEachImage(Registry, CollectAffectedImage, &ctx);
+
+	return (collected ? STATUS_SUCCESS : STATUS_INSUFFICIENT_RESOURCES);
+}
+
+void
+ReleaseAffectedRoots
+(
+	AFFECTED_ROOTS *Roots
+)
+{
+	if (Roots->Roots != NULL)
+	{
+		ExFreePoolWithTag(Roots->Roots, ST_POOL_TAG);
+
+		Roots->Roots = NULL;
+	}
+
+	Roots->NumRoots = 0;
+	Roots->MaxRoots = 0;
+}
+
+void
+ComputeAffected
+(
+	procregistry::CONTEXT *Registry,
+	registeredimage::CONTEXT *Configuration,
+	const AFFECTED_ROOTS *Roots
+)
+{
+	//
+	// The parent of each root is outside of any affected subtree,
+	// and its current settings are also its target settings.
+	//
+
+	for (SIZE_T i = 0; i < Roots->NumRoots; ++i)
+	{
+		auto root = Roots->Roots[i];
+
+		Evaluate(Configuration, root);
+
+		if (!util::SplittingEnabled(root->TargetSettings.Split)
+			&& root->ParentEntry != NULL
+			&& util::SplittingEnabled(root->ParentEntry->Settings.Split))
+		{
+			root->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
+		}
+
+		procregistry::ForEachDescendant(Registry, root, PropagateTargetSplitSetting, Configuration);
+	}
+}
+
+} // namespace targetsettings
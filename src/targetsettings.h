@@ -0,0 +1,108 @@
+#pragma once
+
+#include <wdm.h>
+#include "containers/procregistry.h"
+#include "containers/registeredimage.h"
+
+//
+// Computation of target split settings for process registry entries.
+//
+// Only TargetSettings.Split is updated. Realizing the settings, i.e. updating firewall
+// filters and announcing changes, is left to the caller.
+//
+// The caller must ensure there are no structural changes to the registry,
+// and no concurrent updates to the configuration.
+//
+
+namespace targetsettings
+{
+
+//
+// Evaluate()
+//
+// Set the target split setting of a single entry, without considering its ancestors.
+//
+// The target state is split if either of:
+//
+// - Imagename is included in config, or is located under a directory prefix in config.
+// - Currently split by inheritance and parent has departed.
+//
+void
+Evaluate
+(
+	registeredimage::CONTEXT *Configuration,
+	procregistry::PROCESS_REGISTRY_ENTRY *Entry
+);
+
+//
+// ComputeAll()
+//
+// Set the target split setting of every entry in the registry.
+//
+// Parents are visited before children, so each entry is evaluated once
+// regardless of the depth of the process tree.
+//
+void
+ComputeAll
+(
+	procregistry::CONTEXT *Registry,
+	registeredimage::CONTEXT *Configuration
+);
+
+//
+// Entries whose split setting may change after a configuration update, and which have
+// no ancestors with the same property. Affected entries that are descendants of a root
+// are reached by traversing the subtree.
+//
+struct AFFECTED_ROOTS
+{
+	procregistry::PROCESS_REGISTRY_ENTRY **Roots;
+	SIZE_T NumRoots;
+	SIZE_T MaxRoots;
+};
+
+//
+// CollectAffectedRoots()
+//
+// Find the subtrees that need to be re-evaluated after `Entries` have been added to
+// or removed from `OldConfiguration`, resulting in `Configuration`.
+//
+// Processes are found through the image index in the process registry. If only exact
+// entries changed, each entry is a single lookup. Otherwise, each distinct running
+// image is evaluated once against the changed entries.
+//
+// Release the result with ReleaseAffectedRoots(), also on failure.
+//
+NTSTATUS
+CollectAffectedRoots
+(
+	procregistry::CONTEXT *Registry,
+	registeredimage::CONTEXT *OldConfiguration,
+	registeredimage::CONTEXT *Configuration,
+	registeredimage::CONTEXT *Entries,
+	AFFECTED_ROOTS *Roots
+);
+
+void
+ReleaseAffectedRoots
+(
+	AFFECTED_ROOTS *Roots
+);
+
+//
+// ComputeAffected()
+//
+// Set the target split setting of every entry in the affected subtrees.
+//
+// Processes outside of these subtrees are unaffected, since their own image and
+// the images of all their ancestors are matched the same as before.
+//
+void
+ComputeAffected
+(
+	procregistry::CONTEXT *Registry,
+	registeredimage::CONTEXT *Configuration,
+	const AFFECTED_ROOTS *Roots
+);
+
+} // namespace targetsettings
@@ -1,9 +1,80 @@
 #include <ntifs.h>
 #include "util.h"
 
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
 namespace util
 {
 
+namespace
+{
+
+//
+// DowncaseAscii()
+//
+// Converts `Length` characters, and returns false as soon as a non-ASCII character
+// is encountered. `Dest` is then partially updated.
+//
+// SSE2 is always available on x64, and using it in kernel mode does not require
+// saving the floating point state.
+//
+bool
+DowncaseAscii
+(
+	WCHAR *Dest,
+	const WCHAR *Src,
+	SIZE_T Length
+)
+{
+	SIZE_T i = 0;
+
+#if defined(_M_AMD64)
+
+	const auto nonAsciiMask = _mm_set1_epi16((short)0xFF80);
+	const auto zero = _mm_setzero_si128();
+	const auto beforeUpper = _mm_set1_epi16(L'A' - 1);
+	const auto afterUpper = _mm_set1_epi16(L'Z' + 1);
+	const auto caseBit = _mm_set1_epi16(0x20);
+
+	for (; i + 8 <= Length; i += 8)
+	{
+		auto chars = _mm_loadu_si128((const __m128i*)(Src + i));
+
+		auto nonAscii = _mm_cmpeq_epi16(_mm_and_si128(chars, nonAsciiMask), zero);
+
+		if (_mm_movemask_epi8(nonAscii) != 0xFFFF)
+		{
+			return false;
+		}
+
+		auto upper = _mm_and_si128(_mm_cmpgt_epi16(chars, beforeUpper), _mm_cmplt_epi16(chars, afterUpper));
+
+		chars = _mm_or_si128(chars, _mm_and_si128(upper, caseBit));
+
+		_mm_storeu_si128((__m128i*)(Dest + i), chars);
+	}
+
+#endif
+
+	for (; i < Length; ++i)
+	{
+		const auto c = Src[i];
+
+		if (c >= 0x80)
+		{
+			return false;
+		}
+
+		Dest[i] = (c >= L'A' && c <= L'Z') ? (WCHAR)(c | 0x20) : c;
+	}
+
+	return true;
+}
+
+} // anonymous namespace
+
 void
 ReparentList
 (
@@ -213,6 +284,29 @@ IsEmptyRange
 	return true;
 }
 
+_IRQL_requires_max_(APC_LEVEL)
+NTSTATUS
+DowncaseString
+(
+	UNICODE_STRING *Dest,
+	const UNICODE_STRING *Src
+)
+{
+	if (Dest->MaximumLength < Src->Length)
+	{
+		return STATUS_BUFFER_OVERFLOW;
+	}
+
+	if (DowncaseAscii(Dest->Buffer, Src->Buffer, Src->Length / sizeof(WCHAR)))
+	{
+		Dest->Length = Src->Length;
+
+		return STATUS_SUCCESS;
+	}
+
+	return RtlDowncaseUnicodeString(Dest, Src, FALSE);
+}
+
 NTSTATUS
 AllocateCopyDowncaseString
 (
@@ -222,41 +316,35 @@ AllocateCopyDowncaseString
 )
 {
 	//
-	// Unfortunately, there is no way to determine the required buffer size.
-	//
-	// It would be possible to allocate e.g. `In.Length * 1.5` bytes, and waste memory.
-	//
-	// We opt for the slightly less time efficient method of allocating an exact size
-	// twice and copying the string.
+	// Characters are converted one for one, so the lower case string
+	// is the same length as the original string.
 	//
 
+	const auto poolType = (Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
+
 	UNICODE_STRING lower;
 
-	auto status = RtlDowncaseUnicodeString(&lower, Src, TRUE);
+	lower.Length = 0;
+	lower.MaximumLength = Src->Length;
+	lower.Buffer = (PWCH)ExAllocatePoolUninitialized(poolType, Src->Length, ST_POOL_TAG);
 
-	if (!NT_SUCCESS(status))
+	if (lower.Buffer == NULL)
 	{
-		return status;
+		return STATUS_INSUFFICIENT_RESOURCES;
 	}
 
-	const auto poolType = (Pageable == ST_PAGEABLE::YES) ? PagedPool : NonPagedPool;
-
-	auto finalBuffer = (PWCH)ExAllocatePoolUninitialized(poolType, lower.Length, ST_POOL_TAG);
+	auto status = DowncaseString(&lower, Src);
 
-	if (finalBuffer == NULL)
+	if (!NT_SUCCESS(status))
 	{
-		RtlFreeUnicodeString(&lower);
+		ExFreePoolWithTag(lower.Buffer, ST_POOL_TAG);
 
-		return STATUS_INSUFFICIENT_RESOURCES;
+		return status;
 	}
 
-	RtlCopyMemory(finalBuffer, lower.Buffer, lower.Length);
-
 	Dest->Length = lower.Length;
-	Dest->MaximumLength = lower.Length;
-	Dest->Buffer = finalBuffer;
-
-	RtlFreeUnicodeString(&lower);
+	Dest->MaximumLength = lower.MaximumLength;
+	Dest->Buffer = lower.Buffer;
 
 	return STATUS_SUCCESS;
 }
@@ -340,6 +428,48 @@ SplittingEnabled
 		|| Status == ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE);
 }
 
+bool
+EqualMemory
+(
+	const void *lhs,
+	const void *rhs,
+	SIZE_T Length
+)
+{
+	auto l = (const UCHAR*)lhs;
+	auto r = (const UCHAR*)rhs;
+
+	SIZE_T i = 0;
+
+#if defined(_M_AMD64)
+
+	for (; i + 16 <= Length; i += 16)
+	{
+		auto equal = _mm_cmpeq_epi8
+		(
+			_mm_loadu_si128((const __m128i*)(l + i)),
+			_mm_loadu_si128((const __m128i*)(r + i))
+		);
+
+		if (_mm_movemask_epi8(equal) != 0xFFFF)
+		{
+			return false;
+		}
+	}
+
+#endif
+
+	for (; i < Length; ++i)
+	{
+		if (l[i] != r[i])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 bool
 Equal
 (
@@ -352,14 +482,7 @@ Equal
 		return false;
 	}
 
-	const auto equalBytes = RtlCompareMemory
-	(
-		lhs->Buffer,
-		rhs->Buffer,
-		lhs->Length
-	);
-
-	return equalBytes == lhs->Length;
+	return EqualMemory(lhs->Buffer, rhs->Buffer, lhs->Length);
 }
 
 void
@@ -77,6 +77,24 @@ IsEmptyRange
 	SIZE_T Length
 );
 
+//
+// DowncaseString()
+//
+// IRQL <= APC.
+//
+// Same as RtlDowncaseUnicodeString() without allocating the destination string.
+//
+// Strings that consist entirely of ASCII characters, which is the case for nearly all
+// device paths, are converted without consulting the system case tables.
+//
+_IRQL_requires_max_(APC_LEVEL)
+NTSTATUS
+DowncaseString
+(
+	UNICODE_STRING *Dest,
+	const UNICODE_STRING *Src
+);
+
 //
 // AllocateCopyDowncaseString()
 //
@@ -130,6 +148,19 @@ SplittingEnabled
 	ST_PROCESS_SPLIT_STATUS Status
 );
 
+//
+// EqualMemory()
+//
+// Same as RtlEqualMemory() but compares 16 bytes at a time where possible.
+//
+bool
+EqualMemory
+(
+	const void *lhs,
+	const void *rhs,
+	SIZE_T Length
+);
+
 bool
 Equal
 (
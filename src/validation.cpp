@@ -8,7 +8,8 @@ bool
 ValidateUserBufferConfiguration
 (
     void *Buffer,
-    size_t BufferLength
+    size_t BufferLength,
+    bool EntryFlags
 )
 {
    auto bufferEnd = (UCHAR*)Buffer + BufferLength;
@@ -52,6 +53,10 @@ ValidateUserBufferConfiguration
 
     //
     // Verify that all strings reside within the string buffer.
+    // Also verify flags, and that prefixes and patterns are not empty.
+    //
+    // Clients of the original format leave the flags field as uninitialized padding,
+    // so it is only inspected when the client has opted in to entry flags.
     //
 
     auto entry = (ST_CONFIGURATION_ENTRY*)(header + 1);
@@ -65,6 +70,29 @@ ValidateUserBufferConfiguration
         {
             return false;
         }
+
+        if (!EntryFlags)
+        {
+            continue;
+        }
+
+        if ((entry->Flags & ~ST_CONFIGURATION_ENTRY_FLAGS_VALID) != 0)
+        {
+            return false;
+        }
+
+        const USHORT typeFlags = ST_CONFIGURATION_ENTRY_FLAG_PREFIX | ST_CONFIGURATION_ENTRY_FLAG_PATTERN;
+
+        if ((entry->Flags & typeFlags) == typeFlags)
+        {
+            return false;
+        }
+
+        if ((entry->Flags & typeFlags) != 0
+            && entry->ImageNameLength == 0)
+        {
+            return false;
+        }
     }
 
     return true;
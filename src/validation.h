@@ -7,11 +7,15 @@
 //
 // Validates configuration data sent by user mode.
 //
+// `EntryFlags` specifies whether ST_CONFIGURATION_ENTRY::Flags is in use.
+// If it's not, the field is padding and its contents are ignored.
+//
 bool
 ValidateUserBufferConfiguration
 (
     void *Buffer,
-    size_t BufferLength
+    size_t BufferLength,
+    bool EntryFlags
 );
 
 //
@@ -171,13 +171,38 @@ void ProcessInitialize(const std::wstring &baselineGuidStr, const std::wstring &
 	std::wcout << L"Successfully initialized driver" << std::endl;
 }
 
+bool HasWildcard(const std::wstring &imageName, size_t length)
+{
+	return imageName.find_first_of(L"*?") < length;
+}
+
+//
+// Config entries that end with "\\*" are sent as directory prefixes,
+// unless there are other wildcards in the entry.
+//
+bool IsPrefixEntry(const std::wstring &imageName)
+{
+	return imageName.size() > 2
+		&& 0 == imageName.compare(imageName.size() - 2, 2, L"\\*")
+		&& !HasWildcard(imageName, imageName.size() - 1);
+}
+
+//
+// Other config entries with wildcards are sent as patterns.
+//
+bool IsPatternEntry(const std::wstring &imageName)
+{
+	return !IsPrefixEntry(imageName)
+		&& HasWildcard(imageName, imageName.size());
+}
+
 std::vector<uint8_t> MakeConfiguration(const std::vector<std::wstring> &imageNames)
 {
 	size_t totalStringLength = 0;
 
 	for (const auto &imageName : imageNames)
 	{
-		totalStringLength += imageName.size() * sizeof(wchar_t);
+		totalStringLength += (imageName.size() - (IsPrefixEntry(imageName) ? 1 : 0)) * sizeof(wchar_t);
 	}
 
 	size_t totalBufferSize = sizeof(ST_CONFIGURATION_HEADER)
@@ -196,10 +221,15 @@ std::vector<uint8_t> MakeConfiguration(const std::vector<std::wstring> &imageNam
 
 	for (const auto &imageName : imageNames)
 	{
-		auto stringLength = imageName.size() * sizeof(wchar_t);
+		const auto prefix = IsPrefixEntry(imageName);
+
+		// Keep the trailing backslash but drop the asterisk.
+		auto stringLength = (imageName.size() - (prefix ? 1 : 0)) * sizeof(wchar_t);
 
 		entry->ImageNameLength = (USHORT)stringLength;
 		entry->ImageNameOffset = stringOffset;
+		entry->Flags = (prefix ? ST_CONFIGURATION_ENTRY_FLAG_PREFIX
+			: (IsPatternEntry(imageName) ? ST_CONFIGURATION_ENTRY_FLAG_PATTERN : 0));
 
 		memcpy(stringDest, imageName.c_str(), stringLength);
 
@@ -232,7 +262,7 @@ void ProcessSetConfig(const std::vector<std::wstring> &imageNames)
 
 	DWORD bytesReturned;
 
-	auto status = SendIoControl((DWORD)IOCTL_ST_SET_CONFIGURATION,
+	auto status = SendIoControl((DWORD)IOCTL_ST_SET_CONFIGURATION_EX,
 		&blob[0], (DWORD)blob.size(), nullptr, 0, &bytesReturned);
 
 	if (!status)
@@ -245,19 +275,36 @@ void ProcessSetConfig(const std::vector<std::wstring> &imageNames)
 	std::wcout << L"Successfully set configuration" << std::endl;
 }
 
-void ProcessAddConfig(const std::wstring &imageName)
+void SendConfigurationDelta(DWORD code, const std::wstring &imageName)
 {
-	auto tempNames = g_imagenames;
+	if (INVALID_HANDLE_VALUE == g_DriverHandle)
+	{
+		THROW_ERROR("Not connected to driver");
+	}
 
-	tempNames.push_back(imageName);
+	auto blob = MakeConfiguration({ imageName });
 
-	ProcessSetConfig(tempNames);
+	DWORD bytesReturned;
 
-	// Persist data now that the above call did not throw.
-	g_imagenames = tempNames;
+	auto status = SendIoControl(code, &blob[0], (DWORD)blob.size(), nullptr, 0, &bytesReturned);
+
+	if (!status)
+	{
+		THROW_ERROR("Update configuration");
+	}
+
+	std::wcout << L"Driver state: " << MapDriverState(GetDriverState()) << std::endl;
 }
 
-void ProcessClearConfig();
+void ProcessAddConfig(const std::wstring &imageName)
+{
+	SendConfigurationDelta((DWORD)IOCTL_ST_ADD_CONFIGURATION_ENTRIES, imageName);
+
+	// Persist data now that the above call did not throw.
+	g_imagenames.push_back(imageName);
+
+	std::wcout << L"Successfully added configuration entry" << std::endl;
+}
 
 void ProcessRemoveConfig(const std::wstring &imageName)
 {
@@ -271,23 +318,15 @@ void ProcessRemoveConfig(const std::wstring &imageName)
 		THROW_ERROR("Specified imagename was not previously registered");
 	}
 
-	auto indexMatch = std::distance(g_imagenames.begin(), iterMatch);
-
-	auto tempNames = g_imagenames;
-
-	tempNames.erase(tempNames.begin() + indexMatch);
-
-	if (tempNames.empty())
-	{
-		ProcessClearConfig();
-
-		return;
-	}
-
-	ProcessSetConfig(tempNames);
+	//
+	// Send the name as registered, so it's flagged the same way.
+	//
+	SendConfigurationDelta((DWORD)IOCTL_ST_REMOVE_CONFIGURATION_ENTRIES, *iterMatch);
 
 	// Persist data now that the above call did not throw.
-	g_imagenames = tempNames;
+	g_imagenames.erase(iterMatch);
+
+	std::wcout << L"Successfully removed configuration entry" << std::endl;
 }
 
 void ProcessGetConfig()
@@ -333,6 +372,11 @@ void ProcessGetConfig()
 			(wchar_t*)(stringBuffer + entry->ImageNameOffset),
 			(wchar_t*)(stringBuffer + entry->ImageNameOffset + entry->ImageNameLength)
 		);
+
+		if ((entry->Flags & ST_CONFIGURATION_ENTRY_FLAG_PREFIX) != 0)
+		{
+			imageNames.back().push_back(L'*');
+		}
 	}
 
 	std::wcout << L"Successfully got configuration" << std::endl;
@@ -581,6 +625,81 @@ void ProcessQueryProcess(const std::wstring &processId)
 	std::wcout << L"Imagename: " << r->ImageName << std::endl;
 }
 
+void DisplayLatencyHistogram(const std::wstring &title, const ST_LATENCY_HISTOGRAM &histogram)
+{
+	std::wcout << title << L":" << std::endl;
+
+	bool empty = true;
+
+	for (size_t i = 0; i < ST_LATENCY_HISTOGRAM_NUM_BUCKETS; ++i)
+	{
+		if (histogram.Buckets[i] == 0)
+		{
+			continue;
+		}
+
+		empty = false;
+
+		const auto low = (i == 0) ? 0 : (1ULL << i);
+
+		std::wstringstream range;
+
+		if (i == ST_LATENCY_HISTOGRAM_NUM_BUCKETS - 1)
+		{
+			range << low << L"+ us";
+		}
+		else
+		{
+			range << low << L"-" << ((1ULL << (i + 1)) - 1) << L" us";
+		}
+
+		std::wcout << L"  " << std::setw(20) << std::left << range.str()
+			<< std::right << histogram.Buckets[i] << std::endl;
+	}
+
+	if (empty)
+	{
+		std::wcout << L"  No samples" << std::endl;
+	}
+}
+
+void ProcessGetStatistics()
+{
+	ST_PROCESS_EVENT_STATISTICS stats = { 0 };
+
+	DWORD bytesReturned;
+
+	auto status = SendIoControl((DWORD)IOCTL_ST_GET_STATISTICS,
+		nullptr, 0, &stats, (DWORD)sizeof(stats), &bytesReturned);
+
+	if (!status || bytesReturned != sizeof(stats))
+	{
+		THROW_ERROR("Get statistics");
+	}
+
+	DisplayLatencyHistogram(L"Notification to dispatch", stats.QueueLatency);
+	DisplayLatencyHistogram(L"Dispatch to registration", stats.RegistrationLatency);
+
+	std::wcout << L"Ring depth high-water: " << stats.RingDepthHighWater << std::endl;
+	std::wcout << L"Overflow depth high-water: " << stats.OverflowDepthHighWater << std::endl;
+	std::wcout << L"Coalesced pairs: " << stats.NumCoalescedPairs << std::endl;
+	std::wcout << L"Overflowed events: " << stats.NumOverflowed << std::endl;
+	std::wcout << L"Spilled image names: " << stats.NumSpilled << std::endl;
+	std::wcout << L"Dropped events: " << stats.NumDropped << std::endl;
+	std::wcout << L"Early verdicts: " << stats.NumEarlyVerdicts << std::endl;
+	std::wcout << L"Classifications answered early: " << stats.NumEarlyClassifications << std::endl;
+	std::wcout << L"Pended classifications: " << stats.NumPendedClassifications << std::endl;
+	std::wcout << L"Verdict cache hits: " << stats.NumVerdictCacheHits << std::endl;
+	std::wcout << L"Verdict cache misses: " << stats.NumVerdictCacheMisses << std::endl;
+	std::wcout << L"Verdict cache invalidations: " << stats.NumVerdictCacheInvalidations << std::endl;
+	std::wcout << L"Registry entry allocations: " << stats.NumRegistryEntryAllocations << std::endl;
+	std::wcout << L"Registry entry frees: " << stats.NumRegistryEntryFrees << std::endl;
+	std::wcout << L"Registry entry peak: " << stats.PeakRegistryEntries << std::endl;
+	std::wcout << L"Event allocations: " << stats.NumEventAllocations << std::endl;
+	std::wcout << L"Event frees: " << stats.NumEventFrees << std::endl;
+	std::wcout << L"Event peak: " << stats.PeakEvents << std::endl;
+}
+
 void ProcessDisplayEvents()
 {
 	g_DisplayEvents = !g_DisplayEvents;
@@ -892,6 +1011,12 @@ int main()
 				continue;
 			}
 
+			if (0 == _wcsicmp(tokens[0].c_str(), L"get-stats"))
+			{
+				ProcessGetStatistics();
+				continue;
+			}
+
 			if (0 == _wcsicmp(tokens[0].c_str(), L"quick"))
 			{
 				if (g_DriverHandle != INVALID_HANDLE_VALUE)
@@ -0,0 +1,398 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "processtree.h"
+#include "containers/pidindex.h"
+
+using harness::Configuration;
+using harness::Numbered;
+using harness::Pid;
+using harness::ProcessTree;
+using harness::UnicodeString;
+
+namespace
+{
+
+const char16_t BROWSER[] = u"\\device\\harddiskvolume1\\program files\\browser\\browser.exe";
+const char16_t TORRENT[] = u"\\device\\harddiskvolume1\\program files\\torrent\\torrent.exe";
+const char16_t PORTABLE[] = u"\\device\\harddiskvolume1\\portable\\";
+
+//
+// Time in microseconds, distributed evenly on a log scale across [Low, High).
+//
+double
+LogUniform
+(
+	harness::Random &Random,
+	double Low,
+	double High
+)
+{
+	const auto fraction = (double)Random.Below(1 << 20) / (double)(1 << 20);
+
+	return Low * std::pow(High / Low, fraction);
+}
+
+struct PROCESS
+{
+	size_t Parent;
+	std::u16string Image;
+};
+
+enum class EVENT_KIND
+{
+	ARRIVE,
+	REGISTER,
+	CONNECT,
+	DEPART
+};
+
+struct EVENT
+{
+	double Time;
+	EVENT_KIND Kind;
+	size_t Process;
+};
+
+//
+// Process arrivals and the connections the new processes make, in time order.
+//
+// Each arrival is registered by the worker after `RegistrationDelay` times a random factor
+// between 0.1 and 10. Most processes open a few connections over their first 100 ms.
+// A tenth of the new processes are the browser, which is configured to be split, and a
+// third of all processes are started by one of the browsers. Processes that are started
+// from the configured prefix are split, but are not recognized by the early verdicts,
+// which only consider exact entries.
+//
+struct Trace
+{
+	std::vector<PROCESS> Processes;
+	std::vector<EVENT> Events;
+};
+
+Trace
+MakeTrace
+(
+	harness::Random &Random,
+	size_t NumArrivals,
+	double RegistrationDelay
+)
+{
+	Trace trace;
+
+	//
+	// Process 0 stands in for the processes that are running when the replay starts,
+	// and process 1 is a browser that's already registered.
+	//
+
+	trace.Processes.push_back({ 0, u"\\device\\harddiskvolume1\\windows\\explorer.exe" });
+	trace.Processes.push_back({ 0, BROWSER });
+
+	std::vector<size_t> browsers = { 1 };
+
+	double now = 0;
+
+	for (size_t i = 0; i < NumArrivals; ++i)
+	{
+		now += LogUniform(Random, 10, 10000);
+
+		const auto process = trace.Processes.size();
+
+		PROCESS p;
+
+		p.Parent = (Random.Below(3) == 0) ? browsers[Random.Below(browsers.size())] : 0;
+
+		const auto kind = Random.Below(100);
+
+		if (kind < 10)
+		{
+			p.Image = BROWSER;
+
+			browsers.push_back(process);
+		}
+		else if (kind < 13)
+		{
+			p.Image = Numbered(PORTABLE, Random.Below(5)) + u".exe";
+		}
+		else if (kind < 15)
+		{
+			p.Image = TORRENT;
+		}
+		else
+		{
+			p.Image = Numbered(u"\\device\\harddiskvolume1\\program files\\vendor\\app", Random.Below(300)) + u".exe";
+		}
+
+		trace.Processes.push_back(p);
+
+		const auto lifetime = LogUniform(Random, 1000, 10000000);
+
+		trace.Events.push_back({ now, EVENT_KIND::ARRIVE, process });
+		trace.Events.push_back({ now + RegistrationDelay * LogUniform(Random, 0.1, 10), EVENT_KIND::REGISTER, process });
+		trace.Events.push_back({ now + lifetime, EVENT_KIND::DEPART, process });
+
+		for (auto n = Random.Below(6); n != 0; --n)
+		{
+			trace.Events.push_back({ now + LogUniform(Random, 10, 100000), EVENT_KIND::CONNECT, process });
+		}
+	}
+
+	std::stable_sort(trace.Events.begin(), trace.Events.end(), [](const EVENT &Lhs, const EVENT &Rhs)
+	{
+		return Lhs.Time < Rhs.Time;
+	});
+
+	return trace;
+}
+
+struct RESULT
+{
+	size_t Classifications;
+	size_t AnsweredEarly;
+	size_t Pended;
+	size_t PendedSplit;
+};
+
+bool
+QuerySplit
+(
+	procregistry::CONTEXT *Registry,
+	pidindex::CONTEXT *EarlyVerdicts,
+	HANDLE ProcessId,
+	ST_PROCESS_SPLIT_STATUS *Split
+)
+{
+	if (procregistry::QuerySplitStatus(Registry, ProcessId, Split))
+	{
+		return true;
+	}
+
+	if (EarlyVerdicts == NULL)
+	{
+		return false;
+	}
+
+	LONG attributes;
+
+	if (!pidindex::QueryAttributes(EarlyVerdicts, ProcessId, &attributes, NULL))
+	{
+		return false;
+	}
+
+	*Split = (ST_PROCESS_SPLIT_STATUS)attributes;
+
+	return true;
+}
+
+//
+// Replay `Trace`, classifying each connection the way CallbackQueryProcess() does.
+//
+// With `EarlyVerdicts`, arrivals are resolved the way ResolveEarlyVerdict() in procmgmt does:
+// an exact configuration entry, or a parent that's split according to the registry or to its
+// own early verdict. The verdict is withdrawn when the process is registered or departs.
+//
+RESULT
+Replay
+(
+	const Trace &Trace,
+	bool EarlyVerdicts
+)
+{
+	RESULT result = { 0, 0, 0, 0 };
+
+	ProcessTree tree;
+
+	if (!NT_SUCCESS(tree.Status()))
+	{
+		return result;
+	}
+
+	Configuration configuration(tree.ImageNames());
+
+	configuration.Add(registeredimage::ENTRY_TYPE::EXACT, BROWSER);
+	configuration.Add(registeredimage::ENTRY_TYPE::EXACT, TORRENT);
+	configuration.Add(registeredimage::ENTRY_TYPE::PREFIX, PORTABLE);
+
+	pidindex::CONTEXT *earlyVerdicts = NULL;
+
+	if (EarlyVerdicts && !NT_SUCCESS(pidindex::Initialize(&earlyVerdicts)))
+	{
+		return result;
+	}
+
+	std::vector<bool> registered(Trace.Processes.size(), false);
+	std::vector<bool> departed(Trace.Processes.size(), false);
+	std::vector<bool> split(Trace.Processes.size(), false);
+	std::vector<size_t> pended(Trace.Processes.size(), 0);
+
+	tree.Add(0, Pid(1), Trace.Processes[0].Image);
+	tree.Add(Pid(1), Pid(2), Trace.Processes[1].Image, ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG);
+
+	registered[0] = registered[1] = true;
+	split[1] = true;
+
+	for (const auto &event : Trace.Events)
+	{
+		const auto &process = Trace.Processes[event.Process];
+		const auto pid = Pid(1 + event.Process);
+		const auto parentPid = Pid(1 + process.Parent);
+
+		switch (event.Kind)
+		{
+			case EVENT_KIND::ARRIVE:
+			{
+				if (earlyVerdicts == NULL)
+				{
+					break;
+				}
+
+				UnicodeString image(process.Image);
+
+				ST_PROCESS_SPLIT_STATUS status;
+
+				if (registeredimage::HasEntry(configuration.Get(), image.Get()))
+				{
+					status = ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG;
+				}
+				else if (QuerySplit(tree.Registry(), earlyVerdicts, parentPid, &status)
+					&& util::SplittingEnabled(status))
+				{
+					status = ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
+				}
+				else
+				{
+					break;
+				}
+
+				pidindex::Insert(earlyVerdicts, pid, (void*)(ULONG_PTR)(event.Process + 1), status);
+
+				break;
+			}
+			case EVENT_KIND::REGISTER:
+			{
+				if (departed[event.Process])
+				{
+					break;
+				}
+
+				tree.Add(parentPid, pid, process.Image);
+
+				auto entry = tree.Find(pid);
+
+				if (registeredimage::HasMatchingEntry(configuration.Get(), entry->ImageName))
+				{
+					entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG;
+				}
+				else if (entry->ParentEntry != NULL && util::SplittingEnabled(entry->ParentEntry->Settings.Split))
+				{
+					entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
+				}
+
+				tree.RealizeSubtree(entry);
+
+				registered[event.Process] = true;
+				split[event.Process] = util::SplittingEnabled(entry->Settings.Split);
+
+				if (earlyVerdicts != NULL)
+				{
+					pidindex::Remove(earlyVerdicts, pid);
+				}
+
+				break;
+			}
+			case EVENT_KIND::CONNECT:
+			{
+				if (departed[event.Process])
+				{
+					break;
+				}
+
+				++result.Classifications;
+
+				ST_PROCESS_SPLIT_STATUS status;
+
+				if (procregistry::GetSplitStatus(tree.Registry(), pid, &status))
+				{
+					break;
+				}
+
+				LONG attributes;
+
+				if (earlyVerdicts != NULL && pidindex::QueryAttributes(earlyVerdicts, pid, &attributes, NULL))
+				{
+					++result.AnsweredEarly;
+
+					break;
+				}
+
+				++pended[event.Process];
+
+				break;
+			}
+			case EVENT_KIND::DEPART:
+			{
+				departed[event.Process] = true;
+
+				if (registered[event.Process])
+				{
+					procregistry::DeleteEntryById(tree.Registry(), pid);
+				}
+
+				if (earlyVerdicts != NULL)
+				{
+					pidindex::Remove(earlyVerdicts, pid);
+				}
+
+				break;
+			}
+		}
+	}
+
+	if (earlyVerdicts != NULL)
+	{
+		pidindex::TearDown(&earlyVerdicts);
+	}
+
+	//
+	// Whether a process is split is only settled once it's registered.
+	//
+
+	for (size_t i = 0; i < pended.size(); ++i)
+	{
+		result.Pended += pended[i];
+		result.PendedSplit += split[i] ? pended[i] : 0;
+	}
+
+	return result;
+}
+
+} // anonymous namespace
+
+//
+// Classifications that are pended because the process isn't known yet, without and with
+// early verdicts, for workers that lag behind process creation by different amounts.
+//
+TEST_CASE(PendedClassifications)
+{
+	const size_t NUM_ARRIVALS = 20000;
+
+	printf("%10s %6s %16s %15s %15s %13s\n", "delay", "early", "classifications", "answered early", "pended", "pended split");
+
+	for (double delay : { 100.0, 1000.0, 10000.0 })
+	{
+		harness::Random random;
+
+		const auto trace = MakeTrace(random, NUM_ARRIVALS, delay);
+
+		for (bool early : { false, true })
+		{
+			const auto result = Replay(trace, early);
+
+			printf("%7.0f us %6s %16zu %15zu %8zu %5.1f%% %13zu\n", delay, early ? "yes" : "no",
+				result.Classifications, result.AnsweredEarly, result.Pended,
+				100.0 * (double)result.Pended / (double)result.Classifications, result.PendedSplit);
+		}
+	}
+}
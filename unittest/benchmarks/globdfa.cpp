@@ -0,0 +1,122 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "glob.h"
+#include "unicode.h"
+#include "containers/globdfa.h"
+
+using harness::UnicodeString;
+
+namespace
+{
+
+std::u16string
+Numbered
+(
+	const char16_t *Text,
+	size_t Number
+)
+{
+	std::u16string s(Text);
+
+	for (auto c : std::to_string(Number))
+	{
+		s += (char16_t)c;
+	}
+
+	return s;
+}
+
+} // anonymous namespace
+
+//
+// Patterns in the style of per-user installations of versioned applications.
+//
+TEST_CASE(CompileAndMatch)
+{
+	const size_t NUM_PATTERNS = 1000;
+
+	std::vector<std::u16string> patternText;
+
+	for (size_t i = 0; i < NUM_PATTERNS; ++i)
+	{
+		patternText.push_back(Numbered(u"\\device\\*\\users\\*\\appdata\\local\\vendor", i)
+			+ u"\\app-*\\" + Numbered(u"app", i) + u".exe");
+	}
+
+	std::vector<UnicodeString> storage(patternText.begin(), patternText.end());
+	std::vector<const LOWER_UNICODE_STRING*> patterns;
+
+	for (auto &pattern : storage)
+	{
+		patterns.push_back(pattern.Lower());
+	}
+
+	globdfa::CONTEXT *dfa = NULL;
+
+	const auto compileNs = harness::MeasureNs(1, 3, [&]()
+	{
+		if (dfa != NULL)
+		{
+			globdfa::TearDown(&dfa);
+		}
+
+		REQUIRE(NT_SUCCESS(globdfa::Compile(patterns.data(), patterns.size(), ST_PAGEABLE::NO, &dfa)));
+	});
+
+	REQUIRE(dfa != NULL);
+
+	printf("patterns: %zu\n", NUM_PATTERNS);
+	printf("states:   %zu\n", (size_t)globdfa::NumStates(dfa));
+	printf("compile:  %.1f ms\n", compileNs / 1e6);
+
+	//
+	// Half of the paths are matched by a pattern, the others differ in the last component.
+	//
+
+	harness::Random random;
+
+	std::vector<std::u16string> pathText;
+
+	for (size_t i = 0; i < 256; ++i)
+	{
+		const auto n = (size_t)random.Below(NUM_PATTERNS);
+
+		pathText.push_back(Numbered(u"\\device\\harddiskvolume3\\users\\jane\\appdata\\local\\vendor", n)
+			+ u"\\app-1.2.3\\" + Numbered((i % 2 == 0) ? u"app" : u"tool", n) + u".exe");
+	}
+
+	std::vector<UnicodeString> paths(pathText.begin(), pathText.end());
+
+	size_t hits = 0;
+
+	const auto dfaNs = harness::MeasureNs(paths.size(), 5, [&]()
+	{
+		for (auto &path : paths)
+		{
+			hits += globdfa::Match(dfa, path.Lower());
+		}
+	});
+
+	const auto backtrackingNs = harness::MeasureNs(paths.size(), 3, [&]()
+	{
+		for (const auto &path : pathText)
+		{
+			for (const auto &pattern : patternText)
+			{
+				if (harness::GlobMatch(pattern, path))
+				{
+					++hits;
+					break;
+				}
+			}
+		}
+	});
+
+	harness::Consume(hits);
+
+	printf("match:    %.1f ns per path\n", dfaNs);
+	printf("each pattern, backtracking: %.1f ns per path\n", backtrackingNs);
+
+	globdfa::TearDown(&dfa);
+}
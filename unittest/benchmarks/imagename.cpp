@@ -0,0 +1,164 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "unicode.h"
+#include "containers/imagename.h"
+#include "util.h"
+
+using harness::UnicodeString;
+
+//
+// Footprint of image names when every process owns a lower case copy of its name,
+// compared with names interned once per distinct image.
+//
+// 20,000 processes are spread over 200 images.
+//
+TEST_CASE(InternedFootprint)
+{
+	const size_t NUM_PROCESSES = 20000;
+	const size_t NUM_IMAGES = 200;
+
+	std::vector<UnicodeString> images;
+
+	for (size_t i = 0; i < NUM_IMAGES; ++i)
+	{
+		std::u16string path(u"\\device\\harddiskvolume3\\program files\\vendor ");
+
+		for (auto c : std::to_string(i))
+		{
+			path += (char16_t)c;
+		}
+
+		path += u"\\application\\bin\\x64\\application.exe";
+
+		images.emplace_back(path);
+	}
+
+	harness::Random random;
+
+	std::vector<size_t> assignment(NUM_PROCESSES);
+
+	for (auto &image : assignment)
+	{
+		image = (size_t)random.Below(NUM_IMAGES);
+	}
+
+	//
+	// Private copies.
+	//
+
+	auto before = shim::NumOutstandingBytes();
+
+	std::vector<LOWER_UNICODE_STRING> copies(NUM_PROCESSES);
+
+	for (size_t i = 0; i < NUM_PROCESSES; ++i)
+	{
+		REQUIRE(NT_SUCCESS(util::DuplicateString(&copies[i], images[assignment[i]].Lower(), ST_PAGEABLE::NO)));
+	}
+
+	const auto copiedBytes = shim::NumOutstandingBytes() - before;
+
+	for (auto &copy : copies)
+	{
+		util::FreeStringBuffer(&copy);
+	}
+
+	//
+	// Interned names. The table itself is not counted.
+	//
+
+	imagename::CONTEXT *table;
+
+	REQUIRE(NT_SUCCESS(imagename::Initialize(&table)));
+
+	before = shim::NumOutstandingBytes();
+
+	std::vector<imagename::IMAGE_NAME*> names(NUM_PROCESSES);
+
+	for (size_t i = 0; i < NUM_PROCESSES; ++i)
+	{
+		REQUIRE(NT_SUCCESS(imagename::Intern(table, images[assignment[i]].Lower(), &names[i])));
+	}
+
+	const auto internedBytes = shim::NumOutstandingBytes() - before;
+
+	imagename::STATISTICS stats;
+
+	imagename::GetStatistics(table, &stats);
+
+	for (auto name : names)
+	{
+		imagename::Release(name);
+	}
+
+	imagename::TearDown(&table);
+
+	printf("processes %zu, images %zu\n", NUM_PROCESSES, NUM_IMAGES);
+	printf("  private copies: %lld bytes\n", (long long)copiedBytes);
+	printf("  interned names: %lld bytes\n", (long long)internedBytes);
+
+	//
+	// What storing names as a volume index plus a relative path would save at most:
+	// the prefix bytes, less a 16-bit volume index per name.
+	//
+
+	const auto maxSavings = stats.VolumePrefixBytes - (stats.NumEntries * sizeof(USHORT));
+
+	printf("  of which volume prefixes: %zu bytes\n", (size_t)stats.VolumePrefixBytes);
+	printf("  volume index would save at most: %zu bytes (%.1f%%)\n", (size_t)maxSavings,
+		100.0 * (double)maxSavings / (double)internedBytes);
+}
+
+TEST_CASE(InternExisting)
+{
+	imagename::CONTEXT *table;
+
+	REQUIRE(NT_SUCCESS(imagename::Initialize(&table)));
+
+	UnicodeString path(u"\\device\\harddiskvolume3\\program files\\vendor\\application\\application.exe");
+	UnicodeString mixed(u"\\Device\\HarddiskVolume3\\Program Files\\Vendor\\Application\\Application.exe");
+
+	imagename::IMAGE_NAME *name;
+
+	REQUIRE(NT_SUCCESS(imagename::Intern(table, path.Lower(), &name)));
+
+	const size_t ITERATIONS = 200000;
+
+	const auto intern = harness::MeasureNs(ITERATIONS, 5, [&]()
+	{
+		for (size_t i = 0; i < ITERATIONS; ++i)
+		{
+			imagename::IMAGE_NAME *n;
+
+			imagename::Intern(table, path.Lower(), &n);
+			imagename::Release(n);
+		}
+	});
+
+	const auto internDowncase = harness::MeasureNs(ITERATIONS, 5, [&]()
+	{
+		for (size_t i = 0; i < ITERATIONS; ++i)
+		{
+			imagename::IMAGE_NAME *n;
+
+			imagename::InternDowncase(table, mixed.Get(), &n);
+			imagename::Release(n);
+		}
+	});
+
+	const auto findAnyCase = harness::MeasureNs(ITERATIONS, 5, [&]()
+	{
+		for (size_t i = 0; i < ITERATIONS; ++i)
+		{
+			imagename::Release(imagename::FindAnyCase(table, mixed.Get()));
+		}
+	});
+
+	printf("intern + release, existing name: %.1f ns\n", intern);
+	printf("intern downcase + release:       %.1f ns\n", internDowncase);
+	printf("find any case + release:         %.1f ns\n", findAnyCase);
+
+	imagename::Release(name);
+
+	imagename::TearDown(&table);
+}
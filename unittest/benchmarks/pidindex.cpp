@@ -0,0 +1,382 @@
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+#include "harness.h"
+#include "containers/pidindex.h"
+
+namespace
+{
+
+//
+// Touch enough memory to evict the index from all cache levels.
+//
+void
+EvictCaches
+(
+	std::vector<UCHAR> &Buffer
+)
+{
+	for (size_t i = 0; i < Buffer.size(); i += 64)
+	{
+		Buffer[i] += 1;
+	}
+
+	harness::Consume(Buffer[0]);
+}
+
+} // anonymous namespace
+
+//
+// Lock-free lookups of 50k random PIDs, as performed when classifying connections.
+//
+TEST_CASE(QueryAttributes)
+{
+	const size_t NUM_PIDS = 50000;
+	const size_t NUM_LOOKUPS = 4096;
+
+	pidindex::CONTEXT *index;
+
+	REQUIRE(NT_SUCCESS(pidindex::Initialize(&index)));
+
+	harness::Random random;
+
+	std::vector<HANDLE> pids;
+
+	for (size_t i = 0; i < NUM_PIDS; ++i)
+	{
+		auto pid = (HANDLE)(ULONG_PTR)(4 * (1 + random.Below(1 << 20)));
+
+		if (NT_SUCCESS(pidindex::Insert(index, pid, pid, 0)))
+		{
+			pids.push_back(pid);
+		}
+	}
+
+	std::vector<HANDLE> lookups(NUM_LOOKUPS);
+
+	for (auto &pid : lookups)
+	{
+		pid = pids[random.Below(pids.size())];
+	}
+
+	std::vector<UCHAR> evictionBuffer(64 * 1024 * 1024);
+
+	size_t found = 0;
+
+	double coldNs = 0;
+
+	for (size_t r = 0; r < 5; ++r)
+	{
+		EvictCaches(evictionBuffer);
+
+		const auto ns = harness::MeasureNs(NUM_LOOKUPS, 1, [&]()
+		{
+			for (auto pid : lookups)
+			{
+				LONG attributes;
+
+				found += pidindex::QueryAttributes(index, pid, &attributes, NULL);
+			}
+		});
+
+		coldNs = (r == 0) ? ns : min(coldNs, ns);
+	}
+
+	const auto warmNs = harness::MeasureNs(NUM_LOOKUPS, 5, [&]()
+	{
+		for (auto pid : lookups)
+		{
+			LONG attributes;
+
+			found += pidindex::QueryAttributes(index, pid, &attributes, NULL);
+		}
+	});
+
+	harness::Consume(found);
+
+	printf("entries:        %zu\n", pids.size());
+	printf("cold lookup:    %.1f ns\n", coldNs);
+	printf("warm lookup:    %.1f ns\n", warmNs);
+
+	pidindex::TearDown(&index);
+}
+
+//
+// Lookups in the index and in an ordered map of the same PIDs. The map stands in for the AVL
+// table the registry used before, which chased log2(n) pointers for each lookup.
+//
+TEST_CASE(LookupVersusOrderedMap)
+{
+	const size_t NUM_LOOKUPS = 4096;
+
+	printf("%10s %14s %14s\n", "entries", "index", "ordered map");
+
+	harness::Random random;
+
+	for (size_t numPids : { 1000, 15000, 100000 })
+	{
+		pidindex::CONTEXT *index;
+
+		REQUIRE(NT_SUCCESS(pidindex::Initialize(&index)));
+
+		std::map<HANDLE, LONG> map;
+		std::vector<HANDLE> pids;
+
+		while (pids.size() < numPids)
+		{
+			auto pid = (HANDLE)(ULONG_PTR)(4 * (1 + random.Below(1 << 20)));
+
+			if (NT_SUCCESS(pidindex::Insert(index, pid, pid, 0)))
+			{
+				map[pid] = 0;
+				pids.push_back(pid);
+			}
+		}
+
+		std::vector<HANDLE> lookups(NUM_LOOKUPS);
+
+		for (auto &pid : lookups)
+		{
+			pid = pids[random.Below(pids.size())];
+		}
+
+		size_t found = 0;
+
+		const auto indexNs = harness::MeasureNs(NUM_LOOKUPS, 5, [&]()
+		{
+			for (auto pid : lookups)
+			{
+				LONG attributes;
+
+				found += pidindex::QueryAttributes(index, pid, &attributes, NULL);
+			}
+		});
+
+		const auto mapNs = harness::MeasureNs(NUM_LOOKUPS, 5, [&]()
+		{
+			for (auto pid : lookups)
+			{
+				found += (map.find(pid) != map.end());
+			}
+		});
+
+		harness::Consume(found);
+
+		printf("%10zu %11.1f ns %11.1f ns\n", numPids, indexNs, mapNs);
+
+		pidindex::TearDown(&index);
+	}
+}
+
+//
+// Processes departing and new processes arriving in their place, with the number of live
+// processes held steady. Each pair is one Remove() and one Insert().
+//
+// Windows hands out the PIDs of departed processes again, so live PIDs stay within a range
+// proportional to the number of live processes. New processes either take the PID that was
+// freed least recently, or a PID that has never been used. The latter sweeps PIDs through
+// the slot array, and homes that wrap around land on runs of occupied slots.
+//
+TEST_CASE(Churn)
+{
+	const size_t NUM_PAIRS = 100000;
+
+	printf("%10s %14s %14s\n", "live", "reused PIDs", "fresh PIDs");
+
+	harness::Random random;
+
+	for (size_t numLive : { 1000, 15000, 100000 })
+	{
+		std::vector<size_t> departing(NUM_PAIRS);
+
+		for (auto &slot : departing)
+		{
+			slot = random.Below(numLive);
+		}
+
+		double ns[2];
+
+		for (int fresh = 0; fresh < 2; ++fresh)
+		{
+			pidindex::CONTEXT *index;
+
+			REQUIRE(NT_SUCCESS(pidindex::Initialize(&index)));
+
+			std::vector<HANDLE> live;
+
+			size_t nextPid = 1;
+
+			while (live.size() < numLive)
+			{
+				auto pid = (HANDLE)(ULONG_PTR)(4 * nextPid++);
+
+				REQUIRE(NT_SUCCESS(pidindex::Insert(index, pid, pid, 0)));
+
+				live.push_back(pid);
+			}
+
+			//
+			// Freed PIDs, oldest first. Seeded so there is always one to reuse.
+			//
+			std::vector<HANDLE> freed;
+
+			for (size_t i = 0; i < numLive / 4; ++i)
+			{
+				freed.push_back((HANDLE)(ULONG_PTR)(4 * nextPid++));
+			}
+
+			size_t oldestFreed = 0;
+
+			ns[fresh] = harness::MeasureNs(NUM_PAIRS, 1, [&]()
+			{
+				for (auto slot : departing)
+				{
+					pidindex::Remove(index, live[slot]);
+
+					HANDLE pid;
+
+					if (fresh != 0)
+					{
+						pid = (HANDLE)(ULONG_PTR)(4 * nextPid++);
+					}
+					else
+					{
+						freed.push_back(live[slot]);
+
+						pid = freed[oldestFreed++];
+					}
+
+					pidindex::Insert(index, pid, pid, 0);
+
+					live[slot] = pid;
+				}
+			});
+
+			REQUIRE(pidindex::NumEntries(index) == numLive);
+
+			pidindex::TearDown(&index);
+		}
+
+		printf("%10zu %11.1f ns %11.1f ns\n", numLive, ns[0], ns[1]);
+	}
+}
+
+//
+// Lock-free lookups by 1 to 64 reader threads, while a single writer updates attributes
+// and replaces processes as fast as it can. This is callouts classifying connections on
+// every processor, while procmgmt applies process events.
+//
+// Each row runs for a fixed time. Throughput only scales while there are processors to
+// run the readers on; beyond that the threads share processors with each other.
+//
+TEST_CASE(ConcurrentReaders)
+{
+	const size_t NUM_PIDS = 15000;
+	const auto DURATION = std::chrono::milliseconds(250);
+
+	printf("processors: %u\n", std::thread::hardware_concurrency());
+	printf("%10s %16s %16s %16s\n", "readers", "lookups/s", "per reader/s", "writes/s");
+
+	for (size_t numReaders = 1; numReaders <= 64; numReaders *= 2)
+	{
+		pidindex::CONTEXT *index;
+
+		REQUIRE(NT_SUCCESS(pidindex::Initialize(&index)));
+
+		for (size_t pid = 1; pid <= NUM_PIDS; ++pid)
+		{
+			const auto handle = (HANDLE)(ULONG_PTR)(4 * pid);
+
+			REQUIRE(NT_SUCCESS(pidindex::Insert(index, handle, handle, 0)));
+		}
+
+		std::atomic<bool> done(false);
+		std::atomic<size_t> started(0);
+		std::atomic<size_t> totalLookups(0);
+
+		std::vector<std::thread> readers;
+
+		for (size_t r = 0; r < numReaders; ++r)
+		{
+			readers.emplace_back([&, r]()
+			{
+				harness::Random random(r + 1);
+
+				size_t lookups = 0;
+				size_t found = 0;
+
+				++started;
+
+				while (!done.load(std::memory_order_relaxed))
+				{
+					for (size_t i = 0; i < 64; ++i)
+					{
+						LONG attributes;
+
+						const auto pid = (HANDLE)(ULONG_PTR)(4 * (1 + random.Below(NUM_PIDS)));
+
+						found += pidindex::QueryAttributes(index, pid, &attributes, NULL);
+					}
+
+					lookups += 64;
+				}
+
+				harness::Consume(found);
+
+				totalLookups += lookups;
+			});
+		}
+
+		while (started.load() != numReaders)
+		{
+			std::this_thread::yield();
+		}
+
+		//
+		// Alternate between updating attributes and replacing a process, which shifts
+		// slots on removal.
+		//
+
+		harness::Random random;
+
+		size_t writes = 0;
+
+		const auto start = std::chrono::steady_clock::now();
+
+		while (std::chrono::steady_clock::now() - start < DURATION)
+		{
+			for (size_t i = 0; i < 64; ++i)
+			{
+				const auto pid = (HANDLE)(ULONG_PTR)(4 * (1 + random.Below(NUM_PIDS)));
+
+				if (i % 2 == 0)
+				{
+					pidindex::SetAttributes(index, pid, (LONG)writes);
+				}
+				else
+				{
+					pidindex::Remove(index, pid);
+					pidindex::Insert(index, pid, pid, (LONG)writes);
+				}
+
+				++writes;
+			}
+		}
+
+		done.store(true);
+
+		for (auto &reader : readers)
+		{
+			reader.join();
+		}
+
+		const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("%10zu %16.3e %16.3e %16.3e\n", numReaders, totalLookups.load() / seconds,
+			totalLookups.load() / seconds / numReaders, writes / seconds);
+
+		pidindex::TearDown(&index);
+	}
+}
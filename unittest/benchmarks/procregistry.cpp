@@ -0,0 +1,514 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "processtree.h"
+
+using harness::Numbered;
+using harness::Pid;
+using harness::ProcessTree;
+using harness::Snapshot;
+
+namespace
+{
+
+//
+// Snapshot shaped like a running system: a few hundred distinct images, and each process
+// started by a random earlier process. Listed in random order.
+//
+Snapshot
+SystemSnapshot
+(
+	harness::Random &Random,
+	size_t NumProcesses
+)
+{
+	Snapshot snapshot;
+
+	for (size_t i = 1; i <= NumProcesses; ++i)
+	{
+		const auto parent = (i > 1) ? 1 + Random.Below(i - 1) : 0;
+
+		snapshot.Add(Pid(parent), Pid(i),
+			Numbered(u"\\device\\harddiskvolume1\\program files\\vendor\\app", Random.Below(300)) + u".exe");
+	}
+
+	snapshot.Shuffle(Random);
+
+	return snapshot;
+}
+
+//
+// A single chain of processes, listed in pairs with the child ahead of its parent.
+//
+// Adding entries one by one then leaves every other entry to be linked afterwards, and
+// each of those links checks the entire ancestry of the parent for a cycle.
+//
+Snapshot
+ChainSnapshot
+(
+	size_t NumProcesses
+)
+{
+	Snapshot snapshot;
+
+	for (size_t i = 1; i <= NumProcesses; i += 2)
+	{
+		if (i + 1 <= NumProcesses)
+		{
+			snapshot.Add(Pid(i), Pid(i + 1), Numbered(u"\\device\\harddiskvolume1\\app", i % 10) + u".exe");
+		}
+
+		snapshot.Add(Pid(i - 1), Pid(i), Numbered(u"\\device\\harddiskvolume1\\app", i % 10) + u".exe");
+	}
+
+	return snapshot;
+}
+
+//
+// The registration loop before the snapshot was added in bulk: reserve the index, add each
+// entry, then resolve the parents of entries that were added ahead of their parent.
+//
+bool
+AddOneByOne
+(
+	procregistry::CONTEXT *Registry,
+	Snapshot &Snapshot
+)
+{
+	if (!NT_SUCCESS(procregistry::Reserve(Registry, Snapshot.Size())))
+	{
+		return false;
+	}
+
+	auto entries = Snapshot.Entries();
+
+	for (size_t i = 0; i < Snapshot.Size(); ++i)
+	{
+		procregistry::PROCESS_REGISTRY_ENTRY entry;
+
+		auto status = procregistry::InitializeEntryLower(Registry, entries[i].ParentProcessId,
+			entries[i].ProcessId, ST_PROCESS_SPLIT_STATUS_OFF, &entries[i].ImageName, &entry);
+
+		if (!NT_SUCCESS(status))
+		{
+			return false;
+		}
+
+		status = procregistry::AddEntry(Registry, &entry);
+
+		if (!NT_SUCCESS(status))
+		{
+			procregistry::ReleaseEntry(&entry);
+
+			return false;
+		}
+	}
+
+	procregistry::ResolveParentLinks(Registry);
+
+	return true;
+}
+
+//
+// Time both ways of registering `Snapshot` and print a row.
+//
+void
+MeasureRegistration
+(
+	Snapshot &Snapshot,
+	size_t Repetitions
+)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	double oneByOneNs = 0;
+	double snapshotNs = 0;
+
+	for (size_t r = 0; r < Repetitions; ++r)
+	{
+		bool added;
+
+		auto ns = harness::MeasureNs(1, 1, [&]()
+		{
+			added = AddOneByOne(tree.Registry(), Snapshot);
+		});
+
+		REQUIRE(added);
+
+		oneByOneNs = (r == 0) ? ns : min(oneByOneNs, ns);
+
+		procregistry::Reset(tree.Registry());
+
+		NTSTATUS status;
+
+		ns = harness::MeasureNs(1, 1, [&]()
+		{
+			status = tree.AddSnapshot(Snapshot);
+		});
+
+		REQUIRE(NT_SUCCESS(status));
+
+		snapshotNs = (r == 0) ? ns : min(snapshotNs, ns);
+
+		procregistry::Reset(tree.Registry());
+	}
+
+	printf("%10zu %11.2f ms %11.2f ms\n", Snapshot.Size(), oneByOneNs / 1e6, snapshotNs / 1e6);
+}
+
+//
+// An event for a process that arrives or departs after the snapshot was registered.
+//
+struct PROCESS_EVENT
+{
+	bool Arriving;
+	HANDLE ParentProcessId;
+	HANDLE ProcessId;
+
+	// Index of the image name in the snapshot.
+	size_t Image;
+};
+
+//
+// Processes arriving and the oldest processes departing, in turns.
+// New processes are started by a random live process.
+//
+std::vector<PROCESS_EVENT>
+ChurnEvents
+(
+	harness::Random &Random,
+	size_t NumLive,
+	size_t NumEvents
+)
+{
+	std::vector<PROCESS_EVENT> events;
+	std::vector<size_t> live;
+
+	for (size_t i = 1; i <= NumLive; ++i)
+	{
+		live.push_back(i);
+	}
+
+	size_t nextPid = NumLive + 1;
+	size_t oldest = 0;
+
+	for (size_t i = 0; i < NumEvents; ++i)
+	{
+		if (i % 2 == 0)
+		{
+			const auto parent = live[oldest + Random.Below(live.size() - oldest)];
+
+			events.push_back({ true, Pid(parent), Pid(nextPid), (size_t)Random.Below(NumLive) });
+
+			live.push_back(nextPid++);
+		}
+		else
+		{
+			events.push_back({ false, 0, Pid(live[oldest++]), 0 });
+		}
+	}
+
+	return events;
+}
+
+//
+// Apply events to the registry in batches, the way procmgmt does.
+// Entries for arriving processes are initialized before the lock is acquired.
+//
+// The lock is either held for each registry update, or once for each batch.
+//
+void
+ApplyEvents
+(
+	procregistry::CONTEXT *Registry,
+	WDFSPINLOCK Lock,
+	const std::vector<PROCESS_EVENT> &Events,
+	Snapshot &Names,
+	size_t BatchSize,
+	bool LockPerBatch
+)
+{
+	std::vector<procregistry::PROCESS_REGISTRY_ENTRY> prepared(BatchSize);
+
+	auto names = Names.Entries();
+
+	for (size_t first = 0; first < Events.size(); first += BatchSize)
+	{
+		const auto end = min(first + BatchSize, Events.size());
+
+		for (size_t i = first; i < end; ++i)
+		{
+			const auto &event = Events[i];
+
+			if (event.Arriving)
+			{
+				REQUIRE(NT_SUCCESS(procregistry::InitializeEntryLower(Registry, event.ParentProcessId,
+					event.ProcessId, ST_PROCESS_SPLIT_STATUS_OFF, &names[event.Image].ImageName,
+					&prepared[i - first])));
+			}
+		}
+
+		if (LockPerBatch)
+		{
+			WdfSpinLockAcquire(Lock);
+		}
+
+		for (size_t i = first; i < end; ++i)
+		{
+			const auto &event = Events[i];
+
+			if (!LockPerBatch)
+			{
+				WdfSpinLockAcquire(Lock);
+			}
+
+			if (event.Arriving)
+			{
+				procregistry::AddEntry(Registry, &prepared[i - first]);
+			}
+			else
+			{
+				procregistry::DeleteEntry(Registry, procregistry::FindEntry(Registry, event.ProcessId));
+			}
+
+			if (!LockPerBatch)
+			{
+				WdfSpinLockRelease(Lock);
+			}
+		}
+
+		if (LockPerBatch)
+		{
+			WdfSpinLockRelease(Lock);
+		}
+	}
+}
+
+} // anonymous namespace
+
+//
+// Registering a process snapshot, as done by IOCTL_ST_REGISTER_PROCESSES.
+// Image names are already lower case, so only the registry is measured.
+//
+TEST_CASE(RegisterSnapshot)
+{
+	printf("%10s %14s %14s\n", "processes", "one by one", "snapshot");
+
+	harness::Random random;
+
+	for (size_t numProcesses : { 1000, 10000, 100000 })
+	{
+		auto snapshot = SystemSnapshot(random, numProcesses);
+
+		MeasureRegistration(snapshot, 5);
+	}
+}
+
+//
+// Worst case for adding entries one by one, which is quadratic in the depth of the tree.
+// Larger chains take minutes to register that way.
+//
+TEST_CASE(RegisterChain)
+{
+	printf("%10s %14s %14s\n", "processes", "one by one", "snapshot");
+
+	for (size_t numProcesses : { 1000, 10000, 30000 })
+	{
+		auto snapshot = ChainSnapshot(numProcesses);
+
+		MeasureRegistration(snapshot, 1);
+	}
+}
+
+//
+// Releasing a registered snapshot, as done by IOCTL_ST_RESET.
+// Deleting entries one by one is what the registry did before it was reset in bulk,
+// and what a paged registry still does.
+//
+TEST_CASE(Reset)
+{
+	printf("%10s %14s %14s\n", "processes", "one by one", "reset");
+
+	harness::Random random;
+
+	for (size_t numProcesses : { 1000, 10000, 100000 })
+	{
+		auto snapshot = SystemSnapshot(random, numProcesses);
+
+		ProcessTree tree;
+
+		REQUIRE(NT_SUCCESS(tree.Status()));
+
+		const size_t REPETITIONS = 5;
+
+		double oneByOneNs = 0;
+		double resetNs = 0;
+
+		for (size_t r = 0; r < REPETITIONS; ++r)
+		{
+			REQUIRE(NT_SUCCESS(tree.AddSnapshot(snapshot)));
+
+			auto entries = tree.Entries();
+
+			auto ns = harness::MeasureNs(1, 1, [&]()
+			{
+				for (auto entry : entries)
+				{
+					procregistry::DeleteEntry(tree.Registry(), entry);
+				}
+			});
+
+			REQUIRE(procregistry::IsEmpty(tree.Registry()));
+
+			oneByOneNs = (r == 0) ? ns : min(oneByOneNs, ns);
+
+			REQUIRE(NT_SUCCESS(tree.AddSnapshot(snapshot)));
+
+			ns = harness::MeasureNs(1, 1, [&]()
+			{
+				procregistry::Reset(tree.Registry());
+			});
+
+			resetNs = (r == 0) ? ns : min(resetNs, ns);
+		}
+
+		printf("%10zu %11.2f ms %11.2f ms\n", numProcesses, oneByOneNs / 1e6, resetNs / 1e6);
+	}
+}
+
+//
+// Applying a stream of process events in batches, as done by procmgmt.
+// The registry lock is taken either for each event, or once for each batch.
+//
+TEST_CASE(ApplyEventBatch)
+{
+	const size_t NUM_LIVE = 1000;
+	const size_t NUM_EVENTS = 20000;
+	const size_t REPETITIONS = 10;
+
+	harness::Random random;
+
+	auto snapshot = SystemSnapshot(random, NUM_LIVE);
+	auto events = ChurnEvents(random, NUM_LIVE, NUM_EVENTS);
+
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	WDFSPINLOCK lock;
+
+	REQUIRE(NT_SUCCESS(WdfSpinLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &lock)));
+
+	printf("%10s %14s %14s %14s\n", "batch", "per event", "per batch", "acquisitions");
+
+	for (size_t batchSize : { 1, 8, 32, 128 })
+	{
+		double best[2] = { 0, 0 };
+
+		for (size_t r = 0; r < REPETITIONS; ++r)
+		{
+			for (int lockPerBatch = 0; lockPerBatch < 2; ++lockPerBatch)
+			{
+				REQUIRE(NT_SUCCESS(tree.AddSnapshot(snapshot)));
+
+				const auto ns = harness::MeasureNs(events.size(), 1, [&]()
+				{
+					ApplyEvents(tree.Registry(), lock, events, snapshot, batchSize, lockPerBatch != 0);
+				});
+
+				REQUIRE(tree.Entries().size() == NUM_LIVE);
+
+				best[lockPerBatch] = (r == 0) ? ns : min(best[lockPerBatch], ns);
+
+				procregistry::Reset(tree.Registry());
+			}
+		}
+
+		printf("%10zu %11.1f ns %11.1f ns %14zu\n", batchSize, best[0], best[1],
+			(events.size() + batchSize - 1) / batchSize);
+	}
+
+	WdfObjectDelete(lock);
+}
+
+//
+// Processes arriving and departing at a steady rate, with `live` processes running.
+// The oldest processes depart first, and they have accumulated the most children, which
+// are orphaned as they go.
+//
+// Each event is one AddEntry() or one DeleteEntry(). A departure costs time in proportion
+// to the children it orphans. The number of live processes only matters through cache
+// misses once the registry outgrows the caches.
+//
+TEST_CASE(Churn)
+{
+	const size_t NUM_EVENTS = 200000;
+
+	printf("%10s %14s %16s\n", "live", "per event", "events/s");
+
+	harness::Random random;
+
+	for (size_t numLive : { 1000, 10000, 100000 })
+	{
+		auto snapshot = SystemSnapshot(random, numLive);
+		auto events = ChurnEvents(random, numLive, NUM_EVENTS);
+
+		auto names = snapshot.Entries();
+
+		ProcessTree tree;
+
+		REQUIRE(NT_SUCCESS(tree.Status()));
+
+		//
+		// The snapshot lists PIDs 1 through `numLive`, which are also the PIDs that
+		// ChurnEvents() starts out with.
+		//
+
+		double best = 0;
+
+		for (size_t r = 0; r < 3; ++r)
+		{
+			REQUIRE(NT_SUCCESS(tree.AddSnapshot(snapshot)));
+
+			std::vector<procregistry::PROCESS_REGISTRY_ENTRY> prepared(events.size());
+
+			for (size_t i = 0; i < events.size(); ++i)
+			{
+				const auto &event = events[i];
+
+				if (event.Arriving)
+				{
+					REQUIRE(NT_SUCCESS(procregistry::InitializeEntryLower(tree.Registry(), event.ParentProcessId,
+						event.ProcessId, ST_PROCESS_SPLIT_STATUS_OFF, &names[event.Image].ImageName, &prepared[i])));
+				}
+			}
+
+			const auto ns = harness::MeasureNs(events.size(), 1, [&]()
+			{
+				for (size_t i = 0; i < events.size(); ++i)
+				{
+					const auto &event = events[i];
+
+					if (event.Arriving)
+					{
+						procregistry::AddEntry(tree.Registry(), &prepared[i]);
+					}
+					else
+					{
+						procregistry::DeleteEntryById(tree.Registry(), event.ProcessId);
+					}
+				}
+			});
+
+			REQUIRE(tree.Entries().size() == numLive);
+
+			best = (r == 0) ? ns : min(best, ns);
+
+			procregistry::Reset(tree.Registry());
+		}
+
+		printf("%10zu %11.1f ns %16.3e\n", numLive, best, 1e9 / best);
+	}
+}
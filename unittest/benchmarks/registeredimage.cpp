@@ -0,0 +1,469 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "unicode.h"
+#include "containers/registeredimage.h"
+
+using harness::UnicodeString;
+
+namespace
+{
+
+std::u16string
+NumberedPath
+(
+	const char16_t *Prefix,
+	size_t Number
+)
+{
+	std::u16string path(u"\\device\\harddiskvolume3\\program files\\");
+
+	path += Prefix;
+
+	for (auto c : std::to_string(Number))
+	{
+		path += (char16_t)c;
+	}
+
+	return path + u"\\application.exe";
+}
+
+//
+// The representation before entries were hashed: a list of entries,
+// searched by comparing interned name pointers.
+//
+struct LIST_ENTRY_REFERENCE
+{
+	LIST_ENTRY ListEntry;
+	imagename::IMAGE_NAME *ImageName;
+};
+
+bool
+ListHasEntryExact
+(
+	LIST_ENTRY *List,
+	const imagename::IMAGE_NAME *ImageName
+)
+{
+	for (auto entry = List->Flink; entry != List; entry = entry->Flink)
+	{
+		if (((LIST_ENTRY_REFERENCE*)entry)->ImageName == ImageName)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+} // anonymous namespace
+
+//
+// Exact lookups of interned names, half of which are configured.
+//
+TEST_CASE(ExactLookup)
+{
+	imagename::CONTEXT *imageNames;
+
+	REQUIRE(NT_SUCCESS(imagename::Initialize(&imageNames)));
+
+	printf("%10s %12s %12s %12s\n", "entries", "list", "hash", "any case");
+
+	for (size_t numEntries : { 10, 100, 1000, 10000 })
+	{
+		registeredimage::CONTEXT *images;
+
+		REQUIRE(NT_SUCCESS(registeredimage::Initialize(&images, imageNames, ST_PAGEABLE::NO)));
+
+		LIST_ENTRY list;
+
+		InitializeListHead(&list);
+
+		std::vector<imagename::IMAGE_NAME*> configured;
+		std::vector<imagename::IMAGE_NAME*> queries;
+		std::vector<UnicodeString> upperQueries;
+
+		for (size_t i = 0; i < numEntries; ++i)
+		{
+			UnicodeString path(NumberedPath(u"configured ", i));
+			UnicodeString other(NumberedPath(u"other ", i));
+
+			imagename::IMAGE_NAME *name, *otherName;
+
+			REQUIRE(NT_SUCCESS(imagename::InternDowncase(imageNames, path.Get(), &name)));
+			REQUIRE(NT_SUCCESS(imagename::InternDowncase(imageNames, other.Get(), &otherName)));
+
+			REQUIRE(NT_SUCCESS(registeredimage::AddEntryExact(images, name)));
+
+			//
+			// List nodes are allocated one by one, as they were.
+			//
+
+			auto node = (LIST_ENTRY_REFERENCE*)ExAllocatePoolUninitialized(NonPagedPool,
+				sizeof(LIST_ENTRY_REFERENCE), ST_POOL_TAG);
+
+			REQUIRE(node != NULL);
+
+			node->ImageName = name;
+
+			InsertTailList(&list, &node->ListEntry);
+
+			configured.push_back(name);
+
+			queries.push_back(name);
+			queries.push_back(otherName);
+
+			std::u16string upper(path.Text());
+
+			for (auto &c : upper)
+			{
+				if (c >= u'a' && c <= u'z')
+				{
+					c = (char16_t)(c - 0x20);
+				}
+			}
+
+			upperQueries.emplace_back(upper);
+			upperQueries.emplace_back(other.Text());
+		}
+
+		harness::Random random;
+
+		std::vector<size_t> order(4096);
+
+		for (auto &index : order)
+		{
+			index = (size_t)random.Below(queries.size());
+		}
+
+		size_t hits = 0;
+
+		const auto listNs = harness::MeasureNs(order.size(), 5, [&]()
+		{
+			for (auto index : order)
+			{
+				hits += ListHasEntryExact(&list, queries[index]);
+			}
+		});
+
+		const auto hashNs = harness::MeasureNs(order.size(), 5, [&]()
+		{
+			for (auto index : order)
+			{
+				hits += registeredimage::HasEntryExact(images, queries[index]);
+			}
+		});
+
+		const auto anyCaseNs = harness::MeasureNs(order.size(), 5, [&]()
+		{
+			for (auto index : order)
+			{
+				hits += registeredimage::HasEntry(images, upperQueries[index].Get());
+			}
+		});
+
+		harness::Consume(hits);
+
+		printf("%10zu %9.1f ns %9.1f ns %9.1f ns\n", numEntries, listNs, hashNs, anyCaseNs);
+
+		while (!IsListEmpty(&list))
+		{
+			ExFreePoolWithTag(RemoveHeadList(&list), ST_POOL_TAG);
+		}
+
+		registeredimage::TearDown(&images);
+
+		for (auto name : queries)
+		{
+			imagename::Release(name);
+		}
+	}
+
+	imagename::TearDown(&imageNames);
+}
+
+//
+// Exact lookups of configured and of unconfigured names, at the highest load factor.
+// Most lookups miss, and are rejected by the filter without visiting a bucket.
+//
+TEST_CASE(ExactLookupMiss)
+{
+	imagename::CONTEXT *imageNames;
+
+	REQUIRE(NT_SUCCESS(imagename::Initialize(&imageNames)));
+
+	printf("%10s %12s %12s\n", "entries", "hit", "miss");
+
+	for (size_t numEntries : { 16, 256, 4096, 65536 })
+	{
+		registeredimage::CONTEXT *images;
+
+		REQUIRE(NT_SUCCESS(registeredimage::Initialize(&images, imageNames, ST_PAGEABLE::NO)));
+
+		std::vector<imagename::IMAGE_NAME*> configured;
+		std::vector<imagename::IMAGE_NAME*> other;
+
+		for (size_t i = 0; i < numEntries; ++i)
+		{
+			UnicodeString path(NumberedPath(u"configured ", i));
+			UnicodeString otherPath(NumberedPath(u"other ", i));
+
+			imagename::IMAGE_NAME *name, *otherName;
+
+			REQUIRE(NT_SUCCESS(imagename::InternDowncase(imageNames, path.Get(), &name)));
+			REQUIRE(NT_SUCCESS(imagename::InternDowncase(imageNames, otherPath.Get(), &otherName)));
+
+			REQUIRE(NT_SUCCESS(registeredimage::AddEntryExact(images, name)));
+
+			configured.push_back(name);
+			other.push_back(otherName);
+		}
+
+		harness::Random random;
+
+		std::vector<size_t> order(4096);
+
+		for (auto &index : order)
+		{
+			index = (size_t)random.Below(numEntries);
+		}
+
+		size_t hits = 0;
+
+		const auto hitNs = harness::MeasureNs(order.size(), 5, [&]()
+		{
+			for (auto index : order)
+			{
+				hits += registeredimage::HasEntryExact(images, configured[index]);
+			}
+		});
+
+		REQUIRE(hits == 5 * order.size());
+
+		const auto missNs = harness::MeasureNs(order.size(), 5, [&]()
+		{
+			for (auto index : order)
+			{
+				hits += registeredimage::HasEntryExact(images, other[index]);
+			}
+		});
+
+		harness::Consume(hits);
+
+		printf("%10zu %9.1f ns %9.1f ns\n", numEntries, hitNs, missNs);
+
+		registeredimage::TearDown(&images);
+
+		for (size_t i = 0; i < numEntries; ++i)
+		{
+			imagename::Release(configured[i]);
+			imagename::Release(other[i]);
+		}
+	}
+
+	imagename::TearDown(&imageNames);
+}
+
+//
+// Releasing a configuration, as done when it's cleared or replaced.
+// The reference frees list nodes to the pool one by one, as the configuration did before
+// entries were allocated from an arena.
+//
+TEST_CASE(Reset)
+{
+	imagename::CONTEXT *imageNames;
+
+	REQUIRE(NT_SUCCESS(imagename::Initialize(&imageNames)));
+
+	printf("%10s %12s %12s\n", "entries", "list", "reset");
+
+	for (size_t numEntries : { 1000, 10000, 100000 })
+	{
+		registeredimage::CONTEXT *images;
+
+		REQUIRE(NT_SUCCESS(registeredimage::Initialize(&images, imageNames, ST_PAGEABLE::NO)));
+
+		std::vector<imagename::IMAGE_NAME*> names;
+
+		for (size_t i = 0; i < numEntries; ++i)
+		{
+			UnicodeString path(NumberedPath(u"configured ", i));
+
+			imagename::IMAGE_NAME *name;
+
+			REQUIRE(NT_SUCCESS(imagename::InternDowncase(imageNames, path.Get(), &name)));
+
+			names.push_back(name);
+		}
+
+		const size_t REPETITIONS = 5;
+
+		double listNs = 0;
+		double resetNs = 0;
+
+		for (size_t r = 0; r < REPETITIONS; ++r)
+		{
+			LIST_ENTRY list;
+
+			InitializeListHead(&list);
+
+			for (auto name : names)
+			{
+				auto node = (LIST_ENTRY_REFERENCE*)ExAllocatePoolUninitialized(NonPagedPool,
+					sizeof(LIST_ENTRY_REFERENCE), ST_POOL_TAG);
+
+				REQUIRE(node != NULL);
+
+				imagename::AddRef(name);
+
+				node->ImageName = name;
+
+				InsertTailList(&list, &node->ListEntry);
+			}
+
+			auto ns = harness::MeasureNs(1, 1, [&]()
+			{
+				while (!IsListEmpty(&list))
+				{
+					auto node = (LIST_ENTRY_REFERENCE*)RemoveHeadList(&list);
+
+					imagename::Release(node->ImageName);
+
+					ExFreePoolWithTag(node, ST_POOL_TAG);
+				}
+			});
+
+			listNs = (r == 0) ? ns : min(listNs, ns);
+
+			for (auto name : names)
+			{
+				REQUIRE(NT_SUCCESS(registeredimage::AddEntryExact(images, name)));
+			}
+
+			ns = harness::MeasureNs(1, 1, [&]()
+			{
+				registeredimage::Reset(images);
+			});
+
+			resetNs = (r == 0) ? ns : min(resetNs, ns);
+		}
+
+		printf("%10zu %9.2f ms %9.2f ms\n", numEntries, listNs / 1e6, resetNs / 1e6);
+
+		for (auto name : names)
+		{
+			imagename::Release(name);
+		}
+
+		registeredimage::TearDown(&images);
+	}
+
+	imagename::TearDown(&imageNames);
+}
+
+//
+// Replay the configuration lookups made in the process creation notification, for a trace
+// of process creations with mixed-case image names as reported by the system.
+//
+// Most images that are started are already running, so their names are interned, and few
+// of them are configured. The trace is replayed against an empty configuration and against
+// configurations of increasing size.
+//
+TEST_CASE(NotifyPathReplay)
+{
+	imagename::CONTEXT *imageNames;
+
+	REQUIRE(NT_SUCCESS(imagename::Initialize(&imageNames)));
+
+	const size_t NUM_RUNNING_IMAGES = 2000;
+	const size_t NUM_CREATIONS = 4096;
+
+	//
+	// Names kept interned by the process registry, and their mixed-case equivalents.
+	//
+
+	std::vector<imagename::IMAGE_NAME*> running;
+	std::vector<UnicodeString> reported;
+
+	for (size_t i = 0; i < NUM_RUNNING_IMAGES; ++i)
+	{
+		std::u16string path(NumberedPath(u"Vendor ", i));
+
+		path[1] = u'D';
+
+		UnicodeString mixed(path);
+
+		imagename::IMAGE_NAME *name;
+
+		REQUIRE(NT_SUCCESS(imagename::InternDowncase(imageNames, mixed.Get(), &name)));
+
+		running.push_back(name);
+		reported.emplace_back(path);
+	}
+
+	harness::Random random;
+
+	//
+	// One in eight creations is of an image that isn't running.
+	//
+
+	std::vector<UnicodeString> trace;
+
+	for (size_t i = 0; i < NUM_CREATIONS; ++i)
+	{
+		const auto path = (random.Below(8) == 0)
+			? NumberedPath(u"New ", i)
+			: reported[random.Below(NUM_RUNNING_IMAGES)].Text();
+
+		trace.emplace_back(path);
+	}
+
+	printf("%10s %12s %12s %10s\n", "entries", "HasEntry", "notify path", "matched");
+
+	for (size_t numEntries : { 0, 10, 100 })
+	{
+		registeredimage::CONTEXT *images;
+
+		REQUIRE(NT_SUCCESS(registeredimage::Initialize(&images, imageNames, ST_PAGEABLE::NO)));
+
+		for (size_t i = 0; i < numEntries; ++i)
+		{
+			REQUIRE(NT_SUCCESS(registeredimage::AddEntryExact(images, running[i])));
+		}
+
+		size_t matched = 0;
+
+		const auto hasEntryNs = harness::MeasureNs(trace.size(), 5, [&]()
+		{
+			for (auto &name : trace)
+			{
+				matched += registeredimage::HasEntry(images, name.Get());
+			}
+		});
+
+		size_t notifyMatched = 0;
+
+		const auto notifyNs = harness::MeasureNs(trace.size(), 5, [&]()
+		{
+			for (auto &name : trace)
+			{
+				notifyMatched += (!registeredimage::IsEmpty(images)
+					&& registeredimage::HasEntry(images, name.Get()));
+			}
+		});
+
+		REQUIRE(matched == notifyMatched);
+
+		printf("%10zu %9.1f ns %9.1f ns %9.1f%%\n", numEntries, hasEntryNs, notifyNs,
+			100.0 * matched / (5 * trace.size()));
+
+		registeredimage::TearDown(&images);
+	}
+
+	for (auto name : running)
+	{
+		imagename::Release(name);
+	}
+
+	imagename::TearDown(&imageNames);
+}
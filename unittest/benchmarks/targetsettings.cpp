@@ -0,0 +1,156 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "processtree.h"
+#include "targetsettings.h"
+
+using harness::Configuration;
+using harness::Numbered;
+using harness::Pid;
+using harness::ProcessTree;
+using registeredimage::ENTRY_TYPE;
+
+//
+// Target computation for a single chain of processes, none of which is split.
+// Every ancestry walk therefore runs all the way to the root.
+//
+TEST_CASE(Chain)
+{
+	printf("%8s %16s %16s\n", "depth", "ancestry walks", "topological");
+
+	for (size_t depth : { 1000, 5000, 20000 })
+	{
+		ProcessTree tree;
+
+		REQUIRE(NT_SUCCESS(tree.Status()));
+
+		for (size_t i = 1; i <= depth; ++i)
+		{
+			REQUIRE(tree.Add(Pid(i - 1), Pid(i), Numbered(u"\\device\\harddiskvolume1\\app", i % 10) + u".exe"));
+		}
+
+		Configuration config(tree.ImageNames());
+
+		REQUIRE(NT_SUCCESS(config.Status()));
+		REQUIRE(config.Add(ENTRY_TYPE::EXACT, u"\\device\\harddiskvolume1\\other.exe"));
+
+		auto entries = tree.Entries();
+
+		size_t split = 0;
+
+		const auto walkNs = harness::MeasureNs(1, 3, [&]()
+		{
+			for (auto entry : entries)
+			{
+				split += util::SplittingEnabled(harness::AncestryWalkTargetSplit(config.Get(), entry));
+			}
+		});
+
+		const auto topologicalNs = harness::MeasureNs(1, 3, [&]()
+		{
+			targetsettings::ComputeAll(tree.Registry(), config.Get());
+		});
+
+		harness::Consume(split);
+
+		printf("%8zu %13.1f us %13.1f us\n", depth, walkNs / 1e3, topologicalNs / 1e3);
+	}
+}
+
+//
+// A single entry is added to the configuration of a registry with 20k processes.
+// The delta covers collecting the affected subtrees and computing their target settings.
+// Filter updates are not included.
+//
+TEST_CASE(Delta)
+{
+	const size_t NUM_PROCESSES = 20000;
+	const size_t NUM_IMAGES = 3000;
+	const size_t NUM_TOOL_PROCESSES = 6;
+
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	harness::Random random;
+
+	for (size_t i = 1; i <= NUM_PROCESSES; ++i)
+	{
+		const auto parent = (i == 1 || random.Below(10) == 0) ? 0 : (1 + random.Below(i - 1));
+
+		const auto path = (i % (NUM_PROCESSES / NUM_TOOL_PROCESSES) == 0)
+			? std::u16string(u"\\device\\harddiskvolume1\\tools\\tool.exe")
+			: Numbered(u"\\device\\harddiskvolume1\\apps\\app", random.Below(NUM_IMAGES)) + u".exe";
+
+		REQUIRE(tree.Add(Pid(parent), Pid(i), path));
+	}
+
+	Configuration baseline(tree.ImageNames());
+
+	REQUIRE(NT_SUCCESS(baseline.Status()));
+
+	for (size_t i = 0; i < 10; ++i)
+	{
+		REQUIRE(baseline.Add(ENTRY_TYPE::EXACT, Numbered(u"\\device\\harddiskvolume1\\apps\\app", i) + u".exe"));
+	}
+
+	targetsettings::ComputeAll(tree.Registry(), baseline.Get());
+
+	tree.Realize();
+
+	struct CASE
+	{
+		const char *Name;
+		ENTRY_TYPE Type;
+		const char16_t *Text;
+	};
+
+	const CASE cases[] =
+	{
+		{ "image not running", ENTRY_TYPE::EXACT, u"\\device\\harddiskvolume1\\tools\\absent.exe" },
+		{ "image running", ENTRY_TYPE::EXACT, u"\\device\\harddiskvolume1\\tools\\tool.exe" },
+		{ "prefix entry", ENTRY_TYPE::PREFIX, u"\\device\\harddiskvolume1\\tools\\" },
+	};
+
+	printf("%-20s %8s %12s %12s\n", "added entry", "roots", "delta", "full");
+
+	for (const auto &c : cases)
+	{
+		Configuration entries(tree.ImageNames());
+
+		REQUIRE(NT_SUCCESS(entries.Status()));
+		REQUIRE(entries.Add(c.Type, c.Text));
+
+		registeredimage::CONTEXT *updated;
+
+		REQUIRE(NT_SUCCESS(registeredimage::Clone(baseline.Get(), NULL, &updated)));
+
+		Configuration config(updated);
+
+		REQUIRE(NT_SUCCESS(registeredimage::Merge(config.Get(), entries.Get())));
+
+		SIZE_T numRoots = 0;
+
+		const auto deltaNs = harness::MeasureNs(1, 20, [&]()
+		{
+			targetsettings::AFFECTED_ROOTS affected;
+
+			if (NT_SUCCESS(targetsettings::CollectAffectedRoots(tree.Registry(), baseline.Get(),
+				config.Get(), entries.Get(), &affected)))
+			{
+				targetsettings::ComputeAffected(tree.Registry(), config.Get(), &affected);
+
+				numRoots = affected.NumRoots;
+			}
+
+			targetsettings::ReleaseAffectedRoots(&affected);
+		});
+
+		const auto fullNs = harness::MeasureNs(1, 5, [&]()
+		{
+			targetsettings::ComputeAll(tree.Registry(), config.Get());
+		});
+
+		printf("%-20s %8zu %9.1f us %9.1f us\n", c.Name, (size_t)numRoots, deltaNs / 1e3, fullNs / 1e3);
+	}
+}
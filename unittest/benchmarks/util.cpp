@@ -0,0 +1,133 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "unicode.h"
+#include "util.h"
+
+//
+// This benchmark is built twice: bench_util uses the SSE2 paths in util.cpp, and
+// bench_util_scalar uses the scalar paths. Compare the output of the two.
+//
+
+using harness::UnicodeString;
+
+namespace
+{
+
+#if defined(_M_AMD64)
+const char *const PATH_NAME = "SSE2";
+#else
+const char *const PATH_NAME = "scalar";
+#endif
+
+//
+// Device paths of typical length, in mixed case.
+//
+std::vector<UnicodeString>
+DevicePaths
+(
+	size_t Count
+)
+{
+	harness::Random random;
+
+	std::vector<UnicodeString> paths;
+
+	for (size_t i = 0; i < Count; ++i)
+	{
+		std::u16string path(u"\\Device\\HarddiskVolume3\\Program Files\\Vendor");
+
+		const auto depth = 1 + random.Below(4);
+
+		for (size_t j = 0; j < depth; ++j)
+		{
+			path += u"\\Component";
+
+			for (auto c : std::to_string(random.Below(1000)))
+			{
+				path += (char16_t)c;
+			}
+		}
+
+		path += u"\\Application.EXE";
+
+		paths.emplace_back(path);
+	}
+
+	return paths;
+}
+
+} // anonymous namespace
+
+TEST_CASE(DowncaseString)
+{
+	auto paths = DevicePaths(4096);
+
+	std::vector<WCHAR> buffer(1024);
+
+	UNICODE_STRING lower;
+
+	lower.Buffer = buffer.data();
+	lower.MaximumLength = (USHORT)(buffer.size() * sizeof(WCHAR));
+
+	size_t totalChars = 0;
+
+	for (auto &path : paths)
+	{
+		totalChars += path.Get()->Length / sizeof(WCHAR);
+	}
+
+	const auto utilNs = harness::MeasureNs(paths.size(), 20, [&]()
+	{
+		for (auto &path : paths)
+		{
+			util::DowncaseString(&lower, path.Get());
+
+			harness::Consume(lower.Buffer[0]);
+		}
+	});
+
+	const auto rtlNs = harness::MeasureNs(paths.size(), 20, [&]()
+	{
+		for (auto &path : paths)
+		{
+			RtlDowncaseUnicodeString(&lower, path.Get(), FALSE);
+
+			harness::Consume(lower.Buffer[0]);
+		}
+	});
+
+	printf("%zu paths, %.1f characters on average\n", paths.size(), (double)totalChars / paths.size());
+	printf("util::DowncaseString (%s)       %6.1f ns\n", PATH_NAME, utilNs);
+	printf("RtlDowncaseUnicodeString (shim) %6.1f ns\n", rtlNs);
+}
+
+TEST_CASE(EqualMemory)
+{
+	auto paths = DevicePaths(4096);
+	auto copies = paths;
+
+	size_t equal = 0;
+
+	const auto utilNs = harness::MeasureNs(paths.size(), 20, [&]()
+	{
+		for (size_t i = 0; i < paths.size(); ++i)
+		{
+			equal += util::EqualMemory(paths[i].Get()->Buffer, copies[i].Get()->Buffer, paths[i].Get()->Length);
+		}
+	});
+
+	const auto rtlNs = harness::MeasureNs(paths.size(), 20, [&]()
+	{
+		for (size_t i = 0; i < paths.size(); ++i)
+		{
+			equal += (RtlCompareMemory(paths[i].Get()->Buffer, copies[i].Get()->Buffer, paths[i].Get()->Length)
+				== paths[i].Get()->Length);
+		}
+	});
+
+	harness::Consume(equal);
+
+	printf("util::EqualMemory (%s)  %6.1f ns\n", PATH_NAME, utilNs);
+	printf("RtlCompareMemory (shim) %6.1f ns\n", rtlNs);
+}
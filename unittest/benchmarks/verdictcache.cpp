@@ -0,0 +1,108 @@
+#include <vector>
+#include "harness.h"
+#include "containers/pidindex.h"
+#include "containers/verdictcache.h"
+
+namespace
+{
+
+bool
+NTAPI
+Resolve
+(
+	HANDLE ProcessId,
+	LONG *Value,
+	void *Context
+)
+{
+	return pidindex::QueryAttributes((pidindex::CONTEXT*)Context, ProcessId, Value, NULL);
+}
+
+} // anonymous namespace
+
+//
+// Connections arrive in bursts from a few processes, while the index holds 50k processes.
+// Each connection is one lookup.
+//
+TEST_CASE(BurstReplay)
+{
+	const size_t NUM_INDEXED = 50000;
+	const size_t NUM_ACTIVE = 8;
+	const size_t CONNECTIONS_PER_BURST = 200;
+	const size_t NUM_BURSTS = 64;
+
+	pidindex::CONTEXT *index;
+	verdictcache::CONTEXT *cache;
+
+	REQUIRE(NT_SUCCESS(pidindex::Initialize(&index)));
+	REQUIRE(NT_SUCCESS(verdictcache::Initialize(&cache)));
+
+	for (size_t i = 1; i <= NUM_INDEXED; ++i)
+	{
+		REQUIRE(NT_SUCCESS(pidindex::Insert(index, (HANDLE)(ULONG_PTR)(i * 4), index, (LONG)(i % 3))));
+	}
+
+	harness::Random random;
+
+	std::vector<HANDLE> active(NUM_ACTIVE);
+
+	for (auto &pid : active)
+	{
+		pid = (HANDLE)(ULONG_PTR)(4 * (1 + random.Below(NUM_INDEXED)));
+	}
+
+	//
+	// Each burst comes from one process, interleaved with a few connections from the others.
+	//
+
+	std::vector<HANDLE> replay;
+
+	for (size_t b = 0; b < NUM_BURSTS; ++b)
+	{
+		const auto pid = active[b % NUM_ACTIVE];
+
+		for (size_t c = 0; c < CONNECTIONS_PER_BURST; ++c)
+		{
+			replay.push_back((random.Below(10) == 0) ? active[random.Below(NUM_ACTIVE)] : pid);
+		}
+	}
+
+	LONG sum = 0;
+
+	const auto cachedNs = harness::MeasureNs(replay.size(), 5, [&]()
+	{
+		for (auto pid : replay)
+		{
+			LONG value = 0;
+
+			verdictcache::Lookup(cache, pid, Resolve, index, &value);
+
+			sum += value;
+		}
+	});
+
+	const auto uncachedNs = harness::MeasureNs(replay.size(), 5, [&]()
+	{
+		for (auto pid : replay)
+		{
+			LONG value = 0;
+
+			pidindex::QueryAttributes(index, pid, &value, NULL);
+
+			sum += value;
+		}
+	});
+
+	harness::Consume(sum);
+
+	verdictcache::STATISTICS statistics;
+
+	verdictcache::GetStatistics(cache, &statistics);
+
+	printf("hit rate:  %.2f%%\n", 100.0 * statistics.Hits / (statistics.Hits + statistics.Misses));
+	printf("cached:    %.1f ns per lookup\n", cachedNs);
+	printf("uncached:  %.1f ns per lookup\n", uncachedNs);
+
+	verdictcache::TearDown(&cache);
+	pidindex::TearDown(&index);
+}
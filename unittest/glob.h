@@ -0,0 +1,76 @@
+#pragma once
+
+//
+// glob.h
+//
+// Backtracking glob matcher with the semantics documented in globdfa.h.
+// Used as the reference that compiled automata are compared against.
+//
+
+#include <string>
+
+namespace harness
+{
+
+inline
+bool
+GlobMatch
+(
+	const char16_t *Pattern,
+	const char16_t *PatternEnd,
+	const char16_t *Path,
+	const char16_t *PathEnd
+)
+{
+	while (Pattern != PatternEnd)
+	{
+		if (*Pattern == u'*')
+		{
+			//
+			// Try every run of non-separator characters, including the empty run.
+			//
+
+			for (auto p = Path; ; ++p)
+			{
+				if (GlobMatch(Pattern + 1, PatternEnd, p, PathEnd))
+				{
+					return true;
+				}
+
+				if (p == PathEnd || *p == u'\\')
+				{
+					return false;
+				}
+			}
+		}
+
+		if (Path == PathEnd)
+		{
+			return false;
+		}
+
+		if (*Pattern == u'?' ? (*Path == u'\\') : (*Pattern != *Path))
+		{
+			return false;
+		}
+
+		++Pattern;
+		++Path;
+	}
+
+	return Path == PathEnd;
+}
+
+inline
+bool
+GlobMatch
+(
+	const std::u16string &Pattern,
+	const std::u16string &Path
+)
+{
+	return GlobMatch(Pattern.data(), Pattern.data() + Pattern.size(),
+		Path.data(), Path.data() + Path.size());
+}
+
+} // namespace harness
@@ -0,0 +1,102 @@
+#include <cstring>
+#include <vector>
+#include "harness.h"
+#include "shim/kernel.h"
+
+namespace harness
+{
+
+namespace
+{
+
+struct TEST
+{
+	const char *Name;
+	TEST_FUNCTION Function;
+};
+
+std::vector<TEST> &
+Tests
+(
+)
+{
+	static std::vector<TEST> tests;
+
+	return tests;
+}
+
+size_t g_NumFailedChecks = 0;
+
+} // anonymous namespace
+
+REGISTRAR::REGISTRAR(const char *Name, TEST_FUNCTION Function)
+{
+	Tests().push_back(TEST{ Name, Function });
+}
+
+void
+Fail
+(
+	const char *File,
+	int Line,
+	const char *Expression
+)
+{
+	fprintf(stderr, "%s:%d: check failed: %s\n", File, Line, Expression);
+
+	++g_NumFailedChecks;
+}
+
+} // namespace harness
+
+int main(int argc, char *argv[])
+{
+	using namespace harness;
+
+	const char *filter = (argc > 1 ? argv[1] : NULL);
+
+	size_t numRun = 0;
+	size_t numFailed = 0;
+
+	for (const auto &test : Tests())
+	{
+		if (filter != NULL && strstr(test.Name, filter) == NULL)
+		{
+			continue;
+		}
+
+		++numRun;
+
+		const auto failedChecks = g_NumFailedChecks;
+		const auto allocations = shim::NumOutstandingAllocations();
+
+		printf("[ RUN  ] %s\n", test.Name);
+		fflush(stdout);
+
+		test.Function();
+
+		shim::FailAllocation(-1);
+
+		if (shim::NumOutstandingAllocations() != allocations)
+		{
+			fprintf(stderr, "%s: %lld pool allocations leaked\n", test.Name,
+				(long long)(shim::NumOutstandingAllocations() - allocations));
+
+			++g_NumFailedChecks;
+		}
+
+		const auto passed = (g_NumFailedChecks == failedChecks);
+
+		if (!passed)
+		{
+			++numFailed;
+		}
+
+		printf("[ %s ] %s\n", (passed ? " OK " : "FAIL"), test.Name);
+		fflush(stdout);
+	}
+
+	printf("%zu of %zu passed\n", numRun - numFailed, numRun);
+
+	return (numFailed == 0 && numRun != 0) ? 0 : 1;
+}
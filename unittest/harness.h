@@ -0,0 +1,133 @@
+#pragma once
+
+//
+// harness.h
+//
+// Minimal runner for host-side tests and benchmarks.
+//
+// Each test is a function registered with TEST_CASE(). The runner executes all tests,
+// or those whose name contains the first command line argument, and fails a test that
+// leaves pool allocations behind.
+//
+// Include standard headers before this header and before any driver headers,
+// since the kernel shim defines `min` and `max` as macros.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+namespace harness
+{
+
+typedef void (*TEST_FUNCTION)();
+
+struct REGISTRAR
+{
+	REGISTRAR(const char *Name, TEST_FUNCTION Function);
+};
+
+void
+Fail
+(
+	const char *File,
+	int Line,
+	const char *Expression
+);
+
+//
+// Deterministic pseudo random numbers, so failures can be reproduced.
+//
+class Random
+{
+public:
+
+	explicit Random(uint64_t Seed = 0x5EED) : m_state(Seed | 1)
+	{
+	}
+
+	uint64_t Next()
+	{
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 7;
+		m_state ^= m_state << 17;
+
+		return m_state;
+	}
+
+	// Uniform in [0, Bound).
+	uint64_t Below(uint64_t Bound)
+	{
+		return Next() % Bound;
+	}
+
+private:
+
+	uint64_t m_state;
+};
+
+//
+// Returns the best time per iteration, in nanoseconds, over `Repetitions` runs.
+// `Function` performs `Iterations` iterations per call.
+//
+template<typename T>
+double
+MeasureNs
+(
+	size_t Iterations,
+	size_t Repetitions,
+	T Function
+)
+{
+	double best = 0;
+
+	for (size_t r = 0; r < Repetitions; ++r)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		Function();
+
+		const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+
+		const auto perIteration = elapsed.count() / (double)Iterations;
+
+		if (r == 0 || perIteration < best)
+		{
+			best = perIteration;
+		}
+	}
+
+	return best;
+}
+
+//
+// Keeps the compiler from discarding a computed value.
+//
+template<typename T>
+void
+Consume
+(
+	const T &Value
+)
+{
+	asm volatile("" : : "g"(&Value) : "memory");
+}
+
+} // namespace harness
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static harness::REGISTRAR name##_registrar(#name, name); \
+	static void name()
+
+#define CHECK(e) ((e) ? (void)0 : harness::Fail(__FILE__, __LINE__, #e))
+
+#define REQUIRE(e) \
+	do \
+	{ \
+		if (!(e)) \
+		{ \
+			harness::Fail(__FILE__, __LINE__, #e); \
+			return; \
+		} \
+	} while (false)
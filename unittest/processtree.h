@@ -0,0 +1,376 @@
+#pragma once
+
+//
+// processtree.h
+//
+// Process registry populated with synthetic process trees, and configurations to
+// evaluate them against. Shared by the tests and benchmarks of code that computes
+// split settings.
+//
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "harness.h"
+#include "unicode.h"
+#include "containers/procregistry.h"
+#include "containers/registeredimage.h"
+#include "util.h"
+
+namespace harness
+{
+
+inline
+HANDLE
+Pid
+(
+	size_t Number
+)
+{
+	return (HANDLE)(ULONG_PTR)(Number * 4);
+}
+
+inline
+std::u16string
+Numbered
+(
+	const char16_t *Text,
+	size_t Number
+)
+{
+	std::u16string s(Text);
+
+	for (auto c : std::to_string(Number))
+	{
+		s += (char16_t)c;
+	}
+
+	return s;
+}
+
+//
+// Process snapshot, as received by IOCTL_ST_REGISTER_PROCESSES once the names are downcased.
+//
+class Snapshot
+{
+public:
+
+	//
+	// `Path` must be lower case.
+	//
+	void Add(HANDLE ParentProcessId, HANDLE ProcessId, std::u16string Path)
+	{
+		m_entries.push_back({ ParentProcessId, ProcessId, { 0 } });
+		m_paths.push_back(std::move(Path));
+	}
+
+	size_t Size() const
+	{
+		return m_entries.size();
+	}
+
+	const procregistry::SNAPSHOT_ENTRY &operator[](size_t Index) const
+	{
+		return m_entries[Index];
+	}
+
+	const std::u16string &Path(size_t Index) const
+	{
+		return m_paths[Index];
+	}
+
+	//
+	// Reorder entries, so parents are not necessarily listed before their children.
+	//
+	void Shuffle(Random &Random)
+	{
+		for (size_t i = m_entries.size(); i > 1; --i)
+		{
+			const auto j = Random.Below(i);
+
+			std::swap(m_entries[i - 1], m_entries[j]);
+			std::swap(m_paths[i - 1], m_paths[j]);
+		}
+	}
+
+	const procregistry::SNAPSHOT_ENTRY *Entries()
+	{
+		for (size_t i = 0; i < m_entries.size(); ++i)
+		{
+			auto &name = m_entries[i].ImageName;
+
+			name.Length = (USHORT)(m_paths[i].size() * sizeof(WCHAR));
+			name.MaximumLength = name.Length;
+			name.Buffer = (PWCH)m_paths[i].data();
+		}
+
+		return m_entries.data();
+	}
+
+private:
+
+	std::vector<procregistry::SNAPSHOT_ENTRY> m_entries;
+	std::vector<std::u16string> m_paths;
+};
+
+class ProcessTree
+{
+public:
+
+	explicit ProcessTree(ST_PAGEABLE Pageable = ST_PAGEABLE::NO)
+	{
+		m_status = imagename::Initialize(&m_imageNames);
+
+		if (NT_SUCCESS(m_status))
+		{
+			m_status = procregistry::Initialize(&m_registry, m_imageNames, Pageable);
+		}
+	}
+
+	~ProcessTree()
+	{
+		if (m_registry != NULL)
+		{
+			procregistry::TearDown(&m_registry);
+		}
+
+		if (m_imageNames != NULL)
+		{
+			imagename::TearDown(&m_imageNames);
+		}
+	}
+
+	ProcessTree(const ProcessTree&) = delete;
+	ProcessTree &operator=(const ProcessTree&) = delete;
+
+	NTSTATUS Status() const
+	{
+		return m_status;
+	}
+
+	imagename::CONTEXT *ImageNames()
+	{
+		return m_imageNames;
+	}
+
+	procregistry::CONTEXT *Registry()
+	{
+		return m_registry;
+	}
+
+	//
+	// `Path` must be lower case.
+	//
+	bool Add(HANDLE ParentProcessId, HANDLE ProcessId, const std::u16string &Path,
+		ST_PROCESS_SPLIT_STATUS Split = ST_PROCESS_SPLIT_STATUS_OFF)
+	{
+		UnicodeString path(Path);
+
+		procregistry::PROCESS_REGISTRY_ENTRY entry;
+
+		auto status = procregistry::InitializeEntryLower(m_registry, ParentProcessId, ProcessId,
+			Split, path.Lower(), &entry);
+
+		if (!NT_SUCCESS(status))
+		{
+			return false;
+		}
+
+		status = procregistry::AddEntry(m_registry, &entry);
+
+		if (!NT_SUCCESS(status))
+		{
+			procregistry::ReleaseEntry(&entry);
+
+			return false;
+		}
+
+		return true;
+	}
+
+	NTSTATUS AddSnapshot(Snapshot &Snapshot)
+	{
+		return procregistry::AddSnapshot(m_registry, Snapshot.Entries(), Snapshot.Size());
+	}
+
+	procregistry::PROCESS_REGISTRY_ENTRY *Find(HANDLE ProcessId)
+	{
+		return procregistry::FindEntry(m_registry, ProcessId);
+	}
+
+	//
+	// Make the target settings of all entries current.
+	//
+	void Realize()
+	{
+		procregistry::ForEach(m_registry, RealizeEntry, m_registry);
+	}
+
+	//
+	// Same as Realize(), for `Root` and its descendants.
+	//
+	void RealizeSubtree(procregistry::PROCESS_REGISTRY_ENTRY *Root)
+	{
+		RealizeEntry(Root, m_registry);
+
+		procregistry::ForEachDescendant(m_registry, Root, RealizeEntry, m_registry);
+	}
+
+	std::vector<procregistry::PROCESS_REGISTRY_ENTRY*> Entries()
+	{
+		std::vector<procregistry::PROCESS_REGISTRY_ENTRY*> entries;
+
+		procregistry::ForEach(m_registry, [](procregistry::PROCESS_REGISTRY_ENTRY *Entry, void *Context)
+		{
+			((std::vector<procregistry::PROCESS_REGISTRY_ENTRY*>*)Context)->push_back(Entry);
+
+			return true;
+		}, &entries);
+
+		return entries;
+	}
+
+private:
+
+	static bool NTAPI RealizeEntry(procregistry::PROCESS_REGISTRY_ENTRY *Entry, void *Context)
+	{
+		Entry->PreviousSettings = Entry->Settings;
+		Entry->Settings = Entry->TargetSettings;
+
+		procregistry::PublishSettings((procregistry::CONTEXT*)Context, Entry);
+
+		return true;
+	}
+
+	imagename::CONTEXT *m_imageNames = NULL;
+	procregistry::CONTEXT *m_registry = NULL;
+	NTSTATUS m_status;
+};
+
+//
+// Owned registered image instance.
+//
+class Configuration
+{
+public:
+
+	Configuration(imagename::CONTEXT *ImageNames)
+	{
+		m_status = registeredimage::Initialize(&m_context, ImageNames, ST_PAGEABLE::NO);
+	}
+
+	explicit Configuration(registeredimage::CONTEXT *Context) : m_context(Context), m_status(STATUS_SUCCESS)
+	{
+	}
+
+	~Configuration()
+	{
+		if (m_context != NULL)
+		{
+			registeredimage::TearDown(&m_context);
+		}
+	}
+
+	Configuration(const Configuration&) = delete;
+	Configuration &operator=(const Configuration&) = delete;
+
+	NTSTATUS Status() const
+	{
+		return m_status;
+	}
+
+	registeredimage::CONTEXT *Get()
+	{
+		return m_context;
+	}
+
+	bool Add(registeredimage::ENTRY_TYPE Type, const std::u16string &Text)
+	{
+		UnicodeString text(Text);
+
+		NTSTATUS status;
+
+		switch (Type)
+		{
+			case registeredimage::ENTRY_TYPE::PREFIX:
+			{
+				status = registeredimage::AddPrefixEntry(m_context, text.Get());
+
+				break;
+			}
+			case registeredimage::ENTRY_TYPE::PATTERN:
+			{
+				status = registeredimage::AddPatternEntry(m_context, text.Get());
+
+				break;
+			}
+			default:
+			{
+				status = registeredimage::AddEntry(m_context, text.Get());
+
+				break;
+			}
+		}
+
+		return NT_SUCCESS(status) || status == STATUS_DUPLICATE_OBJECTID;
+	}
+
+	bool Compile()
+	{
+		return NT_SUCCESS(registeredimage::CompilePatterns(m_context));
+	}
+
+private:
+
+	registeredimage::CONTEXT *m_context = NULL;
+	NTSTATUS m_status;
+};
+
+//
+// The target split setting as computed before settings were propagated in a single pass:
+// evaluate the entry, and if it's not split, walk its ancestry looking for an ancestor
+// that is split by configuration or by orphaned inheritance.
+//
+inline
+ST_PROCESS_SPLIT_STATUS
+AncestryWalkTargetSplit
+(
+	registeredimage::CONTEXT *Configuration,
+	const procregistry::PROCESS_REGISTRY_ENTRY *Entry
+)
+{
+	auto evaluate = [Configuration](const procregistry::PROCESS_REGISTRY_ENTRY *Entry)
+	{
+		if (registeredimage::HasMatchingEntry(Configuration, Entry->ImageName))
+		{
+			return ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG;
+		}
+
+		if (Entry->ParentProcessId == 0
+			&& Entry->Settings.Split == ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE)
+		{
+			return ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
+		}
+
+		return ST_PROCESS_SPLIT_STATUS_OFF;
+	};
+
+	const auto split = evaluate(Entry);
+
+	if (util::SplittingEnabled(split))
+	{
+		return split;
+	}
+
+	for (auto ancestor = Entry->ParentEntry; ancestor != NULL; ancestor = ancestor->ParentEntry)
+	{
+		if (util::SplittingEnabled(evaluate(ancestor)))
+		{
+			return ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
+		}
+	}
+
+	return ST_PROCESS_SPLIT_STATUS_OFF;
+}
+
+} // namespace harness
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "kernel.h"
+
+//
+// Same layout as the Windows definition.
+//
+typedef struct in6_addr
+{
+	union
+	{
+		UCHAR Byte[16];
+		USHORT Word[8];
+	}
+	u;
+}
+IN6_ADDR, *PIN6_ADDR;
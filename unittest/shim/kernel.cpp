@@ -0,0 +1,436 @@
+#include <atomic>
+#include <chrono>
+#include <clocale>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cwctype>
+#include <thread>
+#include "kernel.h"
+
+namespace shim
+{
+
+struct OBJECT
+{
+	virtual ~OBJECT() = default;
+};
+
+struct SPINLOCK : OBJECT
+{
+	std::atomic_flag Locked = ATOMIC_FLAG_INIT;
+	KIRQL OldIrql;
+};
+
+namespace
+{
+
+//
+// Each allocation is preceded by a header that records its size.
+// The header keeps the returned pointer aligned on MEMORY_ALLOCATION_ALIGNMENT.
+//
+struct ALLOCATION_HEADER
+{
+	alignas(MEMORY_ALLOCATION_ALIGNMENT) SIZE_T Size;
+};
+
+std::atomic<LONG64> g_NumOutstandingAllocations{ 0 };
+std::atomic<LONG64> g_NumOutstandingBytes{ 0 };
+std::atomic<LONG64> g_FailCountdown{ -1 };
+std::atomic<ULONG> g_ProcessorCount{ 1 };
+
+thread_local KIRQL t_Irql = PASSIVE_LEVEL;
+thread_local ULONG t_Processor = 0;
+
+bool
+ShouldFailAllocation
+(
+)
+{
+	auto countdown = g_FailCountdown.load();
+
+	while (countdown >= 0)
+	{
+		if (g_FailCountdown.compare_exchange_weak(countdown, countdown - 1))
+		{
+			return countdown == 0;
+		}
+	}
+
+	return false;
+}
+
+void
+EnsureLocale
+(
+)
+{
+	static const bool initialized = (setlocale(LC_CTYPE, "C.UTF-8") != NULL);
+
+	UNREFERENCED_PARAMETER(initialized);
+}
+
+} // anonymous namespace
+
+LONG64
+NumOutstandingAllocations
+(
+)
+{
+	return g_NumOutstandingAllocations.load();
+}
+
+LONG64
+NumOutstandingBytes
+(
+)
+{
+	return g_NumOutstandingBytes.load();
+}
+
+void
+FailAllocation
+(
+	LONG64 Countdown
+)
+{
+	g_FailCountdown.store(Countdown);
+}
+
+void
+SetProcessorCount
+(
+	ULONG Count
+)
+{
+	g_ProcessorCount.store(Count);
+}
+
+void
+SetCurrentProcessor
+(
+	ULONG Number
+)
+{
+	t_Processor = Number;
+}
+
+} // namespace shim
+
+using namespace shim;
+
+ULONG DbgPrint(const char *Format, ...)
+{
+	if (getenv("ST_SHIM_DBGPRINT") == NULL)
+	{
+		return 0;
+	}
+
+	va_list args;
+
+	va_start(args, Format);
+	vfprintf(stderr, Format, args);
+	va_end(args);
+
+	return 0;
+}
+
+void *ExAllocatePoolUninitialized(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag)
+{
+	UNREFERENCED_PARAMETER(PoolType);
+	UNREFERENCED_PARAMETER(Tag);
+
+	if (ShouldFailAllocation())
+	{
+		return NULL;
+	}
+
+	auto header = (ALLOCATION_HEADER*)malloc(sizeof(ALLOCATION_HEADER) + NumberOfBytes);
+
+	if (header == NULL)
+	{
+		return NULL;
+	}
+
+	header->Size = NumberOfBytes;
+
+	++g_NumOutstandingAllocations;
+	g_NumOutstandingBytes += NumberOfBytes;
+
+	//
+	// Make reliance on uninitialized memory show up in tests.
+	//
+
+	memset(header + 1, 0xCD, NumberOfBytes);
+
+	return header + 1;
+}
+
+void *ExAllocatePoolZero(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag)
+{
+	auto p = ExAllocatePoolUninitialized(PoolType, NumberOfBytes, Tag);
+
+	if (p != NULL)
+	{
+		memset(p, 0, NumberOfBytes);
+	}
+
+	return p;
+}
+
+void ExFreePoolWithTag(void *P, ULONG Tag)
+{
+	UNREFERENCED_PARAMETER(Tag);
+
+	assert(P != NULL);
+
+	auto header = (ALLOCATION_HEADER*)P - 1;
+
+	--g_NumOutstandingAllocations;
+	g_NumOutstandingBytes -= header->Size;
+
+	free(header);
+}
+
+KIRQL KeGetCurrentIrql()
+{
+	return t_Irql;
+}
+
+void KeRaiseIrql(KIRQL NewIrql, KIRQL *OldIrql)
+{
+	assert(NewIrql >= t_Irql);
+
+	*OldIrql = t_Irql;
+	t_Irql = NewIrql;
+}
+
+void KeLowerIrql(KIRQL NewIrql)
+{
+	assert(NewIrql <= t_Irql);
+
+	t_Irql = NewIrql;
+}
+
+ULONG KeQueryMaximumProcessorCountEx(USHORT GroupNumber)
+{
+	UNREFERENCED_PARAMETER(GroupNumber);
+
+	return g_ProcessorCount.load();
+}
+
+ULONG KeGetCurrentProcessorNumberEx(PPROCESSOR_NUMBER ProcNumber)
+{
+	if (ProcNumber != NULL)
+	{
+		ProcNumber->Group = 0;
+		ProcNumber->Number = (UCHAR)t_Processor;
+		ProcNumber->Reserved = 0;
+	}
+
+	return t_Processor;
+}
+
+ULONG64 KeQueryInterruptTime()
+{
+	using namespace std::chrono;
+
+	//
+	// 100 ns units.
+	//
+
+	return (ULONG64)(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() / 100);
+}
+
+ULONG64 KeQueryInterruptTimePrecise(PULONG64 QpcTimeStamp)
+{
+	const auto now = KeQueryInterruptTime();
+
+	if (QpcTimeStamp != NULL)
+	{
+		*QpcTimeStamp = now;
+	}
+
+	return now;
+}
+
+//
+// There's no guarantee that the host has more than one processor,
+// so spinning threads give up their time slice.
+//
+void YieldProcessor()
+{
+	std::this_thread::yield();
+}
+
+//
+// Only relative intervals are supported.
+//
+NTSTATUS KeDelayExecutionThread(KPROCESSOR_MODE WaitMode, BOOLEAN Alertable, PLARGE_INTEGER Interval)
+{
+	UNREFERENCED_PARAMETER(WaitMode);
+	UNREFERENCED_PARAMETER(Alertable);
+
+	assert(t_Irql == PASSIVE_LEVEL);
+	assert(Interval->QuadPart <= 0);
+
+	std::this_thread::sleep_for(std::chrono::nanoseconds(-Interval->QuadPart * 100));
+
+	return STATUS_SUCCESS;
+}
+
+void RtlInitUnicodeString(PUNICODE_STRING Dest, PCWSTR Source)
+{
+	SIZE_T length = 0;
+
+	while (Source[length] != 0)
+	{
+		++length;
+	}
+
+	Dest->Length = (USHORT)(length * sizeof(WCHAR));
+	Dest->MaximumLength = (USHORT)(Dest->Length + sizeof(WCHAR));
+	Dest->Buffer = (PWCH)Source;
+}
+
+WCHAR RtlDowncaseUnicodeChar(WCHAR SourceCharacter)
+{
+	EnsureLocale();
+
+	const auto lower = towlower((wint_t)SourceCharacter);
+
+	//
+	// Mappings that leave the BMP, or that would map into a surrogate, are not applied.
+	//
+
+	if (lower > 0xFFFF || (lower >= 0xD800 && lower <= 0xDFFF))
+	{
+		return SourceCharacter;
+	}
+
+	return (WCHAR)lower;
+}
+
+WCHAR RtlUpcaseUnicodeChar(WCHAR SourceCharacter)
+{
+	EnsureLocale();
+
+	const auto upper = towupper((wint_t)SourceCharacter);
+
+	if (upper > 0xFFFF || (upper >= 0xD800 && upper <= 0xDFFF))
+	{
+		return SourceCharacter;
+	}
+
+	return (WCHAR)upper;
+}
+
+NTSTATUS RtlDowncaseUnicodeString(PUNICODE_STRING Dest, PCUNICODE_STRING Source, BOOLEAN Allocate)
+{
+	if (Allocate)
+	{
+		Dest->Buffer = (PWCH)ExAllocatePoolUninitialized(PagedPool, Source->Length, 0);
+
+		if (Dest->Buffer == NULL)
+		{
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+
+		Dest->MaximumLength = Source->Length;
+	}
+	else if (Dest->MaximumLength < Source->Length)
+	{
+		return STATUS_BUFFER_OVERFLOW;
+	}
+
+	for (SIZE_T i = 0; i < Source->Length / sizeof(WCHAR); ++i)
+	{
+		Dest->Buffer[i] = RtlDowncaseUnicodeChar(Source->Buffer[i]);
+	}
+
+	Dest->Length = Source->Length;
+
+	return STATUS_SUCCESS;
+}
+
+LONG RtlCompareUnicodeString(PCUNICODE_STRING Lhs, PCUNICODE_STRING Rhs, BOOLEAN CaseInsensitive)
+{
+	const auto lhsLength = Lhs->Length / sizeof(WCHAR);
+	const auto rhsLength = Rhs->Length / sizeof(WCHAR);
+
+	for (SIZE_T i = 0; i < lhsLength && i < rhsLength; ++i)
+	{
+		auto l = Lhs->Buffer[i];
+		auto r = Rhs->Buffer[i];
+
+		if (CaseInsensitive)
+		{
+			l = RtlDowncaseUnicodeChar(l);
+			r = RtlDowncaseUnicodeChar(r);
+		}
+
+		if (l != r)
+		{
+			return (LONG)l - (LONG)r;
+		}
+	}
+
+	return (LONG)lhsLength - (LONG)rhsLength;
+}
+
+BOOLEAN RtlEqualUnicodeString(PCUNICODE_STRING Lhs, PCUNICODE_STRING Rhs, BOOLEAN CaseInsensitive)
+{
+	return Lhs->Length == Rhs->Length && RtlCompareUnicodeString(Lhs, Rhs, CaseInsensitive) == 0;
+}
+
+NTSTATUS ObOpenObjectByPointer(PVOID, ULONG, void*, ACCESS_MASK, void*, KPROCESSOR_MODE, HANDLE*)
+{
+	return STATUS_NOT_SUPPORTED;
+}
+
+PVOID MmGetSystemRoutineAddress(PUNICODE_STRING)
+{
+	return NULL;
+}
+
+NTSTATUS ZwClose(HANDLE)
+{
+	return STATUS_NOT_SUPPORTED;
+}
+
+NTSTATUS WdfSpinLockCreate(PWDF_OBJECT_ATTRIBUTES Attributes, WDFSPINLOCK *SpinLock)
+{
+	UNREFERENCED_PARAMETER(Attributes);
+
+	*SpinLock = new SPINLOCK;
+
+	return STATUS_SUCCESS;
+}
+
+void WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+	KIRQL oldIrql;
+
+	KeRaiseIrql(DISPATCH_LEVEL, &oldIrql);
+
+	while (SpinLock->Locked.test_and_set(std::memory_order_acquire))
+	{
+		YieldProcessor();
+	}
+
+	SpinLock->OldIrql = oldIrql;
+}
+
+void WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+	const auto oldIrql = SpinLock->OldIrql;
+
+	SpinLock->Locked.clear(std::memory_order_release);
+
+	KeLowerIrql(oldIrql);
+}
+
+void WdfObjectDelete(WDFOBJECT Object)
+{
+	delete (OBJECT*)Object;
+}
@@ -0,0 +1,554 @@
+#pragma once
+
+//
+// kernel.h
+//
+// User mode stand-ins for the subset of WDM and KMDF that the driver's containers use.
+// This lets container sources be built unmodified and exercised on the host.
+//
+// Pool allocations are counted so tests can check for leaks, and can be made to fail
+// on demand. IRQL and the current processor number are tracked per thread.
+//
+// Build with -fshort-wchar so WCHAR is 16 bits, as it is on Windows.
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+static_assert(sizeof(wchar_t) == 2, "Build with -fshort-wchar");
+
+#if defined(__x86_64__) && !defined(ST_SHIM_NO_SIMD)
+#define _M_AMD64 1
+#endif
+
+//
+// Basic types.
+//
+
+typedef unsigned char UCHAR;
+typedef unsigned char BOOLEAN;
+typedef unsigned short USHORT;
+typedef int LONG;
+typedef unsigned int ULONG;
+typedef int64_t LONG64;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONG64;
+typedef uint64_t ULONGLONG;
+typedef uintptr_t ULONG_PTR;
+typedef size_t SIZE_T;
+typedef wchar_t WCHAR;
+typedef WCHAR *PWCH;
+typedef WCHAR *PWSTR;
+typedef const WCHAR *PCWSTR;
+typedef void *PVOID;
+typedef void *HANDLE;
+typedef ULONG *PULONG;
+typedef ULONG64 *PULONG64;
+typedef LONG NTSTATUS;
+typedef UCHAR KIRQL;
+typedef ULONG ACCESS_MASK;
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAXUSHORT 0xFFFF
+#define MAXLONG 0x7FFFFFFF
+#define MAXULONG 0xFFFFFFFF
+
+#define ANYSIZE_ARRAY 1
+#define PAGE_SIZE 0x1000
+#define MEMORY_ALLOCATION_ALIGNMENT 16
+#define SYSTEM_CACHE_ALIGNMENT_SIZE 64
+#define DECLSPEC_CACHEALIGN alignas(SYSTEM_CACHE_ALIGNMENT_SIZE)
+
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#define TYPE_ALIGNMENT(t) alignof(t)
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define CONTAINING_RECORD(address, type, field) \
+	((type *)((char *)(address) - offsetof(type, field)))
+
+#define UNREFERENCED_PARAMETER(p) ((void)(p))
+
+#define NTAPI
+#define FORCEINLINE inline
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+//
+// Annotations.
+//
+
+#define _IRQL_requires_(irql)
+#define _IRQL_requires_max_(irql)
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_opt_
+#define _Out_opt_
+#define __in
+#define __out_opt
+#define __out_bcount(size)
+
+//
+// Status codes.
+//
+
+#define NT_SUCCESS(status) (((NTSTATUS)(status)) >= 0)
+
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000L)
+#define STATUS_BUFFER_OVERFLOW          ((NTSTATUS)0x80000005L)
+#define STATUS_UNSUCCESSFUL             ((NTSTATUS)0xC0000001L)
+#define STATUS_NOT_IMPLEMENTED          ((NTSTATUS)0xC0000002L)
+#define STATUS_INFO_LENGTH_MISMATCH     ((NTSTATUS)0xC0000004L)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000DL)
+#define STATUS_INSUFFICIENT_RESOURCES   ((NTSTATUS)0xC000009AL)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS)0xC00000BBL)
+#define STATUS_NOT_FOUND                ((NTSTATUS)0xC0000225L)
+#define STATUS_DUPLICATE_OBJECTID       ((NTSTATUS)0xC000022AL)
+#define STATUS_NOT_CAPABLE              ((NTSTATUS)0xC0000429L)
+#define STATUS_IMPLEMENTATION_LIMIT     ((NTSTATUS)0xC000042BL)
+
+//
+// Diagnostics.
+//
+
+#define NT_ASSERT(e) assert(e)
+
+ULONG DbgPrint(const char *Format, ...);
+
+inline void DbgBreakPoint() { __builtin_trap(); }
+
+//
+// Lists.
+//
+
+typedef struct _LIST_ENTRY
+{
+	struct _LIST_ENTRY *Flink;
+	struct _LIST_ENTRY *Blink;
+}
+LIST_ENTRY, *PLIST_ENTRY;
+
+typedef struct _SINGLE_LIST_ENTRY
+{
+	struct _SINGLE_LIST_ENTRY *Next;
+}
+SINGLE_LIST_ENTRY, *PSINGLE_LIST_ENTRY;
+
+inline void InitializeListHead(LIST_ENTRY *Head)
+{
+	Head->Flink = Head->Blink = Head;
+}
+
+inline bool IsListEmpty(const LIST_ENTRY *Head)
+{
+	return Head->Flink == Head;
+}
+
+inline BOOLEAN RemoveEntryList(LIST_ENTRY *Entry)
+{
+	auto flink = Entry->Flink;
+	auto blink = Entry->Blink;
+
+	blink->Flink = flink;
+	flink->Blink = blink;
+
+	return flink == blink;
+}
+
+inline LIST_ENTRY *RemoveHeadList(LIST_ENTRY *Head)
+{
+	auto entry = Head->Flink;
+
+	RemoveEntryList(entry);
+
+	return entry;
+}
+
+inline LIST_ENTRY *RemoveTailList(LIST_ENTRY *Head)
+{
+	auto entry = Head->Blink;
+
+	RemoveEntryList(entry);
+
+	return entry;
+}
+
+inline void InsertTailList(LIST_ENTRY *Head, LIST_ENTRY *Entry)
+{
+	auto blink = Head->Blink;
+
+	Entry->Flink = Head;
+	Entry->Blink = blink;
+	blink->Flink = Entry;
+	Head->Blink = Entry;
+}
+
+inline void InsertHeadList(LIST_ENTRY *Head, LIST_ENTRY *Entry)
+{
+	auto flink = Head->Flink;
+
+	Entry->Flink = flink;
+	Entry->Blink = Head;
+	flink->Blink = Entry;
+	Head->Flink = Entry;
+}
+
+inline void PushEntryList(SINGLE_LIST_ENTRY *Head, SINGLE_LIST_ENTRY *Entry)
+{
+	Entry->Next = Head->Next;
+	Head->Next = Entry;
+}
+
+inline SINGLE_LIST_ENTRY *PopEntryList(SINGLE_LIST_ENTRY *Head)
+{
+	auto entry = Head->Next;
+
+	if (entry != NULL)
+	{
+		Head->Next = entry->Next;
+	}
+
+	return entry;
+}
+
+//
+// Memory.
+//
+
+#define RtlCopyMemory(d, s, l) memcpy((d), (s), (l))
+#define RtlMoveMemory(d, s, l) memmove((d), (s), (l))
+#define RtlZeroMemory(d, l) memset((d), 0, (l))
+#define RtlFillMemory(d, l, f) memset((d), (f), (l))
+#define RtlEqualMemory(a, b, l) (memcmp((a), (b), (l)) == 0)
+
+inline SIZE_T RtlCompareMemory(const void *Lhs, const void *Rhs, SIZE_T Length)
+{
+	SIZE_T i = 0;
+
+	while (i < Length && ((const UCHAR*)Lhs)[i] == ((const UCHAR*)Rhs)[i])
+	{
+		++i;
+	}
+
+	return i;
+}
+
+enum POOL_TYPE
+{
+	NonPagedPool = 0,
+	NonPagedPoolNx = 512,
+	PagedPool = 1
+};
+
+void *ExAllocatePoolUninitialized(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag);
+void *ExAllocatePoolZero(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag);
+void ExFreePoolWithTag(void *P, ULONG Tag);
+
+//
+// IRQL and processors.
+//
+
+#define PASSIVE_LEVEL 0
+#define APC_LEVEL 1
+#define DISPATCH_LEVEL 2
+
+#define ALL_PROCESSOR_GROUPS 0xFFFF
+
+typedef struct _PROCESSOR_NUMBER
+{
+	USHORT Group;
+	UCHAR Number;
+	UCHAR Reserved;
+}
+PROCESSOR_NUMBER, *PPROCESSOR_NUMBER;
+
+KIRQL KeGetCurrentIrql();
+void KeRaiseIrql(KIRQL NewIrql, KIRQL *OldIrql);
+void KeLowerIrql(KIRQL NewIrql);
+
+ULONG KeQueryMaximumProcessorCountEx(USHORT GroupNumber);
+ULONG KeGetCurrentProcessorNumberEx(PPROCESSOR_NUMBER ProcNumber);
+
+ULONG64 KeQueryInterruptTime();
+ULONG64 KeQueryInterruptTimePrecise(PULONG64 QpcTimeStamp);
+
+//
+// Interlocked operations and barriers.
+//
+// These are full barriers, like their Windows counterparts.
+//
+
+void YieldProcessor();
+
+inline void KeMemoryBarrier() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+inline void MemoryBarrier() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+inline void KeMemoryBarrierWithoutFence() { __atomic_signal_fence(__ATOMIC_SEQ_CST); }
+inline void _ReadWriteBarrier() { __atomic_signal_fence(__ATOMIC_SEQ_CST); }
+
+inline LONG InterlockedIncrement(volatile LONG *Target) { return __atomic_add_fetch(Target, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedDecrement(volatile LONG *Target) { return __atomic_sub_fetch(Target, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchange(volatile LONG *Target, LONG Value) { return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchangeAdd(volatile LONG *Target, LONG Value) { return __atomic_fetch_add(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedAdd(volatile LONG *Target, LONG Value) { return __atomic_add_fetch(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedOr(volatile LONG *Target, LONG Value) { return __atomic_fetch_or(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedAnd(volatile LONG *Target, LONG Value) { return __atomic_fetch_and(Target, Value, __ATOMIC_SEQ_CST); }
+
+inline LONG InterlockedCompareExchange(volatile LONG *Target, LONG Exchange, LONG Comparand)
+{
+	__atomic_compare_exchange_n(Target, &Comparand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+	return Comparand;
+}
+
+inline LONG64 InterlockedIncrement64(volatile LONG64 *Target) { return __atomic_add_fetch(Target, 1, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedDecrement64(volatile LONG64 *Target) { return __atomic_sub_fetch(Target, 1, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedExchange64(volatile LONG64 *Target, LONG64 Value) { return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedExchangeAdd64(volatile LONG64 *Target, LONG64 Value) { return __atomic_fetch_add(Target, Value, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedAdd64(volatile LONG64 *Target, LONG64 Value) { return __atomic_add_fetch(Target, Value, __ATOMIC_SEQ_CST); }
+
+inline LONG64 InterlockedCompareExchange64(volatile LONG64 *Target, LONG64 Exchange, LONG64 Comparand)
+{
+	__atomic_compare_exchange_n(Target, &Comparand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+	return Comparand;
+}
+
+inline PVOID InterlockedExchangePointer(PVOID volatile *Target, PVOID Value)
+{
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+inline PVOID InterlockedCompareExchangePointer(PVOID volatile *Target, PVOID Exchange, PVOID Comparand)
+{
+	__atomic_compare_exchange_n(Target, &Comparand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+	return Comparand;
+}
+
+inline LONG ReadAcquire(const volatile LONG *Source) { return __atomic_load_n(Source, __ATOMIC_ACQUIRE); }
+inline LONG ReadNoFence(const volatile LONG *Source) { return __atomic_load_n(Source, __ATOMIC_RELAXED); }
+inline ULONG ReadULongAcquire(const volatile ULONG *Source) { return __atomic_load_n(Source, __ATOMIC_ACQUIRE); }
+inline ULONG ReadULongNoFence(const volatile ULONG *Source) { return __atomic_load_n(Source, __ATOMIC_RELAXED); }
+inline LONG64 ReadAcquire64(const volatile LONG64 *Source) { return __atomic_load_n(Source, __ATOMIC_ACQUIRE); }
+inline LONG64 ReadNoFence64(const volatile LONG64 *Source) { return __atomic_load_n(Source, __ATOMIC_RELAXED); }
+inline ULONG64 ReadULong64Acquire(const volatile ULONG64 *Source) { return __atomic_load_n(Source, __ATOMIC_ACQUIRE); }
+inline ULONG64 ReadULong64NoFence(const volatile ULONG64 *Source) { return __atomic_load_n(Source, __ATOMIC_RELAXED); }
+inline PVOID ReadPointerAcquire(PVOID const volatile *Source) { return __atomic_load_n(Source, __ATOMIC_ACQUIRE); }
+inline PVOID ReadPointerNoFence(PVOID const volatile *Source) { return __atomic_load_n(Source, __ATOMIC_RELAXED); }
+
+inline void WriteRelease(volatile LONG *Destination, LONG Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELEASE); }
+inline void WriteNoFence(volatile LONG *Destination, LONG Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELAXED); }
+inline void WriteULongRelease(volatile ULONG *Destination, ULONG Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELEASE); }
+inline void WriteULongNoFence(volatile ULONG *Destination, ULONG Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELAXED); }
+inline void WriteRelease64(volatile LONG64 *Destination, LONG64 Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELEASE); }
+inline void WriteNoFence64(volatile LONG64 *Destination, LONG64 Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELAXED); }
+inline void WriteULong64Release(volatile ULONG64 *Destination, ULONG64 Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELEASE); }
+inline void WriteULong64NoFence(volatile ULONG64 *Destination, ULONG64 Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELAXED); }
+inline void WritePointerRelease(PVOID volatile *Destination, PVOID Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELEASE); }
+inline void WritePointerNoFence(PVOID volatile *Destination, PVOID Value) { __atomic_store_n(Destination, Value, __ATOMIC_RELAXED); }
+
+//
+// Bit scanning.
+//
+
+inline BOOLEAN _BitScanForward(ULONG *Index, ULONG Mask)
+{
+	if (Mask == 0)
+	{
+		return FALSE;
+	}
+
+	*Index = (ULONG)__builtin_ctz(Mask);
+
+	return TRUE;
+}
+
+inline BOOLEAN _BitScanReverse(ULONG *Index, ULONG Mask)
+{
+	if (Mask == 0)
+	{
+		return FALSE;
+	}
+
+	*Index = 31 - (ULONG)__builtin_clz(Mask);
+
+	return TRUE;
+}
+
+inline BOOLEAN _BitScanForward64(ULONG *Index, ULONG64 Mask)
+{
+	if (Mask == 0)
+	{
+		return FALSE;
+	}
+
+	*Index = (ULONG)__builtin_ctzll(Mask);
+
+	return TRUE;
+}
+
+inline BOOLEAN _BitScanReverse64(ULONG *Index, ULONG64 Mask)
+{
+	if (Mask == 0)
+	{
+		return FALSE;
+	}
+
+	*Index = 63 - (ULONG)__builtin_clzll(Mask);
+
+	return TRUE;
+}
+
+//
+// Strings.
+//
+
+typedef struct _UNICODE_STRING
+{
+	USHORT Length;
+	USHORT MaximumLength;
+	PWCH Buffer;
+}
+UNICODE_STRING, *PUNICODE_STRING;
+
+typedef const UNICODE_STRING *PCUNICODE_STRING;
+
+#define DECLARE_CONST_UNICODE_STRING(name, str) \
+	const UNICODE_STRING name = { sizeof(str) - sizeof(WCHAR), sizeof(str), (PWCH)(str) }
+
+void RtlInitUnicodeString(PUNICODE_STRING Dest, PCWSTR Source);
+
+//
+// Follows the C.UTF-8 locale, which maps the same characters as the system case tables
+// for all practical purposes. Tests that compare against it only rely on it being fixed.
+//
+WCHAR RtlDowncaseUnicodeChar(WCHAR SourceCharacter);
+WCHAR RtlUpcaseUnicodeChar(WCHAR SourceCharacter);
+
+NTSTATUS RtlDowncaseUnicodeString(PUNICODE_STRING Dest, PCUNICODE_STRING Source, BOOLEAN Allocate);
+
+LONG RtlCompareUnicodeString(PCUNICODE_STRING Lhs, PCUNICODE_STRING Rhs, BOOLEAN CaseInsensitive);
+
+BOOLEAN RtlEqualUnicodeString(PCUNICODE_STRING Lhs, PCUNICODE_STRING Rhs, BOOLEAN CaseInsensitive);
+
+//
+// Processes.
+//
+// Only declared, so util.cpp links. Calling any of these fails.
+//
+
+typedef struct _KPROCESS *PEPROCESS;
+
+enum PROCESSINFOCLASS
+{
+	ProcessImageFileName = 27
+};
+
+enum KPROCESSOR_MODE
+{
+	KernelMode,
+	UserMode
+};
+
+typedef union _LARGE_INTEGER
+{
+	LONGLONG QuadPart;
+}
+LARGE_INTEGER, *PLARGE_INTEGER;
+
+NTSTATUS KeDelayExecutionThread(KPROCESSOR_MODE WaitMode, BOOLEAN Alertable, PLARGE_INTEGER Interval);
+
+#define OBJ_KERNEL_HANDLE 0x00000200L
+#define GENERIC_READ 0x80000000L
+
+NTSTATUS ObOpenObjectByPointer(PVOID Object, ULONG HandleAttributes, void *PassedAccessState,
+	ACCESS_MASK DesiredAccess, void *ObjectType, KPROCESSOR_MODE AccessMode, HANDLE *Handle);
+
+PVOID MmGetSystemRoutineAddress(PUNICODE_STRING SystemRoutineName);
+
+NTSTATUS ZwClose(HANDLE Handle);
+
+//
+// Framework objects.
+//
+
+typedef void *WDFOBJECT;
+
+typedef struct _WDF_OBJECT_ATTRIBUTES *PWDF_OBJECT_ATTRIBUTES;
+
+#define WDF_NO_OBJECT_ATTRIBUTES NULL
+
+namespace shim
+{
+struct SPINLOCK;
+}
+
+typedef shim::SPINLOCK *WDFSPINLOCK;
+
+NTSTATUS WdfSpinLockCreate(PWDF_OBJECT_ATTRIBUTES Attributes, WDFSPINLOCK *SpinLock);
+void WdfSpinLockAcquire(WDFSPINLOCK SpinLock);
+void WdfSpinLockRelease(WDFSPINLOCK SpinLock);
+
+void WdfObjectDelete(WDFOBJECT Object);
+
+//
+// Controls for tests.
+//
+
+namespace shim
+{
+
+//
+// Number of pool allocations that have not been freed.
+//
+LONG64
+NumOutstandingAllocations
+(
+);
+
+//
+// Total size of pool allocations that have not been freed.
+//
+LONG64
+NumOutstandingBytes
+(
+);
+
+//
+// Fail the allocation that is made `Countdown` allocations from now.
+// Zero fails the next allocation. A negative value disables failure injection.
+//
+void
+FailAllocation
+(
+	LONG64 Countdown
+);
+
+//
+// Number of processors reported by KeQueryMaximumProcessorCountEx().
+//
+void
+SetProcessorCount
+(
+	ULONG Count
+);
+
+//
+// Processor number reported to the calling thread by KeGetCurrentProcessorNumberEx().
+//
+void
+SetCurrentProcessor
+(
+	ULONG Number
+);
+
+} // namespace shim
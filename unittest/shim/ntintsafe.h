@@ -0,0 +1,15 @@
+#pragma once
+
+#include "kernel.h"
+
+#define STATUS_INTEGER_OVERFLOW ((NTSTATUS)0xC0000095L)
+
+inline NTSTATUS RtlSIZETMult(SIZE_T Multiplicand, SIZE_T Multiplier, SIZE_T *Result)
+{
+	return __builtin_mul_overflow(Multiplicand, Multiplier, Result) ? STATUS_INTEGER_OVERFLOW : STATUS_SUCCESS;
+}
+
+inline NTSTATUS RtlULongPtrAdd(ULONG_PTR Augend, ULONG_PTR Addend, ULONG_PTR *Result)
+{
+	return __builtin_add_overflow(Augend, Addend, Result) ? STATUS_INTEGER_OVERFLOW : STATUS_SUCCESS;
+}
@@ -0,0 +1,137 @@
+#include <vector>
+#include "harness.h"
+#include "containers/arena.h"
+
+namespace
+{
+
+bool
+IsAligned
+(
+	const void *Object
+)
+{
+	return ((ULONG_PTR)Object % MEMORY_ALLOCATION_ALIGNMENT) == 0;
+}
+
+} // anonymous namespace
+
+TEST_CASE(ObjectsAreAlignedAndDistinct)
+{
+	arena::CONTEXT *arena;
+
+	REQUIRE(NT_SUCCESS(arena::Initialize(&arena, ST_PAGEABLE::NO)));
+
+	std::vector<UCHAR*> objects;
+
+	for (SIZE_T size = 1; size < 3000; size += 37)
+	{
+		auto object = (UCHAR*)arena::Allocate(arena, size);
+
+		REQUIRE(object != NULL);
+
+		CHECK(IsAligned(object));
+
+		memset(object, (int)(size & 0xFF), size);
+
+		objects.push_back(object);
+	}
+
+	//
+	// No object was overwritten by a later one.
+	//
+
+	SIZE_T size = 1;
+
+	for (auto object : objects)
+	{
+		for (SIZE_T i = 0; i < size; ++i)
+		{
+			if (object[i] != (UCHAR)(size & 0xFF))
+			{
+				CHECK(false);
+
+				break;
+			}
+		}
+
+		size += 37;
+	}
+
+	arena::TearDown(&arena);
+
+	CHECK(arena == NULL);
+}
+
+TEST_CASE(ResetKeepsOneChunk)
+{
+	arena::CONTEXT *arena;
+
+	REQUIRE(NT_SUCCESS(arena::Initialize(&arena, ST_PAGEABLE::NO)));
+
+	const auto baseline = shim::NumOutstandingAllocations();
+
+	for (size_t round = 0; round < 3; ++round)
+	{
+		for (size_t i = 0; i < 1000; ++i)
+		{
+			REQUIRE(arena::Allocate(arena, 64) != NULL);
+		}
+
+		CHECK(shim::NumOutstandingAllocations() > baseline + 1);
+
+		arena::Reset(arena);
+
+		CHECK(shim::NumOutstandingAllocations() == baseline + 1);
+	}
+
+	arena::TearDown(&arena);
+}
+
+TEST_CASE(ResetReleasesOversizedObjects)
+{
+	arena::CONTEXT *arena;
+
+	REQUIRE(NT_SUCCESS(arena::Initialize(&arena, ST_PAGEABLE::NO)));
+
+	const auto baseline = shim::NumOutstandingAllocations();
+
+	//
+	// An oversized object first, so it's the only chunk, then mixed sizes.
+	//
+
+	REQUIRE(arena::Allocate(arena, 64 * 1024) != NULL);
+
+	arena::Reset(arena);
+
+	CHECK(shim::NumOutstandingAllocations() == baseline);
+
+	for (size_t i = 0; i < 100; ++i)
+	{
+		REQUIRE(arena::Allocate(arena, (i % 10 == 0) ? 32 * 1024 : 200) != NULL);
+	}
+
+	arena::Reset(arena);
+
+	CHECK(shim::NumOutstandingAllocations() == baseline + 1);
+
+	arena::Reset(arena);
+
+	CHECK(shim::NumOutstandingAllocations() == baseline + 1);
+
+	arena::TearDown(&arena);
+}
+
+TEST_CASE(FailedChunkAllocationReturnsNull)
+{
+	arena::CONTEXT *arena;
+
+	REQUIRE(NT_SUCCESS(arena::Initialize(&arena, ST_PAGEABLE::NO)));
+
+	shim::FailAllocation(0);
+
+	CHECK(arena::Allocate(arena, 64) == NULL);
+	CHECK(arena::Allocate(arena, 64) != NULL);
+
+	arena::TearDown(&arena);
+}
@@ -0,0 +1,128 @@
+#include <vector>
+#include "harness.h"
+#include "containers/casefold.h"
+
+namespace
+{
+
+struct TABLE
+{
+	TABLE()
+	{
+		Status = casefold::Initialize(&Context);
+	}
+
+	~TABLE()
+	{
+		casefold::TearDown(&Context);
+	}
+
+	casefold::CONTEXT *Context = NULL;
+	NTSTATUS Status;
+};
+
+UNICODE_STRING
+MakeString
+(
+	std::vector<WCHAR> &Buffer
+)
+{
+	UNICODE_STRING s;
+
+	s.Length = (USHORT)(Buffer.size() * sizeof(WCHAR));
+	s.MaximumLength = s.Length;
+	s.Buffer = Buffer.data();
+
+	return s;
+}
+
+} // anonymous namespace
+
+TEST_CASE(FoldMatchesSystemForEveryCodeUnit)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	size_t numMapped = 0;
+
+	for (ULONG c = 0; c <= MAXUSHORT; ++c)
+	{
+		const auto expected = RtlDowncaseUnicodeChar((WCHAR)c);
+
+		CHECK(casefold::Fold(table.Context, (WCHAR)c) == expected);
+
+		numMapped += (expected != (WCHAR)c);
+	}
+
+	//
+	// Make sure the reference is not trivial.
+	//
+
+	CHECK(numMapped > 1000);
+}
+
+TEST_CASE(TableIsCompact)
+{
+	const auto before = shim::NumOutstandingBytes();
+
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	const auto tableBytes = shim::NumOutstandingBytes() - before;
+
+	printf("case folding table: %lld bytes\n", (long long)tableBytes);
+
+	CHECK(tableBytes < 64 * 1024);
+}
+
+TEST_CASE(EqualMatchesCaseInsensitiveCompare)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	//
+	// Pairs of cased characters, and characters that are not cased.
+	//
+
+	const WCHAR alphabet[] =
+	{
+		L'a', L'A', L'z', L'Z', L'\\', L'.', L'0', L'@', L'[',
+		0xE4, 0xC4, 0xE5, 0xC5, 0x3B1, 0x391, 0x430, 0x410, 0xFF41, 0xFF21, 0x130, 0x69
+	};
+
+	harness::Random random;
+
+	for (size_t iteration = 0; iteration < 20000; ++iteration)
+	{
+		const auto length = (size_t)random.Below(40);
+
+		std::vector<WCHAR> lhs(length);
+		std::vector<WCHAR> rhs(length);
+
+		for (size_t i = 0; i < length; ++i)
+		{
+			lhs[i] = alphabet[random.Below(ARRAYSIZE(alphabet))];
+
+			//
+			// Mostly the same character in either case, sometimes a different character.
+			//
+
+			rhs[i] = (random.Below(8) != 0)
+				? ((random.Below(2) == 0) ? RtlUpcaseUnicodeChar(lhs[i]) : RtlDowncaseUnicodeChar(lhs[i]))
+				: alphabet[random.Below(ARRAYSIZE(alphabet))];
+		}
+
+		if (length != 0 && random.Below(16) == 0)
+		{
+			rhs.pop_back();
+		}
+
+		auto l = MakeString(lhs);
+		auto r = MakeString(rhs);
+
+		CHECK(casefold::Equal(table.Context, &l, &r) == (RtlCompareUnicodeString(&l, &r, TRUE) == 0));
+	}
+}
@@ -0,0 +1,386 @@
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+#include "harness.h"
+#include "processtree.h"
+#include "procmon/coalesce.h"
+
+using harness::Pid;
+
+namespace
+{
+
+struct EVENT
+{
+	bool Arriving;
+	HANDLE ProcessId;
+	bool Coalesced;
+
+	bool operator==(const EVENT &Rhs) const
+	{
+		return Arriving == Rhs.Arriving && ProcessId == Rhs.ProcessId && Coalesced == Rhs.Coalesced;
+	}
+};
+
+EVENT Arrival(size_t Number)
+{
+	return { true, Pid(Number), false };
+}
+
+EVENT Departure(size_t Number, bool Coalesced = false)
+{
+	return { false, Pid(Number), Coalesced };
+}
+
+//
+// A queue of process events as collected by the procmon worker thread.
+//
+class Batch
+{
+public:
+
+	Batch()
+	{
+		InitializeListHead(&m_queue);
+		InitializeListHead(&m_cancelled);
+	}
+
+	Batch(const Batch&) = delete;
+	Batch &operator=(const Batch&) = delete;
+
+	void Arrive(size_t Number, size_t ParentNumber)
+	{
+		auto &details = m_details.emplace_back();
+
+		details.ParentProcessId = Pid(ParentNumber);
+		RtlZeroMemory(&details.ImageName, sizeof(details.ImageName));
+
+		Queue(Pid(Number), &details);
+	}
+
+	void Depart(size_t Number)
+	{
+		Queue(Pid(Number), NULL);
+	}
+
+	SIZE_T Coalesce(procmon::coalesce::CONTEXT *Context)
+	{
+		return procmon::coalesce::CoalesceEvents(Context, &m_queue, &m_cancelled);
+	}
+
+	std::vector<EVENT> Delivered() const
+	{
+		return Events(&m_queue);
+	}
+
+	std::vector<EVENT> Cancelled() const
+	{
+		return Events(&m_cancelled);
+	}
+
+private:
+
+	void Queue(HANDLE ProcessId, procmon::PROCESS_EVENT_DETAILS *Details)
+	{
+		auto &event = m_events.emplace_back();
+
+		RtlZeroMemory(&event, sizeof(event));
+
+		event.ProcessId = ProcessId;
+		event.Details = Details;
+
+		InsertTailList(&m_queue, &event.ListEntry);
+	}
+
+	static std::vector<EVENT> Events(const LIST_ENTRY *List)
+	{
+		std::vector<EVENT> events;
+
+		for (auto link = List->Flink; link != List; link = link->Flink)
+		{
+			auto event = (const procmon::PROCESS_EVENT*)link;
+
+			events.push_back({ event->Details != NULL, event->ProcessId, event->Coalesced });
+		}
+
+		return events;
+	}
+
+	// Deques don't move their elements when growing at the ends.
+	std::deque<procmon::PROCESS_EVENT> m_events;
+	std::deque<procmon::PROCESS_EVENT_DETAILS> m_details;
+
+	LIST_ENTRY m_queue;
+	LIST_ENTRY m_cancelled;
+};
+
+std::unique_ptr<procmon::coalesce::CONTEXT> NewContext()
+{
+	auto context = std::make_unique<procmon::coalesce::CONTEXT>();
+
+	RtlZeroMemory(context.get(), sizeof(*context));
+
+	return context;
+}
+
+} // anonymous namespace
+
+TEST_CASE(ArrivalAndDepartureInOneBatchAreCoalesced)
+{
+	auto context = NewContext();
+
+	Batch batch;
+
+	batch.Arrive(10, 1);
+	batch.Arrive(11, 1);
+	batch.Depart(10);
+	batch.Depart(12);
+
+	CHECK(batch.Coalesce(context.get()) == 1);
+
+	const std::vector<EVENT> delivered{ Arrival(11), Departure(10, true), Departure(12) };
+	const std::vector<EVENT> cancelled{ Arrival(10) };
+
+	CHECK(batch.Delivered() == delivered);
+	CHECK(batch.Cancelled() == cancelled);
+}
+
+TEST_CASE(DepartureOfEarlierArrivalIsNotCoalesced)
+{
+	auto context = NewContext();
+
+	{
+		Batch batch;
+
+		batch.Arrive(10, 1);
+
+		CHECK(batch.Coalesce(context.get()) == 0);
+	}
+
+	//
+	// Slots from the previous batch are not matched.
+	//
+
+	Batch batch;
+
+	batch.Depart(10);
+
+	CHECK(batch.Coalesce(context.get()) == 0);
+
+	const std::vector<EVENT> delivered{ Departure(10) };
+
+	CHECK(batch.Delivered() == delivered);
+	CHECK(batch.Cancelled().empty());
+}
+
+TEST_CASE(ParentWithChildrenIsKept)
+{
+	auto context = NewContext();
+
+	Batch batch;
+
+	batch.Arrive(10, 1);
+	batch.Arrive(20, 10);
+	batch.Depart(10);
+	batch.Depart(20);
+
+	//
+	// The child has no children of its own, so it's coalesced.
+	//
+
+	CHECK(batch.Coalesce(context.get()) == 1);
+
+	const std::vector<EVENT> delivered{ Arrival(10), Departure(10), Departure(20, true) };
+	const std::vector<EVENT> cancelled{ Arrival(20) };
+
+	CHECK(batch.Delivered() == delivered);
+	CHECK(batch.Cancelled() == cancelled);
+}
+
+TEST_CASE(ChildOfDepartedParentDoesNotKeepIt)
+{
+	auto context = NewContext();
+
+	Batch batch;
+
+	//
+	// The child names a PID whose process has already departed, so it can't have been
+	// created by that process.
+	//
+
+	batch.Arrive(10, 1);
+	batch.Depart(10);
+	batch.Arrive(20, 10);
+
+	CHECK(batch.Coalesce(context.get()) == 1);
+
+	const std::vector<EVENT> delivered{ Departure(10, true), Arrival(20) };
+
+	CHECK(batch.Delivered() == delivered);
+}
+
+TEST_CASE(ReusedPidIsCoalescedPerProcess)
+{
+	auto context = NewContext();
+
+	Batch batch;
+
+	//
+	// The first process with the PID has a child and is kept. The second process
+	// with the same PID has none and is coalesced. The third is still alive.
+	//
+
+	batch.Arrive(10, 1);
+	batch.Arrive(20, 10);
+	batch.Depart(10);
+	batch.Arrive(10, 1);
+	batch.Depart(10);
+	batch.Arrive(10, 2);
+
+	CHECK(batch.Coalesce(context.get()) == 1);
+
+	const std::vector<EVENT> delivered
+	{
+		Arrival(10), Arrival(20), Departure(10), Departure(10, true), Arrival(10)
+	};
+
+	const std::vector<EVENT> cancelled{ Arrival(10) };
+
+	CHECK(batch.Delivered() == delivered);
+	CHECK(batch.Cancelled() == cancelled);
+}
+
+TEST_CASE(ReusedPidWithinOneBatchIsCoalescedTwice)
+{
+	auto context = NewContext();
+
+	Batch batch;
+
+	batch.Arrive(10, 1);
+	batch.Depart(10);
+	batch.Arrive(10, 1);
+	batch.Depart(10);
+
+	CHECK(batch.Coalesce(context.get()) == 2);
+
+	const std::vector<EVENT> delivered{ Departure(10, true), Departure(10, true) };
+
+	CHECK(batch.Delivered() == delivered);
+	CHECK(batch.Cancelled().size() == 2);
+}
+
+//
+// Random batches, including more distinct PIDs than there are slots, checked against
+// what coalescing promises: a cancelled arrival is paired with the next departure of
+// its PID, and no arrival in between named it as its parent.
+//
+TEST_CASE(CoalescedPairsAreValid)
+{
+	auto context = NewContext();
+
+	harness::Random random;
+
+	for (size_t round = 0; round < 200; ++round)
+	{
+		Batch batch;
+
+		std::vector<EVENT> queued;
+		std::vector<size_t> parents;
+		std::map<size_t, bool> alive;
+
+		const auto numPids = 8 + random.Below(round < 100 ? 64 : 600);
+		const auto numEvents = random.Below(1000);
+
+		for (size_t i = 0; i < numEvents; ++i)
+		{
+			const auto number = 1 + random.Below(numPids);
+
+			if (alive[number])
+			{
+				batch.Depart(number);
+
+				queued.push_back(Departure(number));
+				parents.push_back(0);
+
+				alive[number] = false;
+			}
+			else
+			{
+				const auto parent = 1 + random.Below(numPids);
+
+				batch.Arrive(number, parent);
+
+				queued.push_back(Arrival(number));
+				parents.push_back(parent);
+
+				alive[number] = true;
+			}
+		}
+
+		const auto numCoalesced = batch.Coalesce(context.get());
+
+		const auto delivered = batch.Delivered();
+
+		CHECK(batch.Cancelled().size() == numCoalesced);
+		CHECK(delivered.size() + numCoalesced == queued.size());
+
+		//
+		// Walk the queued events alongside the delivered ones, to find which were cancelled.
+		// Events keep their order.
+		//
+
+		size_t next = 0;
+		size_t numMarked = 0;
+
+		std::vector<bool> cancelled(queued.size(), false);
+
+		for (size_t i = 0; i < queued.size(); ++i)
+		{
+			auto expected = queued[i];
+
+			if (next < delivered.size() && delivered[next].Arriving == expected.Arriving
+				&& delivered[next].ProcessId == expected.ProcessId)
+			{
+				numMarked += delivered[next].Coalesced;
+
+				if (delivered[next].Coalesced)
+				{
+					//
+					// The most recent arrival of the PID must have been cancelled, and no
+					// arrival since then may name it as its parent.
+					//
+
+					REQUIRE(!expected.Arriving);
+
+					size_t j = i;
+
+					while (j-- > 0 && queued[j].ProcessId != expected.ProcessId)
+					{
+						CHECK(!(queued[j].Arriving && Pid(parents[j]) == expected.ProcessId));
+					}
+
+					REQUIRE(j < i);
+
+					CHECK(queued[j].Arriving);
+					CHECK(cancelled[j]);
+				}
+
+				++next;
+
+				continue;
+			}
+
+			//
+			// Only arrivals are cancelled.
+			//
+
+			CHECK(expected.Arriving);
+
+			cancelled[i] = true;
+		}
+
+		CHECK(next == delivered.size());
+		CHECK(numMarked == numCoalesced);
+	}
+}
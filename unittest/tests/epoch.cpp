@@ -0,0 +1,291 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "harness.h"
+#include "epoch.h"
+
+namespace
+{
+
+struct EPOCH
+{
+	EPOCH(ULONG NumProcessors = 1)
+	{
+		shim::SetProcessorCount(NumProcessors);
+		shim::SetCurrentProcessor(0);
+
+		Status = epoch::Initialize(&Context);
+	}
+
+	~EPOCH()
+	{
+		epoch::TearDown(&Context);
+
+		shim::SetProcessorCount(1);
+		shim::SetCurrentProcessor(0);
+	}
+
+	epoch::CONTEXT *Context = NULL;
+	NTSTATUS Status;
+};
+
+//
+// Reader that enters a read section on its own thread and processor, and stays in it until
+// it's told to leave.
+//
+struct HELD_READER
+{
+	HELD_READER(epoch::CONTEXT *Context, ULONG Processor)
+	{
+		Thread = std::thread([this, Context, Processor]()
+		{
+			shim::SetCurrentProcessor(Processor);
+
+			epoch::READ_SECTION section;
+
+			epoch::Enter(Context, &section);
+
+			Entered.store(true);
+
+			while (!Release.load())
+			{
+				std::this_thread::yield();
+			}
+
+			epoch::Leave(Context, &section);
+		});
+
+		while (!Entered.load())
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	void Leave()
+	{
+		Release.store(true);
+
+		Thread.join();
+	}
+
+	std::atomic<bool> Entered{ false };
+	std::atomic<bool> Release{ false };
+	std::thread Thread;
+};
+
+//
+// Call Synchronize() on a separate thread.
+//
+struct SYNCHRONIZER
+{
+	SYNCHRONIZER(epoch::CONTEXT *Context)
+	{
+		Thread = std::thread([this, Context]()
+		{
+			epoch::Synchronize(Context);
+
+			Done.store(true);
+		});
+	}
+
+	//
+	// Whether the grace period is still running after giving it ample time to end.
+	//
+	bool IsWaiting()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		return !Done.load();
+	}
+
+	void Join()
+	{
+		Thread.join();
+	}
+
+	std::atomic<bool> Done{ false };
+	std::thread Thread;
+};
+
+} // anonymous namespace
+
+TEST_CASE(SynchronizeWithoutReadersReturns)
+{
+	EPOCH epoch(4);
+
+	REQUIRE(NT_SUCCESS(epoch.Status));
+
+	for (size_t i = 0; i < 100; ++i)
+	{
+		epoch::Synchronize(epoch.Context);
+	}
+
+	//
+	// Read sections that were left don't hold up later grace periods.
+	//
+
+	epoch::READ_SECTION section;
+
+	epoch::Enter(epoch.Context, &section);
+	epoch::Leave(epoch.Context, &section);
+
+	epoch::Synchronize(epoch.Context);
+
+	CHECK(KeGetCurrentIrql() == PASSIVE_LEVEL);
+}
+
+TEST_CASE(GracePeriodWaitsForEarlierReaders)
+{
+	EPOCH epoch(4);
+
+	REQUIRE(NT_SUCCESS(epoch.Status));
+
+	HELD_READER first(epoch.Context, 1);
+	HELD_READER second(epoch.Context, 2);
+
+	SYNCHRONIZER synchronizer(epoch.Context);
+
+	CHECK(synchronizer.IsWaiting());
+
+	first.Leave();
+
+	CHECK(synchronizer.IsWaiting());
+
+	second.Leave();
+
+	synchronizer.Join();
+
+	CHECK(synchronizer.Done.load());
+}
+
+TEST_CASE(GracePeriodIgnoresLaterReaders)
+{
+	EPOCH epoch(4);
+
+	REQUIRE(NT_SUCCESS(epoch.Status));
+
+	HELD_READER early(epoch.Context, 1);
+
+	SYNCHRONIZER synchronizer(epoch.Context);
+
+	CHECK(synchronizer.IsWaiting());
+
+	//
+	// This reader enters after the epoch was advanced, on the same processor as the
+	// earlier reader. It must not extend the grace period.
+	//
+
+	HELD_READER late(epoch.Context, 1);
+
+	early.Leave();
+
+	synchronizer.Join();
+
+	CHECK(synchronizer.Done.load());
+
+	//
+	// The next grace period waits for it.
+	//
+
+	SYNCHRONIZER next(epoch.Context);
+
+	CHECK(next.IsWaiting());
+
+	late.Leave();
+
+	next.Join();
+}
+
+//
+// Readers dereference a published object, and the writer replaces and frees it after each
+// grace period. A reader must never see an object that has been retired.
+//
+TEST_CASE(PublishedObjectsOutliveReaders)
+{
+	const ULONG NUM_READERS = 4;
+
+	EPOCH epoch(NUM_READERS + 1);
+
+	REQUIRE(NT_SUCCESS(epoch.Status));
+
+	struct OBJECT
+	{
+		std::atomic<ULONG> Live;
+	};
+
+	std::atomic<OBJECT*> published(new OBJECT{ { 1 } });
+	std::atomic<bool> done(false);
+	std::atomic<size_t> started(0);
+	std::vector<size_t> retired(NUM_READERS), reads(NUM_READERS);
+
+	std::vector<std::thread> readers;
+
+	for (ULONG r = 0; r < NUM_READERS; ++r)
+	{
+		readers.emplace_back([&, r]()
+		{
+			shim::SetCurrentProcessor(r + 1);
+
+			++started;
+
+			while (!done.load())
+			{
+				epoch::READ_SECTION section;
+
+				epoch::Enter(epoch.Context, &section);
+
+				auto object = published.load(std::memory_order_acquire);
+
+				for (size_t i = 0; i < 4; ++i)
+				{
+					retired[r] += (object->Live.load() != 1);
+
+					std::this_thread::yield();
+				}
+
+				++reads[r];
+
+				epoch::Leave(epoch.Context, &section);
+			}
+		});
+	}
+
+	while (started.load() != NUM_READERS)
+	{
+		std::this_thread::yield();
+	}
+
+	for (size_t i = 0; i < 2000; ++i)
+	{
+		auto old = published.exchange(new OBJECT{ { 1 } }, std::memory_order_release);
+
+		epoch::Synchronize(epoch.Context);
+
+		//
+		// Retire the object before it's freed, so a reader that is still using it
+		// is detected without a sanitizer.
+		//
+
+		old->Live.store(0);
+
+		delete old;
+
+		std::this_thread::yield();
+	}
+
+	done.store(true);
+
+	for (auto &reader : readers)
+	{
+		reader.join();
+	}
+
+	delete published.load();
+
+	for (ULONG r = 0; r < NUM_READERS; ++r)
+	{
+		CHECK(retired[r] == 0);
+		CHECK(reads[r] != 0);
+	}
+}
@@ -0,0 +1,141 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "glob.h"
+#include "unicode.h"
+#include "containers/globdfa.h"
+
+using harness::UnicodeString;
+
+namespace
+{
+
+struct AUTOMATON
+{
+	AUTOMATON(const std::vector<std::u16string> &Patterns)
+	{
+		std::vector<UnicodeString> storage(Patterns.begin(), Patterns.end());
+		std::vector<const LOWER_UNICODE_STRING*> patterns;
+
+		for (auto &pattern : storage)
+		{
+			patterns.push_back(pattern.Lower());
+		}
+
+		Status = globdfa::Compile(patterns.data(), patterns.size(), ST_PAGEABLE::NO, &Context);
+	}
+
+	~AUTOMATON()
+	{
+		if (Context != NULL)
+		{
+			globdfa::TearDown(&Context);
+		}
+	}
+
+	bool Match(const std::u16string &Path)
+	{
+		UnicodeString path(Path);
+
+		return globdfa::Match(Context, path.Lower());
+	}
+
+	globdfa::CONTEXT *Context = NULL;
+	NTSTATUS Status;
+};
+
+//
+// Strings over a small alphabet, so wildcards and literals overlap often.
+//
+std::u16string
+RandomString
+(
+	harness::Random &Random,
+	const char16_t *Alphabet,
+	size_t MaxLength
+)
+{
+	const std::u16string alphabet(Alphabet);
+
+	std::u16string s;
+
+	const auto length = Random.Below(MaxLength + 1);
+
+	for (size_t i = 0; i < length; ++i)
+	{
+		s += alphabet[Random.Below(alphabet.size())];
+	}
+
+	return s;
+}
+
+} // anonymous namespace
+
+TEST_CASE(WildcardsStayWithinComponent)
+{
+	AUTOMATON dfa({
+		u"\\device\\*\\users\\*\\appdata\\local\\discord\\app-*\\discord.exe",
+		u"\\device\\harddiskvolume1\\tools\\?.exe"
+	});
+
+	REQUIRE(NT_SUCCESS(dfa.Status));
+
+	CHECK(dfa.Match(u"\\device\\harddiskvolume1\\users\\jane\\appdata\\local\\discord\\app-1.0.9\\discord.exe"));
+	CHECK(dfa.Match(u"\\device\\x\\users\\\\appdata\\local\\discord\\app-\\discord.exe"));
+	CHECK(!dfa.Match(u"\\device\\a\\b\\users\\jane\\appdata\\local\\discord\\app-1\\discord.exe"));
+	CHECK(!dfa.Match(u"\\device\\a\\users\\jane\\appdata\\local\\discord\\app-1\\discord.exe2"));
+
+	CHECK(dfa.Match(u"\\device\\harddiskvolume1\\tools\\a.exe"));
+	CHECK(!dfa.Match(u"\\device\\harddiskvolume1\\tools\\ab.exe"));
+	CHECK(!dfa.Match(u"\\device\\harddiskvolume1\\tools\\.exe"));
+	CHECK(!dfa.Match(u"\\device\\harddiskvolume1\\tools\\\\.exe"));
+}
+
+TEST_CASE(AgreesWithBacktrackingMatcher)
+{
+	harness::Random random;
+
+	for (size_t round = 0; round < 200; ++round)
+	{
+		std::vector<std::u16string> patterns;
+
+		const auto numPatterns = 1 + random.Below(8);
+
+		for (size_t i = 0; i < numPatterns; ++i)
+		{
+			patterns.push_back(RandomString(random, u"ab\\*?", 8));
+		}
+
+		AUTOMATON dfa(patterns);
+
+		REQUIRE(NT_SUCCESS(dfa.Status));
+
+		for (size_t i = 0; i < 200; ++i)
+		{
+			const auto path = RandomString(random, u"abc\\", 10);
+
+			bool expected = false;
+
+			for (const auto &pattern : patterns)
+			{
+				expected = expected || harness::GlobMatch(pattern, path);
+			}
+
+			CHECK(dfa.Match(path) == expected);
+		}
+	}
+}
+
+TEST_CASE(CompileFailsCleanlyWithoutMemory)
+{
+	for (LONG64 countdown = 0; countdown < 4; ++countdown)
+	{
+		shim::FailAllocation(countdown);
+
+		AUTOMATON dfa({ u"\\device\\*\\a?.exe", u"\\device\\b\\*" });
+
+		shim::FailAllocation(-1);
+
+		CHECK(NT_SUCCESS(dfa.Status) || dfa.Context == NULL);
+	}
+}
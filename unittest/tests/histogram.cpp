@@ -0,0 +1,131 @@
+#include "harness.h"
+#include <wdm.h>
+#include "histogram.h"
+
+//
+// histogram.h only uses basic integer types and relies on the includer for them.
+//
+
+namespace
+{
+
+//
+// Bucket by the position of the highest set bit, as documented in defs/statistics.h.
+//
+ULONG
+ReferenceBucket
+(
+	ULONGLONG Value
+)
+{
+	ULONG index = 0;
+
+	for (ULONG bit = 1; bit < 64; ++bit)
+	{
+		if (Value >= (1ULL << bit))
+		{
+			index = bit;
+		}
+	}
+
+	return min(index, (ULONG)(ST_LATENCY_HISTOGRAM_NUM_BUCKETS - 1));
+}
+
+ULONGLONG
+Total
+(
+	const ST_LATENCY_HISTOGRAM *Histogram
+)
+{
+	ULONGLONG total = 0;
+
+	for (auto count : Histogram->Buckets)
+	{
+		total += count;
+	}
+
+	return total;
+}
+
+} // anonymous namespace
+
+TEST_CASE(BucketsCoverPowersOfTwo)
+{
+	CHECK(histogram::BucketIndex(0) == 0);
+	CHECK(histogram::BucketIndex(1) == 0);
+
+	for (ULONG n = 1; n < ST_LATENCY_HISTOGRAM_NUM_BUCKETS; ++n)
+	{
+		const auto low = 1ULL << n;
+
+		CHECK(histogram::BucketIndex(low - 1) == n - 1);
+		CHECK(histogram::BucketIndex(low) == n);
+		CHECK(histogram::BucketIndex(low + (low / 2)) == n);
+	}
+
+	//
+	// The last bucket counts everything above its lower bound.
+	//
+
+	const auto last = ST_LATENCY_HISTOGRAM_NUM_BUCKETS - 1;
+
+	CHECK(histogram::BucketIndex((1ULL << (last + 1)) - 1) == last);
+	CHECK(histogram::BucketIndex(1ULL << (last + 1)) == last);
+	CHECK(histogram::BucketIndex(1ULL << 63) == last);
+	CHECK(histogram::BucketIndex(~0ULL) == last);
+}
+
+TEST_CASE(BucketIndexMatchesReference)
+{
+	harness::Random random;
+
+	for (size_t i = 0; i < 100000; ++i)
+	{
+		//
+		// Spread values over every magnitude.
+		//
+
+		const auto value = random.Next() >> random.Below(64);
+
+		CHECK(histogram::BucketIndex(value) == ReferenceBucket(value));
+	}
+}
+
+TEST_CASE(IntervalsAreRecordedInMicroseconds)
+{
+	ST_LATENCY_HISTOGRAM histogram = { 0 };
+
+	const ULONGLONG START = 1000000;
+
+	//
+	// Interrupt time is in units of 100 ns.
+	//
+
+	histogram::RecordInterval(&histogram, START, START);
+	histogram::RecordInterval(&histogram, START, START + 19);
+
+	CHECK(histogram.Buckets[0] == 2);
+
+	histogram::RecordInterval(&histogram, START, START + 20);
+	histogram::RecordInterval(&histogram, START, START + 39);
+
+	CHECK(histogram.Buckets[1] == 2);
+
+	histogram::RecordInterval(&histogram, START, START + (1000 * 10));
+
+	CHECK(histogram.Buckets[9] == 1);
+
+	//
+	// A clock that goes backwards records a zero interval.
+	//
+
+	histogram::RecordInterval(&histogram, START, START - 1);
+
+	CHECK(histogram.Buckets[0] == 3);
+
+	histogram::RecordInterval(&histogram, 0, ~0ULL);
+
+	CHECK(histogram.Buckets[ST_LATENCY_HISTOGRAM_NUM_BUCKETS - 1] == 1);
+
+	CHECK(Total(&histogram) == 7);
+}
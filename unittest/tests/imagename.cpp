@@ -0,0 +1,303 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "unicode.h"
+#include "containers/imagename.h"
+
+using harness::UnicodeString;
+
+namespace
+{
+
+struct TABLE
+{
+	TABLE()
+	{
+		Status = imagename::Initialize(&Context);
+	}
+
+	~TABLE()
+	{
+		if (Context != NULL)
+		{
+			imagename::TearDown(&Context);
+		}
+	}
+
+	imagename::CONTEXT *Context = NULL;
+	NTSTATUS Status;
+};
+
+} // anonymous namespace
+
+TEST_CASE(InternReturnsSameNameForEqualStrings)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	UnicodeString first(u"\\device\\harddiskvolume1\\windows\\notepad.exe");
+	UnicodeString second(first.Text());
+
+	imagename::IMAGE_NAME *a, *b;
+
+	REQUIRE(NT_SUCCESS(imagename::Intern(table.Context, first.Lower(), &a)));
+	REQUIRE(NT_SUCCESS(imagename::Intern(table.Context, second.Lower(), &b)));
+
+	CHECK(a == b);
+	CHECK(a->RefCount == 2);
+	CHECK(a->String.Buffer != first.Get()->Buffer);
+	CHECK(imagename::NumEntries(table.Context) == 1);
+
+	imagename::Release(a);
+	imagename::Release(b);
+
+	CHECK(imagename::NumEntries(table.Context) == 0);
+}
+
+TEST_CASE(InternDowncaseMatchesLowerCaseName)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	UnicodeString lower(u"\\device\\harddiskvolume1\\program files\\app\\app.exe");
+	UnicodeString mixed(u"\\Device\\HarddiskVolume1\\Program Files\\App\\APP.exe");
+
+	imagename::IMAGE_NAME *a, *b;
+
+	REQUIRE(NT_SUCCESS(imagename::Intern(table.Context, lower.Lower(), &a)));
+	REQUIRE(NT_SUCCESS(imagename::InternDowncase(table.Context, mixed.Get(), &b)));
+
+	CHECK(a == b);
+
+	imagename::Release(a);
+	imagename::Release(b);
+}
+
+TEST_CASE(InternDowncaseHandlesLongNames)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	std::u16string path(u"\\Device\\HarddiskVolume2");
+
+	while (path.size() < 1000)
+	{
+		path += u"\\Directory";
+	}
+
+	UnicodeString mixed(path + u"\\Image.EXE");
+
+	imagename::IMAGE_NAME *name;
+
+	REQUIRE(NT_SUCCESS(imagename::InternDowncase(table.Context, mixed.Get(), &name)));
+
+	const auto text = harness::ToText(&name->String);
+
+	CHECK(text.size() == mixed.Text().size());
+	CHECK(text.find(u'D') == std::u16string::npos);
+	CHECK(text.substr(text.size() - 10) == u"\\image.exe");
+
+	imagename::Release(name);
+}
+
+TEST_CASE(FindAnyCaseIgnoresCasing)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	UnicodeString lower(u"\\device\\harddiskvolume3\\\u00e5\u00e4\u00f6\\tool.exe");
+	UnicodeString upper(u"\\DEVICE\\HARDDISKVOLUME3\\\u00c5\u00c4\u00d6\\TOOL.EXE");
+	UnicodeString other(u"\\DEVICE\\HARDDISKVOLUME3\\\u00c5\u00c4\u00d6\\TOOL2.EXE");
+
+	imagename::IMAGE_NAME *name;
+
+	REQUIRE(NT_SUCCESS(imagename::Intern(table.Context, lower.Lower(), &name)));
+
+	auto found = imagename::FindAnyCase(table.Context, upper.Get());
+
+	CHECK(found == name);
+	CHECK(imagename::FindAnyCase(table.Context, other.Get()) == NULL);
+
+	if (found != NULL)
+	{
+		imagename::Release(found);
+	}
+
+	imagename::Release(name);
+}
+
+TEST_CASE(ReleasedNameIsNotFound)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	UnicodeString lower(u"\\device\\harddiskvolume1\\a.exe");
+
+	imagename::IMAGE_NAME *name;
+
+	REQUIRE(NT_SUCCESS(imagename::Intern(table.Context, lower.Lower(), &name)));
+
+	imagename::AddRef(name);
+	imagename::ReleaseMany(name, 2);
+
+	CHECK(imagename::FindAnyCase(table.Context, lower.Get()) == NULL);
+	CHECK(imagename::NumEntries(table.Context) == 0);
+}
+
+TEST_CASE(StatisticsTrackVolumePrefix)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	UnicodeString device(u"\\device\\harddiskvolume1\\a.exe");
+	UnicodeString other(u"\\??\\c:\\a.exe");
+
+	imagename::IMAGE_NAME *a, *b;
+
+	REQUIRE(NT_SUCCESS(imagename::Intern(table.Context, device.Lower(), &a)));
+	REQUIRE(NT_SUCCESS(imagename::Intern(table.Context, other.Lower(), &b)));
+
+	CHECK(a->VolumePrefixLength == sizeof(u"\\device\\harddiskvolume1\\") - sizeof(WCHAR));
+	CHECK(b->VolumePrefixLength == 0);
+
+	imagename::STATISTICS stats;
+
+	imagename::GetStatistics(table.Context, &stats);
+
+	CHECK(stats.NumEntries == 2);
+	CHECK(stats.StringBytes == (SIZE_T)(device.Get()->Length + other.Get()->Length));
+	CHECK(stats.VolumePrefixBytes == a->VolumePrefixLength);
+
+	imagename::Release(a);
+	imagename::Release(b);
+
+	imagename::GetStatistics(table.Context, &stats);
+
+	CHECK(stats.NumEntries == 0);
+	CHECK(stats.StringBytes == 0);
+	CHECK(stats.VolumePrefixBytes == 0);
+}
+
+TEST_CASE(InternFailsCleanlyWithoutMemory)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	UnicodeString lower(u"\\device\\harddiskvolume1\\a.exe");
+
+	imagename::IMAGE_NAME *name;
+
+	shim::FailAllocation(0);
+
+	CHECK(imagename::Intern(table.Context, lower.Lower(), &name) == STATUS_INSUFFICIENT_RESOURCES);
+	CHECK(imagename::NumEntries(table.Context) == 0);
+}
+
+TEST_CASE(FindAnyCaseFoldsEveryCodeUnit)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	//
+	// Intern "x" + the lower case form of every code unit, and find it through the
+	// original code unit. This checks that hashing while folding agrees with hashing
+	// the lower case name, for every code unit.
+	//
+
+	std::vector<imagename::IMAGE_NAME*> names;
+
+	for (ULONG c = 1; c <= MAXUSHORT; ++c)
+	{
+		const std::u16string text{ u'x', (char16_t)c };
+		const std::u16string lower{ u'x', (char16_t)RtlDowncaseUnicodeChar((WCHAR)c) };
+
+		UnicodeString lowerString(lower);
+
+		imagename::IMAGE_NAME *name;
+
+		REQUIRE(NT_SUCCESS(imagename::Intern(table.Context, lowerString.Lower(), &name)));
+
+		names.push_back(name);
+
+		UnicodeString textString(text);
+
+		auto found = imagename::FindAnyCase(table.Context, textString.Get());
+
+		CHECK(found == name);
+
+		if (found != NULL)
+		{
+			imagename::Release(found);
+		}
+	}
+
+	for (auto name : names)
+	{
+		imagename::Release(name);
+	}
+
+	CHECK(imagename::NumEntries(table.Context) == 0);
+}
+
+TEST_CASE(VolumePrefixRequiresDeviceAndVolume)
+{
+	TABLE table;
+
+	REQUIRE(NT_SUCCESS(table.Status));
+
+	struct
+	{
+		const char16_t *Path;
+		size_t PrefixChars;
+	}
+	cases[] =
+	{
+		{ u"\\device\\harddiskvolume12\\windows\\a.exe", 25 },
+		{ u"\\device\\mup\\server\\share\\a.exe", 12 },
+		{ u"\\device\\harddiskvolume1\\", 24 },
+		{ u"\\device\\harddiskvolume1", 0 },
+		{ u"\\device\\", 0 },
+		{ u"\\device", 0 },
+		{ u"\\devices\\harddiskvolume1\\a.exe", 0 },
+		{ u"device\\harddiskvolume1\\a.exe", 0 },
+		{ u"", 0 },
+	};
+
+	SIZE_T expectedPrefixBytes = 0;
+
+	std::vector<imagename::IMAGE_NAME*> names;
+
+	for (const auto &c : cases)
+	{
+		UnicodeString path(c.Path);
+
+		imagename::IMAGE_NAME *name;
+
+		REQUIRE(NT_SUCCESS(imagename::Intern(table.Context, path.Lower(), &name)));
+
+		CHECK(name->VolumePrefixLength == c.PrefixChars * sizeof(WCHAR));
+
+		expectedPrefixBytes += c.PrefixChars * sizeof(WCHAR);
+
+		names.push_back(name);
+	}
+
+	imagename::STATISTICS stats;
+
+	imagename::GetStatistics(table.Context, &stats);
+
+	CHECK(stats.VolumePrefixBytes == expectedPrefixBytes);
+
+	for (auto name : names)
+	{
+		imagename::Release(name);
+	}
+}
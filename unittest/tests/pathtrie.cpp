@@ -0,0 +1,153 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "unicode.h"
+#include "containers/pathtrie.h"
+
+using harness::UnicodeString;
+
+namespace
+{
+
+struct TRIE
+{
+	TRIE()
+	{
+		Status = pathtrie::Initialize(&Context, ST_PAGEABLE::NO);
+	}
+
+	~TRIE()
+	{
+		if (Context != NULL)
+		{
+			pathtrie::TearDown(&Context);
+		}
+	}
+
+	NTSTATUS Insert(const std::u16string &Prefix)
+	{
+		UnicodeString prefix(Prefix);
+
+		return pathtrie::Insert(Context, prefix.Lower());
+	}
+
+	bool HasPrefixOf(const std::u16string &Path)
+	{
+		UnicodeString path(Path);
+
+		return pathtrie::HasPrefixOf(Context, path.Lower());
+	}
+
+	pathtrie::CONTEXT *Context = NULL;
+	NTSTATUS Status;
+};
+
+} // anonymous namespace
+
+TEST_CASE(MatchesPathsUnderPrefix)
+{
+	TRIE trie;
+
+	REQUIRE(NT_SUCCESS(trie.Status));
+
+	CHECK(pathtrie::IsEmpty(trie.Context));
+	CHECK(!trie.HasPrefixOf(u"\\device\\harddiskvolume1\\a.exe"));
+
+	CHECK(NT_SUCCESS(trie.Insert(u"\\device\\harddiskvolume1\\apps\\")));
+	CHECK(NT_SUCCESS(trie.Insert(u"\\device\\harddiskvolume1\\application data\\")));
+	CHECK(NT_SUCCESS(trie.Insert(u"\\device\\harddiskvolume2\\")));
+
+	CHECK(!pathtrie::IsEmpty(trie.Context));
+
+	CHECK(trie.HasPrefixOf(u"\\device\\harddiskvolume1\\apps\\a.exe"));
+	CHECK(trie.HasPrefixOf(u"\\device\\harddiskvolume1\\application data\\b\\c.exe"));
+	CHECK(trie.HasPrefixOf(u"\\device\\harddiskvolume2\\x.exe"));
+	CHECK(trie.HasPrefixOf(u"\\device\\harddiskvolume1\\apps\\"));
+
+	CHECK(!trie.HasPrefixOf(u"\\device\\harddiskvolume1\\app\\a.exe"));
+	CHECK(!trie.HasPrefixOf(u"\\device\\harddiskvolume1\\applications\\a.exe"));
+	CHECK(!trie.HasPrefixOf(u"\\device\\harddiskvolume1\\apps"));
+	CHECK(!trie.HasPrefixOf(u"\\device\\harddiskvolume3\\x.exe"));
+}
+
+TEST_CASE(RejectsDuplicateAndEmptyPrefixes)
+{
+	TRIE trie;
+
+	REQUIRE(NT_SUCCESS(trie.Status));
+
+	CHECK(NT_SUCCESS(trie.Insert(u"\\device\\a\\")));
+	CHECK(trie.Insert(u"\\device\\a\\") == STATUS_DUPLICATE_OBJECTID);
+	CHECK(!NT_SUCCESS(trie.Insert(u"")));
+}
+
+TEST_CASE(AgreesWithLinearScan)
+{
+	TRIE trie;
+
+	REQUIRE(NT_SUCCESS(trie.Status));
+
+	//
+	// Short components over a small alphabet, so prefixes split each other's edges often.
+	//
+
+	harness::Random random;
+
+	auto makePath = [&random](size_t Components)
+	{
+		std::u16string path(u"\\device");
+
+		for (size_t i = 0; i < Components; ++i)
+		{
+			path += u'\\';
+
+			const auto length = 1 + random.Below(3);
+
+			for (size_t j = 0; j < length; ++j)
+			{
+				path += (char16_t)(u'a' + random.Below(3));
+			}
+		}
+
+		return path;
+	};
+
+	std::vector<std::u16string> prefixes;
+
+	for (size_t i = 0; i < 200; ++i)
+	{
+		auto prefix = makePath(1 + random.Below(3)) + u"\\";
+
+		const auto status = trie.Insert(prefix);
+
+		REQUIRE(NT_SUCCESS(status) || status == STATUS_DUPLICATE_OBJECTID);
+
+		if (NT_SUCCESS(status))
+		{
+			prefixes.push_back(prefix);
+		}
+	}
+
+	for (size_t i = 0; i < 5000; ++i)
+	{
+		const auto path = makePath(1 + random.Below(4)) + u".exe";
+
+		bool expected = false;
+
+		for (const auto &prefix : prefixes)
+		{
+			if (path.compare(0, prefix.size(), prefix) == 0)
+			{
+				expected = true;
+				break;
+			}
+		}
+
+		CHECK(trie.HasPrefixOf(path) == expected);
+	}
+
+	pathtrie::Reset(trie.Context);
+
+	CHECK(pathtrie::IsEmpty(trie.Context));
+	CHECK(!trie.HasPrefixOf(prefixes.front() + u"a.exe"));
+}
@@ -0,0 +1,414 @@
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+#include "harness.h"
+#include "containers/pidindex.h"
+
+namespace
+{
+
+struct INDEX
+{
+	INDEX()
+	{
+		Status = pidindex::Initialize(&Context);
+	}
+
+	~INDEX()
+	{
+		if (Context != NULL)
+		{
+			pidindex::TearDown(&Context);
+		}
+	}
+
+	pidindex::CONTEXT *Context = NULL;
+	NTSTATUS Status;
+};
+
+HANDLE
+Pid
+(
+	size_t Number
+)
+{
+	return (HANDLE)(ULONG_PTR)(Number * 4);
+}
+
+void*
+ValueOf
+(
+	size_t Number
+)
+{
+	return (void*)(ULONG_PTR)(0x1000 + Number);
+}
+
+//
+// Home slot of PID number `Number`. Same as SlotIndex() in pidindex.cpp.
+//
+size_t
+HomeSlot
+(
+	size_t Number,
+	size_t Capacity
+)
+{
+	size_t bits = 0;
+
+	while (((size_t)1 << bits) < Capacity)
+	{
+		++bits;
+	}
+
+	return (size_t)((Number * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+}
+
+//
+// The `Count` smallest PID numbers, from `Start` onwards, whose home slot is `Home`.
+//
+std::vector<size_t>
+NumbersWithHome
+(
+	size_t Home,
+	size_t Capacity,
+	size_t Start,
+	size_t Count
+)
+{
+	std::vector<size_t> numbers;
+
+	for (auto number = Start; numbers.size() < Count; ++number)
+	{
+		if (HomeSlot(number, Capacity) == Home)
+		{
+			numbers.push_back(number);
+		}
+	}
+
+	return numbers;
+}
+
+} // anonymous namespace
+
+//
+// Random operations checked against a map. PIDs are drawn from a range that is dense
+// enough for long probe sequences, and the index grows and shrinks along the way.
+//
+TEST_CASE(AgreesWithReferenceModel)
+{
+	INDEX index;
+
+	REQUIRE(NT_SUCCESS(index.Status));
+
+	harness::Random random;
+
+	struct MAPPING
+	{
+		LONG Attributes;
+		ULONG Generation;
+	};
+
+	std::map<size_t, MAPPING> model;
+
+	for (size_t i = 0; i < 200000; ++i)
+	{
+		const auto pid = 1 + (size_t)random.Below(((i / 50000) % 2 == 0) ? 5000 : 500);
+
+		switch (random.Below(4))
+		{
+			case 0:
+			case 1:
+			{
+				const auto attributes = (LONG)random.Below(3);
+
+				const auto status = pidindex::Insert(index.Context, Pid(pid), ValueOf(pid), attributes);
+
+				if (model.count(pid) != 0)
+				{
+					CHECK(status == STATUS_DUPLICATE_OBJECTID);
+
+					break;
+				}
+
+				REQUIRE(NT_SUCCESS(status));
+
+				ULONG generation;
+				LONG queried;
+
+				REQUIRE(pidindex::QueryAttributes(index.Context, Pid(pid), &queried, &generation));
+
+				CHECK(generation != 0);
+
+				model[pid] = MAPPING{ attributes, generation };
+
+				break;
+			}
+			case 2:
+			{
+				CHECK(pidindex::Remove(index.Context, Pid(pid)) == (model.erase(pid) != 0));
+
+				break;
+			}
+			default:
+			{
+				const auto attributes = (LONG)random.Below(3);
+
+				const auto found = model.find(pid);
+
+				CHECK(pidindex::SetAttributes(index.Context, Pid(pid), attributes) == (found != model.end()));
+
+				if (found != model.end())
+				{
+					found->second.Attributes = attributes;
+				}
+
+				break;
+			}
+		}
+
+		const auto probe = 1 + (size_t)random.Below(5000);
+		const auto expected = model.find(probe);
+
+		LONG attributes;
+		ULONG generation;
+
+		const auto queried = pidindex::QueryAttributes(index.Context, Pid(probe), &attributes, &generation);
+
+		CHECK(queried == (expected != model.end()));
+		CHECK(pidindex::Find(index.Context, Pid(probe)) == (queried ? ValueOf(probe) : NULL));
+
+		if (queried && expected != model.end())
+		{
+			CHECK(attributes == expected->second.Attributes);
+			CHECK(generation == expected->second.Generation);
+		}
+	}
+
+	CHECK(pidindex::NumEntries(index.Context) == model.size());
+}
+
+//
+// PIDs that share a home slot form a single probe sequence. Build sequences that run past
+// the end of the slot array and wrap around, and remove each member in turn. Backward shift
+// deletion must leave every other member reachable.
+//
+TEST_CASE(RemovalKeepsProbeSequencesIntact)
+{
+	//
+	// The index starts out with 1024 slots. Keep the load low enough that it isn't grown.
+	//
+
+	const size_t CAPACITY = 1024;
+
+	std::vector<size_t> cluster;
+
+	for (size_t home : { CAPACITY - 2, CAPACITY - 1, (size_t)0, (size_t)1 })
+	{
+		const auto numbers = NumbersWithHome(home, CAPACITY, 1, 4);
+
+		cluster.insert(cluster.end(), numbers.begin(), numbers.end());
+	}
+
+	//
+	// The run above covers slots 1022 through 13. A PID that lives in its home slot
+	// directly after the run must stay put when the run is shifted.
+	//
+
+	cluster.push_back(NumbersWithHome(14, CAPACITY, 1, 1)[0]);
+
+	for (size_t removed = 0; removed < cluster.size(); ++removed)
+	{
+		INDEX index;
+
+		REQUIRE(NT_SUCCESS(index.Status));
+
+		for (auto pid : cluster)
+		{
+			REQUIRE(NT_SUCCESS(pidindex::Insert(index.Context, Pid(pid), ValueOf(pid), (LONG)pid)));
+		}
+
+		REQUIRE(pidindex::Remove(index.Context, Pid(cluster[removed])));
+
+		for (size_t i = 0; i < cluster.size(); ++i)
+		{
+			LONG attributes;
+
+			const auto found = pidindex::QueryAttributes(index.Context, Pid(cluster[i]), &attributes, NULL);
+
+			CHECK(found == (i != removed));
+			CHECK(pidindex::Find(index.Context, Pid(cluster[i])) == ((i != removed) ? ValueOf(cluster[i]) : NULL));
+
+			if (found)
+			{
+				CHECK(attributes == (LONG)cluster[i]);
+			}
+		}
+
+		CHECK(pidindex::NumEntries(index.Context) == cluster.size() - 1);
+	}
+}
+
+TEST_CASE(ReusedPidHasNewGeneration)
+{
+	INDEX index;
+
+	REQUIRE(NT_SUCCESS(index.Status));
+
+	ULONG first, second;
+	LONG attributes;
+
+	REQUIRE(NT_SUCCESS(pidindex::Insert(index.Context, Pid(7), ValueOf(7), 0)));
+	REQUIRE(pidindex::QueryAttributes(index.Context, Pid(7), &attributes, &first));
+
+	REQUIRE(pidindex::Remove(index.Context, Pid(7)));
+
+	REQUIRE(NT_SUCCESS(pidindex::Insert(index.Context, Pid(7), ValueOf(7), 0)));
+	REQUIRE(pidindex::QueryAttributes(index.Context, Pid(7), &attributes, &second));
+
+	CHECK(first != 0);
+	CHECK(second != 0);
+	CHECK(first != second);
+}
+
+TEST_CASE(InsertAfterReserveDoesNotAllocate)
+{
+	INDEX index;
+
+	REQUIRE(NT_SUCCESS(index.Status));
+
+	const size_t NUM_ENTRIES = 10000;
+
+	REQUIRE(NT_SUCCESS(pidindex::Reserve(index.Context, NUM_ENTRIES)));
+
+	shim::FailAllocation(0);
+
+	for (size_t i = 1; i <= NUM_ENTRIES; ++i)
+	{
+		REQUIRE(NT_SUCCESS(pidindex::Insert(index.Context, Pid(i), ValueOf(i), 0)));
+	}
+
+	shim::FailAllocation(-1);
+
+	for (size_t i = 1; i <= NUM_ENTRIES; ++i)
+	{
+		CHECK(pidindex::Find(index.Context, Pid(i)) == ValueOf(i));
+	}
+}
+
+//
+// Lock-free readers run against a writer that keeps inserting, updating, removing and
+// growing the index. Each mapping's attributes are derived from its PID, so a reader that
+// observes a torn slot, or a slot of another PID, sees attributes that don't match.
+//
+TEST_CASE(LockFreeReadersSeeConsistentSlots)
+{
+	INDEX index;
+
+	REQUIRE(NT_SUCCESS(index.Status));
+
+	const size_t NUM_PIDS = 10000;
+	const size_t NUM_READERS = 3;
+
+	auto attributesOf = [](size_t Pid, size_t Round)
+	{
+		return (LONG)(((Pid * 31) + Round) & 0xFFFF);
+	};
+
+	std::atomic<bool> done(false);
+	std::atomic<size_t> round(0);
+	std::atomic<size_t> started(0);
+	std::vector<size_t> inconsistent(NUM_READERS), hits(NUM_READERS);
+
+	std::vector<std::thread> readers;
+
+	for (size_t r = 0; r < NUM_READERS; ++r)
+	{
+		readers.emplace_back([&, r]()
+		{
+			harness::Random random(r + 1);
+
+			++started;
+
+			while (!done.load())
+			{
+				const auto pid = 1 + (size_t)random.Below(NUM_PIDS);
+
+				//
+				// The writer only moves forward, so the round read before the lookup bounds
+				// the attributes that the lookup may return.
+				//
+
+				const auto before = round.load();
+
+				LONG attributes;
+
+				if (!pidindex::QueryAttributes(index.Context, Pid(pid), &attributes, NULL))
+				{
+					continue;
+				}
+
+				const auto after = round.load();
+
+				++hits[r];
+
+				bool valid = false;
+
+				for (auto candidate = (before == 0 ? 0 : before - 1); candidate <= after; ++candidate)
+				{
+					valid = valid || (attributes == attributesOf(pid, candidate));
+				}
+
+				if (!valid)
+				{
+					++inconsistent[r];
+				}
+			}
+		});
+	}
+
+	while (started.load() != NUM_READERS)
+	{
+		std::this_thread::yield();
+	}
+
+	//
+	// The writer yields regularly, so readers get to run on hosts with few processors.
+	//
+
+	for (size_t n = 0; n < 12; ++n)
+	{
+		round.store(n);
+
+		for (size_t pid = 1; pid <= NUM_PIDS; ++pid)
+		{
+			if (pid % 512 == 0)
+			{
+				std::this_thread::yield();
+			}
+
+			if (n % 3 == 2)
+			{
+				pidindex::Remove(index.Context, Pid(pid));
+			}
+			else if (!NT_SUCCESS(pidindex::Insert(index.Context, Pid(pid), ValueOf(pid), attributesOf(pid, n))))
+			{
+				pidindex::SetAttributes(index.Context, Pid(pid), attributesOf(pid, n));
+			}
+		}
+	}
+
+	done.store(true);
+
+	for (auto &reader : readers)
+	{
+		reader.join();
+	}
+
+	for (size_t r = 0; r < NUM_READERS; ++r)
+	{
+		CHECK(inconsistent[r] == 0);
+		CHECK(hits[r] != 0);
+	}
+}
@@ -0,0 +1,982 @@
+#include <map>
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "processtree.h"
+
+using harness::Numbered;
+using harness::Pid;
+using harness::ProcessTree;
+using harness::Snapshot;
+
+namespace
+{
+
+//
+// Random forest in which some parents are missing from the snapshot, listed in random order.
+//
+Snapshot
+RandomSnapshot
+(
+	harness::Random &Random,
+	size_t NumProcesses
+)
+{
+	Snapshot snapshot;
+
+	for (size_t i = 1; i <= NumProcesses; ++i)
+	{
+		size_t parent = 0;
+
+		switch (Random.Below(4))
+		{
+			case 0:
+			{
+				break;
+			}
+			case 1:
+			{
+				parent = NumProcesses + 1 + Random.Below(100);
+
+				break;
+			}
+			default:
+			{
+				if (i > 1)
+				{
+					parent = 1 + Random.Below(i - 1);
+				}
+
+				break;
+			}
+		}
+
+		const auto path = (Random.Below(8) == 0)
+			? std::u16string()
+			: Numbered(u"\\device\\harddiskvolume1\\app", Random.Below(20)) + u".exe";
+
+		snapshot.Add(Pid(parent), Pid(i), path);
+	}
+
+	snapshot.Shuffle(Random);
+
+	return snapshot;
+}
+
+//
+// PID -> PID of the linked parent, or zero.
+//
+std::map<HANDLE, HANDLE>
+ParentLinks
+(
+	ProcessTree &Tree
+)
+{
+	std::map<HANDLE, HANDLE> links;
+
+	for (auto entry : Tree.Entries())
+	{
+		links[entry->ProcessId] = (entry->ParentEntry != NULL) ? entry->ParentEntry->ProcessId : 0;
+	}
+
+	return links;
+}
+
+size_t
+NumVisitedTopological
+(
+	ProcessTree &Tree
+)
+{
+	size_t visited = 0;
+
+	procregistry::ForEachTopological(Tree.Registry(), [](procregistry::PROCESS_REGISTRY_ENTRY*, void *Context)
+	{
+		++*(size_t*)Context;
+
+		return true;
+	}, &visited);
+
+	return visited;
+}
+
+//
+// PIDs of the entries visited by ForEachChild().
+//
+std::vector<HANDLE>
+Children
+(
+	ProcessTree &Tree,
+	HANDLE ProcessId
+)
+{
+	std::vector<HANDLE> children;
+
+	procregistry::ForEachChild(Tree.Registry(), Tree.Find(ProcessId), [](procregistry::PROCESS_REGISTRY_ENTRY *Entry, void *Context)
+	{
+		((std::vector<HANDLE>*)Context)->push_back(Entry->ProcessId);
+
+		return true;
+	}, &children);
+
+	return children;
+}
+
+//
+// PIDs of the entries visited by ForEachDescendant().
+//
+std::vector<HANDLE>
+Descendants
+(
+	ProcessTree &Tree,
+	HANDLE ProcessId
+)
+{
+	std::vector<HANDLE> descendants;
+
+	procregistry::ForEachDescendant(Tree.Registry(), Tree.Find(ProcessId), [](procregistry::PROCESS_REGISTRY_ENTRY *Entry, void *Context)
+	{
+		((std::vector<HANDLE>*)Context)->push_back(Entry->ProcessId);
+
+		return true;
+	}, &descendants);
+
+	return descendants;
+}
+
+//
+// Descendants of `ProcessId` in pre-order, with children in the order they were linked,
+// computed from the parent links.
+//
+std::vector<HANDLE>
+ReferenceDescendants
+(
+	ProcessTree &Tree,
+	HANDLE ProcessId
+)
+{
+	std::vector<HANDLE> descendants;
+	std::vector<HANDLE> pending;
+
+	auto pushChildren = [&](HANDLE Parent)
+	{
+		auto children = Children(Tree, Parent);
+
+		pending.insert(pending.end(), children.rbegin(), children.rend());
+	};
+
+	pushChildren(ProcessId);
+
+	while (!pending.empty())
+	{
+		const auto pid = pending.back();
+
+		pending.pop_back();
+
+		descendants.push_back(pid);
+
+		pushChildren(pid);
+	}
+
+	return descendants;
+}
+
+} // anonymous namespace
+
+TEST_CASE(SnapshotMatchesAddingEntriesOneByOne)
+{
+	harness::Random random;
+
+	for (size_t round = 0; round < 20; ++round)
+	{
+		auto snapshot = RandomSnapshot(random, 1 + random.Below(500));
+
+		ProcessTree oneByOne;
+		ProcessTree bulk;
+
+		REQUIRE(NT_SUCCESS(oneByOne.Status()));
+		REQUIRE(NT_SUCCESS(bulk.Status()));
+
+		for (size_t i = 0; i < snapshot.Size(); ++i)
+		{
+			REQUIRE(oneByOne.Add(snapshot[i].ParentProcessId, snapshot[i].ProcessId, snapshot.Path(i)));
+		}
+
+		procregistry::ResolveParentLinks(oneByOne.Registry());
+
+		REQUIRE(NT_SUCCESS(bulk.AddSnapshot(snapshot)));
+
+		CHECK(ParentLinks(bulk) == ParentLinks(oneByOne));
+		CHECK(NumVisitedTopological(bulk) == snapshot.Size());
+
+		for (size_t i = 0; i < snapshot.Size(); ++i)
+		{
+			auto entry = bulk.Find(snapshot[i].ProcessId);
+
+			REQUIRE(entry != NULL);
+
+			CHECK(entry->ParentProcessId == snapshot[i].ParentProcessId);
+			CHECK(entry->Settings.Split == ST_PROCESS_SPLIT_STATUS_OFF);
+			CHECK(harness::ToText(&entry->ImageName->String) == snapshot.Path(i));
+
+			ST_PROCESS_SPLIT_STATUS split;
+
+			CHECK(procregistry::GetSplitStatus(bulk.Registry(), snapshot[i].ProcessId, &split));
+		}
+	}
+}
+
+//
+// Terminal servers run upwards of 15k processes. Register that many, then create and delete
+// processes at random, reusing PIDs along the way. Lookups must agree with a map of the live
+// processes throughout.
+//
+TEST_CASE(LookupsAgreeWithReferenceAfterChurn)
+{
+	const size_t NUM_LIVE = 15000;
+	const size_t NUM_EVENTS = 60000;
+	const size_t PID_RANGE = 2 * NUM_LIVE;
+
+	harness::Random random;
+
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	//
+	// PID -> split status the entry was added with.
+	//
+	std::map<HANDLE, ST_PROCESS_SPLIT_STATUS> model;
+
+	auto add = [&](size_t Number)
+	{
+		const auto split = (random.Below(2) == 0)
+			? ST_PROCESS_SPLIT_STATUS_OFF
+			: ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG;
+
+		const auto path = Numbered(u"\\device\\harddiskvolume1\\app", random.Below(50)) + u".exe";
+
+		REQUIRE(tree.Add(0, Pid(Number), path, split));
+
+		model[Pid(Number)] = split;
+	};
+
+	while (model.size() < NUM_LIVE)
+	{
+		const auto number = 1 + random.Below(PID_RANGE);
+
+		if (model.find(Pid(number)) == model.end())
+		{
+			add(number);
+		}
+	}
+
+	for (size_t i = 0; i < NUM_EVENTS; ++i)
+	{
+		const auto number = 1 + random.Below(PID_RANGE);
+		const auto pid = Pid(number);
+
+		if (model.find(pid) == model.end())
+		{
+			add(number);
+		}
+		else
+		{
+			REQUIRE(procregistry::DeleteEntryById(tree.Registry(), pid));
+
+			model.erase(pid);
+		}
+
+		//
+		// Spot check a few PIDs after each event, and every PID now and then.
+		//
+
+		const auto numChecks = (i % 10000 == 0) ? PID_RANGE : 4;
+
+		for (size_t c = 0; c < numChecks; ++c)
+		{
+			const auto probe = Pid((numChecks == PID_RANGE) ? 1 + c : 1 + random.Below(PID_RANGE));
+
+			const auto expected = model.find(probe);
+			const auto entry = tree.Find(probe);
+
+			ST_PROCESS_SPLIT_STATUS split;
+
+			const auto found = procregistry::QuerySplitStatus(tree.Registry(), probe, &split);
+
+			if (expected == model.end())
+			{
+				CHECK(entry == NULL);
+				CHECK(!found);
+
+				continue;
+			}
+
+			REQUIRE(entry != NULL);
+
+			CHECK(entry->ProcessId == probe);
+			CHECK(found);
+			CHECK(split == expected->second);
+		}
+	}
+
+	CHECK(tree.Entries().size() == model.size());
+}
+
+TEST_CASE(SnapshotBreaksCycles)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	//
+	// 1 -> 2 -> 3 -> 1 is a cycle, and 4 hangs off the cycle.
+	// 5 claims to be its own parent.
+	//
+
+	Snapshot snapshot;
+
+	snapshot.Add(Pid(3), Pid(1), u"a.exe");
+	snapshot.Add(Pid(1), Pid(2), u"a.exe");
+	snapshot.Add(Pid(2), Pid(3), u"a.exe");
+	snapshot.Add(Pid(2), Pid(4), u"b.exe");
+	snapshot.Add(Pid(5), Pid(5), u"b.exe");
+
+	REQUIRE(NT_SUCCESS(tree.AddSnapshot(snapshot)));
+
+	size_t numRootsInCycle = 0;
+
+	for (size_t i = 1; i <= 3; ++i)
+	{
+		numRootsInCycle += (tree.Find(Pid(i))->ParentEntry == NULL);
+	}
+
+	CHECK(numRootsInCycle == 1);
+	CHECK(tree.Find(Pid(4))->ParentEntry == tree.Find(Pid(2)));
+	CHECK(tree.Find(Pid(5))->ParentEntry == NULL);
+	CHECK(NumVisitedTopological(tree) == snapshot.Size());
+}
+
+TEST_CASE(SnapshotRejectsDuplicatePids)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	Snapshot snapshot;
+
+	snapshot.Add(0, Pid(1), u"a.exe");
+	snapshot.Add(Pid(1), Pid(2), u"b.exe");
+	snapshot.Add(0, Pid(1), u"c.exe");
+
+	CHECK(tree.AddSnapshot(snapshot) == STATUS_DUPLICATE_OBJECTID);
+	CHECK(procregistry::IsEmpty(tree.Registry()));
+	CHECK(imagename::NumEntries(tree.ImageNames()) == 0);
+}
+
+TEST_CASE(FailedSnapshotLeavesRegistryEmpty)
+{
+	harness::Random random;
+
+	auto snapshot = RandomSnapshot(random, 200);
+
+	//
+	// Fail each allocation in turn, until there is none left to fail.
+	//
+
+	for (int failAt = 0;; ++failAt)
+	{
+		ProcessTree tree;
+
+		REQUIRE(NT_SUCCESS(tree.Status()));
+
+		shim::FailAllocation(failAt);
+
+		const auto status = tree.AddSnapshot(snapshot);
+
+		shim::FailAllocation(-1);
+
+		if (NT_SUCCESS(status))
+		{
+			CHECK(failAt > 0);
+			CHECK(NumVisitedTopological(tree) == snapshot.Size());
+
+			break;
+		}
+
+		CHECK(status == STATUS_INSUFFICIENT_RESOURCES);
+		CHECK(procregistry::IsEmpty(tree.Registry()));
+		CHECK(imagename::NumEntries(tree.ImageNames()) == 0);
+
+		ST_PROCESS_SPLIT_STATUS split;
+
+		CHECK(!procregistry::GetSplitStatus(tree.Registry(), snapshot[0].ProcessId, &split));
+	}
+}
+
+TEST_CASE(ResetReleasesEntriesAndNames)
+{
+	//
+	// A non-paged registry is reset per image, and a paged registry per entry.
+	//
+
+	for (auto pageable : { ST_PAGEABLE::NO, ST_PAGEABLE::YES })
+	{
+		ProcessTree tree(pageable);
+
+		REQUIRE(NT_SUCCESS(tree.Status()));
+
+		harness::Random random;
+
+		for (size_t round = 0; round < 3; ++round)
+		{
+			auto snapshot = RandomSnapshot(random, 1000);
+
+			REQUIRE(NT_SUCCESS(tree.AddSnapshot(snapshot)));
+
+			//
+			// Entries added and deleted individually as well.
+			//
+
+			REQUIRE(tree.Add(0, Pid(5000), u"\\device\\harddiskvolume1\\late.exe", ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG));
+			REQUIRE(procregistry::DeleteEntryById(tree.Registry(), snapshot[0].ProcessId));
+
+			CHECK(imagename::NumEntries(tree.ImageNames()) != 0);
+
+			procregistry::Reset(tree.Registry());
+
+			CHECK(procregistry::IsEmpty(tree.Registry()));
+			CHECK(imagename::NumEntries(tree.ImageNames()) == 0);
+			CHECK(NumVisitedTopological(tree) == 0);
+			CHECK(tree.Find(Pid(5000)) == NULL);
+
+			ST_PROCESS_SPLIT_STATUS split;
+
+			CHECK(!procregistry::GetSplitStatus(tree.Registry(), Pid(5000), &split));
+			CHECK(!procregistry::GetSplitStatus(tree.Registry(), snapshot[1].ProcessId, &split));
+
+			size_t numImages = 0;
+
+			procregistry::ForEachImage(tree.Registry(), [](const imagename::IMAGE_NAME*, void *Context)
+			{
+				++*(size_t*)Context;
+
+				return true;
+			}, &numImages);
+
+			CHECK(numImages == 0);
+		}
+	}
+}
+
+//
+// ForEach() used to visit entries in PID order. It now visits them in the order they were
+// added, which is visible to clients through the order of splitting events.
+//
+TEST_CASE(ForEachVisitsEntriesInInsertionOrder)
+{
+	auto order = [](ProcessTree &Tree)
+	{
+		std::vector<HANDLE> pids;
+
+		for (auto entry : Tree.Entries())
+		{
+			pids.push_back(entry->ProcessId);
+		}
+
+		return pids;
+	};
+
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	REQUIRE(tree.Add(0, Pid(30), u"\\device\\harddiskvolume1\\c.exe"));
+	REQUIRE(tree.Add(Pid(30), Pid(10), u"\\device\\harddiskvolume1\\a.exe"));
+	REQUIRE(tree.Add(0, Pid(20), u"\\device\\harddiskvolume1\\b.exe"));
+
+	CHECK(order(tree) == (std::vector<HANDLE>{ Pid(30), Pid(10), Pid(20) }));
+
+	//
+	// A PID that is reused goes to the back.
+	//
+
+	REQUIRE(procregistry::DeleteEntryById(tree.Registry(), Pid(10)));
+	REQUIRE(tree.Add(0, Pid(10), u"\\device\\harddiskvolume1\\a.exe"));
+
+	CHECK(order(tree) == (std::vector<HANDLE>{ Pid(30), Pid(20), Pid(10) }));
+
+	//
+	// A snapshot keeps its own order, even though it's sorted on PID to link parents.
+	//
+
+	Snapshot snapshot;
+
+	snapshot.Add(Pid(2), Pid(3), u"\\device\\harddiskvolume1\\c.exe");
+	snapshot.Add(0, Pid(1), u"\\device\\harddiskvolume1\\a.exe");
+	snapshot.Add(Pid(1), Pid(2), u"\\device\\harddiskvolume1\\b.exe");
+
+	ProcessTree bulk;
+
+	REQUIRE(NT_SUCCESS(bulk.Status()));
+	REQUIRE(NT_SUCCESS(bulk.AddSnapshot(snapshot)));
+
+	CHECK(order(bulk) == (std::vector<HANDLE>{ Pid(3), Pid(1), Pid(2) }));
+}
+
+TEST_CASE(AddEntryLinksChildToParent)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	REQUIRE(tree.Add(0, Pid(1), u"a.exe"));
+	REQUIRE(tree.Add(Pid(1), Pid(2), u"b.exe"));
+	REQUIRE(tree.Add(Pid(1), Pid(3), u"b.exe"));
+	REQUIRE(tree.Add(Pid(2), Pid(4), u"c.exe"));
+
+	//
+	// Missing parent, and a process that claims to be its own parent.
+	//
+
+	REQUIRE(tree.Add(Pid(100), Pid(5), u"c.exe"));
+	REQUIRE(tree.Add(Pid(6), Pid(6), u"c.exe"));
+
+	auto root = tree.Find(Pid(1));
+
+	CHECK(root->ParentEntry == NULL);
+	CHECK(tree.Find(Pid(2))->ParentEntry == root);
+	CHECK(tree.Find(Pid(3))->ParentEntry == root);
+	CHECK(procregistry::GetParentEntry(tree.Registry(), tree.Find(Pid(4))) == tree.Find(Pid(2)));
+
+	CHECK(tree.Find(Pid(5))->ParentEntry == NULL);
+	CHECK(tree.Find(Pid(5))->ParentProcessId == Pid(100));
+	CHECK(tree.Find(Pid(6))->ParentEntry == NULL);
+
+	CHECK(Children(tree, Pid(1)) == std::vector<HANDLE>({ Pid(2), Pid(3) }));
+	CHECK(Children(tree, Pid(2)) == std::vector<HANDLE>({ Pid(4) }));
+	CHECK(Children(tree, Pid(3)).empty());
+	CHECK(Children(tree, Pid(6)).empty());
+
+	//
+	// Entries added ahead of their parent are linked once links are resolved.
+	//
+
+	REQUIRE(tree.Add(Pid(100), Pid(101), u"c.exe"));
+	REQUIRE(tree.Add(0, Pid(100), u"a.exe"));
+
+	CHECK(tree.Find(Pid(5))->ParentEntry == NULL);
+
+	procregistry::ResolveParentLinks(tree.Registry());
+
+	CHECK(tree.Find(Pid(5))->ParentEntry == tree.Find(Pid(100)));
+	CHECK(tree.Find(Pid(101))->ParentEntry == tree.Find(Pid(100)));
+	CHECK(Children(tree, Pid(100)).size() == 2);
+}
+
+TEST_CASE(DeleteEntryOrphansChildren)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	//
+	// 1 -> { 2 -> { 4 }, 3, 5 }
+	//
+
+	REQUIRE(tree.Add(0, Pid(1), u"a.exe"));
+	REQUIRE(tree.Add(Pid(1), Pid(2), u"b.exe"));
+	REQUIRE(tree.Add(Pid(1), Pid(3), u"b.exe"));
+	REQUIRE(tree.Add(Pid(1), Pid(5), u"b.exe"));
+	REQUIRE(tree.Add(Pid(2), Pid(4), u"c.exe"));
+
+	//
+	// Deleting a middle sibling leaves the others linked, in order.
+	//
+
+	REQUIRE(procregistry::DeleteEntryById(tree.Registry(), Pid(3)));
+
+	CHECK(Children(tree, Pid(1)) == std::vector<HANDLE>({ Pid(2), Pid(5) }));
+
+	REQUIRE(procregistry::DeleteEntryById(tree.Registry(), Pid(1)));
+
+	for (size_t pid : { 2, 5 })
+	{
+		auto entry = tree.Find(Pid(pid));
+
+		REQUIRE(entry != NULL);
+
+		CHECK(entry->ParentEntry == NULL);
+		CHECK(entry->ParentProcessId == 0);
+	}
+
+	//
+	// Grandchildren stay with their parent.
+	//
+
+	CHECK(tree.Find(Pid(4))->ParentEntry == tree.Find(Pid(2)));
+	CHECK(Children(tree, Pid(2)) == std::vector<HANDLE>({ Pid(4) }));
+
+	CHECK(NumVisitedTopological(tree) == 3);
+
+	//
+	// Deleting a leaf leaves its parent without children.
+	//
+
+	REQUIRE(procregistry::DeleteEntryById(tree.Registry(), Pid(4)));
+
+	CHECK(Children(tree, Pid(2)).empty());
+	CHECK(Descendants(tree, Pid(2)).empty());
+}
+
+TEST_CASE(ForEachChildStopsWhenAsked)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	REQUIRE(tree.Add(0, Pid(1), u"a.exe"));
+
+	for (size_t pid = 2; pid <= 10; ++pid)
+	{
+		REQUIRE(tree.Add(Pid(1), Pid(pid), u"b.exe"));
+	}
+
+	size_t visited = 0;
+
+	const auto completed = procregistry::ForEachChild(tree.Registry(), tree.Find(Pid(1)), [](procregistry::PROCESS_REGISTRY_ENTRY*, void *Context)
+	{
+		return ++*(size_t*)Context < 3;
+	}, &visited);
+
+	CHECK(!completed);
+	CHECK(visited == 3);
+
+	visited = 0;
+
+	const auto completedDescendants = procregistry::ForEachDescendant(tree.Registry(), tree.Find(Pid(1)), [](procregistry::PROCESS_REGISTRY_ENTRY*, void *Context)
+	{
+		return ++*(size_t*)Context < 5;
+	}, &visited);
+
+	CHECK(!completedDescendants);
+	CHECK(visited == 5);
+}
+
+//
+// The walk doesn't use a stack, so a chain deeper than any call stack could hold is fine.
+//
+TEST_CASE(ForEachDescendantWalksDeepChain)
+{
+	const size_t DEPTH = 200000;
+
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	REQUIRE(NT_SUCCESS(procregistry::Reserve(tree.Registry(), DEPTH)));
+
+	for (size_t pid = 1; pid <= DEPTH; ++pid)
+	{
+		REQUIRE(tree.Add(Pid(pid - 1), Pid(pid), u"a.exe"));
+	}
+
+	auto descendants = Descendants(tree, Pid(1));
+
+	REQUIRE(descendants.size() == DEPTH - 1);
+
+	for (size_t i = 0; i < descendants.size(); ++i)
+	{
+		CHECK(descendants[i] == Pid(i + 2));
+	}
+
+	CHECK(Descendants(tree, Pid(DEPTH / 2)).size() == DEPTH / 2);
+	CHECK(Descendants(tree, Pid(DEPTH)).empty());
+}
+
+TEST_CASE(ForEachDescendantWalksWideFanOut)
+{
+	const size_t WIDTH = 20000;
+
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	//
+	// The root has `WIDTH` children, and every other child has two children of its own.
+	//
+
+	REQUIRE(tree.Add(0, Pid(1), u"a.exe"));
+
+	size_t nextPid = 2;
+
+	std::vector<HANDLE> expected;
+
+	for (size_t i = 0; i < WIDTH; ++i)
+	{
+		const auto child = nextPid++;
+
+		REQUIRE(tree.Add(Pid(1), Pid(child), u"b.exe"));
+
+		expected.push_back(Pid(child));
+
+		if (i % 2 == 0)
+		{
+			for (size_t g = 0; g < 2; ++g)
+			{
+				const auto grandchild = nextPid++;
+
+				REQUIRE(tree.Add(Pid(child), Pid(grandchild), u"c.exe"));
+
+				expected.push_back(Pid(grandchild));
+			}
+		}
+	}
+
+	CHECK(Children(tree, Pid(1)).size() == WIDTH);
+	CHECK(Descendants(tree, Pid(1)) == expected);
+	CHECK(Descendants(tree, Pid(2)) == std::vector<HANDLE>({ Pid(3), Pid(4) }));
+}
+
+TEST_CASE(ForEachDescendantAfterDeletingMiddleNode)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	//
+	// 1 -> { 2 -> { 3 -> { 4 }, 5 }, 6 }
+	//
+
+	REQUIRE(tree.Add(0, Pid(1), u"a.exe"));
+	REQUIRE(tree.Add(Pid(1), Pid(2), u"a.exe"));
+	REQUIRE(tree.Add(Pid(2), Pid(3), u"a.exe"));
+	REQUIRE(tree.Add(Pid(3), Pid(4), u"a.exe"));
+	REQUIRE(tree.Add(Pid(2), Pid(5), u"a.exe"));
+	REQUIRE(tree.Add(Pid(1), Pid(6), u"a.exe"));
+
+	CHECK(Descendants(tree, Pid(1)) == std::vector<HANDLE>({ Pid(2), Pid(3), Pid(4), Pid(5), Pid(6) }));
+
+	REQUIRE(procregistry::DeleteEntryById(tree.Registry(), Pid(2)));
+
+	//
+	// The subtrees of the deleted entry are now separate trees.
+	//
+
+	CHECK(Descendants(tree, Pid(1)) == std::vector<HANDLE>({ Pid(6) }));
+	CHECK(Descendants(tree, Pid(3)) == std::vector<HANDLE>({ Pid(4) }));
+	CHECK(Descendants(tree, Pid(5)).empty());
+	CHECK(NumVisitedTopological(tree) == 5);
+}
+
+TEST_CASE(ReusedPidIsNotLinkedToOrphans)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	//
+	// 1 -> 2 -> 3
+	//
+
+	REQUIRE(tree.Add(0, Pid(1), u"a.exe"));
+	REQUIRE(tree.Add(Pid(1), Pid(2), u"b.exe"));
+	REQUIRE(tree.Add(Pid(2), Pid(3), u"c.exe"));
+
+	REQUIRE(procregistry::DeleteEntryById(tree.Registry(), Pid(2)));
+
+	//
+	// A new process is assigned the PID of the departed one.
+	// The orphan must not be adopted by it.
+	//
+
+	REQUIRE(tree.Add(Pid(1), Pid(2), u"d.exe"));
+
+	auto reused = tree.Find(Pid(2));
+
+	CHECK(reused->ParentEntry == tree.Find(Pid(1)));
+	CHECK(Children(tree, Pid(2)).empty());
+	CHECK(tree.Find(Pid(3))->ParentEntry == NULL);
+	CHECK(tree.Find(Pid(3))->ParentProcessId == 0);
+
+	procregistry::ResolveParentLinks(tree.Registry());
+
+	CHECK(tree.Find(Pid(3))->ParentEntry == NULL);
+	CHECK(Descendants(tree, Pid(1)) == std::vector<HANDLE>({ Pid(2) }));
+
+	//
+	// Processes started by the new process are its children.
+	//
+
+	REQUIRE(tree.Add(Pid(2), Pid(4), u"e.exe"));
+
+	CHECK(Descendants(tree, Pid(1)) == std::vector<HANDLE>({ Pid(2), Pid(4) }));
+}
+
+//
+// Random creations and deletions. After each step, compare the walk of a random entry
+// with the walk computed from child lists, and each child list with the parent links.
+//
+TEST_CASE(ChildListsAgreeWithParentLinksUnderChurn)
+{
+	const size_t NUM_STEPS = 3000;
+	const size_t PID_RANGE = 400;
+
+	harness::Random random;
+
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	for (size_t step = 0; step < NUM_STEPS; ++step)
+	{
+		const auto pid = Pid(1 + random.Below(PID_RANGE));
+
+		if (tree.Find(pid) == NULL)
+		{
+			const auto parent = (random.Below(8) == 0) ? 0 : Pid(1 + random.Below(PID_RANGE));
+
+			REQUIRE(tree.Add(parent, pid, u"a.exe"));
+		}
+		else
+		{
+			REQUIRE(procregistry::DeleteEntryById(tree.Registry(), pid));
+		}
+
+		auto entries = tree.Entries();
+
+		if (entries.empty())
+		{
+			continue;
+		}
+
+		auto probe = entries[random.Below(entries.size())];
+
+		CHECK(Descendants(tree, probe->ProcessId) == ReferenceDescendants(tree, probe->ProcessId));
+
+		if (step % 100 != 0)
+		{
+			continue;
+		}
+
+		auto links = ParentLinks(tree);
+
+		std::map<HANDLE, size_t> numChildren;
+
+		for (auto entry : entries)
+		{
+			for (auto child : Children(tree, entry->ProcessId))
+			{
+				CHECK(links[child] == entry->ProcessId);
+
+				++numChildren[entry->ProcessId];
+			}
+		}
+
+		for (auto &link : links)
+		{
+			if (link.second != 0)
+			{
+				CHECK(tree.Find(link.first)->ParentProcessId == link.second);
+
+				--numChildren[link.second];
+			}
+		}
+
+		for (auto &count : numChildren)
+		{
+			CHECK(count.second == 0);
+		}
+	}
+}
+
+TEST_CASE(QuerySplitStatusBypassesVerdictCache)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	REQUIRE(tree.Add(0, Pid(1), u"\\device\\harddiskvolume1\\parent.exe", ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG));
+	REQUIRE(tree.Add(Pid(1), Pid(2), u"\\device\\harddiskvolume1\\child.exe"));
+
+	verdictcache::STATISTICS before;
+
+	procregistry::GetVerdictCacheStatistics(tree.Registry(), &before);
+
+	ST_PROCESS_SPLIT_STATUS split;
+
+	for (size_t i = 0; i < 10; ++i)
+	{
+		REQUIRE(procregistry::QuerySplitStatus(tree.Registry(), Pid(1), &split));
+		CHECK(split == ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG);
+
+		REQUIRE(procregistry::QuerySplitStatus(tree.Registry(), Pid(2), &split));
+		CHECK(split == ST_PROCESS_SPLIT_STATUS_OFF);
+
+		CHECK(!procregistry::QuerySplitStatus(tree.Registry(), Pid(3), &split));
+	}
+
+	verdictcache::STATISTICS after;
+
+	procregistry::GetVerdictCacheStatistics(tree.Registry(), &after);
+
+	CHECK(after.Hits == before.Hits);
+	CHECK(after.Misses == before.Misses);
+
+	//
+	// Updates are visible without invalidating anything.
+	//
+
+	auto entry = tree.Find(Pid(2));
+
+	REQUIRE(entry != NULL);
+
+	entry->TargetSettings.Split = ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE;
+
+	tree.Realize();
+
+	REQUIRE(procregistry::QuerySplitStatus(tree.Registry(), Pid(2), &split));
+	CHECK(split == ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE);
+}
+
+TEST_CASE(EntryCacheStatisticsTrackRegistryEntries)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	for (size_t i = 1; i <= 10; ++i)
+	{
+		REQUIRE(tree.Add(0, Pid(i), u"\\device\\harddiskvolume1\\app.exe"));
+	}
+
+	for (size_t i = 1; i <= 4; ++i)
+	{
+		REQUIRE(procregistry::DeleteEntryById(tree.Registry(), Pid(i)));
+	}
+
+	REQUIRE(tree.Add(0, Pid(11), u"\\device\\harddiskvolume1\\app.exe"));
+
+	slab::STATISTICS statistics;
+
+	procregistry::GetEntryCacheStatistics(tree.Registry(), &statistics);
+
+	CHECK(statistics.Allocations == 11);
+	CHECK(statistics.Frees == 4);
+	CHECK(statistics.InUse == 7);
+	CHECK(statistics.PeakInUse == 10);
+
+	//
+	// Pageable registries allocate entries from the pool.
+	//
+
+	ProcessTree pageable(ST_PAGEABLE::YES);
+
+	REQUIRE(NT_SUCCESS(pageable.Status()));
+	REQUIRE(pageable.Add(0, Pid(1), u"\\device\\harddiskvolume1\\app.exe"));
+
+	procregistry::GetEntryCacheStatistics(pageable.Registry(), &statistics);
+
+	CHECK(statistics.Allocations == 0);
+	CHECK(statistics.PeakInUse == 0);
+}
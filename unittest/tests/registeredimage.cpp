@@ -0,0 +1,451 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "unicode.h"
+#include "containers/registeredimage.h"
+
+using harness::UnicodeString;
+
+namespace
+{
+
+//
+// An image name table and a registered image instance that uses it.
+//
+struct FIXTURE
+{
+	FIXTURE()
+	{
+		Status = imagename::Initialize(&ImageNames);
+
+		if (NT_SUCCESS(Status))
+		{
+			Status = registeredimage::Initialize(&Images, ImageNames, ST_PAGEABLE::NO);
+		}
+	}
+
+	~FIXTURE()
+	{
+		if (Images != NULL)
+		{
+			registeredimage::TearDown(&Images);
+		}
+
+		if (ImageNames != NULL)
+		{
+			imagename::TearDown(&ImageNames);
+		}
+	}
+
+	imagename::IMAGE_NAME *Intern(const char16_t *Path)
+	{
+		UnicodeString path(Path);
+
+		imagename::IMAGE_NAME *name = NULL;
+
+		imagename::InternDowncase(ImageNames, path.Get(), &name);
+
+		return name;
+	}
+
+	bool Add(const char16_t *Path)
+	{
+		UnicodeString path(Path);
+
+		return NT_SUCCESS(registeredimage::AddEntry(Images, path.Get()));
+	}
+
+	bool Has(const char16_t *Path)
+	{
+		UnicodeString path(Path);
+
+		return registeredimage::HasEntry(Images, path.Get());
+	}
+
+	bool Remove(const char16_t *Path)
+	{
+		UnicodeString path(Path);
+
+		return registeredimage::RemoveEntry(Images, path.Get());
+	}
+
+	std::vector<std::u16string> Entries()
+	{
+		std::vector<std::u16string> entries;
+
+		registeredimage::ForEach(Images, [](const LOWER_UNICODE_STRING *ImageName,
+			registeredimage::ENTRY_TYPE, void *Context)
+		{
+			((std::vector<std::u16string>*)Context)->push_back(harness::ToText(ImageName));
+
+			return true;
+		}, &entries);
+
+		return entries;
+	}
+
+	imagename::CONTEXT *ImageNames = NULL;
+	registeredimage::CONTEXT *Images = NULL;
+	NTSTATUS Status;
+};
+
+std::u16string
+NumberedPath
+(
+	size_t Number
+)
+{
+	std::u16string path(u"\\device\\harddiskvolume1\\apps\\app");
+
+	for (auto c : std::to_string(Number))
+	{
+		path += (char16_t)c;
+	}
+
+	return path + u".exe";
+}
+
+} // anonymous namespace
+
+TEST_CASE(ExactEntriesIgnoreCasing)
+{
+	FIXTURE f;
+
+	REQUIRE(NT_SUCCESS(f.Status));
+
+	CHECK(registeredimage::IsEmpty(f.Images));
+
+	CHECK(f.Add(u"\\Device\\HarddiskVolume1\\Apps\\Browser.exe"));
+	CHECK(f.Add(u"\\device\\harddiskvolume1\\apps\\BROWSER.EXE"));
+
+	CHECK(f.Entries().size() == 1);
+
+	CHECK(f.Has(u"\\DEVICE\\HARDDISKVOLUME1\\APPS\\BROWSER.EXE"));
+	CHECK(!f.Has(u"\\device\\harddiskvolume1\\apps\\browser2.exe"));
+
+	auto name = f.Intern(u"\\device\\harddiskvolume1\\apps\\browser.exe");
+
+	CHECK(registeredimage::HasEntryExact(f.Images, name));
+	CHECK(registeredimage::HasMatchingEntry(f.Images, name));
+
+	imagename::Release(name);
+
+	CHECK(f.Remove(u"\\Device\\HarddiskVolume1\\Apps\\Browser.EXE"));
+	CHECK(!f.Remove(u"\\Device\\HarddiskVolume1\\Apps\\Browser.EXE"));
+	CHECK(registeredimage::IsEmpty(f.Images));
+}
+
+TEST_CASE(EntriesAreEnumeratedInInsertionOrder)
+{
+	FIXTURE f;
+
+	REQUIRE(NT_SUCCESS(f.Status));
+
+	CHECK(f.Add(u"\\device\\c.exe"));
+	CHECK(f.Add(u"\\device\\a.exe"));
+	CHECK(f.Add(u"\\device\\b.exe"));
+	CHECK(f.Remove(u"\\device\\a.exe"));
+	CHECK(f.Add(u"\\device\\a.exe"));
+
+	const std::vector<std::u16string> expected{ u"\\device\\c.exe", u"\\device\\b.exe", u"\\device\\a.exe" };
+
+	CHECK(f.Entries() == expected);
+}
+
+//
+// Prefixes are also kept in a trie and patterns in an automaton, neither of which determines
+// the order of enumeration.
+//
+TEST_CASE(EntriesOfAllTypesAreEnumeratedInInsertionOrder)
+{
+	FIXTURE f;
+
+	REQUIRE(NT_SUCCESS(f.Status));
+
+	UnicodeString prefix(u"\\device\\z\\");
+	UnicodeString pattern(u"\\device\\*.exe");
+
+	CHECK(f.Add(u"\\device\\c.exe"));
+	CHECK(NT_SUCCESS(registeredimage::AddPrefixEntry(f.Images, prefix.Get())));
+	CHECK(f.Add(u"\\device\\a.exe"));
+	CHECK(NT_SUCCESS(registeredimage::AddPatternEntry(f.Images, pattern.Get())));
+
+	const std::vector<std::u16string> expected{ u"\\device\\c.exe", u"\\device\\z\\",
+		u"\\device\\a.exe", u"\\device\\*.exe" };
+
+	CHECK(f.Entries() == expected);
+}
+
+TEST_CASE(LookupsSurviveRehashing)
+{
+	FIXTURE f;
+
+	REQUIRE(NT_SUCCESS(f.Status));
+
+	const size_t NUM_ENTRIES = 5000;
+
+	for (size_t i = 0; i < NUM_ENTRIES; i += 2)
+	{
+		UnicodeString path(NumberedPath(i));
+
+		REQUIRE(NT_SUCCESS(registeredimage::AddEntry(f.Images, path.Get())));
+	}
+
+	for (size_t i = 0; i < NUM_ENTRIES; ++i)
+	{
+		UnicodeString path(NumberedPath(i));
+
+		CHECK(registeredimage::HasEntry(f.Images, path.Get()) == (i % 2 == 0));
+	}
+
+	for (size_t i = 0; i < NUM_ENTRIES; i += 4)
+	{
+		UnicodeString path(NumberedPath(i));
+
+		CHECK(registeredimage::RemoveEntry(f.Images, path.Get()));
+	}
+
+	for (size_t i = 0; i < NUM_ENTRIES; ++i)
+	{
+		UnicodeString path(NumberedPath(i));
+
+		CHECK(registeredimage::HasEntry(f.Images, path.Get()) == (i % 4 == 2));
+	}
+}
+
+TEST_CASE(FailedAddLeavesInstanceUnchanged)
+{
+	FIXTURE f;
+
+	REQUIRE(NT_SUCCESS(f.Status));
+
+	//
+	// Fill the initial buckets so the next add has to grow them.
+	//
+
+	size_t i = 0;
+
+	for (; i < 16; ++i)
+	{
+		UnicodeString path(NumberedPath(i));
+
+		REQUIRE(NT_SUCCESS(registeredimage::AddEntry(f.Images, path.Get())));
+	}
+
+	UnicodeString path(NumberedPath(i));
+
+	//
+	// The name is interned first, and the bucket array is allocated next.
+	//
+
+	shim::FailAllocation(1);
+
+	CHECK(!NT_SUCCESS(registeredimage::AddEntry(f.Images, path.Get())));
+	CHECK(!registeredimage::HasEntry(f.Images, path.Get()));
+	CHECK(f.Entries().size() == 16);
+
+	for (size_t j = 0; j < 16; ++j)
+	{
+		UnicodeString existing(NumberedPath(j));
+
+		CHECK(registeredimage::HasEntry(f.Images, existing.Get()));
+	}
+}
+
+TEST_CASE(ResetReleasesEntriesAndNames)
+{
+	FIXTURE f;
+
+	REQUIRE(NT_SUCCESS(f.Status));
+
+	for (size_t round = 0; round < 3; ++round)
+	{
+		//
+		// Enough entries to need several arena chunks, and removals so the free list
+		// is not empty.
+		//
+
+		for (size_t i = 0; i < 2000; ++i)
+		{
+			UnicodeString path(NumberedPath(i));
+
+			REQUIRE(NT_SUCCESS(registeredimage::AddEntry(f.Images, path.Get())));
+		}
+
+		for (size_t i = 0; i < 2000; i += 5)
+		{
+			UnicodeString path(NumberedPath(i));
+
+			REQUIRE(registeredimage::RemoveEntry(f.Images, path.Get()));
+		}
+
+		UnicodeString prefix(u"\\device\\harddiskvolume1\\tools\\");
+		UnicodeString pattern(u"\\device\\harddiskvolume1\\*\\game.exe");
+
+		REQUIRE(NT_SUCCESS(registeredimage::AddPrefixEntry(f.Images, prefix.Get())));
+		REQUIRE(NT_SUCCESS(registeredimage::AddPatternEntry(f.Images, pattern.Get())));
+		REQUIRE(NT_SUCCESS(registeredimage::CompilePatterns(f.Images)));
+
+		registeredimage::Reset(f.Images);
+
+		CHECK(registeredimage::IsEmpty(f.Images));
+		CHECK(f.Entries().empty());
+		CHECK(imagename::NumEntries(f.ImageNames) == 0);
+
+		CHECK(!f.Has(NumberedPath(1).c_str()));
+
+		auto name = f.Intern(u"\\device\\harddiskvolume1\\tools\\a.exe");
+
+		CHECK(!registeredimage::HasMatchingEntry(f.Images, name));
+
+		imagename::Release(name);
+
+		name = f.Intern(u"\\device\\harddiskvolume1\\dir\\game.exe");
+
+		CHECK(!registeredimage::HasMatchingEntry(f.Images, name));
+
+		imagename::Release(name);
+	}
+}
+
+TEST_CASE(FilterHasNoFalseNegatives)
+{
+	FIXTURE f;
+
+	REQUIRE(NT_SUCCESS(f.Status));
+
+	//
+	// Enough entries to grow the filter several times, and to fill each block with
+	// many entries.
+	//
+
+	const size_t NUM_ENTRIES = 20000;
+
+	std::vector<imagename::IMAGE_NAME*> names;
+
+	for (size_t i = 0; i < NUM_ENTRIES; ++i)
+	{
+		auto name = f.Intern(NumberedPath(i).c_str());
+
+		REQUIRE(name != NULL);
+
+		names.push_back(name);
+	}
+
+	std::vector<bool> present(NUM_ENTRIES, false);
+
+	auto checkAll = [&]()
+	{
+		size_t falseNegatives = 0;
+
+		for (size_t i = 0; i < NUM_ENTRIES; ++i)
+		{
+			const auto found = registeredimage::HasEntryExact(f.Images, names[i]);
+
+			falseNegatives += (present[i] && !found);
+
+			CHECK(found == present[i]);
+		}
+
+		CHECK(falseNegatives == 0);
+	};
+
+	//
+	// Entries added through growth, every third name left out.
+	//
+
+	for (size_t i = 0; i < NUM_ENTRIES; ++i)
+	{
+		if (i % 3 != 0)
+		{
+			REQUIRE(NT_SUCCESS(registeredimage::AddEntryExact(f.Images, names[i])));
+
+			present[i] = true;
+		}
+	}
+
+	checkAll();
+
+	//
+	// Removals rebuild the filter from the remaining entries.
+	//
+
+	harness::Random random;
+
+	for (size_t i = 0; i < 200; ++i)
+	{
+		const auto index = (size_t)random.Below(NUM_ENTRIES);
+
+		if (present[index])
+		{
+			REQUIRE(registeredimage::RemoveEntryExact(f.Images, names[index]));
+
+			present[index] = false;
+		}
+	}
+
+	checkAll();
+
+	//
+	// Entries are added again after a reset, which clears the filter.
+	//
+
+	registeredimage::Reset(f.Images);
+
+	std::fill(present.begin(), present.end(), false);
+
+	for (size_t i = 0; i < NUM_ENTRIES; i += 7)
+	{
+		REQUIRE(NT_SUCCESS(registeredimage::AddEntryExact(f.Images, names[i])));
+
+		present[i] = true;
+	}
+
+	checkAll();
+
+	for (auto name : names)
+	{
+		imagename::Release(name);
+	}
+}
+
+TEST_CASE(FailedFilterGrowthKeepsEntries)
+{
+	FIXTURE f;
+
+	REQUIRE(NT_SUCCESS(f.Status));
+
+	//
+	// Grow until the filter is about to grow along with the buckets.
+	//
+
+	size_t i = 0;
+
+	for (; i < 64; ++i)
+	{
+		UnicodeString path(NumberedPath(i));
+
+		REQUIRE(NT_SUCCESS(registeredimage::AddEntry(f.Images, path.Get())));
+	}
+
+	UnicodeString path(NumberedPath(i));
+
+	//
+	// The name is interned first, then the buckets and the filter are allocated.
+	//
+
+	shim::FailAllocation(2);
+
+	CHECK(!NT_SUCCESS(registeredimage::AddEntry(f.Images, path.Get())));
+	CHECK(!registeredimage::HasEntry(f.Images, path.Get()));
+
+	for (size_t j = 0; j < i; ++j)
+	{
+		UnicodeString existing(NumberedPath(j));
+
+		CHECK(registeredimage::HasEntry(f.Images, existing.Get()));
+	}
+
+	CHECK(NT_SUCCESS(registeredimage::AddEntry(f.Images, path.Get())));
+	CHECK(registeredimage::HasEntry(f.Images, path.Get()));
+}
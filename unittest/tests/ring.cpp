@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "harness.h"
+#include "containers/ring.h"
+
+namespace
+{
+
+struct RING
+{
+	RING(SIZE_T SlotSize, SIZE_T NumSlots)
+	{
+		Status = ring::Initialize(&Context, SlotSize, NumSlots);
+	}
+
+	~RING()
+	{
+		ring::TearDown(&Context);
+	}
+
+	ring::CONTEXT *Context = NULL;
+	NTSTATUS Status;
+};
+
+struct ITEM
+{
+	ULONG Producer;
+	ULONG Sequence;
+};
+
+//
+// Publish a single item and return the slot.
+//
+void*
+Produce
+(
+	ring::CONTEXT *Context,
+	ULONG Producer,
+	ULONG Sequence
+)
+{
+	auto item = (ITEM*)ring::Reserve(Context);
+
+	if (item != NULL)
+	{
+		item->Producer = Producer;
+		item->Sequence = Sequence;
+
+		ring::Publish(Context, item);
+	}
+
+	return item;
+}
+
+} // anonymous namespace
+
+TEST_CASE(NumSlotsMustBePowerOfTwo)
+{
+	ring::CONTEXT *context;
+
+	CHECK(ring::Initialize(&context, 16, 0) == STATUS_INVALID_PARAMETER);
+	CHECK(ring::Initialize(&context, 16, 12) == STATUS_INVALID_PARAMETER);
+	CHECK(context == NULL);
+}
+
+TEST_CASE(SlotsArePoppedInOrderOfReservation)
+{
+	const SIZE_T NUM_SLOTS = 8;
+
+	RING r(sizeof(ITEM), NUM_SLOTS);
+
+	REQUIRE(NT_SUCCESS(r.Status));
+
+	CHECK(ring::Pop(r.Context) == NULL);
+
+	for (ULONG lap = 0; lap < 3; ++lap)
+	{
+		//
+		// Reserve every slot, and publish them in reverse.
+		//
+
+		std::vector<ITEM*> items;
+
+		for (ULONG i = 0; i < NUM_SLOTS; ++i)
+		{
+			auto item = (ITEM*)ring::Reserve(r.Context);
+
+			REQUIRE(item != NULL);
+			CHECK(ring::Contains(r.Context, item));
+			CHECK((ULONG_PTR)item % MEMORY_ALLOCATION_ALIGNMENT == 0);
+
+			item->Sequence = i;
+
+			items.push_back(item);
+		}
+
+		CHECK(ring::Reserve(r.Context) == NULL);
+		CHECK(ring::Depth(r.Context) == NUM_SLOTS);
+
+		for (auto it = items.rbegin(); it != items.rend(); ++it)
+		{
+			//
+			// Nothing can be popped ahead of the first slot.
+			//
+
+			CHECK(ring::Pop(r.Context) == NULL);
+
+			ring::Publish(r.Context, *it);
+		}
+
+		for (ULONG i = 0; i < NUM_SLOTS; ++i)
+		{
+			auto item = (ITEM*)ring::Pop(r.Context);
+
+			REQUIRE(item != NULL);
+			CHECK(item->Sequence == i);
+
+			ring::Release(r.Context, item);
+		}
+
+		CHECK(ring::Pop(r.Context) == NULL);
+		CHECK(ring::Depth(r.Context) == 0);
+	}
+
+	ITEM outside;
+
+	CHECK(!ring::Contains(r.Context, &outside));
+}
+
+TEST_CASE(SlotsCanBeReleasedOutOfOrder)
+{
+	const SIZE_T NUM_SLOTS = 16;
+
+	RING r(sizeof(ITEM), NUM_SLOTS);
+
+	REQUIRE(NT_SUCCESS(r.Status));
+
+	harness::Random random;
+
+	ULONG produced = 0;
+	ULONG consumed = 0;
+
+	std::vector<ITEM*> held;
+
+	for (size_t round = 0; round < 2000; ++round)
+	{
+		while (Produce(r.Context, 0, produced) != NULL)
+		{
+			++produced;
+		}
+
+		//
+		// Producers can't wrap past a slot that is held, so slots that are held and slots
+		// that are waiting to be popped never exceed the size of the ring.
+		//
+
+		CHECK(produced - consumed + held.size() <= NUM_SLOTS);
+
+		for (auto item = (ITEM*)ring::Pop(r.Context); item != NULL; item = (ITEM*)ring::Pop(r.Context))
+		{
+			CHECK(item->Sequence == consumed++);
+
+			held.push_back(item);
+		}
+
+		//
+		// Release a random subset of the held slots, in random order.
+		//
+
+		for (size_t i = held.size(); i > 1; --i)
+		{
+			std::swap(held[i - 1], held[random.Below(i)]);
+		}
+
+		const auto numRelease = random.Below(held.size() + 1);
+
+		for (size_t i = 0; i < numRelease; ++i)
+		{
+			ring::Release(r.Context, held.back());
+
+			held.pop_back();
+		}
+	}
+
+	for (auto item : held)
+	{
+		ring::Release(r.Context, item);
+	}
+
+	//
+	// Every slot is free again.
+	//
+
+	for (ULONG i = 0; i < NUM_SLOTS; ++i)
+	{
+		CHECK(Produce(r.Context, 0, produced++) != NULL);
+	}
+
+	CHECK(ring::Reserve(r.Context) == NULL);
+	CHECK(consumed > 1000);
+}
+
+//
+// Producers racing to reserve and publish slots, while the consumer releases slots
+// out of order. Every item must be received exactly once, and in order for each producer.
+//
+TEST_CASE(ConcurrentProducersDeliverEveryItem)
+{
+	const ULONG NUM_PRODUCERS = 4;
+	const ULONG ITEMS_PER_PRODUCER = 50000;
+
+	RING r(sizeof(ITEM), 32);
+
+	REQUIRE(NT_SUCCESS(r.Status));
+
+	std::atomic<ULONG> started(0);
+	std::atomic<LONG64> numFull(0);
+
+	std::vector<std::thread> producers;
+
+	for (ULONG p = 0; p < NUM_PRODUCERS; ++p)
+	{
+		producers.emplace_back([&, p]()
+		{
+			++started;
+
+			for (ULONG sequence = 0; sequence < ITEMS_PER_PRODUCER; ++sequence)
+			{
+				while (Produce(r.Context, p, sequence) == NULL)
+				{
+					++numFull;
+
+					std::this_thread::yield();
+				}
+
+				if (sequence % 64 == 0)
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	while (started.load() != NUM_PRODUCERS)
+	{
+		std::this_thread::yield();
+	}
+
+	harness::Random random;
+
+	std::vector<ULONG> next(NUM_PRODUCERS, 0);
+	std::vector<ITEM*> held;
+
+	size_t received = 0;
+	size_t outOfOrder = 0;
+
+	while (received < NUM_PRODUCERS * ITEMS_PER_PRODUCER)
+	{
+		auto item = (ITEM*)ring::Pop(r.Context);
+
+		if (item == NULL)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			REQUIRE(item->Producer < NUM_PRODUCERS);
+
+			outOfOrder += (item->Sequence != next[item->Producer]);
+
+			next[item->Producer] = item->Sequence + 1;
+
+			++received;
+
+			held.push_back(item);
+		}
+
+		//
+		// Hold on to a few slots and release one at random.
+		//
+
+		if (!held.empty() && (item == NULL || held.size() > 4))
+		{
+			const auto index = random.Below(held.size());
+
+			ring::Release(r.Context, held[index]);
+
+			held[index] = held.back();
+			held.pop_back();
+		}
+	}
+
+	for (auto &producer : producers)
+	{
+		producer.join();
+	}
+
+	for (auto item : held)
+	{
+		ring::Release(r.Context, item);
+	}
+
+	CHECK(outOfOrder == 0);
+	CHECK(ring::Pop(r.Context) == NULL);
+	CHECK(ring::Depth(r.Context) == 0);
+
+	for (ULONG p = 0; p < NUM_PRODUCERS; ++p)
+	{
+		CHECK(next[p] == ITEMS_PER_PRODUCER);
+	}
+
+	printf("ring was full %lld times\n", (long long)numFull.load());
+}
@@ -0,0 +1,290 @@
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "harness.h"
+#include "seqlock.h"
+#include "firewall/ipaddresses.h"
+
+using firewall::IP_ADDRESSES_MGMT;
+using firewall::SPLITTING_MODE;
+
+namespace
+{
+
+//
+// Address set number `Number`. Every byte depends on the number, so a copy that mixes
+// two sets can be told apart from both of them.
+//
+ST_IP_ADDRESSES
+AddressesOf
+(
+	ULONG Number
+)
+{
+	ST_IP_ADDRESSES addresses;
+
+	addresses.TunnelIpv4.s_addr = Number;
+	addresses.InternetIpv4.s_addr = ~Number;
+
+	for (size_t i = 0; i < 16; ++i)
+	{
+		addresses.TunnelIpv6.u.Byte[i] = (UCHAR)(Number + i);
+		addresses.InternetIpv6.u.Byte[i] = (UCHAR)((Number >> 8) ^ (0xA5 + i));
+	}
+
+	return addresses;
+}
+
+bool
+IsConsistent
+(
+	const ST_IP_ADDRESSES &Addresses
+)
+{
+	const auto expected = AddressesOf(Addresses.TunnelIpv4.s_addr);
+
+	return 0 == memcmp(&Addresses, &expected, sizeof(expected));
+}
+
+void
+InitializeAddresses
+(
+	IP_ADDRESSES_MGMT *IpAddresses,
+	ULONG Number
+)
+{
+	seqlock::Initialize(&IpAddresses->Lock);
+
+	IpAddresses->Addresses = AddressesOf(Number);
+	IpAddresses->SplittingMode = SPLITTING_MODE::MODE_0;
+}
+
+} // anonymous namespace
+
+TEST_CASE(RetryReadDetectsWrites)
+{
+	seqlock::SEQLOCK lock;
+
+	seqlock::Initialize(&lock);
+
+	const auto sequence = seqlock::BeginRead(&lock);
+
+	CHECK(!seqlock::RetryRead(&lock, sequence));
+
+	const auto oldIrql = seqlock::BeginWrite(&lock);
+
+	CHECK(KeGetCurrentIrql() == DISPATCH_LEVEL);
+
+	//
+	// A reader that began before the write section must retry, whether the write is
+	// in progress or completed.
+	//
+
+	CHECK(seqlock::RetryRead(&lock, sequence));
+
+	seqlock::EndWrite(&lock, oldIrql);
+
+	CHECK(KeGetCurrentIrql() == oldIrql);
+	CHECK(seqlock::RetryRead(&lock, sequence));
+
+	const auto next = seqlock::BeginRead(&lock);
+
+	CHECK(next == sequence + 2);
+	CHECK(!seqlock::RetryRead(&lock, next));
+}
+
+//
+// Interleave a write between the two halves of a copy, the way a writer on another
+// processor would. The copy is torn, and the reader has to notice.
+//
+TEST_CASE(TornCopyIsRetried)
+{
+	IP_ADDRESSES_MGMT ipAddresses;
+
+	InitializeAddresses(&ipAddresses, 1);
+
+	const auto sequence = seqlock::BeginRead(&ipAddresses.Lock);
+
+	ST_IP_ADDRESSES copy;
+
+	const size_t half = sizeof(copy) / 2;
+
+	memcpy(&copy, &ipAddresses.Addresses, half);
+
+	const auto update = AddressesOf(2);
+
+	firewall::PublishIpAddresses(&ipAddresses, &update, SPLITTING_MODE::MODE_1);
+
+	memcpy(((UCHAR*)&copy) + half, ((UCHAR*)&ipAddresses.Addresses) + half, sizeof(copy) - half);
+
+	CHECK(!IsConsistent(copy));
+	CHECK(seqlock::RetryRead(&ipAddresses.Lock, sequence));
+
+	//
+	// The retry observes the update in full.
+	//
+
+	firewall::ReadIpAddresses(&ipAddresses, &copy);
+
+	CHECK(IsConsistent(copy));
+	CHECK(copy.TunnelIpv4.s_addr == 2);
+	CHECK(ipAddresses.SplittingMode == SPLITTING_MODE::MODE_1);
+}
+
+//
+// A reader that arrives while a write section is half done has to wait for it to complete.
+//
+TEST_CASE(ReaderWaitsForWriteInProgress)
+{
+	IP_ADDRESSES_MGMT ipAddresses;
+
+	InitializeAddresses(&ipAddresses, 1);
+
+	const auto update = AddressesOf(2);
+
+	const auto oldIrql = seqlock::BeginWrite(&ipAddresses.Lock);
+
+	ipAddresses.Addresses.TunnelIpv4 = update.TunnelIpv4;
+	ipAddresses.Addresses.TunnelIpv6 = update.TunnelIpv6;
+
+	std::atomic<bool> started(false);
+	std::atomic<bool> finished(false);
+
+	ST_IP_ADDRESSES copy;
+
+	std::thread reader([&]()
+	{
+		started.store(true);
+
+		firewall::ReadIpAddresses(&ipAddresses, &copy);
+
+		finished.store(true);
+	});
+
+	while (!started.load())
+	{
+		std::this_thread::yield();
+	}
+
+	for (size_t i = 0; i < 1000; ++i)
+	{
+		std::this_thread::yield();
+	}
+
+	CHECK(!finished.load());
+
+	ipAddresses.Addresses.InternetIpv4 = update.InternetIpv4;
+	ipAddresses.Addresses.InternetIpv6 = update.InternetIpv6;
+
+	seqlock::EndWrite(&ipAddresses.Lock, oldIrql);
+
+	reader.join();
+
+	CHECK(finished.load());
+	CHECK(IsConsistent(copy));
+	CHECK(copy.TunnelIpv4.s_addr == 2);
+}
+
+//
+// Lock-free readers, as in the callouts, against a writer that keeps publishing new
+// addresses. No reader may observe a mix of two address sets.
+//
+TEST_CASE(ConcurrentReadersNeverSeeTornAddresses)
+{
+	const size_t NUM_READERS = 3;
+	const ULONG NUM_UPDATES = 20000;
+
+	IP_ADDRESSES_MGMT ipAddresses;
+
+	InitializeAddresses(&ipAddresses, 0);
+
+	std::atomic<bool> done(false);
+	std::atomic<ULONG> published(0);
+	std::atomic<size_t> started(0);
+
+	std::vector<size_t> torn(NUM_READERS), stale(NUM_READERS), reads(NUM_READERS), versions(NUM_READERS);
+
+	std::vector<std::thread> readers;
+
+	for (size_t r = 0; r < NUM_READERS; ++r)
+	{
+		readers.emplace_back([&, r]()
+		{
+			ULONG previous = 0;
+
+			++started;
+
+			while (!done.load())
+			{
+				//
+				// Everything published before the read must be visible.
+				//
+
+				const auto floor = published.load();
+
+				ST_IP_ADDRESSES copy;
+
+				firewall::ReadIpAddresses(&ipAddresses, &copy);
+
+				++reads[r];
+
+				if (!IsConsistent(copy))
+				{
+					++torn[r];
+
+					continue;
+				}
+
+				const auto number = copy.TunnelIpv4.s_addr;
+
+				if (number < floor || number < previous)
+				{
+					++stale[r];
+				}
+
+				versions[r] += (number != previous);
+
+				previous = number;
+			}
+		});
+	}
+
+	while (started.load() != NUM_READERS)
+	{
+		std::this_thread::yield();
+	}
+
+	//
+	// The writer yields regularly, so readers get to run on hosts with few processors.
+	//
+
+	for (ULONG n = 1; n <= NUM_UPDATES; ++n)
+	{
+		const auto update = AddressesOf(n);
+
+		firewall::PublishIpAddresses(&ipAddresses, &update, (SPLITTING_MODE)(n % 10));
+
+		published.store(n);
+
+		if (n % 64 == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	done.store(true);
+
+	for (auto &reader : readers)
+	{
+		reader.join();
+	}
+
+	for (size_t r = 0; r < NUM_READERS; ++r)
+	{
+		CHECK(torn[r] == 0);
+		CHECK(stale[r] == 0);
+		CHECK(reads[r] != 0);
+		CHECK(versions[r] > 1);
+	}
+}
@@ -0,0 +1,284 @@
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+#include "harness.h"
+#include "containers/slab.h"
+
+namespace
+{
+
+struct CACHE
+{
+	CACHE(SIZE_T ObjectSize)
+	{
+		Status = slab::Initialize(&Context, ObjectSize);
+	}
+
+	~CACHE()
+	{
+		if (Context != NULL)
+		{
+			slab::TearDown(&Context);
+		}
+	}
+
+	slab::STATISTICS Statistics()
+	{
+		slab::STATISTICS statistics;
+
+		slab::GetStatistics(Context, &statistics);
+
+		return statistics;
+	}
+
+	slab::CONTEXT *Context = NULL;
+	NTSTATUS Status;
+};
+
+//
+// Mirrors the slab geometry in slab.cpp.
+//
+SIZE_T
+ObjectsPerSlab
+(
+	SIZE_T ObjectSize
+)
+{
+	return max((4 * PAGE_SIZE - MEMORY_ALLOCATION_ALIGNMENT) / ObjectSize, (SIZE_T)8);
+}
+
+} // anonymous namespace
+
+//
+// Random allocations and frees, checked against a model of the objects in use.
+// Each object is filled with a pattern derived from its identity, so objects that overlap,
+// or that are handed out while still in use, are detected.
+//
+TEST_CASE(AgreesWithReferenceModel)
+{
+	for (SIZE_T requested : { 1, 72, 200, 1024, 5000 })
+	{
+		CACHE cache(requested);
+
+		REQUIRE(NT_SUCCESS(cache.Status));
+
+		const auto objectSize = slab::ObjectSize(cache.Context);
+
+		CHECK(objectSize >= requested);
+		CHECK(objectSize % MEMORY_ALLOCATION_ALIGNMENT == 0);
+
+		harness::Random random(requested);
+
+		std::map<UCHAR*, UCHAR> inUse;
+
+		SIZE_T allocations = 0, frees = 0, peak = 0;
+		UCHAR nextPattern = 0;
+
+		for (size_t i = 0; i < 20000; ++i)
+		{
+			//
+			// Grow and shrink the working set in phases.
+			//
+
+			const auto allocate = inUse.empty() || (random.Below(100) < (((i / 2000) % 2 == 0) ? 70 : 30));
+
+			if (allocate)
+			{
+				auto object = (UCHAR*)slab::Allocate(cache.Context);
+
+				REQUIRE(object != NULL);
+				REQUIRE(inUse.find(object) == inUse.end());
+
+				CHECK((ULONG_PTR)object % MEMORY_ALLOCATION_ALIGNMENT == 0);
+
+				memset(object, ++nextPattern, objectSize);
+
+				inUse[object] = nextPattern;
+
+				++allocations;
+				peak = max(peak, (SIZE_T)inUse.size());
+			}
+			else
+			{
+				auto it = inUse.begin();
+
+				std::advance(it, random.Below(inUse.size()));
+
+				for (SIZE_T b = 0; b < objectSize; ++b)
+				{
+					if (it->first[b] != it->second)
+					{
+						CHECK(false);
+						break;
+					}
+				}
+
+				slab::Free(cache.Context, it->first);
+
+				inUse.erase(it);
+
+				++frees;
+			}
+		}
+
+		const auto statistics = cache.Statistics();
+
+		CHECK(statistics.Allocations == allocations);
+		CHECK(statistics.Frees == frees);
+		CHECK(statistics.InUse == inUse.size());
+		CHECK(statistics.PeakInUse == peak);
+
+		const auto perSlab = ObjectsPerSlab(objectSize);
+
+		CHECK(statistics.Slabs == (peak + perSlab - 1) / perSlab);
+
+		for (const auto &object : inUse)
+		{
+			slab::Free(cache.Context, object.first);
+		}
+	}
+}
+
+TEST_CASE(ConcurrentAllocateAndFree)
+{
+	CACHE cache(64);
+
+	REQUIRE(NT_SUCCESS(cache.Status));
+
+	const size_t NUM_THREADS = 4;
+	const size_t NUM_ROUNDS = 20000;
+
+	std::vector<std::thread> threads;
+	std::vector<size_t> corrupted(NUM_THREADS);
+
+	for (size_t t = 0; t < NUM_THREADS; ++t)
+	{
+		threads.emplace_back([&cache, &corrupted, t]()
+		{
+			harness::Random random(t + 1);
+
+			std::vector<ULONG_PTR*> held;
+
+			for (size_t i = 0; i < NUM_ROUNDS; ++i)
+			{
+				if (held.size() < 64 && (held.empty() || random.Below(2) == 0))
+				{
+					auto object = (ULONG_PTR*)slab::Allocate(cache.Context);
+
+					if (object != NULL)
+					{
+						object[0] = t;
+						object[1] = (ULONG_PTR)object;
+
+						held.push_back(object);
+					}
+				}
+				else
+				{
+					const auto index = random.Below(held.size());
+
+					auto object = held[index];
+
+					if (object[0] != t || object[1] != (ULONG_PTR)object)
+					{
+						++corrupted[t];
+					}
+
+					held[index] = held.back();
+					held.pop_back();
+
+					slab::Free(cache.Context, object);
+				}
+			}
+
+			for (auto object : held)
+			{
+				slab::Free(cache.Context, object);
+			}
+		});
+	}
+
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	for (auto count : corrupted)
+	{
+		CHECK(count == 0);
+	}
+
+	const auto statistics = cache.Statistics();
+
+	CHECK(statistics.InUse == 0);
+	CHECK(statistics.Allocations == statistics.Frees);
+	CHECK(statistics.PeakInUse <= NUM_THREADS * 64);
+}
+
+TEST_CASE(FailedSlabAllocationReturnsNull)
+{
+	CACHE cache(128);
+
+	REQUIRE(NT_SUCCESS(cache.Status));
+
+	shim::FailAllocation(0);
+
+	CHECK(slab::Allocate(cache.Context) == NULL);
+
+	const auto statistics = cache.Statistics();
+
+	CHECK(statistics.Allocations == 0);
+	CHECK(statistics.Slabs == 0);
+
+	auto object = slab::Allocate(cache.Context);
+
+	CHECK(object != NULL);
+
+	slab::Free(cache.Context, object);
+}
+
+TEST_CASE(ResetReleasesAllSlabs)
+{
+	CACHE cache(128);
+
+	REQUIRE(NT_SUCCESS(cache.Status));
+
+	const auto baseline = shim::NumOutstandingAllocations();
+
+	for (size_t round = 0; round < 3; ++round)
+	{
+		std::vector<UCHAR*> objects;
+
+		for (size_t i = 0; i < 1000; ++i)
+		{
+			auto object = (UCHAR*)slab::Allocate(cache.Context);
+
+			REQUIRE(object != NULL);
+
+			memset(object, (int)i, 128);
+
+			objects.push_back(object);
+		}
+
+		CHECK(shim::NumOutstandingAllocations() > baseline);
+
+		//
+		// Free some objects individually first, so the free list is not empty.
+		//
+
+		for (size_t i = 0; i < objects.size(); i += 3)
+		{
+			slab::Free(cache.Context, objects[i]);
+		}
+
+		slab::Reset(cache.Context);
+
+		CHECK(shim::NumOutstandingAllocations() == baseline);
+
+		const auto statistics = cache.Statistics();
+
+		CHECK(statistics.InUse == 0);
+		CHECK(statistics.Allocations == statistics.Frees);
+	}
+}
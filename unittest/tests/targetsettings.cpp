@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "processtree.h"
+#include "targetsettings.h"
+
+using harness::Configuration;
+using harness::Numbered;
+using harness::Pid;
+using harness::ProcessTree;
+using registeredimage::ENTRY_TYPE;
+
+namespace
+{
+
+const size_t NUM_DIRECTORIES = 5;
+const size_t NUM_APPS = 6;
+
+std::u16string
+Directory
+(
+	size_t Number
+)
+{
+	return Numbered(u"\\device\\harddiskvolume1\\dir", Number) + u"\\";
+}
+
+std::u16string
+ImagePath
+(
+	size_t Directory,
+	size_t App
+)
+{
+	return ::Directory(Directory) + Numbered(u"app", App) + u".exe";
+}
+
+//
+// Random forest over a small set of images.
+//
+// Entries are added in random order, so some are added ahead of their parent.
+// Some entries have a parent that is not in the registry, and some roots were split
+// by inheritance before their parent departed.
+//
+bool
+PopulateForest
+(
+	harness::Random &Random,
+	ProcessTree &Tree,
+	size_t NumProcesses
+)
+{
+	std::vector<size_t> parents(NumProcesses);
+
+	for (size_t i = 0; i < NumProcesses; ++i)
+	{
+		const auto kind = Random.Below(10);
+
+		if (i == 0 || kind < 2)
+		{
+			parents[i] = 0;
+		}
+		else if (kind == 2)
+		{
+			parents[i] = 100000 + i;
+		}
+		else
+		{
+			parents[i] = 1 + Random.Below(i);
+		}
+	}
+
+	std::vector<size_t> order(NumProcesses);
+
+	for (size_t i = 0; i < NumProcesses; ++i)
+	{
+		order[i] = i;
+	}
+
+	for (size_t i = NumProcesses; i > 1; --i)
+	{
+		std::swap(order[i - 1], order[Random.Below(i)]);
+	}
+
+	for (auto i : order)
+	{
+		const auto split = (parents[i] == 0 && Random.Below(5) == 0)
+			? ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE
+			: ST_PROCESS_SPLIT_STATUS_OFF;
+
+		const auto path = ImagePath(Random.Below(NUM_DIRECTORIES), Random.Below(NUM_APPS));
+
+		if (!Tree.Add(Pid(parents[i]), Pid(1 + i), path, split))
+		{
+			return false;
+		}
+	}
+
+	procregistry::ResolveParentLinks(Tree.Registry());
+
+	return true;
+}
+
+bool
+AddRandomEntry
+(
+	harness::Random &Random,
+	Configuration &Config
+)
+{
+	const auto directory = Random.Below(NUM_DIRECTORIES);
+	const auto app = Random.Below(NUM_APPS);
+
+	switch (Random.Below(4))
+	{
+		case 0:
+		{
+			return Config.Add(ENTRY_TYPE::PREFIX, Directory(directory));
+		}
+		case 1:
+		{
+			return Config.Add(ENTRY_TYPE::PATTERN, Numbered(u"\\device\\*\\dir", directory) + u"\\app?.exe");
+		}
+		default:
+		{
+			return Config.Add(ENTRY_TYPE::EXACT, ImagePath(directory, app));
+		}
+	}
+}
+
+} // anonymous namespace
+
+TEST_CASE(ComputeAllAgreesWithAncestryWalk)
+{
+	harness::Random random;
+
+	for (size_t round = 0; round < 500; ++round)
+	{
+		ProcessTree tree;
+
+		REQUIRE(NT_SUCCESS(tree.Status()));
+		REQUIRE(PopulateForest(random, tree, 1 + random.Below(200)));
+
+		Configuration config(tree.ImageNames());
+
+		REQUIRE(NT_SUCCESS(config.Status()));
+
+		const auto numEntries = random.Below(4);
+
+		for (size_t i = 0; i < numEntries; ++i)
+		{
+			REQUIRE(AddRandomEntry(random, config));
+		}
+
+		REQUIRE(config.Compile());
+
+		targetsettings::ComputeAll(tree.Registry(), config.Get());
+
+		for (auto entry : tree.Entries())
+		{
+			CHECK(entry->TargetSettings.Split == harness::AncestryWalkTargetSplit(config.Get(), entry));
+		}
+	}
+}
+
+TEST_CASE(ComputeAllHandlesDeepChains)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	const size_t DEPTH = 20000;
+
+	REQUIRE(tree.Add(0, Pid(1), ImagePath(0, 0)));
+
+	for (size_t i = 2; i <= DEPTH; ++i)
+	{
+		REQUIRE(tree.Add(Pid(i - 1), Pid(i), ImagePath(1, 1)));
+	}
+
+	Configuration config(tree.ImageNames());
+
+	REQUIRE(NT_SUCCESS(config.Status()));
+	REQUIRE(config.Add(ENTRY_TYPE::EXACT, ImagePath(0, 0)));
+
+	targetsettings::ComputeAll(tree.Registry(), config.Get());
+
+	CHECK(tree.Find(Pid(1))->TargetSettings.Split == ST_PROCESS_SPLIT_STATUS_ON_BY_CONFIG);
+	CHECK(tree.Find(Pid(DEPTH))->TargetSettings.Split == ST_PROCESS_SPLIT_STATUS_ON_BY_INHERITANCE);
+}
+
+//
+// Entries are added, removed, or the configuration is replaced and the difference between
+// the configurations is used as the delta. Either way, the settings reached by updating only
+// the affected subtrees are the same as those of a full recomputation.
+//
+TEST_CASE(DeltaAgreesWithComputeAll)
+{
+	harness::Random random;
+
+	size_t numAffected = 0;
+
+	for (size_t round = 0; round < 1000; ++round)
+	{
+		ProcessTree tree;
+
+		REQUIRE(NT_SUCCESS(tree.Status()));
+		REQUIRE(PopulateForest(random, tree, 1 + random.Below(200)));
+
+		Configuration oldConfig(tree.ImageNames());
+
+		REQUIRE(NT_SUCCESS(oldConfig.Status()));
+
+		const auto numEntries = random.Below(4);
+
+		for (size_t i = 0; i < numEntries; ++i)
+		{
+			REQUIRE(AddRandomEntry(random, oldConfig));
+		}
+
+		REQUIRE(oldConfig.Compile());
+
+		targetsettings::ComputeAll(tree.Registry(), oldConfig.Get());
+
+		tree.Realize();
+
+		Configuration entries(tree.ImageNames());
+
+		REQUIRE(NT_SUCCESS(entries.Status()));
+
+		registeredimage::CONTEXT *newContext = NULL;
+
+		const auto mode = random.Below(3);
+
+		if (mode == 2)
+		{
+			//
+			// Replace the configuration, and use the entries that differ as the delta.
+			//
+
+			Configuration replacement(tree.ImageNames());
+
+			REQUIRE(NT_SUCCESS(replacement.Status()));
+
+			for (size_t i = random.Below(4); i > 0; --i)
+			{
+				REQUIRE(AddRandomEntry(random, replacement));
+			}
+
+			registeredimage::CONTEXT *added, *removed;
+
+			REQUIRE(NT_SUCCESS(registeredimage::Clone(replacement.Get(), oldConfig.Get(), &added)));
+			REQUIRE(NT_SUCCESS(registeredimage::Clone(oldConfig.Get(), replacement.Get(), &removed)));
+
+			REQUIRE(NT_SUCCESS(registeredimage::Merge(entries.Get(), added)));
+			REQUIRE(NT_SUCCESS(registeredimage::Merge(entries.Get(), removed)));
+
+			registeredimage::TearDown(&added);
+			registeredimage::TearDown(&removed);
+
+			REQUIRE(NT_SUCCESS(registeredimage::Clone(replacement.Get(), NULL, &newContext)));
+		}
+		else
+		{
+			for (size_t i = 1 + random.Below(2); i > 0; --i)
+			{
+				REQUIRE(AddRandomEntry(random, entries));
+			}
+
+			const auto remove = (mode == 1);
+
+			REQUIRE(NT_SUCCESS(registeredimage::Clone(oldConfig.Get(), (remove ? entries.Get() : NULL), &newContext)));
+
+			if (!remove)
+			{
+				REQUIRE(NT_SUCCESS(registeredimage::Merge(newContext, entries.Get())));
+			}
+		}
+
+		Configuration newConfig(newContext);
+
+		REQUIRE(entries.Compile());
+		REQUIRE(newConfig.Compile());
+
+		targetsettings::AFFECTED_ROOTS affected;
+
+		REQUIRE(NT_SUCCESS(targetsettings::CollectAffectedRoots(tree.Registry(), oldConfig.Get(),
+			newConfig.Get(), entries.Get(), &affected)));
+
+		targetsettings::ComputeAffected(tree.Registry(), newConfig.Get(), &affected);
+
+		for (SIZE_T i = 0; i < affected.NumRoots; ++i)
+		{
+			tree.RealizeSubtree(affected.Roots[i]);
+		}
+
+		numAffected += affected.NumRoots;
+
+		targetsettings::ReleaseAffectedRoots(&affected);
+
+		targetsettings::ComputeAll(tree.Registry(), newConfig.Get());
+
+		for (auto entry : tree.Entries())
+		{
+			CHECK(entry->TargetSettings.Split == entry->Settings.Split);
+		}
+	}
+
+	//
+	// Make sure the comparison isn't vacuous.
+	//
+
+	CHECK(numAffected > 1000);
+}
+
+TEST_CASE(CollectFailsCleanlyWithoutMemory)
+{
+	ProcessTree tree;
+
+	REQUIRE(NT_SUCCESS(tree.Status()));
+
+	for (size_t i = 1; i <= 100; ++i)
+	{
+		REQUIRE(tree.Add(0, Pid(i), ImagePath(0, i % NUM_APPS)));
+	}
+
+	Configuration oldConfig(tree.ImageNames());
+	Configuration entries(tree.ImageNames());
+
+	REQUIRE(NT_SUCCESS(oldConfig.Status()));
+	REQUIRE(NT_SUCCESS(entries.Status()));
+
+	REQUIRE(entries.Add(ENTRY_TYPE::PREFIX, Directory(0)));
+
+	targetsettings::AFFECTED_ROOTS affected;
+
+	shim::FailAllocation(0);
+
+	CHECK(targetsettings::CollectAffectedRoots(tree.Registry(), oldConfig.Get(),
+		entries.Get(), entries.Get(), &affected) == STATUS_INSUFFICIENT_RESOURCES);
+
+	targetsettings::ReleaseAffectedRoots(&affected);
+}
@@ -0,0 +1,168 @@
+#include <cstring>
+#include <vector>
+#include "harness.h"
+#include "util.h"
+
+//
+// This test is built twice: once against the SSE2 paths in util.cpp, and once, as
+// test_util_scalar, against the scalar paths. Both builds compare with the same reference.
+//
+
+namespace
+{
+
+//
+// Characters on either side of each boundary that the ASCII paths test for.
+//
+const WCHAR INTERESTING_CHARS[] =
+{
+	L'@', L'A', L'M', L'Z', L'[', L'`', L'a', L'z', L'{', L'\\', L'.', L'0',
+	0x7F, 0x80, 0xC4, 0xE4, 0xFF, 0x100, 0x130, 0x391, 0x7F80, 0xFF21, 0xFF80, 0xFFFF
+};
+
+const WCHAR GUARD = 0xFEFE;
+
+std::vector<WCHAR>
+RandomString
+(
+	harness::Random &Random,
+	size_t Length,
+	bool AsciiOnly
+)
+{
+	std::vector<WCHAR> s(Length);
+
+	for (auto &c : s)
+	{
+		if (Random.Below(2) == 0)
+		{
+			c = (WCHAR)(0x20 + Random.Below(0x5F));
+		}
+		else
+		{
+			do
+			{
+				c = INTERESTING_CHARS[Random.Below(ARRAYSIZE(INTERESTING_CHARS))];
+			}
+			while (AsciiOnly && c >= 0x80);
+		}
+	}
+
+	return s;
+}
+
+} // anonymous namespace
+
+TEST_CASE(DowncaseStringMatchesReference)
+{
+	harness::Random random;
+
+	for (size_t iteration = 0; iteration < 20000; ++iteration)
+	{
+		const auto length = (size_t)random.Below(80);
+		const auto source = RandomString(random, length, random.Below(2) == 0);
+
+		//
+		// Vary the alignment of both buffers, and surround the destination with guards.
+		//
+
+		const auto sourceOffset = (size_t)random.Below(8);
+		const auto destOffset = (size_t)random.Below(8);
+
+		std::vector<WCHAR> sourceBuffer(sourceOffset + length);
+		std::vector<WCHAR> destBuffer(destOffset + length + 8, GUARD);
+
+		std::copy(source.begin(), source.end(), sourceBuffer.begin() + sourceOffset);
+
+		UNICODE_STRING src;
+
+		src.Length = (USHORT)(length * sizeof(WCHAR));
+		src.MaximumLength = src.Length;
+		src.Buffer = sourceBuffer.data() + sourceOffset;
+
+		UNICODE_STRING dest;
+
+		dest.Length = 0;
+		dest.MaximumLength = src.Length;
+		dest.Buffer = destBuffer.data() + destOffset;
+
+		REQUIRE(NT_SUCCESS(util::DowncaseString(&dest, &src)));
+		REQUIRE(dest.Length == src.Length);
+
+		for (size_t i = 0; i < length; ++i)
+		{
+			CHECK(dest.Buffer[i] == RtlDowncaseUnicodeChar(source[i]));
+		}
+
+		for (size_t i = 0; i < destOffset; ++i)
+		{
+			CHECK(destBuffer[i] == GUARD);
+		}
+
+		for (size_t i = destOffset + length; i < destBuffer.size(); ++i)
+		{
+			CHECK(destBuffer[i] == GUARD);
+		}
+	}
+}
+
+TEST_CASE(DowncaseStringRejectsShortDestination)
+{
+	WCHAR text[] = L"\\Device\\HarddiskVolume1";
+	WCHAR buffer[ARRAYSIZE(text)];
+
+	UNICODE_STRING src;
+
+	RtlInitUnicodeString(&src, text);
+
+	UNICODE_STRING dest;
+
+	dest.Length = 0;
+	dest.MaximumLength = src.Length - sizeof(WCHAR);
+	dest.Buffer = buffer;
+
+	CHECK(util::DowncaseString(&dest, &src) == STATUS_BUFFER_OVERFLOW);
+}
+
+TEST_CASE(EqualMemoryMatchesMemcmp)
+{
+	harness::Random random;
+
+	std::vector<UCHAR> lhs(160);
+	std::vector<UCHAR> rhs(160);
+
+	for (size_t length = 0; length <= 80; ++length)
+	{
+		for (size_t offset = 0; offset < 16; ++offset)
+		{
+			for (size_t i = 0; i < length; ++i)
+			{
+				lhs[offset + i] = (UCHAR)random.Next();
+			}
+
+			const auto rhsOffset = (offset * 7) % 16;
+
+			memcpy(&rhs[rhsOffset], &lhs[offset], length);
+
+			CHECK(util::EqualMemory(&lhs[offset], &rhs[rhsOffset], length));
+
+			//
+			// A difference at every position, including in the trailing bytes that follow the
+			// last whole block, and in the high bit only.
+			//
+
+			for (size_t i = 0; i < length; ++i)
+			{
+				const UCHAR flip = (i % 2 == 0) ? 0x80 : 0x01;
+
+				rhs[rhsOffset + i] ^= flip;
+
+				CHECK(!util::EqualMemory(&lhs[offset], &rhs[rhsOffset], length));
+				CHECK((memcmp(&lhs[offset], &rhs[rhsOffset], length) == 0)
+					== util::EqualMemory(&lhs[offset], &rhs[rhsOffset], length));
+
+				rhs[rhsOffset + i] ^= flip;
+			}
+		}
+	}
+}
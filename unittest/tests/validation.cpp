@@ -0,0 +1,123 @@
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "validation.h"
+#include "defs/config.h"
+
+namespace
+{
+
+struct ENTRY
+{
+	std::u16string ImageName;
+	USHORT Flags;
+};
+
+//
+// Serializes entries in the format of IOCTL_ST_SET_CONFIGURATION.
+//
+std::vector<UCHAR>
+MakeConfiguration
+(
+	const std::vector<ENTRY> &Entries
+)
+{
+	SIZE_T stringLength = 0;
+
+	for (const auto &entry : Entries)
+	{
+		stringLength += entry.ImageName.size() * sizeof(WCHAR);
+	}
+
+	const auto totalLength = sizeof(ST_CONFIGURATION_HEADER)
+		+ (sizeof(ST_CONFIGURATION_ENTRY) * Entries.size()) + stringLength;
+
+	std::vector<UCHAR> buffer(totalLength);
+
+	auto header = (ST_CONFIGURATION_HEADER*)buffer.data();
+	auto entry = (ST_CONFIGURATION_ENTRY*)(header + 1);
+	auto stringDest = (UCHAR*)(entry + Entries.size());
+
+	header->NumEntries = Entries.size();
+	header->TotalLength = totalLength;
+
+	SIZE_T offset = 0;
+
+	for (const auto &source : Entries)
+	{
+		const auto length = source.ImageName.size() * sizeof(WCHAR);
+
+		entry->ImageNameOffset = offset;
+		entry->ImageNameLength = (USHORT)length;
+		entry->Flags = source.Flags;
+
+		memcpy(stringDest + offset, source.ImageName.data(), length);
+
+		offset += length;
+		++entry;
+	}
+
+	return buffer;
+}
+
+bool
+Validate
+(
+	std::vector<UCHAR> Buffer,
+	bool EntryFlags
+)
+{
+	return ValidateUserBufferConfiguration(Buffer.data(), Buffer.size(), EntryFlags);
+}
+
+} // anonymous namespace
+
+TEST_CASE(FlagsAreIgnoredWithoutEntryFlags)
+{
+	//
+	// Clients of the original format may leave garbage in what used to be padding.
+	//
+
+	const auto buffer = MakeConfiguration({
+		{ u"\\device\\harddiskvolume1\\a.exe", 0xCDCD },
+		{ u"", ST_CONFIGURATION_ENTRY_FLAG_PREFIX }
+	});
+
+	CHECK(Validate(buffer, false));
+	CHECK(!Validate(buffer, true));
+}
+
+TEST_CASE(FlagsAreValidatedWithEntryFlags)
+{
+	const auto prefix = ST_CONFIGURATION_ENTRY_FLAG_PREFIX;
+	const auto pattern = ST_CONFIGURATION_ENTRY_FLAG_PATTERN;
+
+	CHECK(Validate(MakeConfiguration({
+		{ u"\\device\\harddiskvolume1\\a.exe", 0 },
+		{ u"\\device\\harddiskvolume1\\apps\\", prefix },
+		{ u"\\device\\harddiskvolume1\\*.exe", pattern }
+	}), true));
+
+	CHECK(!Validate(MakeConfiguration({ { u"\\device\\a.exe", 0x0004 } }), true));
+	CHECK(!Validate(MakeConfiguration({ { u"\\device\\a.exe", prefix | pattern } }), true));
+	CHECK(!Validate(MakeConfiguration({ { u"", pattern } }), true));
+}
+
+TEST_CASE(StringsMustBeWithinBuffer)
+{
+	auto buffer = MakeConfiguration({ { u"\\device\\a.exe", 0 } });
+
+	CHECK(Validate(buffer, false));
+
+	auto entry = (ST_CONFIGURATION_ENTRY*)(buffer.data() + sizeof(ST_CONFIGURATION_HEADER));
+
+	entry->ImageNameOffset = 2;
+
+	CHECK(!Validate(buffer, false));
+
+	auto header = (ST_CONFIGURATION_HEADER*)buffer.data();
+
+	header->TotalLength -= 1;
+
+	CHECK(!Validate(buffer, false));
+}
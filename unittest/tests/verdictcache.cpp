@@ -0,0 +1,305 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "harness.h"
+#include "containers/verdictcache.h"
+
+namespace
+{
+
+struct CACHE
+{
+	CACHE(ULONG NumProcessors = 1)
+	{
+		shim::SetProcessorCount(NumProcessors);
+		shim::SetCurrentProcessor(0);
+
+		Status = verdictcache::Initialize(&Context);
+	}
+
+	~CACHE()
+	{
+		if (Context != NULL)
+		{
+			verdictcache::TearDown(&Context);
+		}
+
+		shim::SetProcessorCount(1);
+		shim::SetCurrentProcessor(0);
+	}
+
+	verdictcache::STATISTICS Statistics()
+	{
+		verdictcache::STATISTICS statistics;
+
+		verdictcache::GetStatistics(Context, &statistics);
+
+		return statistics;
+	}
+
+	verdictcache::CONTEXT *Context = NULL;
+	NTSTATUS Status;
+};
+
+HANDLE
+Pid
+(
+	size_t Number
+)
+{
+	return (HANDLE)(ULONG_PTR)(Number * 4);
+}
+
+//
+// Backing store with one value per PID. Odd PIDs have no mapping.
+//
+struct STORE
+{
+	static const size_t NUM_PIDS = 256;
+
+	STORE()
+	{
+		for (auto &value : Values)
+		{
+			value.store(0);
+		}
+	}
+
+	static bool NTAPI Resolve(HANDLE ProcessId, LONG *Value, void *Context)
+	{
+		auto store = (STORE*)Context;
+
+		++store->Resolves;
+
+		const auto pid = ((ULONG_PTR)ProcessId) / 4;
+
+		if (pid % 2 != 0)
+		{
+			return false;
+		}
+
+		*Value = store->Values[pid % NUM_PIDS].load();
+
+		if (store->OnResolve)
+		{
+			store->OnResolve(store->Context);
+		}
+
+		return true;
+	}
+
+	bool Lookup(verdictcache::CONTEXT *Cache, size_t Pid, LONG *Value)
+	{
+		return verdictcache::Lookup(Cache, ::Pid(Pid), Resolve, this, Value);
+	}
+
+	std::atomic<LONG> Values[NUM_PIDS];
+	std::atomic<size_t> Resolves{ 0 };
+
+	void (*OnResolve)(void *Context) = NULL;
+	void *Context = NULL;
+};
+
+} // anonymous namespace
+
+TEST_CASE(RepeatedLookupsAreCached)
+{
+	CACHE cache;
+
+	REQUIRE(NT_SUCCESS(cache.Status));
+
+	STORE store;
+
+	store.Values[2].store(7);
+
+	LONG value = 0;
+
+	CHECK(store.Lookup(cache.Context, 2, &value));
+	CHECK(value == 7);
+	CHECK(store.Lookup(cache.Context, 2, &value));
+	CHECK(value == 7);
+
+	//
+	// Absent mappings are cached too.
+	//
+
+	CHECK(!store.Lookup(cache.Context, 3, &value));
+	CHECK(!store.Lookup(cache.Context, 3, &value));
+
+	CHECK(store.Resolves == 2);
+
+	const auto statistics = cache.Statistics();
+
+	CHECK(statistics.Hits == 2);
+	CHECK(statistics.Misses == 2);
+	CHECK(statistics.Invalidations == 0);
+}
+
+TEST_CASE(InvalidateForcesResolve)
+{
+	CACHE cache;
+
+	REQUIRE(NT_SUCCESS(cache.Status));
+
+	STORE store;
+
+	LONG value = 0;
+
+	store.Values[2].store(1);
+
+	CHECK(store.Lookup(cache.Context, 2, &value) && value == 1);
+
+	store.Values[2].store(2);
+
+	verdictcache::Invalidate(cache.Context);
+
+	CHECK(store.Lookup(cache.Context, 2, &value) && value == 2);
+	CHECK(store.Resolves == 2);
+	CHECK(cache.Statistics().Invalidations == 1);
+}
+
+//
+// A writer updates the store and invalidates after the lookup has resolved the old value,
+// but before the lookup has stored it in the cache. The stale value must not be served
+// to later lookups.
+//
+TEST_CASE(UpdateDuringResolveIsNotCached)
+{
+	CACHE cache;
+
+	REQUIRE(NT_SUCCESS(cache.Status));
+
+	struct UPDATE
+	{
+		STORE *Store;
+		verdictcache::CONTEXT *Cache;
+	};
+
+	STORE store;
+	UPDATE update{ &store, cache.Context };
+
+	store.Values[2].store(1);
+	store.Context = &update;
+	store.OnResolve = [](void *Context)
+	{
+		auto update = (UPDATE*)Context;
+
+		update->Store->OnResolve = NULL;
+		update->Store->Values[2].store(2);
+
+		verdictcache::Invalidate(update->Cache);
+	};
+
+	LONG value = 0;
+
+	CHECK(store.Lookup(cache.Context, 2, &value) && value == 1);
+	CHECK(store.Lookup(cache.Context, 2, &value) && value == 2);
+}
+
+TEST_CASE(ProcessorsHaveSeparateCaches)
+{
+	CACHE cache(2);
+
+	REQUIRE(NT_SUCCESS(cache.Status));
+
+	STORE store;
+
+	LONG value;
+
+	shim::SetCurrentProcessor(0);
+
+	store.Lookup(cache.Context, 2, &value);
+	store.Lookup(cache.Context, 2, &value);
+
+	shim::SetCurrentProcessor(1);
+
+	store.Lookup(cache.Context, 2, &value);
+
+	CHECK(store.Resolves == 2);
+	CHECK(cache.Statistics().Hits == 1);
+}
+
+//
+// Readers on separate processors look up values that a writer keeps increasing.
+// The writer publishes the value it committed once the cache has been invalidated.
+// A lookup that starts after that must not return anything older.
+//
+TEST_CASE(ReadersNeverObserveValuesOlderThanCommitted)
+{
+	const ULONG NUM_READERS = 4;
+
+	CACHE cache(NUM_READERS);
+
+	REQUIRE(NT_SUCCESS(cache.Status));
+
+	STORE store;
+
+	std::atomic<LONG> committed(0);
+	std::atomic<bool> done(false);
+	std::vector<size_t> stale(NUM_READERS), lookups(NUM_READERS);
+
+	std::vector<std::thread> readers;
+
+	for (ULONG r = 0; r < NUM_READERS; ++r)
+	{
+		readers.emplace_back([&, r]()
+		{
+			shim::SetCurrentProcessor(r);
+
+			harness::Random random(r + 1);
+
+			while (!done.load())
+			{
+				//
+				// A handful of PIDs, so most lookups would be hits if not for the writer.
+				//
+
+				const auto pid = 2 * (1 + random.Below(8));
+
+				const auto floor = committed.load();
+
+				LONG value;
+
+				if (store.Lookup(cache.Context, pid, &value))
+				{
+					++lookups[r];
+
+					if (value < floor)
+					{
+						++stale[r];
+					}
+				}
+			}
+		});
+	}
+
+	for (LONG version = 1; version <= 20000; ++version)
+	{
+		for (size_t pid = 2; pid <= 16; pid += 2)
+		{
+			store.Values[pid].store(version);
+		}
+
+		verdictcache::Invalidate(cache.Context);
+
+		committed.store(version);
+
+		if (version % 64 == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	done.store(true);
+
+	for (auto &reader : readers)
+	{
+		reader.join();
+	}
+
+	for (ULONG r = 0; r < NUM_READERS; ++r)
+	{
+		CHECK(stale[r] == 0);
+		CHECK(lookups[r] != 0);
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+//
+// unicode.h
+//
+// Owning wrapper for the counted strings that driver functions take.
+//
+
+#include <string>
+#include <wdm.h>
+#include "defs/types.h"
+
+namespace harness
+{
+
+class UnicodeString
+{
+public:
+
+	UnicodeString(const char16_t *Text = u"") : m_storage(Text)
+	{
+		Update();
+	}
+
+	UnicodeString(std::u16string Text) : m_storage(std::move(Text))
+	{
+		Update();
+	}
+
+	UnicodeString(const UnicodeString &Other) : m_storage(Other.m_storage)
+	{
+		Update();
+	}
+
+	UnicodeString &operator=(const UnicodeString &Other)
+	{
+		m_storage = Other.m_storage;
+		Update();
+
+		return *this;
+	}
+
+	UNICODE_STRING *Get()
+	{
+		return &m_string;
+	}
+
+	//
+	// For strings that the test knows to be lower case.
+	//
+	LOWER_UNICODE_STRING *Lower()
+	{
+		return (LOWER_UNICODE_STRING*)&m_string;
+	}
+
+	const std::u16string &Text() const
+	{
+		return m_storage;
+	}
+
+private:
+
+	void Update()
+	{
+		m_string.Length = (USHORT)(m_storage.size() * sizeof(WCHAR));
+		m_string.MaximumLength = m_string.Length;
+		m_string.Buffer = (PWCH)m_storage.data();
+	}
+
+	std::u16string m_storage;
+	UNICODE_STRING m_string;
+};
+
+inline
+std::u16string
+ToText
+(
+	const UNICODE_STRING *String
+)
+{
+	return std::u16string((const char16_t*)String->Buffer, String->Length / sizeof(WCHAR));
+}
+
+inline
+std::u16string
+ToText
+(
+	const LOWER_UNICODE_STRING *String
+)
+{
+	return ToText((const UNICODE_STRING*)String);
+}
+
+} // namespace harness